@@ -0,0 +1,121 @@
+#ifndef BIMANUAL_IMPEDANCE_CONTROLLER_H_INCLUDED
+#define BIMANUAL_IMPEDANCE_CONTROLLER_H_INCLUDED
+
+#include "geometry_msgs/msg/pose_stamped.hpp"
+#include <controller_interface/controller_interface.hpp>
+#include <effort_controller_base/TripleBuffer.h>
+#include <effort_controller_base/effort_controller_base.h>
+#include <vector>
+
+namespace bimanual_impedance_controller {
+
+/**
+ * @brief A ROS2-control controller for coordinated impedance of two arms
+ *
+ * The two end effectors are described by their absolute frame, halfway
+ * between them, and their relative pose, that of the second end effector in
+ * the first one.  Both get their own impedance:
+ *
+ *   F_a = K_a e_a - D_a v_a,   v_a = (v_1 + v_2) / 2
+ *   F_r = K_r e_r - D_r v_r,   v_r = v_2 - v_1 - w_1 x (p_2 - p_1)
+ *
+ * The wrenches are distributed to the end effectors by the transposed
+ * velocity maps, so that F_a moves the object held by both arms and F_r
+ * squeezes or twists it.  Each arm then maps its wrench to joint torques
+ * with its own chain model.  The arms' kinematics run in parallel on the
+ * base's worker pool.  The arms may share a trunk, e.g. a torso, whose joints
+ * get the sum of both arms' torques.  Gravity and Coriolis torques come from
+ * the base's model of the whole tree.
+ */
+class BimanualImpedanceController
+    : public virtual effort_controller_base::EffortControllerBase {
+public:
+  BimanualImpedanceController();
+
+  virtual LifecycleNodeInterface::CallbackReturn on_init() override;
+
+  rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::CallbackReturn
+  on_configure(const rclcpp_lifecycle::State &previous_state) override;
+
+  rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::CallbackReturn
+  on_activate(const rclcpp_lifecycle::State &previous_state) override;
+
+  rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::CallbackReturn
+  on_deactivate(const rclcpp_lifecycle::State &previous_state) override;
+
+  controller_interface::return_type
+  update(const rclcpp::Time &time, const rclcpp::Duration &period) override;
+
+  using Base = effort_controller_base::EffortControllerBase;
+
+protected:
+  bool supportsArms() const override { return true; }
+
+private:
+  /**
+   * Per-arm state of the current cycle
+   */
+  struct ArmState {
+    KDL::Frame pose;       // End effector in the robot base frame
+    ctrl::Vector6D twist;  // End effector twist from filtered velocities
+    ctrl::Vector6D wrench; // Share of the coordinated wrenches
+    ctrl::VectorND tau;
+    ctrl::VectorND posture;  // Nullspace target
+    ctrl::VectorND null_space_tau;
+    ctrl::Vector6D null_space_wrench;
+  };
+
+  /**
+   * @brief Evaluate the kinematics of arm k (worker pool)
+   */
+  void evaluateArm(size_t k);
+
+  /**
+   * @brief Compute the joint torques of arm k's wrench (worker pool)
+   */
+  void computeArmTorque(size_t k);
+
+  /**
+   * @brief Compute and distribute the coordinated wrenches
+   */
+  void computeWrenches();
+
+  /**
+   * @brief Absolute frame halfway between the end effectors
+   */
+  static KDL::Frame absoluteFrame(const KDL::Frame &first,
+                                  const KDL::Frame &second);
+
+  /**
+   * @brief Parse a 6 entry diagonal stiffness parameter
+   */
+  bool getStiffness(const std::string &name, ctrl::Vector6D &stiffness);
+
+  std::vector<ArmState> m_arm_states;
+  effort_controller_base::WorkerPool::Job m_evaluate_job;
+  effort_controller_base::WorkerPool::Job m_torque_job;
+
+  ctrl::Vector6D m_absolute_stiffness;
+  ctrl::Vector6D m_absolute_damping;
+  ctrl::Vector6D m_relative_stiffness;
+  ctrl::Vector6D m_relative_damping;
+  double m_null_space_stiffness;
+  double m_null_space_damping;
+
+  // Targets: absolute frame in the robot base frame and the second end
+  // effector in the first one
+  effort_controller_base::TripleBuffer<KDL::Frame> m_absolute_target_buffer;
+  effort_controller_base::TripleBuffer<KDL::Frame> m_relative_target_buffer;
+  KDL::Frame m_absolute_target;
+  KDL::Frame m_relative_target;
+  rclcpp::Subscription<geometry_msgs::msg::PoseStamped>::SharedPtr
+      m_absolute_target_subscriber;
+  rclcpp::Subscription<geometry_msgs::msg::PoseStamped>::SharedPtr
+      m_relative_target_subscriber;
+
+  ctrl::VectorND m_tau;
+};
+
+} // namespace bimanual_impedance_controller
+
+#endif
@@ -0,0 +1,325 @@
+#include <bimanual_impedance_controller/bimanual_impedance_controller.h>
+
+#include "controller_interface/controller_interface.hpp"
+
+namespace bimanual_impedance_controller {
+
+namespace {
+
+ctrl::Vector3D toEigen(const KDL::Vector &vector) {
+  return ctrl::Vector3D(vector.x(), vector.y(), vector.z());
+}
+
+KDL::Frame toFrame(const geometry_msgs::msg::Pose &pose) {
+  return KDL::Frame(
+      KDL::Rotation::Quaternion(pose.orientation.x, pose.orientation.y,
+                                pose.orientation.z, pose.orientation.w),
+      KDL::Vector(pose.position.x, pose.position.y, pose.position.z));
+}
+
+} // namespace
+
+BimanualImpedanceController::BimanualImpedanceController()
+    : Base::EffortControllerBase() {}
+
+rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::CallbackReturn
+BimanualImpedanceController::on_init() {
+  const auto ret = Base::on_init();
+  if (ret != rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+                 CallbackReturn::SUCCESS) {
+    return ret;
+  }
+
+  // Diagonal stiffness along x, y, z, rx, ry, rz in the robot base frame
+  auto_declare<std::vector<double>>(
+      "absolute_stiffness", {500.0, 500.0, 500.0, 50.0, 50.0, 50.0});
+  auto_declare<std::vector<double>>(
+      "relative_stiffness", {1000.0, 1000.0, 1000.0, 100.0, 100.0, 100.0});
+  auto_declare<double>("damping_ratio", 1.0);
+  auto_declare<double>("nullspace_stiffness", 0.0);
+
+  return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+      CallbackReturn::SUCCESS;
+}
+
+bool BimanualImpedanceController::getStiffness(const std::string &name,
+                                               ctrl::Vector6D &stiffness) {
+  const auto values = get_node()->get_parameter(name).as_double_array();
+  if (values.size() != 6) {
+    RCLCPP_ERROR(get_node()->get_logger(), "%s must have 6 entries",
+                 name.c_str());
+    return false;
+  }
+  stiffness = Eigen::Map<const ctrl::Vector6D>(values.data());
+  if ((stiffness.array() < 0.0).any()) {
+    RCLCPP_ERROR(get_node()->get_logger(), "%s must not be negative",
+                 name.c_str());
+    return false;
+  }
+  return true;
+}
+
+rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::CallbackReturn
+BimanualImpedanceController::on_configure(
+    const rclcpp_lifecycle::State &previous_state) {
+  const auto ret = Base::on_configure(previous_state);
+  if (ret != rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+                 CallbackReturn::SUCCESS) {
+    return ret;
+  }
+
+  if (Base::m_arms.size() != 2) {
+    RCLCPP_ERROR(get_node()->get_logger(),
+                 "arms must name exactly two arms, got %zu",
+                 Base::m_arms.size());
+    return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+        CallbackReturn::ERROR;
+  }
+
+  // Impedance, critically damped for unit inertia by default
+  const double damping_ratio =
+      get_node()->get_parameter("damping_ratio").as_double();
+  if (!getStiffness("absolute_stiffness", m_absolute_stiffness) ||
+      !getStiffness("relative_stiffness", m_relative_stiffness)) {
+    return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+        CallbackReturn::ERROR;
+  }
+  if (damping_ratio < 0.0) {
+    RCLCPP_ERROR(get_node()->get_logger(),
+                 "damping_ratio must not be negative");
+    return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+        CallbackReturn::ERROR;
+  }
+  m_absolute_damping =
+      2 * damping_ratio * m_absolute_stiffness.array().sqrt().matrix();
+  m_relative_damping =
+      2 * damping_ratio * m_relative_stiffness.array().sqrt().matrix();
+
+  m_null_space_stiffness =
+      get_node()->get_parameter("nullspace_stiffness").as_double();
+  m_null_space_damping = 2 * sqrt(m_null_space_stiffness);
+
+  // Per-arm storage and the jobs for the worker pool
+  m_arm_states.clear();
+  for (const auto &arm : Base::m_arms) {
+    const size_t joints = arm->joints.size();
+    ArmState state;
+    state.twist = ctrl::Vector6D::Zero();
+    state.wrench = ctrl::Vector6D::Zero();
+    state.tau = ctrl::VectorND::Zero(joints);
+    state.posture = ctrl::VectorND::Zero(joints);
+    state.null_space_tau = ctrl::VectorND::Zero(joints);
+    state.null_space_wrench = ctrl::Vector6D::Zero();
+    m_arm_states.push_back(state);
+  }
+  m_evaluate_job = [this](size_t k) { evaluateArm(k); };
+  m_torque_job = [this](size_t k) { computeArmTorque(k); };
+  m_tau = ctrl::VectorND::Zero(Base::m_joint_number);
+
+  // Targets
+  m_absolute_target_buffer.init(KDL::Frame::Identity());
+  m_relative_target_buffer.init(KDL::Frame::Identity());
+  m_absolute_target_subscriber =
+      get_node()->create_subscription<geometry_msgs::msg::PoseStamped>(
+          get_node()->get_name() + std::string("/target_frame"), 3,
+          [this](const geometry_msgs::msg::PoseStamped::SharedPtr msg) {
+            if (msg->header.frame_id != Base::m_robot_base_link) {
+              auto &clock = *get_node()->get_clock();
+              RCLCPP_WARN_THROTTLE(
+                  get_node()->get_logger(), clock, 3000,
+                  "Got target pose in wrong reference frame. Expected: %s but "
+                  "got %s",
+                  Base::m_robot_base_link.c_str(),
+                  msg->header.frame_id.c_str());
+              return;
+            }
+            m_absolute_target_buffer.write(toFrame(msg->pose));
+          });
+  m_relative_target_subscriber =
+      get_node()->create_subscription<geometry_msgs::msg::PoseStamped>(
+          get_node()->get_name() + std::string("/target_relative_frame"), 3,
+          [this](const geometry_msgs::msg::PoseStamped::SharedPtr msg) {
+            const std::string &first = Base::m_arms[0]->end_effector_link;
+            if (msg->header.frame_id != first) {
+              auto &clock = *get_node()->get_clock();
+              RCLCPP_WARN_THROTTLE(
+                  get_node()->get_logger(), clock, 3000,
+                  "Got relative target pose in wrong reference frame. "
+                  "Expected: %s but got %s",
+                  first.c_str(), msg->header.frame_id.c_str());
+              return;
+            }
+            m_relative_target_buffer.write(toFrame(msg->pose));
+          });
+
+  RCLCPP_INFO(get_node()->get_logger(),
+              "Finished Bimanual Impedance on_configure");
+  return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+      CallbackReturn::SUCCESS;
+}
+
+rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::CallbackReturn
+BimanualImpedanceController::on_activate(
+    const rclcpp_lifecycle::State &previous_state) {
+  Base::on_activate(previous_state);
+
+  // Hold the current poses and posture
+  Base::updateJointStates();
+  Base::forEachArm(m_evaluate_job);
+  const KDL::Frame &first = m_arm_states[0].pose;
+  const KDL::Frame &second = m_arm_states[1].pose;
+  m_absolute_target_buffer.update();  // Discard targets from before
+  m_relative_target_buffer.update();
+  m_absolute_target = absoluteFrame(first, second);
+  m_relative_target = first.Inverse() * second;
+  for (size_t k = 0; k < m_arm_states.size(); ++k) {
+    m_arm_states[k].posture = Base::m_arms[k]->positions.data;
+  }
+
+  RCLCPP_INFO(get_node()->get_logger(),
+              "Finished Bimanual Impedance on_activate");
+  return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+      CallbackReturn::SUCCESS;
+}
+
+rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::CallbackReturn
+BimanualImpedanceController::on_deactivate(
+    const rclcpp_lifecycle::State &previous_state) {
+  // Stop drifting by sending zero joint velocities
+  Base::computeJointEffortCmds(ctrl::VectorND::Zero(Base::m_joint_number));
+  Base::writeJointEffortCmds();
+  Base::on_deactivate(previous_state);
+
+  RCLCPP_INFO(get_node()->get_logger(),
+              "Finished Bimanual Impedance on_deactivate");
+  return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+      CallbackReturn::SUCCESS;
+}
+
+controller_interface::return_type BimanualImpedanceController::update(
+    const rclcpp::Time &time, const rclcpp::Duration &period) {
+  // Update joint states
+  Base::updateJointStates();
+
+  if (m_absolute_target_buffer.update()) {
+    m_absolute_target = m_absolute_target_buffer.readBuffer();
+  }
+  if (m_relative_target_buffer.update()) {
+    m_relative_target = m_relative_target_buffer.readBuffer();
+  }
+
+  // Kinematics of both arms in parallel, then the coupling,
+  // then the joint torques in parallel
+  Base::forEachArm(m_evaluate_job);
+  computeWrenches();
+  Base::forEachArm(m_torque_job);
+
+  // Dynamics of the whole tree, as the arms may share a trunk
+  m_tau.setZero();
+  if (m_compensate_gravity) {
+    m_tau += Base::m_tree_model.gravity().data;
+  }
+  if (m_compensate_coriolis) {
+    m_tau += Base::m_tree_model.coriolis().data;
+  }
+  for (size_t k = 0; k < m_arm_states.size(); ++k) {
+    Base::m_arms[k]->scatterAdd(m_arm_states[k].tau, m_tau);
+  }
+
+  // Saturation of the torque
+  Base::computeJointEffortCmds(m_tau);
+
+  // Write final commands to the hardware interface
+  Base::writeJointEffortCmds();
+
+  Base::m_telemetry.publish(time);
+
+  return controller_interface::return_type::OK;
+}
+
+KDL::Frame BimanualImpedanceController::absoluteFrame(
+    const KDL::Frame &first, const KDL::Frame &second) {
+  // Half of the relative rotation, about its own axis
+  const KDL::Vector rotation = (first.M.Inverse() * second.M).GetRot();
+  return KDL::Frame(
+      first.M * KDL::Rotation::Rot(rotation, 0.5 * rotation.Norm()),
+      0.5 * (first.p + second.p));
+}
+
+void BimanualImpedanceController::evaluateArm(size_t k) {
+  const effort_controller_base::Arm &arm = *Base::m_arms[k];
+  ArmState &state = m_arm_states[k];
+
+  // Evaluate everything this cycle needs, so that the torque job only reads
+  // cached values
+  state.pose = arm.model.linkPoses()[arm.end_effector_link_id];
+  state.twist.noalias() = arm.model.jacobian().data * arm.filtered_velocities;
+  if (m_null_space_stiffness > 0.0) {
+    arm.model.jacobianTransposePseudoInverse();
+  }
+}
+
+void BimanualImpedanceController::computeWrenches() {
+  const ArmState &first = m_arm_states[0];
+  const ArmState &second = m_arm_states[1];
+
+  // Absolute impedance
+  const KDL::Frame absolute = absoluteFrame(first.pose, second.pose);
+  ctrl::Vector6D absolute_error;
+  absolute_error.head<3>() = toEigen(m_absolute_target.p - absolute.p);
+  absolute_error.tail<3>() =
+      toEigen(KDL::diff(absolute.M, m_absolute_target.M));
+  const ctrl::Vector6D absolute_twist = 0.5 * (first.twist + second.twist);
+  const ctrl::Vector6D absolute_wrench =
+      m_absolute_stiffness.cwiseProduct(absolute_error) -
+      m_absolute_damping.cwiseProduct(absolute_twist);
+
+  // Relative impedance.  The relative velocity does not include the motion
+  // of both end effectors as one rigid body.
+  const ctrl::Vector3D distance = toEigen(second.pose.p - first.pose.p);
+  ctrl::Vector6D relative_error;
+  relative_error.head<3>() =
+      toEigen(first.pose.M * m_relative_target.p) - distance;
+  relative_error.tail<3>() = toEigen(
+      KDL::diff(second.pose.M, first.pose.M * m_relative_target.M));
+  ctrl::Vector6D relative_twist = second.twist - first.twist;
+  relative_twist.head<3>() -= first.twist.tail<3>().cross(distance);
+  const ctrl::Vector6D relative_wrench =
+      m_relative_stiffness.cwiseProduct(relative_error) -
+      m_relative_damping.cwiseProduct(relative_twist);
+
+  // Distribute by the transposed velocity maps.  The relative wrench acts at
+  // the second end effector and in reverse at the first one.
+  m_arm_states[0].wrench = 0.5 * absolute_wrench - relative_wrench;
+  m_arm_states[0].wrench.tail<3>() -=
+      distance.cross(ctrl::Vector3D(relative_wrench.head<3>()));
+  m_arm_states[1].wrench = 0.5 * absolute_wrench + relative_wrench;
+}
+
+void BimanualImpedanceController::computeArmTorque(size_t k) {
+  const effort_controller_base::Arm &arm = *Base::m_arms[k];
+  ArmState &state = m_arm_states[k];
+  const ctrl::MatrixND &jac = arm.model.jacobian().data;
+
+  state.tau.noalias() = jac.transpose() * state.wrench;
+
+  // Posture in the nullspace of the end effector
+  if (m_null_space_stiffness > 0.0) {
+    state.null_space_tau =
+        -m_null_space_stiffness * (arm.positions.data - state.posture) -
+        m_null_space_damping * arm.filtered_velocities;
+    state.null_space_wrench.noalias() =
+        arm.model.jacobianTransposePseudoInverse() * state.null_space_tau;
+    state.tau += state.null_space_tau;
+    state.tau.noalias() -= jac.transpose() * state.null_space_wrench;
+  }
+}
+
+} // namespace bimanual_impedance_controller
+
+// Pluginlib
+#include <pluginlib/class_list_macros.hpp>
+
+PLUGINLIB_EXPORT_CLASS(
+    bimanual_impedance_controller::BimanualImpedanceController,
+    controller_interface::ControllerInterface)
@@ -1,10 +1,21 @@
 #ifndef EFFORT_IMPEDANCE_CONTROLLER_H_INCLUDED
 #define EFFORT_IMPEDANCE_CONTROLLER_H_INCLUDED
 
+#include "geometry_msgs/msg/accel_stamped.hpp"
 #include "geometry_msgs/msg/pose_stamped.hpp"
+#include "geometry_msgs/msg/twist_stamped.hpp"
 #include "geometry_msgs/msg/wrench_stamped.hpp"
+#include "nav_msgs/msg/path.hpp"
+#include "std_msgs/msg/float64_multi_array.hpp"
+#include "std_msgs/msg/string.hpp"
 #include <controller_interface/controller_interface.hpp>
+#include <effort_controller_base/CartesianTrajectoryBuffer.h>
+#include <effort_controller_base/GainSchedule.h>
+#include <effort_controller_base/JerkLimitedFilter.h>
+#include <effort_controller_base/NullspaceProjector.h>
+#include <effort_controller_base/TripleBuffer.h>
 #include <effort_controller_base/effort_controller_base.h>
+#include <realtime_tools/realtime_buffer.h>
 
 namespace cartesian_impedance_controller {
 
@@ -63,31 +74,257 @@ public:
 private:
   ctrl::Vector6D compensateGravity();
 
+  bool stageParameters(const std::vector<rclcpp::Parameter> &parameters,
+                       std::string &reason) override;
+  void publishParameters() override;
+
   void targetWrenchCallback(
       const geometry_msgs::msg::WrenchStamped::SharedPtr wrench);
   void
   targetFrameCallback(const geometry_msgs::msg::PoseStamped::SharedPtr target);
+  void targetTrajectoryCallback(const nav_msgs::msg::Path::SharedPtr path);
+  void targetImpedanceCallback(
+      const std_msgs::msg::Float64MultiArray::SharedPtr impedance);
+  void targetTwistCallback(
+      const geometry_msgs::msg::TwistStamped::SharedPtr twist);
+  void targetAccelerationCallback(
+      const geometry_msgs::msg::AccelStamped::SharedPtr acceleration);
+  void gainScheduleCallback(const std_msgs::msg::String::SharedPtr name);
   ctrl::Vector6D computeMotionError();
 
+  /**
+   * @brief Check that stiffness and damping are symmetric positive
+   * semi-definite
+   *
+   * @param stiffness The Cartesian stiffness
+   * @param damping The Cartesian damping
+   * @param error Reason of the failure
+   *
+   * @return True if both are valid
+   */
+  static bool validateImpedance(const ctrl::Matrix6D &stiffness,
+                                const ctrl::Matrix6D &damping,
+                                std::string &error);
+
+  /**
+   * @brief Damping 2 * sqrt(K) for a given stiffness K
+   *
+   * Generalizes the critical damping of unit masses to full matrices.
+   */
+  static ctrl::Matrix6D criticalDamping(const ctrl::Matrix6D &stiffness);
+
+  /**
+   * @brief Square root of a symmetric positive semi-definite matrix
+   */
+  static ctrl::Matrix6D matrixSquareRoot(const ctrl::Matrix6D &matrix);
+
+  /**
+   * @brief Damping design with the operational space inertia
+   *
+   * D = zeta * (Lambda^1/2 K^1/2 + K^1/2 Lambda^1/2), which yields the
+   * given damping ratio zeta along each decoupled task space direction.  For
+   * unit inertia, this reduces to \ref criticalDamping.
+   *
+   * @param stiffness_sqrt The square root of the stiffness in the base frame
+   * @param inertia The operational space inertia Lambda in the base frame
+   */
+  ctrl::Matrix6D operationalSpaceDamping(const ctrl::Matrix6D &stiffness_sqrt,
+                                         const ctrl::Matrix6D &inertia) const;
+
+  /**
+   * @brief Sample the buffered target trajectory
+   *
+   * Overwrites \ref m_target_frame with the interpolated pose if there is an
+   * active trajectory.
+   *
+   * @param time The current time of the control loop
+   */
+  void sampleTargetTrajectory(const rclcpp::Time &time);
+
+  /**
+   * @brief Apply the latest single target pose
+   *
+   * Measures the age of the setpoint from its header stamp and, if enabled,
+   * extrapolates it with its estimated twist to compensate transport delays.
+   *
+   * @param time The current time of the control loop
+   */
+  void applyTargetSetpoint(const rclcpp::Time &time);
+
+  /**
+   * @brief Determine the desired twist and acceleration of this cycle
+   *
+   * Explicit feedforward inputs take precedence over the motion of the
+   * jerk-limited reference.  Stale inputs are ignored.
+   *
+   * @param time The current time of the control loop
+   */
+  void updateFeedforward(const rclcpp::Time &time);
+
   rclcpp::Subscription<geometry_msgs::msg::WrenchStamped>::SharedPtr
       m_target_wrench_subscriber;
   rclcpp::Subscription<geometry_msgs::msg::PoseStamped>::SharedPtr
       m_target_frame_subscriber;
+  rclcpp::Subscription<nav_msgs::msg::Path>::SharedPtr
+      m_target_trajectory_subscriber;
+  rclcpp::Subscription<std_msgs::msg::Float64MultiArray>::SharedPtr
+      m_target_impedance_subscriber;
+  rclcpp::Subscription<geometry_msgs::msg::TwistStamped>::SharedPtr
+      m_target_twist_subscriber;
+  rclcpp::Subscription<geometry_msgs::msg::AccelStamped>::SharedPtr
+      m_target_acceleration_subscriber;
+  rclcpp::Subscription<std_msgs::msg::String>::SharedPtr
+      m_gain_schedule_subscriber;
   KDL::Frame m_target_frame;
-  ctrl::Vector6D m_ft_sensor_wrench;
-  std::string m_ft_sensor_ref_link;
-  KDL::Frame m_ft_sensor_transform;
+
+  /**
+   * Target wrench in the frame it was commanded in, identified by its link id
+   */
+  struct TargetWrench {
+    ctrl::Vector6D wrench = ctrl::Vector6D::Zero();
+    int link_id = 0;
+  };
+  effort_controller_base::TripleBuffer<TargetWrench> m_target_wrench_buffer;
+
+  /**
+   * Stiffness and damping streamed on the target_impedance topic.  Both are
+   * given w.r.t. the end effector link.
+   */
+  struct Impedance {
+    ctrl::Matrix6D stiffness;
+    ctrl::Matrix6D damping;
+  };
+  effort_controller_base::TripleBuffer<Impedance> m_target_impedance;
+  Impedance m_impedance;  // Latest of the streamed and parameter impedance
+
+  /**
+   * A single target pose, handed from the target_frame callback to the
+   * control loop.
+   */
+  struct TargetSetpoint {
+    KDL::Frame frame;
+    KDL::Twist twist = KDL::Twist::Zero();  // Estimated from the last two
+    double stamp = 0.0;                     // Seconds, zero if unknown
+    uint64_t sequence = 0;
+  };
+  realtime_tools::RealtimeBuffer<TargetSetpoint> m_target_setpoint;
+  TargetSetpoint m_last_received_setpoint;  // Callback thread only
+  uint64_t m_applied_setpoint_sequence;
+  bool m_setpoint_active;
+
+  /**
+   * A Cartesian feedforward quantity in the base frame, linear first, handed
+   * from its callback to the control loop.
+   */
+  struct FeedforwardSample {
+    ctrl::Vector6D value = ctrl::Vector6D::Zero();
+    double stamp = 0.0;  // Seconds, reception time if the header is unstamped
+  };
+  realtime_tools::RealtimeBuffer<FeedforwardSample> m_target_twist;
+  realtime_tools::RealtimeBuffer<FeedforwardSample> m_target_acceleration;
+  double m_feedforward_timeout;
+  bool m_feedforward_use_inertia;
+
+  // Feedforward of the current cycle
+  ctrl::Vector6D m_desired_twist;
+  ctrl::Vector6D m_desired_acceleration;
+  bool m_target_twist_fresh;
+
+  /**
+   * Operational space mode.  Uses the operational space inertia for damping
+   * design and acceleration feedforward.
+   */
+  bool m_operational_space;
+  double m_damping_ratio;
+  ctrl::Matrix6D m_stiffness_sqrt;  // W.r.t. the end effector link
+
+  /**
+   * Closed-loop regulation of the contact wrench towards the target wrench,
+   * with the wrench of the force/torque sensor or, without sensor, the one
+   * estimated by the base's external torque observer.
+   */
+  bool m_force_control;
+  double m_force_proportional_gain;
+  double m_force_integral_gain;
+  double m_force_max_integral;
+  ctrl::Vector6D m_force_integral;
+  double m_period = {0.0};
+
+  /**
+   * Passivity with the base's energy tank.  The applied stiffness
+   * m_cartesian_stiffness approaches the commanded one as far as the tank
+   * permits.  The tank is refilled with the power the task damping on the
+   * velocity error dissipated in the last cycle.
+   */
+  ctrl::Matrix6D m_target_stiffness;  // W.r.t. the end effector link
+  double m_dissipated_power = {0.0};
+
+  /**
+   * Hot-reload of `stiffness.*` and `nullspace_stiffness`.  New stiffness is
+   * handed over like a streamed target impedance, but through its own buffer,
+   * since the parameter callback may run concurrently with the
+   * target_impedance callback.  Staged in the parameter callback and
+   * published once the whole change is accepted.
+   */
+  bool m_stiffness_parameters_enabled;  // False with stiffness_matrix
+  Impedance m_staged_impedance;
+  bool m_impedance_staged = {false};
+  effort_controller_base::TripleBuffer<Impedance> m_parameter_impedance;
+  double m_staged_null_space_stiffness;
+  bool m_null_space_stiffness_staged = {false};
+  effort_controller_base::TripleBuffer<double> m_null_space_stiffness_buffer;
+
+  /**
+   * Gain scheduling.  The tables hold scales of the stiffness along the end
+   * effector axes, keyed on the manipulability and the end effector
+   * position.  They apply to the configured or streamed impedance.  The
+   * table selected on the gain_schedule topic is handed over by its id.
+   */
+  bool m_gain_schedule_enabled = {false};
+  effort_controller_base::GainSchedule m_gain_schedule;
+  effort_controller_base::TripleBuffer<int> m_gain_schedule_selection;
+  double m_gain_schedule_blend_time;
+  ctrl::VectorND m_gain_schedule_keys;  // Manipulability, x, y, z
+  size_t m_telemetry_gain_schedule_table;
+  size_t m_telemetry_gain_schedule_blend;
+
+  // Latency compensation
+  bool m_latency_compensation_enabled;
+  double m_latency_max_horizon;
+
+  // Setpoint age statistics since activation
+  double m_setpoint_age_mean;
+  double m_setpoint_age_max;
+  uint64_t m_setpoint_count;
+  size_t m_telemetry_setpoint_age;
+  size_t m_telemetry_setpoint_age_mean;
+  size_t m_telemetry_setpoint_age_max;
+  size_t m_telemetry_compute_time;
+
+  /**
+   * Time-stamped target poses streamed in batches on the target_trajectory
+   * topic.  They are interpolated in each control cycle.
+   */
+  effort_controller_base::CartesianTrajectoryBuffer m_target_trajectory;
+
+  /**
+   * Optional jerk-limited smoothing of the target pose.  The motion error is
+   * computed with respect to \ref m_reference_frame, which equals
+   * \ref m_target_frame if the filter is disabled.
+   */
+  bool m_target_filter_enabled;
+  effort_controller_base::CartesianTargetFilter m_target_filter;
+  KDL::Frame m_reference_frame;
 
   KDL::JntArray m_null_space;
   KDL::Frame m_current_frame;
 
-  ctrl::MatrixND m_identity;
+  effort_controller_base::NullspaceProjector m_null_space_projector;
   ctrl::VectorND m_q_starting_pose;
   ctrl::VectorND m_tau_old;
+  ctrl::VectorND m_null_space_torque;  // Nullspace share of the last torques
 
   ctrl::Vector3D m_old_rot_error;
-  ctrl::VectorND m_old_vel_error;
-  double const m_alpha = 0.3;
   /**
    * Allow users to choose whether to specify their target wrenches in the
    * end-effector frame (= True) or the base frame (= False). The first one
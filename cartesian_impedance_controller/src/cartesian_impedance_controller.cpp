@@ -1,5 +1,8 @@
 #include <cartesian_impedance_controller/cartesian_impedance_controller.h>
-#include <cartesian_impedance_controller/pseudo_inversion.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
 
 #include "controller_interface/controller_interface.hpp"
 #include "effort_controller_base/Utility.h"
@@ -17,9 +20,32 @@ CartesianImpedanceController::on_init() {
     return ret;
   }
 
-  auto_declare<std::string>("ft_sensor_ref_link", "");
   auto_declare<bool>("hand_frame_control", true);
   auto_declare<double>("nullspace_stiffness", 0.0);
+  auto_declare<std::string>("nullspace_projector", "");
+  auto_declare<int>("trajectory_buffer_size", 256);
+
+  auto_declare<double>("feedforward.timeout", 0.1);
+  auto_declare<bool>("feedforward.use_inertia", false);
+
+  auto_declare<bool>("operational_space.enabled", false);
+  auto_declare<double>("operational_space.damping_ratio", 1.0);
+
+  auto_declare<bool>("force_control.enabled", false);
+  auto_declare<double>("force_control.proportional_gain", 0.0);
+  auto_declare<double>("force_control.integral_gain", 5.0);
+  auto_declare<double>("force_control.max_integral", 20.0);
+
+  auto_declare<bool>("latency_compensation.enabled", false);
+  auto_declare<double>("latency_compensation.max_horizon", 0.05);
+
+  auto_declare<bool>("target_filter.enabled", false);
+  auto_declare<double>("target_filter.max_linear_velocity", 0.5);
+  auto_declare<double>("target_filter.max_linear_acceleration", 2.0);
+  auto_declare<double>("target_filter.max_linear_jerk", 20.0);
+  auto_declare<double>("target_filter.max_angular_velocity", 1.0);
+  auto_declare<double>("target_filter.max_angular_acceleration", 5.0);
+  auto_declare<double>("target_filter.max_angular_jerk", 50.0);
 
   constexpr double default_lin_stiff = 500.0;
   constexpr double default_rot_stiff = 50.0;
@@ -30,6 +56,15 @@ CartesianImpedanceController::on_init() {
   auto_declare<double>("stiffness.rot_y", default_rot_stiff);
   auto_declare<double>("stiffness.rot_z", default_rot_stiff);
 
+  // Full 6x6 matrices in row-major order.  If empty, the diagonal stiffness
+  // above and the matching critical damping are used.
+  auto_declare<std::vector<double>>("stiffness_matrix", std::vector<double>());
+  auto_declare<std::vector<double>>("damping_matrix", std::vector<double>());
+
+  auto_declare<std::vector<std::string>>("gain_schedule.names",
+                                         std::vector<std::string>());
+  auto_declare<double>("gain_schedule.blend_time", 0.5);
+
   return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
       CallbackReturn::SUCCESS;
   ;
@@ -44,19 +79,6 @@ CartesianImpedanceController::on_configure(
     return ret;
   }
 
-  // Make sure sensor link is part of the robot chain
-  m_ft_sensor_ref_link =
-      get_node()->get_parameter("ft_sensor_ref_link").as_string();
-  if (!Base::robotChainContains(m_ft_sensor_ref_link)) {
-    RCLCPP_ERROR_STREAM(get_node()->get_logger(),
-                        m_ft_sensor_ref_link
-                            << " is not part of the kinematic chain from "
-                            << Base::m_robot_base_link << " to "
-                            << Base::m_end_effector_link);
-    return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
-        CallbackReturn::ERROR;
-  }
-
   // Set stiffness
   ctrl::Vector6D tmp;
   tmp[0] = get_node()->get_parameter("stiffness.trans_x").as_double();
@@ -68,15 +90,101 @@ CartesianImpedanceController::on_configure(
 
   m_cartesian_stiffness = tmp.asDiagonal();
 
+  // Full stiffness matrix overrides the diagonal entries
+  const auto stiffness_matrix =
+      get_node()->get_parameter("stiffness_matrix").as_double_array();
+  if (!stiffness_matrix.empty()) {
+    if (stiffness_matrix.size() != 36) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "stiffness_matrix must have 36 entries");
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+    m_cartesian_stiffness =
+        Eigen::Map<const Eigen::Matrix<double, 6, 6, Eigen::RowMajor>>(
+            stiffness_matrix.data());
+  }
+
+  m_stiffness_parameters_enabled = stiffness_matrix.empty();
+
   // Set damping
-  tmp[0] = 2 * sqrt(tmp[0]);
-  tmp[1] = 2 * sqrt(tmp[1]);
-  tmp[2] = 2 * sqrt(tmp[2]);
-  tmp[3] = 2 * sqrt(tmp[3]);
-  tmp[4] = 2 * sqrt(tmp[4]);
-  tmp[5] = 2 * sqrt(tmp[5]);
+  const auto damping_matrix =
+      get_node()->get_parameter("damping_matrix").as_double_array();
+  if (damping_matrix.empty()) {
+    m_cartesian_damping = criticalDamping(m_cartesian_stiffness);
+  } else if (damping_matrix.size() == 36) {
+    m_cartesian_damping =
+        Eigen::Map<const Eigen::Matrix<double, 6, 6, Eigen::RowMajor>>(
+            damping_matrix.data());
+  } else {
+    RCLCPP_ERROR(get_node()->get_logger(),
+                 "damping_matrix must have 36 entries");
+    return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+        CallbackReturn::ERROR;
+  }
+
+  std::string impedance_error;
+  if (!validateImpedance(m_cartesian_stiffness, m_cartesian_damping,
+                         impedance_error)) {
+    RCLCPP_ERROR(get_node()->get_logger(), "Invalid impedance: %s",
+                 impedance_error.c_str());
+    return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+        CallbackReturn::ERROR;
+  }
+  m_impedance = {m_cartesian_stiffness, m_cartesian_damping};
+  m_target_impedance.init(m_impedance);
+  m_parameter_impedance.init(m_impedance);
+  m_target_stiffness = m_cartesian_stiffness;
+  m_stiffness_sqrt = matrixSquareRoot(m_cartesian_stiffness);
+
+  // Set operational space mode
+  m_operational_space =
+      get_node()->get_parameter("operational_space.enabled").as_bool();
+  m_damping_ratio =
+      get_node()->get_parameter("operational_space.damping_ratio").as_double();
+  if (m_damping_ratio <= 0.0) {
+    RCLCPP_ERROR(get_node()->get_logger(),
+                 "operational_space.damping_ratio must be positive");
+    return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+        CallbackReturn::ERROR;
+  }
+  RCLCPP_INFO_STREAM(get_node()->get_logger(),
+                     "Operational space mode set to "
+                         << std::boolalpha << m_operational_space);
+
+  // Set force control on the measured or estimated contact wrench
+  m_force_control =
+      get_node()->get_parameter("force_control.enabled").as_bool();
+  m_force_proportional_gain =
+      get_node()->get_parameter("force_control.proportional_gain").as_double();
+  m_force_integral_gain =
+      get_node()->get_parameter("force_control.integral_gain").as_double();
+  m_force_max_integral =
+      get_node()->get_parameter("force_control.max_integral").as_double();
+  if (m_force_control) {
+    if (!Base::m_ft_sensor_enabled &&
+        !Base::m_external_torque_observer_enabled) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "force_control needs ft_sensor.name or "
+                   "external_torque_observer.enabled");
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+    if (m_force_proportional_gain < 0.0 || m_force_integral_gain < 0.0 ||
+        m_force_max_integral < 0.0) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "force_control gains and max_integral must not be "
+                   "negative");
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+  }
 
-  m_cartesian_damping = tmp.asDiagonal();
+  m_target_impedance_subscriber =
+      get_node()->create_subscription<std_msgs::msg::Float64MultiArray>(
+          get_node()->get_name() + std::string("/target_impedance"), 3,
+          std::bind(&CartesianImpedanceController::targetImpedanceCallback,
+                    this, std::placeholders::_1));
 
   // Set nullspace stiffness
   m_null_space_stiffness =
@@ -86,32 +194,198 @@ CartesianImpedanceController::on_configure(
 
   // Set nullspace damping
   m_null_space_damping = 2 * sqrt(m_null_space_stiffness);
+  m_null_space_stiffness_buffer.init(m_null_space_stiffness);
+
+  // Set the nullspace projector.  Defaults to the dynamically consistent one
+  // in operational space mode.
+  const std::string projector =
+      get_node()->get_parameter("nullspace_projector").as_string();
+  effort_controller_base::NullspaceProjector::Type projector_type =
+      m_operational_space
+          ? effort_controller_base::NullspaceProjector::Type::
+                DynamicallyConsistent
+          : effort_controller_base::NullspaceProjector::Type::Kinematic;
+  if (!projector.empty() &&
+      !effort_controller_base::NullspaceProjector::parse(projector,
+                                                         projector_type)) {
+    RCLCPP_ERROR(get_node()->get_logger(),
+                 "Unknown nullspace_projector %s. Choose kinematic or "
+                 "dynamically_consistent",
+                 projector.c_str());
+    return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+        CallbackReturn::ERROR;
+  }
+  m_null_space_projector.setType(projector_type);
 
-  // Set the identity matrix with dimension of the joint space
-  m_identity = ctrl::MatrixND::Identity(m_joint_number, m_joint_number);
-
-  // Make sure sensor wrenches are interpreted correctly
-  // setFtSensorReferenceFrame(Base::m_end_effector_link);
-
+  m_target_wrench_buffer.init(TargetWrench());
   m_target_wrench_subscriber =
       get_node()->create_subscription<geometry_msgs::msg::WrenchStamped>(
           get_node()->get_name() + std::string("/target_wrench"), 10,
           std::bind(&CartesianImpedanceController::targetWrenchCallback, this,
                     std::placeholders::_1));
 
-  // m_ft_sensor_wrench_subscriber =
-  //   get_node()->create_subscription<geometry_msgs::msg::WrenchStamped>(
-  //     get_node()->get_name() + std::string("/ft_sensor_wrench"),
-  //     10,
-  //     std::bind(&CartesianImpedanceController::ftSensorWrenchCallback, this,
-  //     std::placeholders::_1));
-
   m_target_frame_subscriber =
       get_node()->create_subscription<geometry_msgs::msg::PoseStamped>(
           get_node()->get_name() + std::string("/target_frame"), 3,
           std::bind(&CartesianImpedanceController::targetFrameCallback, this,
                     std::placeholders::_1));
 
+  // Preallocate the buffer for streamed target trajectories
+  const int trajectory_buffer_size =
+      get_node()->get_parameter("trajectory_buffer_size").as_int();
+  if (trajectory_buffer_size < 2) {
+    RCLCPP_ERROR(get_node()->get_logger(),
+                 "trajectory_buffer_size must be at least 2");
+    return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+        CallbackReturn::ERROR;
+  }
+  m_target_trajectory.init(trajectory_buffer_size);
+
+  // Set jerk-limited target filter
+  m_target_filter_enabled =
+      get_node()->get_parameter("target_filter.enabled").as_bool();
+  const std::vector<std::string> limit_names = {
+      "target_filter.max_linear_velocity",
+      "target_filter.max_linear_acceleration",
+      "target_filter.max_linear_jerk",
+      "target_filter.max_angular_velocity",
+      "target_filter.max_angular_acceleration",
+      "target_filter.max_angular_jerk"};
+  std::vector<double> limits;
+  for (const auto &name : limit_names) {
+    limits.push_back(get_node()->get_parameter(name).as_double());
+    if (limits.back() <= 0.0) {
+      RCLCPP_ERROR(get_node()->get_logger(), "%s must be positive",
+                   name.c_str());
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+  }
+  m_target_filter.setLinearLimits(limits[0], limits[1], limits[2]);
+  m_target_filter.setAngularLimits(limits[3], limits[4], limits[5]);
+  RCLCPP_INFO_STREAM(get_node()->get_logger(),
+                     "Jerk-limited target filter set to "
+                         << std::boolalpha << m_target_filter_enabled);
+
+  // Set velocity and acceleration feedforward
+  m_feedforward_timeout =
+      get_node()->get_parameter("feedforward.timeout").as_double();
+  m_feedforward_use_inertia =
+      get_node()->get_parameter("feedforward.use_inertia").as_bool();
+
+  m_target_twist_subscriber =
+      get_node()->create_subscription<geometry_msgs::msg::TwistStamped>(
+          get_node()->get_name() + std::string("/target_twist"), 3,
+          std::bind(&CartesianImpedanceController::targetTwistCallback, this,
+                    std::placeholders::_1));
+
+  m_target_acceleration_subscriber =
+      get_node()->create_subscription<geometry_msgs::msg::AccelStamped>(
+          get_node()->get_name() + std::string("/target_acceleration"), 3,
+          std::bind(&CartesianImpedanceController::targetAccelerationCallback,
+                    this, std::placeholders::_1));
+
+  // Set latency compensation of single target poses
+  m_latency_compensation_enabled =
+      get_node()->get_parameter("latency_compensation.enabled").as_bool();
+  m_latency_max_horizon =
+      get_node()->get_parameter("latency_compensation.max_horizon").as_double();
+  if (m_latency_max_horizon < 0.0) {
+    RCLCPP_ERROR(get_node()->get_logger(),
+                 "latency_compensation.max_horizon must not be negative");
+    return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+        CallbackReturn::ERROR;
+  }
+
+  m_telemetry_setpoint_age = Base::m_telemetry.addChannel("setpoint_age");
+  m_telemetry_setpoint_age_mean =
+      Base::m_telemetry.addChannel("setpoint_age_mean");
+  m_telemetry_setpoint_age_max =
+      Base::m_telemetry.addChannel("setpoint_age_max");
+  m_telemetry_compute_time = Base::m_telemetry.addChannel("compute_time");
+
+  // Gain schedule tables, keyed on the manipulability and the end effector
+  // position in the robot base frame
+  const std::vector<std::string> schedule_keys = {"manipulability", "x", "y",
+                                                  "z"};
+  const auto schedule_names =
+      get_node()->get_parameter("gain_schedule.names").as_string_array();
+  m_gain_schedule_enabled = !schedule_names.empty();
+  if (m_gain_schedule_enabled) {
+    std::vector<effort_controller_base::GainSchedule::Table> tables;
+    for (const auto &name : schedule_names) {
+      const std::string prefix = "gain_schedule." + name;
+      auto_declare<std::vector<std::string>>(prefix + ".keys",
+                                             std::vector<std::string>());
+      auto_declare<std::vector<double>>(prefix + ".stiffness_scales",
+                                        std::vector<double>());
+      effort_controller_base::GainSchedule::Table table;
+      table.name = name;
+      for (const auto &key :
+           get_node()->get_parameter(prefix + ".keys").as_string_array()) {
+        const auto it =
+            std::find(schedule_keys.begin(), schedule_keys.end(), key);
+        if (it == schedule_keys.end()) {
+          RCLCPP_ERROR(get_node()->get_logger(),
+                       "Unsupported %s.keys entry '%s'. Choose "
+                       "manipulability, x, y or z",
+                       prefix.c_str(), key.c_str());
+          return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+              CallbackReturn::ERROR;
+        }
+        auto_declare<std::vector<double>>(prefix + "." + key,
+                                          std::vector<double>());
+        table.keys.push_back(it - schedule_keys.begin());
+        table.breakpoints.push_back(
+            get_node()->get_parameter(prefix + "." + key).as_double_array());
+      }
+      table.gains =
+          get_node()->get_parameter(prefix + ".stiffness_scales")
+              .as_double_array();
+      if (std::any_of(table.gains.begin(), table.gains.end(),
+                      [](double scale) { return scale < 0.0; })) {
+        RCLCPP_ERROR(get_node()->get_logger(),
+                     "%s.stiffness_scales must not be negative",
+                     prefix.c_str());
+        return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+            CallbackReturn::ERROR;
+      }
+      tables.push_back(std::move(table));
+    }
+    std::string schedule_error;
+    if (!m_gain_schedule.init(tables, 6, schedule_error)) {
+      RCLCPP_ERROR(get_node()->get_logger(), "gain_schedule: %s",
+                   schedule_error.c_str());
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+    m_gain_schedule_blend_time =
+        get_node()->get_parameter("gain_schedule.blend_time").as_double();
+    if (m_gain_schedule_blend_time < 0.0) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "gain_schedule.blend_time must not be negative");
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+    m_gain_schedule_selection.init(0);
+    m_gain_schedule_keys = ctrl::VectorND::Zero(schedule_keys.size());
+    m_telemetry_gain_schedule_table =
+        Base::m_telemetry.addChannel("gain_schedule_table");
+    m_telemetry_gain_schedule_blend =
+        Base::m_telemetry.addChannel("gain_schedule_blend");
+    m_gain_schedule_subscriber =
+        get_node()->create_subscription<std_msgs::msg::String>(
+            get_node()->get_name() + std::string("/gain_schedule"), 3,
+            std::bind(&CartesianImpedanceController::gainScheduleCallback,
+                      this, std::placeholders::_1));
+  }
+
+  m_target_trajectory_subscriber =
+      get_node()->create_subscription<nav_msgs::msg::Path>(
+          get_node()->get_name() + std::string("/target_trajectory"), 10,
+          std::bind(&CartesianImpedanceController::targetTrajectoryCallback,
+                    this, std::placeholders::_1));
+
   RCLCPP_INFO(get_node()->get_logger(), "Finished Impedance on_configure");
   return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
       CallbackReturn::SUCCESS;
@@ -125,11 +399,27 @@ CartesianImpedanceController::on_activate(
   // Update joint states
   Base::updateJointStates();
 
-  // Compute the forward kinematics
-  Base::m_fk_solver->JntToCart(Base::m_joint_positions, m_current_frame);
+  // Get the end effector pose
+  m_current_frame = Base::linkPose(Base::m_end_effector_link_id);
 
   // Set the target frame to the current frame
   m_target_frame = m_current_frame;
+  m_reference_frame = m_current_frame;
+
+  // Ignore setpoints received before activation
+  m_applied_setpoint_sequence = m_target_setpoint.readFromRT()->sequence;
+  m_setpoint_active = false;
+  m_setpoint_age_mean = 0.0;
+  m_setpoint_age_max = 0.0;
+  m_setpoint_count = 0;
+
+  // Start without feedforward
+  m_target_twist.writeFromNonRT(FeedforwardSample());
+  m_target_acceleration.writeFromNonRT(FeedforwardSample());
+  m_desired_twist = ctrl::Vector6D::Zero();
+  m_desired_acceleration = ctrl::Vector6D::Zero();
+  m_target_twist_fresh = false;
+  m_target_filter.reset(m_current_frame);
 
   RCLCPP_INFO(get_node()->get_logger(), "Finished Impedance on_activate");
 
@@ -137,12 +427,13 @@ CartesianImpedanceController::on_activate(
 
   // Initialize the old torque to zero
   m_tau_old = ctrl::VectorND::Zero(Base::m_joint_number);
+  m_null_space_torque = ctrl::VectorND::Zero(Base::m_joint_number);
 
   m_old_rot_error = ctrl::Vector3D::Zero();
 
-  m_old_vel_error = ctrl::VectorND::Zero(Base::m_joint_number);
-
   m_target_wrench = ctrl::Vector6D::Zero();
+  m_force_integral = ctrl::Vector6D::Zero();
+  m_dissipated_power = 0.0;
 
   return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
       CallbackReturn::SUCCESS;
@@ -152,7 +443,7 @@ rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::CallbackReturn
 CartesianImpedanceController::on_deactivate(
     const rclcpp_lifecycle::State &previous_state) {
   // Stop drifting by sending zero joint velocities
-  Base::computeJointEffortCmds(ctrl::Vector6D::Zero());
+  Base::computeJointEffortCmds(ctrl::VectorND::Zero(Base::m_joint_number));
   Base::writeJointEffortCmds();
   Base::on_deactivate(previous_state);
 
@@ -166,15 +457,47 @@ controller_interface::return_type CartesianImpedanceController::update(
   // Update joint states
   Base::updateJointStates();
 
+  // Read explicit velocity feedforward, used for latency compensation
+  updateFeedforward(time);
+
+  // Take over the latest single target pose
+  applyTargetSetpoint(time);
+
+  // Interpolate streamed target poses
+  sampleTargetTrajectory(time);
+
+  // Smooth sparse setpoints
+  if (m_target_filter_enabled) {
+    m_reference_frame =
+        m_target_filter.update(m_target_frame, period.seconds());
+
+    // Track the motion of the reference unless commanded explicitly
+    if (!m_target_twist_fresh) {
+      m_desired_twist = m_target_filter.twist();
+      m_desired_acceleration = m_target_filter.acceleration();
+    }
+  } else {
+    m_reference_frame = m_target_frame;
+  }
+
   // Compute the torque to applay at the joints
+  m_period = period.seconds();
+  const auto compute_start = std::chrono::steady_clock::now();
   ctrl::VectorND tau_tot = computeTorque();
+  Base::m_telemetry.set(
+      m_telemetry_compute_time,
+      std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                    compute_start)
+          .count());
 
-  // Saturation of the torque
-  Base::computeJointEffortCmds(tau_tot);
+  // Saturation of the torque, giving way in the nullspace first
+  Base::computeJointEffortCmds(tau_tot, m_null_space_torque);
 
   // Write final commands to the hardware interface
   Base::writeJointEffortCmds();
 
+  Base::m_telemetry.publish(time);
+
   return controller_interface::return_type::OK;
 }
 
@@ -184,8 +507,8 @@ ctrl::Vector6D CartesianImpedanceController::computeMotionError() {
   // Transformation from target -> current corresponds to error = target -
   // current
   KDL::Frame error_kdl;
-  error_kdl.M = m_target_frame.M * m_current_frame.M.Inverse();
-  error_kdl.p = m_target_frame.p - m_current_frame.p;
+  error_kdl.M = m_reference_frame.M * m_current_frame.M.Inverse();
+  error_kdl.p = m_reference_frame.p - m_current_frame.p;
 
   // Use Rodrigues Vector for a compact representation of orientation errors
   // Only for angles within [0,Pi)
@@ -216,22 +539,13 @@ ctrl::Vector6D CartesianImpedanceController::computeMotionError() {
 }
 
 ctrl::VectorND CartesianImpedanceController::computeTorque() {
-  // Compute the forward kinematics
-  Base::m_fk_solver->JntToCart(Base::m_joint_positions, m_current_frame);
-
-  // Compute the jacobian
-  Base::m_jnt_to_jac_solver->JntToJac(Base::m_joint_positions,
-                                      Base::m_jacobian);
-
-  // Compute the pseudo-inverse of the jacobian
-  ctrl::MatrixND jac = Base::m_jacobian.data;
-  ctrl::MatrixND jac_tran_pseudo_inverse;
-
-  pseudoInverse(jac.transpose(), &jac_tran_pseudo_inverse);
+  // Get the end effector pose and the jacobian of the current cycle
+  m_current_frame = Base::linkPose(Base::m_end_effector_link_id);
+  const ctrl::MatrixND &jac = Base::m_model.jacobian().data;
 
   // Redefine joints velocities in Eigen format
   ctrl::VectorND q = Base::m_joint_positions.data;
-  ctrl::VectorND q_dot = Base::m_joint_velocities.data;
+  const ctrl::VectorND &q_dot = Base::m_filtered_joint_velocities;
   ctrl::VectorND q_null_space = Base::m_simulated_joint_motion.data;
 
   // Compute the motion error
@@ -239,67 +553,209 @@ ctrl::VectorND CartesianImpedanceController::computeTorque() {
 
   // Initialize the torque vectors
   ctrl::VectorND tau_task(Base::m_joint_number), tau_null(Base::m_joint_number),
-      tau_ext(Base::m_joint_number);
+      tau_avoidance(Base::m_joint_number), tau_ext(Base::m_joint_number);
+
+  // Take over streamed stiffness and damping, or new stiffness parameters.
+  // Parameters win if both arrive in the same cycle.  With the energy tank,
+  // the stiffness only follows as far as the tank permits, see below.
+  bool impedance_changed = false;
+  if (m_target_impedance.update()) {
+    m_impedance = m_target_impedance.readBuffer();
+    impedance_changed = true;
+  }
+  if (m_parameter_impedance.update()) {
+    m_impedance = m_parameter_impedance.readBuffer();
+    impedance_changed = true;
+  }
+  if (impedance_changed) {
+    m_target_stiffness = m_impedance.stiffness;
+    m_cartesian_damping = m_impedance.damping;
+    if (!Base::m_energy_tank_enabled) {
+      m_cartesian_stiffness = m_target_stiffness;
+      if (m_operational_space) {
+        m_stiffness_sqrt = matrixSquareRoot(m_cartesian_stiffness);
+      }
+    }
+  }
+
+  // Scale the stiffness K to S K S with S = diag(sqrt(scales)), and the
+  // damping alike with the square root of S, which keeps the damping ratio
+  if (m_gain_schedule_enabled) {
+    if (m_gain_schedule_selection.update()) {
+      m_gain_schedule.select(m_gain_schedule_selection.readBuffer(),
+                             m_gain_schedule_blend_time);
+    }
+    m_gain_schedule_keys << Base::m_model.manipulability(),
+        m_current_frame.p.x(), m_current_frame.p.y(), m_current_frame.p.z();
+    const ctrl::Vector6D scale =
+        m_gain_schedule.update(m_gain_schedule_keys, m_period).cwiseSqrt();
+    const ctrl::Vector6D damping_scale = scale.cwiseSqrt();
+    m_target_stiffness =
+        scale.asDiagonal() * m_impedance.stiffness * scale.asDiagonal();
+    m_cartesian_damping = damping_scale.asDiagonal() * m_impedance.damping *
+                          damping_scale.asDiagonal();
+    if (!Base::m_energy_tank_enabled) {
+      m_cartesian_stiffness = m_target_stiffness;
+      if (m_operational_space) {
+        m_stiffness_sqrt = matrixSquareRoot(m_cartesian_stiffness);
+      }
+    }
+    Base::m_telemetry.set(m_telemetry_gain_schedule_table,
+                          static_cast<double>(m_gain_schedule.active()));
+    Base::m_telemetry.set(m_telemetry_gain_schedule_blend,
+                          m_gain_schedule.blend());
+  }
+
+  // The end effector rotation and twist.  The rotation is already known from
+  // the forward kinematics above.
+  ctrl::Matrix3D R;
+  R << m_current_frame.M.data[0], m_current_frame.M.data[1],
+      m_current_frame.M.data[2], m_current_frame.M.data[3],
+      m_current_frame.M.data[4], m_current_frame.M.data[5],
+      m_current_frame.M.data[6], m_current_frame.M.data[7],
+      m_current_frame.M.data[8];
+  const ctrl::Vector6D twist = jac * q_dot;
+
+  // Compute the wrench to achieve the desired force
+  m_target_wrench_buffer.update();
+  const TargetWrench &target_wrench = m_target_wrench_buffer.readBuffer();
+  m_target_wrench =
+      Base::displayInBaseLink(target_wrench.wrench, target_wrench.link_id);
+  ctrl::Vector6D applied_wrench = m_target_wrench;
+
+  // Regulate the contact wrench, measured by the sensor if there is one.  The
+  // robot exerts the negative of the external wrench on the environment.
+  // Feedback only acts in contact, so that the target wrench stays a pure
+  // feedforward in free motion and the integral does not wind up.
+  if (m_force_control && Base::m_contact) {
+    const ctrl::Vector6D force_error =
+        m_target_wrench + (Base::m_ft_sensor_enabled ? Base::m_ft_sensor_wrench
+                                                     : Base::m_external_wrench);
+    m_force_integral += m_force_integral_gain * m_period * force_error;
+    m_force_integral = m_force_integral.cwiseMax(-m_force_max_integral)
+                           .cwiseMin(m_force_max_integral);
+    applied_wrench +=
+        m_force_proportional_gain * force_error + m_force_integral;
+  } else {
+    m_force_integral.setZero();
+  }
 
-  // Filter the velocity errorm_old_vel_error
-  q_dot = m_alpha * q_dot + (1 - m_alpha) * m_old_vel_error;
-  for (int i = 0; i < q_dot.size(); i++) {
-    q_dot(i) = std::round(q_dot(i) * 1000) / 1000;
+  // Stiffness increases and the wrench feedforward inject energy.  Scale
+  // them with the energy tank, which the task damping refills.
+  if (Base::m_energy_tank_enabled) {
+    const ctrl::Matrix6D stiffness_step =
+        m_target_stiffness - m_cartesian_stiffness;
+    const double injected =
+        0.5 * motion_error.dot(Base::rotateTensor(stiffness_step, R) *
+                               motion_error) +
+        m_period * applied_wrench.dot(twist);
+    const double scale =
+        Base::passivityScale(m_period * m_dissipated_power, injected);
+    if (!stiffness_step.isZero(0.0)) {
+      if (scale < 1.0) {
+        m_cartesian_stiffness += scale * stiffness_step;
+      } else {
+        m_cartesian_stiffness = m_target_stiffness;
+      }
+      if (m_operational_space) {
+        m_stiffness_sqrt = matrixSquareRoot(m_cartesian_stiffness);
+      }
+    }
+    applied_wrench *= scale;
   }
-  m_old_vel_error = q_dot;
 
   // Compute the stiffness and damping in the base link
-  const auto base_link_stiffness =
-      Base::displayInBaseLink(m_cartesian_stiffness, Base::m_end_effector_link);
-  const auto base_link_damping =
-      Base::displayInBaseLink(m_cartesian_damping, Base::m_end_effector_link);
+  const ctrl::Matrix6D base_link_stiffness =
+      Base::rotateTensor(m_cartesian_stiffness, R);
+  const ctrl::Matrix6D base_link_damping =
+      m_operational_space
+          ? operationalSpaceDamping(Base::rotateTensor(m_stiffness_sqrt, R),
+                                    Base::m_model.taskInertia())
+          : Base::rotateTensor(m_cartesian_damping, R);
+
+  // Compute the task torque, with damping on the velocity error
+  ctrl::Vector6D task_wrench =
+      base_link_stiffness * motion_error +
+      base_link_damping * (m_desired_twist - twist);
+  m_dissipated_power = std::max(
+      0.0, twist.dot(base_link_damping * (twist - m_desired_twist)));
+
+  // Acceleration feedforward with the operational space inertia
+  if ((m_operational_space || m_feedforward_use_inertia) &&
+      !m_desired_acceleration.isZero()) {
+    task_wrench += Base::m_model.taskInertia() * m_desired_acceleration;
+  }
+  tau_task = jac.transpose() * task_wrench;
 
-  // Compute the task torque
-  tau_task = jac.transpose() * (base_link_stiffness * motion_error -
-                                (base_link_damping * (jac * q_dot)));
+  // Take over a new nullspace stiffness from the parameters
+  if (m_null_space_stiffness_buffer.update()) {
+    m_null_space_stiffness = m_null_space_stiffness_buffer.readBuffer();
+    m_null_space_damping = 2 * sqrt(m_null_space_stiffness);
+  }
 
-  // Compute the null space torque
+  // Compute the null space torque.  Only the posture torques are the lower
+  // priority share for saturation.  Self-collision and joint limit avoidance
+  // act in the nullspace as well, so that they do not disturb the task, but
+  // belong to the primary share, so that they never give way first.
   q_null_space = m_q_starting_pose;
-  tau_null = (m_identity - jac.transpose() * jac_tran_pseudo_inverse) *
-             (m_null_space_stiffness * (-q + q_null_space) -
-              m_null_space_damping * q_dot);
+  if (m_null_space_stiffness > 0.0) {
+    m_null_space_projector.project(
+        Base::m_model,
+        m_null_space_stiffness * (-q + q_null_space) -
+            m_null_space_damping * q_dot,
+        m_null_space_torque);
+  } else {
+    m_null_space_torque.setZero();
+  }
+  tau_null = m_null_space_torque;
+  if (Base::m_self_collision_enabled || Base::m_joint_limit_avoidance_enabled) {
+    m_null_space_projector.project(
+        Base::m_model,
+        Base::m_self_collision_torque + Base::m_joint_limit_torque,
+        tau_avoidance);
+    tau_null += tau_avoidance;
+  }
 
-  // Compute the torque to achieve the desired force
-  tau_ext = jac.transpose() * m_target_wrench;
+  tau_ext = jac.transpose() * applied_wrench;
 
+  // Virtual fixtures act outside the nullspace and override the task
   ctrl::VectorND tau = tau_task + tau_null + tau_ext;
-
-  KDL::JntArray tau_coriolis(Base::m_joint_number),
-      tau_gravity(Base::m_joint_number);
+  if (Base::m_virtual_fixtures_enabled) {
+    tau += Base::m_virtual_fixture_torque;
+  }
 
   if (m_compensate_gravity) {
-    Base::m_dyn_solver->JntToGravity(Base::m_joint_positions, tau_gravity);
-    tau = tau + tau_gravity.data;
+    tau += Base::m_model.gravity().data;
   }
   if (m_compensate_coriolis) {
-    Base::m_dyn_solver->JntToCoriolis(Base::m_joint_positions,
-                                      Base::m_joint_velocities, tau_coriolis);
-    tau = tau + tau_coriolis.data;
+    tau += Base::m_model.coriolis().data;
   }
   return tau;
 }
 
 void CartesianImpedanceController::targetWrenchCallback(
     const geometry_msgs::msg::WrenchStamped::SharedPtr wrench) {
-  // Parse the target wrench
-  m_target_wrench[0] = wrench->wrench.force.x;
-  m_target_wrench[1] = wrench->wrench.force.y;
-  m_target_wrench[2] = wrench->wrench.force.z;
-  m_target_wrench[3] = wrench->wrench.torque.x;
-  m_target_wrench[4] = wrench->wrench.torque.y;
-  m_target_wrench[5] = wrench->wrench.torque.z;
-
-  // Check if the wrench is given in the base frame
-  if (wrench->header.frame_id != Base::m_robot_base_link) {
-    // Transform the wrench to the base frame
-    m_target_wrench =
-        Base::displayInBaseLink(m_target_wrench, wrench->header.frame_id);
+  // Resolve the reference frame here, the rotation into the base frame is
+  // done in the control loop with the current link poses.
+  const int link_id = Base::linkId(wrench->header.frame_id);
+  if (link_id < 0) {
+    auto &clock = *get_node()->get_clock();
+    RCLCPP_WARN_THROTTLE(get_node()->get_logger(), clock, 3000,
+                         "Got target wrench in unknown reference frame %s",
+                         wrench->header.frame_id.c_str());
+    return;
   }
+
+  // Parse the target wrench
+  TargetWrench target;
+  target.wrench[0] = wrench->wrench.force.x;
+  target.wrench[1] = wrench->wrench.force.y;
+  target.wrench[2] = wrench->wrench.force.z;
+  target.wrench[3] = wrench->wrench.torque.x;
+  target.wrench[4] = wrench->wrench.torque.y;
+  target.wrench[5] = wrench->wrench.torque.z;
+  target.link_id = link_id;
+  m_target_wrench_buffer.write(target);
 }
 
 void CartesianImpedanceController::targetFrameCallback(
@@ -313,12 +769,342 @@ void CartesianImpedanceController::targetFrameCallback(
     return;
   }
 
-  m_target_frame =
+  TargetSetpoint setpoint;
+  setpoint.frame =
       KDL::Frame(KDL::Rotation::Quaternion(
                      target->pose.orientation.x, target->pose.orientation.y,
                      target->pose.orientation.z, target->pose.orientation.w),
                  KDL::Vector(target->pose.position.x, target->pose.position.y,
                              target->pose.position.z));
+  setpoint.stamp = rclcpp::Time(target->header.stamp).seconds();
+  setpoint.sequence = m_last_received_setpoint.sequence + 1;
+
+  // Estimate the setpoint's twist from the last two samples.  Samples too far
+  // apart belong to different motions.
+  const double dt = setpoint.stamp - m_last_received_setpoint.stamp;
+  constexpr double max_sample_interval = 0.5;
+  if (setpoint.stamp > 0.0 && m_last_received_setpoint.stamp > 0.0 &&
+      dt > 0.0 && dt < max_sample_interval) {
+    setpoint.twist = KDL::diff(m_last_received_setpoint.frame, setpoint.frame,
+                               dt);
+  }
+
+  m_last_received_setpoint = setpoint;
+  m_target_setpoint.writeFromNonRT(setpoint);
+}
+
+void CartesianImpedanceController::targetTrajectoryCallback(
+    const nav_msgs::msg::Path::SharedPtr path) {
+  auto &clock = *get_node()->get_clock();
+
+  // Validate the whole path first, so that it is either queued completely or
+  // not at all.  A partially queued path would end at the wrong pose.
+  size_t new_waypoints = 0;
+  for (const auto &pose : path->poses) {
+    const std::string &frame_id = pose.header.frame_id.empty()
+                                      ? path->header.frame_id
+                                      : pose.header.frame_id;
+    if (frame_id != Base::m_robot_base_link) {
+      RCLCPP_WARN_THROTTLE(
+          get_node()->get_logger(), clock, 3000,
+          "Got target trajectory in wrong reference frame. Expected: %s but "
+          "got %s",
+          Base::m_robot_base_link.c_str(), frame_id.c_str());
+      return;
+    }
+    if (rclcpp::Time(pose.header.stamp).seconds() >
+        m_target_trajectory.lastPushedTime()) {
+      ++new_waypoints;
+    }
+  }
+  if (new_waypoints > m_target_trajectory.space()) {
+    RCLCPP_WARN_THROTTLE(get_node()->get_logger(), clock, 3000,
+                         "Target trajectory buffer is full, dropping "
+                         "trajectory. Consider increasing "
+                         "trajectory_buffer_size");
+    return;
+  }
+
+  for (const auto &pose : path->poses) {
+    effort_controller_base::CartesianWaypoint waypoint;
+    waypoint.time = rclcpp::Time(pose.header.stamp).seconds();
+    waypoint.position << pose.pose.position.x, pose.pose.position.y,
+        pose.pose.position.z;
+    waypoint.orientation =
+        Eigen::Quaterniond(pose.pose.orientation.w, pose.pose.orientation.x,
+                           pose.pose.orientation.y, pose.pose.orientation.z);
+    m_target_trajectory.push(waypoint);
+  }
+}
+
+void CartesianImpedanceController::sampleTargetTrajectory(
+    const rclcpp::Time &time) {
+  ctrl::Vector3D position;
+  Eigen::Quaterniond orientation;
+  if (!m_target_trajectory.sample(time.seconds(), position, orientation)) {
+    return;
+  }
+
+  // The trajectory supersedes earlier single target poses
+  m_setpoint_active = false;
+
+  m_target_frame =
+      KDL::Frame(KDL::Rotation::Quaternion(orientation.x(), orientation.y(),
+                                           orientation.z(), orientation.w()),
+                 KDL::Vector(position.x(), position.y(), position.z()));
+}
+
+void CartesianImpedanceController::applyTargetSetpoint(
+    const rclcpp::Time &time) {
+  const TargetSetpoint &setpoint = *m_target_setpoint.readFromRT();
+  const bool stamped = setpoint.stamp > 0.0;
+  const double age = time.seconds() - setpoint.stamp;
+
+  if (setpoint.sequence != m_applied_setpoint_sequence) {
+    m_applied_setpoint_sequence = setpoint.sequence;
+    m_setpoint_active = true;
+
+    // Age statistics
+    if (stamped) {
+      ++m_setpoint_count;
+      m_setpoint_age_mean += (age - m_setpoint_age_mean) / m_setpoint_count;
+      m_setpoint_age_max = std::max(m_setpoint_age_max, age);
+      Base::m_telemetry.set(m_telemetry_setpoint_age, age);
+      Base::m_telemetry.set(m_telemetry_setpoint_age_mean, m_setpoint_age_mean);
+      Base::m_telemetry.set(m_telemetry_setpoint_age_max, m_setpoint_age_max);
+    }
+  }
+
+  if (!m_setpoint_active) {
+    return;
+  }
+
+  if (m_latency_compensation_enabled && stamped) {
+    // Prefer the explicit twist over the estimated one
+    KDL::Twist twist = setpoint.twist;
+    if (m_target_twist_fresh) {
+      for (int i = 0; i < 6; ++i) {
+        twist(i) = m_desired_twist[i];
+      }
+    }
+    const double horizon = std::clamp(age, 0.0, m_latency_max_horizon);
+    m_target_frame = KDL::addDelta(setpoint.frame, twist, horizon);
+  } else {
+    m_target_frame = setpoint.frame;
+  }
+}
+
+void CartesianImpedanceController::targetImpedanceCallback(
+    const std_msgs::msg::Float64MultiArray::SharedPtr impedance) {
+  auto &clock = *get_node()->get_clock();
+  const auto &data = impedance->data;
+  if (data.size() != 36 && data.size() != 72) {
+    RCLCPP_WARN_THROTTLE(get_node()->get_logger(), clock, 3000,
+                         "Target impedance needs 36 (stiffness) or 72 "
+                         "(stiffness and damping) entries, got %zu",
+                         data.size());
+    return;
+  }
+
+  using RowMajor6D = Eigen::Matrix<double, 6, 6, Eigen::RowMajor>;
+  Impedance target;
+  target.stiffness = Eigen::Map<const RowMajor6D>(data.data());
+  if (data.size() == 72) {
+    target.damping = Eigen::Map<const RowMajor6D>(data.data() + 36);
+  } else {
+    target.damping = criticalDamping(target.stiffness);
+  }
+
+  std::string error;
+  if (!validateImpedance(target.stiffness, target.damping, error)) {
+    RCLCPP_WARN_THROTTLE(get_node()->get_logger(), clock, 3000,
+                         "Rejected target impedance: %s", error.c_str());
+    return;
+  }
+  m_target_impedance.write(target);
+}
+
+bool CartesianImpedanceController::stageParameters(
+    const std::vector<rclcpp::Parameter> &parameters, std::string &reason) {
+  static const std::array<std::string, 6> stiffness_names = {
+      "stiffness.trans_x", "stiffness.trans_y", "stiffness.trans_z",
+      "stiffness.rot_x",   "stiffness.rot_y",   "stiffness.rot_z"};
+
+  // Start from the current values, which the change does not include
+  ctrl::Vector6D stiffness;
+  for (size_t i = 0; i < stiffness_names.size(); ++i) {
+    stiffness[i] = get_node()->get_parameter(stiffness_names[i]).as_double();
+  }
+  m_impedance_staged = false;
+  m_null_space_stiffness_staged = false;
+  for (const auto &parameter : parameters) {
+    const auto it = std::find(stiffness_names.begin(), stiffness_names.end(),
+                              parameter.get_name());
+    if (it != stiffness_names.end()) {
+      if (!m_stiffness_parameters_enabled) {
+        reason = "stiffness_matrix overrides stiffness.*";
+        return false;
+      }
+      stiffness[it - stiffness_names.begin()] = parameter.as_double();
+      m_impedance_staged = true;
+    } else if (parameter.get_name() == "nullspace_stiffness") {
+      m_staged_null_space_stiffness = parameter.as_double();
+      if (m_staged_null_space_stiffness < 0.0) {
+        reason = "nullspace_stiffness must not be negative";
+        return false;
+      }
+      m_null_space_stiffness_staged = true;
+    }
+  }
+
+  if (m_impedance_staged) {
+    const auto damping_matrix =
+        get_node()->get_parameter("damping_matrix").as_double_array();
+    m_staged_impedance.stiffness = stiffness.asDiagonal();
+    if (damping_matrix.size() == 36) {
+      m_staged_impedance.damping =
+          Eigen::Map<const Eigen::Matrix<double, 6, 6, Eigen::RowMajor>>(
+              damping_matrix.data());
+    } else {
+      m_staged_impedance.damping =
+          criticalDamping(m_staged_impedance.stiffness);
+    }
+    if (!validateImpedance(m_staged_impedance.stiffness,
+                           m_staged_impedance.damping, reason)) {
+      m_impedance_staged = false;
+      return false;
+    }
+  }
+  return true;
+}
+
+void CartesianImpedanceController::publishParameters() {
+  if (m_impedance_staged) {
+    m_parameter_impedance.write(m_staged_impedance);
+  }
+  if (m_null_space_stiffness_staged) {
+    m_null_space_stiffness_buffer.write(m_staged_null_space_stiffness);
+  }
+  m_impedance_staged = false;
+  m_null_space_stiffness_staged = false;
+}
+
+void CartesianImpedanceController::gainScheduleCallback(
+    const std_msgs::msg::String::SharedPtr name) {
+  const int table = m_gain_schedule.tableId(name->data);
+  if (table < 0) {
+    RCLCPP_WARN_THROTTLE(get_node()->get_logger(), *get_node()->get_clock(),
+                         3000, "Unknown gain schedule %s",
+                         name->data.c_str());
+    return;
+  }
+  m_gain_schedule_selection.write(table);
+}
+
+bool CartesianImpedanceController::validateImpedance(
+    const ctrl::Matrix6D &stiffness, const ctrl::Matrix6D &damping,
+    std::string &error) {
+  constexpr double tolerance = 1e-9;
+  if (!stiffness.isApprox(stiffness.transpose(), tolerance) ||
+      !damping.isApprox(damping.transpose(), tolerance)) {
+    error = "stiffness and damping must be symmetric";
+    return false;
+  }
+  // Zero eigenvalues are allowed for compliant directions
+  if (Eigen::SelfAdjointEigenSolver<ctrl::Matrix6D>(
+          stiffness, Eigen::EigenvaluesOnly)
+              .eigenvalues()
+              .minCoeff() < -tolerance ||
+      Eigen::SelfAdjointEigenSolver<ctrl::Matrix6D>(damping,
+                                                    Eigen::EigenvaluesOnly)
+              .eigenvalues()
+              .minCoeff() < -tolerance) {
+    error = "stiffness and damping must be positive semi-definite";
+    return false;
+  }
+  return true;
+}
+
+ctrl::Matrix6D CartesianImpedanceController::criticalDamping(
+    const ctrl::Matrix6D &stiffness) {
+  return 2 * matrixSquareRoot(stiffness);
+}
+
+ctrl::Matrix6D CartesianImpedanceController::matrixSquareRoot(
+    const ctrl::Matrix6D &matrix) {
+  Eigen::SelfAdjointEigenSolver<ctrl::Matrix6D> solver(matrix);
+  return solver.operatorSqrt();
+}
+
+ctrl::Matrix6D CartesianImpedanceController::operationalSpaceDamping(
+    const ctrl::Matrix6D &stiffness_sqrt, const ctrl::Matrix6D &inertia) const {
+  const ctrl::Matrix6D inertia_sqrt = matrixSquareRoot(inertia);
+  return m_damping_ratio *
+         (inertia_sqrt * stiffness_sqrt + stiffness_sqrt * inertia_sqrt);
+}
+
+void CartesianImpedanceController::targetTwistCallback(
+    const geometry_msgs::msg::TwistStamped::SharedPtr twist) {
+  if (twist->header.frame_id != Base::m_robot_base_link) {
+    auto &clock = *get_node()->get_clock();
+    RCLCPP_WARN_THROTTLE(
+        get_node()->get_logger(), clock, 3000,
+        "Got target twist in wrong reference frame. Expected: %s but got %s",
+        Base::m_robot_base_link.c_str(), twist->header.frame_id.c_str());
+    return;
+  }
+
+  FeedforwardSample sample;
+  sample.value << twist->twist.linear.x, twist->twist.linear.y,
+      twist->twist.linear.z, twist->twist.angular.x, twist->twist.angular.y,
+      twist->twist.angular.z;
+  sample.stamp = rclcpp::Time(twist->header.stamp).seconds();
+  if (sample.stamp <= 0.0) {
+    sample.stamp = get_node()->now().seconds();
+  }
+  m_target_twist.writeFromNonRT(sample);
+}
+
+void CartesianImpedanceController::targetAccelerationCallback(
+    const geometry_msgs::msg::AccelStamped::SharedPtr acceleration) {
+  if (acceleration->header.frame_id != Base::m_robot_base_link) {
+    auto &clock = *get_node()->get_clock();
+    RCLCPP_WARN_THROTTLE(get_node()->get_logger(), clock, 3000,
+                         "Got target acceleration in wrong reference frame. "
+                         "Expected: %s but got %s",
+                         Base::m_robot_base_link.c_str(),
+                         acceleration->header.frame_id.c_str());
+    return;
+  }
+
+  FeedforwardSample sample;
+  sample.value << acceleration->accel.linear.x, acceleration->accel.linear.y,
+      acceleration->accel.linear.z, acceleration->accel.angular.x,
+      acceleration->accel.angular.y, acceleration->accel.angular.z;
+  sample.stamp = rclcpp::Time(acceleration->header.stamp).seconds();
+  if (sample.stamp <= 0.0) {
+    sample.stamp = get_node()->now().seconds();
+  }
+  m_target_acceleration.writeFromNonRT(sample);
+}
+
+void CartesianImpedanceController::updateFeedforward(
+    const rclcpp::Time &time) {
+  const double now = time.seconds();
+  const FeedforwardSample &twist = *m_target_twist.readFromRT();
+  const FeedforwardSample &acceleration = *m_target_acceleration.readFromRT();
+
+  m_target_twist_fresh =
+      twist.stamp > 0.0 && now - twist.stamp <= m_feedforward_timeout;
+  const bool acceleration_fresh =
+      acceleration.stamp > 0.0 &&
+      now - acceleration.stamp <= m_feedforward_timeout;
+
+  m_desired_twist =
+      m_target_twist_fresh ? twist.value : ctrl::Vector6D::Zero().eval();
+  m_desired_acceleration = acceleration_fresh
+                               ? acceleration.value
+                               : ctrl::Vector6D::Zero().eval();
 }
 }  // namespace cartesian_impedance_controller
 
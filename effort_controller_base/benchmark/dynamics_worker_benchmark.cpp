@@ -0,0 +1,93 @@
+#include <effort_controller_base/DynamicsWorker.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "panda_chain.h"
+
+using effort_controller_base::DynamicsWorker;
+
+namespace {
+
+double microseconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+double percentile(std::vector<double> samples, double p) {
+  const size_t k = static_cast<size_t>(p * (samples.size() - 1));
+  std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+  return samples[k];
+}
+
+}  // namespace
+
+int main() {
+  constexpr int kCycles = 100000;
+  constexpr unsigned int n = benchmark::kPandaJoints;
+
+  const KDL::Chain chain = benchmark::pandaChain();
+  const KDL::Vector gravity_vector(0.0, 0.0, -9.81);
+  KDL::ChainDynParam solver(chain, gravity_vector);
+
+  std::mt19937 generator(1);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  KDL::JntArray q(n), q_dot(n), gravity(n), coriolis(n);
+  KDL::JntSpaceInertiaMatrix mass(n);
+
+  // Let the worker compute one set of results around a random configuration
+  benchmark::randomPandaConfiguration(generator, q);
+  DynamicsWorker worker;
+  worker.init(chain, gravity_vector, 1000.0, 1.0);
+  worker.setJointState(q, q_dot);
+  worker.start();
+  while (!worker.fetch()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  worker.stop();
+  const KDL::JntArray q0 = q;
+
+  // The control loop's share with the worker, close to the worker's q0,
+  // against the synchronous computation
+  std::vector<double> synchronous(kCycles), control_loop(kCycles);
+  double checksum = 0.0;
+  for (int k = 0; k < kCycles; ++k) {
+    for (unsigned int i = 0; i < n; ++i) {
+      q(i) = q0(i) + 0.01 * uniform(generator);
+      q_dot(i) = uniform(generator);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    solver.JntToGravity(q, gravity);
+    solver.JntToCoriolis(q, q_dot, coriolis);
+    solver.JntToMass(q, mass);
+    synchronous[k] = microseconds(start);
+    checksum += gravity(0) + coriolis(0) + mass(0, 0);
+
+    start = std::chrono::steady_clock::now();
+    worker.gravity(q, gravity);
+    worker.coriolis(q_dot, coriolis);
+    worker.massMatrix(q, mass);
+    control_loop[k] = microseconds(start);
+    checksum -= gravity(0) + coriolis(0) + mass(0, 0);
+  }
+
+  const double synchronous_median = percentile(synchronous, 0.5);
+  const double control_loop_p99 = percentile(control_loop, 0.99);
+  std::printf("dynamics_worker: %d cycles of %u joints (checksum %g)\n",
+              kCycles, n, checksum);
+  std::printf("  synchronous: median %.2f us, p99 %.2f us, max %.2f us\n",
+              synchronous_median, percentile(synchronous, 0.99),
+              *std::max_element(synchronous.begin(), synchronous.end()));
+  std::printf("  control loop: median %.2f us, p99 %.2f us, max %.2f us\n",
+              percentile(control_loop, 0.5), control_loop_p99,
+              *std::max_element(control_loop.begin(), control_loop.end()));
+  // The worker must free at least half of the synchronous dynamics time.
+  // Preemption spikes only show in the maximum, which is reported only.
+  return control_loop_p99 < 0.5 * synchronous_median ? 0 : 1;
+}
@@ -0,0 +1,68 @@
+#include <effort_controller_base/RobotModel.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "panda_chain.h"
+
+using effort_controller_base::RobotModel;
+
+namespace {
+
+double percentile(std::vector<double> samples, double p) {
+  const size_t k = static_cast<size_t>(p * (samples.size() - 1));
+  std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+  return samples[k];
+}
+
+}  // namespace
+
+int main() {
+  constexpr int kConfigurations = 100000;
+
+  const KDL::Chain chain = benchmark::pandaChain();
+  KDL::JntArray q(benchmark::kPandaJoints), q_dot(benchmark::kPandaJoints);
+  RobotModel model;
+  model.init(chain, "panda_link0", &q, &q_dot, KDL::Vector(0.0, 0.0, -9.81));
+
+  std::mt19937 generator(1);
+  std::vector<double> samples;
+  samples.reserve(kConfigurations);
+  double total = 0.0;
+  double worst = 0.0;
+  double checksum = 0.0;
+  for (int k = 0; k < kConfigurations; ++k) {
+    benchmark::randomPandaConfiguration(generator, q);
+
+    // The Jacobian is needed by every Cartesian impedance law.  Everything
+    // operational space mode adds on top of it is timed, including M(q).
+    model.invalidate();
+    model.jacobian();
+
+    const auto start = std::chrono::steady_clock::now();
+    model.massMatrix();
+    model.massMatrixLLT();
+    model.taskInertia();
+    const ctrl::MatrixND &j_bar = model.dynamicallyConsistentInverse();
+    const double elapsed = std::chrono::duration<double, std::micro>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    samples.push_back(elapsed);
+    total += elapsed;
+    worst = std::max(worst, elapsed);
+    checksum += j_bar(0, 0);
+  }
+
+  std::printf("operational_space: %d configurations of %u joints\n",
+              kConfigurations, benchmark::kPandaJoints);
+  const double p999 = percentile(samples, 0.999);
+  std::printf("  mean %.2f us, p99.9 %.2f us, max %.2f us (checksum %g)\n",
+              total / kConfigurations, p999, worst, checksum);
+  // Mass matrix, its factorization, Lambda and J_bar within a 1 kHz cycle.
+  // The single worst sample is dominated by preemption of the benchmark
+  // process and only reported.
+  return p999 < 50.0 ? 0 : 1;
+}
@@ -0,0 +1,73 @@
+#ifndef PANDA_CHAIN_H_INCLUDED
+#define PANDA_CHAIN_H_INCLUDED
+
+#include <kdl/chain.hpp>
+#include <kdl/frames.hpp>
+#include <kdl/rigidbodyinertia.hpp>
+#include <kdl/rotationalinertia.hpp>
+#include <kdl/segment.hpp>
+
+#include <array>
+#include <cmath>
+#include <random>
+#include <string>
+
+namespace benchmark {
+
+constexpr unsigned int kPandaJoints = 7;
+
+// Joint position limits of the Panda in rad
+constexpr std::array<double, kPandaJoints> kPandaLower = {
+    -2.8973, -1.7628, -2.8973, -3.0718, -2.8973, -0.0175, -2.8973};
+constexpr std::array<double, kPandaJoints> kPandaUpper = {
+    2.8973, 1.7628, 2.8973, -0.0698, 2.8973, 3.7525, 2.8973};
+
+/**
+ * @brief The kinematic chain of a Franka Emika Panda, from link0 to the flange
+ *
+ * Built from the modified Denavit-Hartenberg parameters of the datasheet.
+ * The link masses are those of the datasheet, with the center of mass at the
+ * link origin and a uniform rotational inertia, which is close enough for
+ * timing the dynamics.
+ */
+inline KDL::Chain pandaChain() {
+  // a, alpha, d of the joints and the flange
+  constexpr double dh[kPandaJoints + 1][3] = {
+      {0.0, 0.0, 0.333},     {0.0, -M_PI_2, 0.0},      {0.0, M_PI_2, 0.316},
+      {0.0825, M_PI_2, 0.0}, {-0.0825, -M_PI_2, 0.384}, {0.0, M_PI_2, 0.0},
+      {0.088, M_PI_2, 0.0},  {0.0, 0.0, 0.107}};
+  constexpr double masses[kPandaJoints] = {4.97, 0.65, 3.23, 3.59,
+                                           1.23, 1.67, 0.74};
+
+  KDL::Chain chain;
+  chain.addSegment(KDL::Segment(
+      "panda_link0_joint1", KDL::Joint(KDL::Joint::None),
+      KDL::Frame::DH_Craig1989(dh[0][0], dh[0][1], dh[0][2], 0.0)));
+  for (unsigned int i = 0; i < kPandaJoints; ++i) {
+    const double m = masses[i];
+    chain.addSegment(KDL::Segment(
+        "panda_link" + std::to_string(i + 1), KDL::Joint(KDL::Joint::RotZ),
+        KDL::Frame::DH_Craig1989(dh[i + 1][0], dh[i + 1][1], dh[i + 1][2],
+                                 0.0),
+        KDL::RigidBodyInertia(
+            m, KDL::Vector::Zero(),
+            KDL::RotationalInertia(0.01 * m, 0.01 * m, 0.01 * m))));
+  }
+  return chain;
+}
+
+/**
+ * @brief A uniformly random configuration within the joint limits
+ */
+template <typename Positions>
+void randomPandaConfiguration(std::mt19937 &generator, Positions &q) {
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  for (unsigned int i = 0; i < kPandaJoints; ++i) {
+    q(i) = kPandaLower[i] +
+           uniform(generator) * (kPandaUpper[i] - kPandaLower[i]);
+  }
+}
+
+}  // namespace benchmark
+
+#endif
@@ -0,0 +1,100 @@
+#include <effort_controller_base/RobotModel.h>
+#include <effort_controller_base/SelfCollision.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "panda_chain.h"
+
+using effort_controller_base::RobotModel;
+using effort_controller_base::SelfCollision;
+
+namespace {
+
+// Two capsules per link of the Panda, one along the link frame's z axis and
+// one offset along x, which gives more pairs than the Panda's own collision
+// model of one capsule per link
+std::vector<SelfCollision::Capsule> pandaCapsules() {
+  std::vector<SelfCollision::Capsule> capsules;
+  for (int link = 1; link <= static_cast<int>(benchmark::kPandaJoints) + 1;
+       ++link) {
+    const int depth = link - 1;
+    capsules.push_back({link, depth, KDL::Vector(0.0, 0.0, -0.15),
+                        KDL::Vector(0.0, 0.0, 0.0), 0.06});
+    capsules.push_back({link, depth, KDL::Vector(0.05, 0.0, -0.05),
+                        KDL::Vector(0.05, 0.0, 0.05), 0.05});
+  }
+  return capsules;
+}
+
+double percentile(std::vector<double> samples, double p) {
+  const size_t k = static_cast<size_t>(p * (samples.size() - 1));
+  std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+  return samples[k];
+}
+
+}  // namespace
+
+int main() {
+  constexpr int kConfigurations = 100000;
+
+  const KDL::Chain chain = benchmark::pandaChain();
+  KDL::JntArray q(benchmark::kPandaJoints), q_dot(benchmark::kPandaJoints);
+  RobotModel model;
+  model.init(chain, "panda_link0", &q, &q_dot, KDL::Vector(0.0, 0.0, -9.81));
+
+  SelfCollision::Settings settings;
+  settings.distance = 0.05;
+  settings.stiffness = 500.0;
+  settings.damping = 20.0;
+  settings.ignore_adjacent = 1;
+  SelfCollision self_collision;
+  self_collision.init(pandaCapsules(), {}, benchmark::kPandaJoints, settings);
+  ctrl::VectorND tau = ctrl::VectorND::Zero(benchmark::kPandaJoints);
+
+  std::mt19937 generator(1);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  std::vector<double> samples;
+  samples.reserve(kConfigurations);
+  double total = 0.0;
+  double worst = 0.0;
+  size_t close = 0;
+  size_t max_close = 0;
+  for (int k = 0; k < kConfigurations; ++k) {
+    benchmark::randomPandaConfiguration(generator, q);
+    for (unsigned int i = 0; i < benchmark::kPandaJoints; ++i) {
+      q_dot(i) = uniform(generator);
+    }
+
+    // The link poses are shared by the whole cycle and not part of the time
+    model.invalidate();
+    model.linkPoses();
+
+    const auto start = std::chrono::steady_clock::now();
+    self_collision.update(model, q_dot.data, tau);
+    const double elapsed = std::chrono::duration<double, std::micro>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    samples.push_back(elapsed);
+    total += elapsed;
+    worst = std::max(worst, elapsed);
+    close += self_collision.closePairs();
+    max_close = std::max(max_close, self_collision.closePairs());
+  }
+
+  std::printf("self_collision: %d configurations, %zu pairs\n",
+              kConfigurations, self_collision.pairs());
+  const double p999 = percentile(samples, 0.999);
+  std::printf("  mean %.2f us, p99.9 %.2f us, max %.2f us\n",
+              total / kConfigurations, p999, worst);
+  std::printf("  close pairs mean %.1f, max %zu\n",
+              static_cast<double>(close) / kConfigurations, max_close);
+  // All pairs must be evaluated well within a 1 kHz cycle.  The single worst
+  // sample is dominated by preemption of the benchmark process and only
+  // reported.
+  return p999 < 20.0 ? 0 : 1;
+}
@@ -0,0 +1,77 @@
+#ifndef ARM_H_INCLUDED
+#define ARM_H_INCLUDED
+
+#include <effort_controller_base/RobotModel.h>
+#include <effort_controller_base/Utility.h>
+
+#include <kdl/chain.hpp>
+#include <kdl/jntarray.hpp>
+#include <string>
+#include <vector>
+
+namespace effort_controller_base {
+
+/**
+ * @brief One kinematic chain of a multi-arm controller
+ *
+ * Each arm runs from the common robot base link to its own end effector and
+ * owns the joint state and the lazily evaluated model of its chain.  The
+ * arms can thus be evaluated independently and in parallel.  Arms may share
+ * the joints of a common trunk.  The chain model takes its link poses and
+ * Jacobian from the controller's tree model, so that the trunk is traversed
+ * once for all arms.  Its own dynamics miss the other arms' loads on the
+ * shared joints, so that the tree model's dynamics apply to the whole robot.
+ */
+struct Arm {
+  Arm() = default;
+  Arm(const Arm &) = delete;
+  Arm &operator=(const Arm &) = delete;
+
+  std::string name;
+  std::string end_effector_link;
+  KDL::Chain chain;
+
+  // Index of each chain joint in the controller's joints
+  std::vector<size_t> joints;
+
+  KDL::JntArray positions;
+  KDL::JntArray velocities;
+  ctrl::VectorND filtered_velocities;
+
+  RobotModel model;
+  int end_effector_link_id = -1;
+
+  // Seconds spent in this arm's jobs during the current cycle
+  double time = 0.0;
+
+  /**
+   * @brief Take over this arm's share of the controller's joint state
+   *
+   * Also invalidates the model.
+   */
+  void readJointState(const KDL::JntArray &q, const KDL::JntArray &q_dot,
+                      const ctrl::VectorND &q_dot_filtered) {
+    for (size_t i = 0; i < joints.size(); ++i) {
+      positions(i) = q(joints[i]);
+      velocities(i) = q_dot(joints[i]);
+      filtered_velocities[i] = q_dot_filtered[joints[i]];
+    }
+    model.invalidate();
+  }
+
+  /**
+   * @brief Add this arm's torques to the controller's torque vector
+   *
+   * Shared joints receive the sum of all arms' torques.  Call for one arm at a
+   * time.
+   */
+  void scatterAdd(const ctrl::VectorND &arm_tau, ctrl::VectorND &tau) const {
+    for (size_t i = 0; i < joints.size(); ++i) {
+      tau[joints[i]] += arm_tau[i];
+    }
+  }
+};
+
+}  // namespace effort_controller_base
+
+#endif
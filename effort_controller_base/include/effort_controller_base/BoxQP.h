@@ -0,0 +1,234 @@
+#ifndef BOX_QP_H_INCLUDED
+#define BOX_QP_H_INCLUDED
+
+#include <Eigen/Cholesky>
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+
+namespace effort_controller_base {
+
+/**
+ * @brief Dense active-set solver for small box-constrained QPs
+ *
+ * Solves
+ *
+ *   min 1/2 x^T H x + f^T x   s.t.   lower <= x <= upper
+ *
+ * for a symmetric positive definite H with at most MaxSize variables, using
+ * a primal active set method.  Each iteration fixes the variables of the
+ * active set at their bounds and solves the reduced system for the free ones.
+ * If the step towards that minimizer hits a bound, the variable is added to
+ * the active set.  Otherwise the bound with the most violated multiplier is
+ * released, until the KKT conditions hold.
+ *
+ * The active set of the previous solution is kept as a warm start, so that
+ * successive problems of a control loop typically converge in one or two
+ * iterations.  The number of iterations is capped.  All iterates are
+ * feasible, so that the result respects the bounds even if the cap is hit.
+ *
+ * All storage has a fixed maximal size, so solving never allocates.
+ */
+template <int MaxSize = 7>
+class BoxQP {
+ public:
+  using Vector = Eigen::Matrix<double, Eigen::Dynamic, 1, 0, MaxSize, 1>;
+  using Matrix =
+      Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0, MaxSize, MaxSize>;
+
+  static constexpr int maxSize() { return MaxSize; }
+
+  /**
+   * @brief Set the problem size and iteration cap, and forget the warm start
+   */
+  void init(int size, int max_iterations) {
+    m_active.setZero(size);
+    m_free.setZero(size);
+    m_gradient.setZero(size);
+    m_max_iterations = max_iterations;
+    m_iterations = 0;
+  }
+
+  /**
+   * @brief Forget the warm start
+   */
+  void reset() { m_active.setZero(); }
+
+  /**
+   * @brief Solve the QP
+   *
+   * @param H The symmetric positive definite Hessian
+   * @param f The linear term
+   * @param lower The lower bounds, may be -infinity
+   * @param upper The upper bounds, may be +infinity.  Must not be below lower.
+   * @param x The solution.  Its previous value is the starting point.
+   *
+   * @return True if the KKT conditions hold within the iteration cap
+   */
+  bool solve(const Matrix &H, const Vector &f, const Vector &lower,
+             const Vector &upper, Vector &x) {
+    const int n = f.size();
+    if (x.size() != n) {
+      x.setZero(n);
+    }
+    m_step.resize(n);
+
+    // Feasible start on the bounds of the warm active set
+    for (int i = 0; i < n; ++i) {
+      if (m_active[i] < 0) {
+        x[i] = lower[i];
+      } else if (m_active[i] > 0) {
+        x[i] = upper[i];
+      } else {
+        x[i] = std::clamp(x[i], lower[i], upper[i]);
+      }
+      if (!std::isfinite(x[i])) {
+        m_active[i] = 0;
+        x[i] = std::clamp(0.0, lower[i], upper[i]);
+      }
+    }
+
+    for (m_iterations = 1; m_iterations <= m_max_iterations; ++m_iterations) {
+      // Minimizer over the free variables, with H_FF x_F = -(f_F + H_FA x_A)
+      int free = 0;
+      for (int i = 0; i < n; ++i) {
+        if (m_active[i] == 0) {
+          m_free[free++] = i;
+        }
+      }
+      m_step.setZero();
+      if (free > 0) {
+        m_reduced.resize(free, free);
+        m_rhs.resize(free);
+        for (int a = 0; a < free; ++a) {
+          const int i = m_free[a];
+          m_rhs[a] = -f[i];
+          for (int j = 0; j < n; ++j) {
+            if (m_active[j] != 0) {
+              m_rhs[a] -= H(i, j) * x[j];
+            }
+          }
+          for (int b = 0; b < free; ++b) {
+            m_reduced(a, b) = H(i, m_free[b]);
+          }
+        }
+        m_llt.compute(m_reduced);
+        m_llt.solveInPlace(m_rhs);
+        for (int a = 0; a < free; ++a) {
+          m_step[m_free[a]] = m_rhs[a] - x[m_free[a]];
+        }
+      }
+
+      // Walk towards the minimizer until the first blocking bound
+      double alpha = 1.0;
+      int blocking = -1;
+      for (int a = 0; a < free; ++a) {
+        const int i = m_free[a];
+        if (m_step[i] < 0.0 && x[i] + m_step[i] < lower[i]) {
+          const double limit = (lower[i] - x[i]) / m_step[i];
+          if (limit < alpha) {
+            alpha = limit;
+            blocking = i;
+          }
+        } else if (m_step[i] > 0.0 && x[i] + m_step[i] > upper[i]) {
+          const double limit = (upper[i] - x[i]) / m_step[i];
+          if (limit < alpha) {
+            alpha = limit;
+            blocking = i;
+          }
+        }
+      }
+      x += alpha * m_step;
+      if (blocking >= 0) {
+        m_active[blocking] = m_step[blocking] < 0.0 ? -1 : 1;
+        x[blocking] =
+            m_active[blocking] < 0 ? lower[blocking] : upper[blocking];
+        continue;
+      }
+
+      // At the minimizer: release the bound with the most violated multiplier
+      m_gradient.noalias() = H * x;
+      m_gradient += f;
+      double worst = 0.0;
+      int release = -1;
+      for (int i = 0; i < n; ++i) {
+        const double violation = m_active[i] < 0   ? -m_gradient[i]
+                                 : m_active[i] > 0 ? m_gradient[i]
+                                                   : 0.0;
+        if (violation > worst) {
+          worst = violation;
+          release = i;
+        }
+      }
+      if (release < 0) {
+        return true;
+      }
+      m_active[release] = 0;
+    }
+    m_iterations = m_max_iterations;
+    return false;
+  }
+
+  /**
+   * @brief The number of iterations of the last solve
+   */
+  int iterations() const { return m_iterations; }
+
+ private:
+  // -1: at the lower bound, 0: free, 1: at the upper bound
+  Eigen::Matrix<int, Eigen::Dynamic, 1, 0, MaxSize, 1> m_active;
+  Eigen::Matrix<int, Eigen::Dynamic, 1, 0, MaxSize, 1> m_free;
+  Matrix m_reduced;
+  Vector m_rhs;
+  Vector m_gradient;
+  Vector m_step;
+  Eigen::LLT<Matrix> m_llt;
+  int m_max_iterations = 10;
+  int m_iterations = 0;
+};
+
+/**
+ * @brief Bounds of one joint torque for the torque saturation QP
+ *
+ * Intersects the effort limits, the torques that keep the joint within its
+ * position and velocity limits and the effort rate limit, in this order of
+ * priority.  A bound that contradicts the bounds before it is clamped to
+ * their nearest end, so that the effort limits always hold and the joint
+ * limits take precedence over the rate limit.  Absent bounds are infinite.
+ *
+ * @param effort The effort limit
+ * @param joint_lower The lower torque bound of the joint limits
+ * @param joint_upper The upper torque bound of the joint limits
+ * @param rate_lower The lower torque bound of the rate limit
+ * @param rate_upper The upper torque bound of the rate limit
+ * @param lower The resulting lower bound
+ * @param upper The resulting upper bound
+ *
+ * @return The number of bounds that were clamped
+ */
+inline int torqueBounds(double effort, double joint_lower, double joint_upper,
+                        double rate_lower, double rate_upper, double &lower,
+                        double &upper) {
+  lower = -effort;
+  upper = effort;
+  int conflicts = 0;
+  auto intersect = [&lower, &upper, &conflicts](double lo, double hi) {
+    if (lo > upper) {
+      lower = upper;
+      ++conflicts;
+    } else if (hi < lower) {
+      upper = lower;
+      ++conflicts;
+    } else {
+      lower = std::max(lower, lo);
+      upper = std::min(upper, hi);
+    }
+  };
+  intersect(joint_lower, joint_upper);
+  intersect(rate_lower, rate_upper);
+  return conflicts;
+}
+
+}  // namespace effort_controller_base
+
+#endif
@@ -0,0 +1,255 @@
+#ifndef CARTESIAN_TRAJECTORY_BUFFER_H_INCLUDED
+#define CARTESIAN_TRAJECTORY_BUFFER_H_INCLUDED
+
+#include <effort_controller_base/Utility.h>
+
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+namespace effort_controller_base {
+
+/**
+ * @brief A time-stamped Cartesian pose
+ *
+ * The time is given in seconds of the clock that drives the controller's
+ * update loop.
+ */
+struct CartesianWaypoint {
+  double time = 0.0;
+  ctrl::Vector3D position = ctrl::Vector3D::Zero();
+  Eigen::Quaterniond orientation = Eigen::Quaterniond::Identity();
+};
+
+/**
+ * @brief Preallocated ring of Cartesian waypoints with in-loop interpolation
+ *
+ * The buffer is a lock-free single-producer/single-consumer queue.  A
+ * non-realtime callback appends waypoints with \ref push and the control loop
+ * samples the trajectory with \ref sample.  Memory is only allocated in
+ * \ref init.
+ *
+ * Positions are interpolated with piecewise cubic Hermite splines whose
+ * tangents are the averaged finite differences of the neighbouring waypoints.
+ * Orientations are interpolated with SQUAD.  The first and the last waypoint
+ * of the queue are reached with zero velocity, so that the robot comes to
+ * rest when upstream stops publishing.
+ */
+class CartesianTrajectoryBuffer {
+ public:
+  CartesianTrajectoryBuffer() = default;
+
+  /**
+   * @brief Allocate storage for the given number of waypoints
+   *
+   * Not real-time safe.  Must not be called concurrently with \ref push or
+   * \ref sample.
+   *
+   * @param capacity The maximum number of buffered waypoints
+   */
+  void init(size_t capacity) {
+    m_waypoints.assign(std::max<size_t>(capacity, 2), CartesianWaypoint());
+    m_head.store(0);
+    m_tail.store(0);
+    m_last_pushed_time = -std::numeric_limits<double>::infinity();
+    m_last_pushed_orientation = Eigen::Quaterniond::Identity();
+  }
+
+  /**
+   * @brief Append a waypoint to the end of the queue (producer side)
+   *
+   * Waypoints that are not strictly newer than the last queued one are
+   * silently discarded.  This makes it safe for planners to re-send
+   * overlapping batches.
+   *
+   * @param waypoint The waypoint to append
+   *
+   * @return False if the buffer is full, true otherwise
+   */
+  bool push(CartesianWaypoint waypoint) {
+    if (waypoint.time <= m_last_pushed_time) {
+      return true;
+    }
+    const size_t head = m_head.load(std::memory_order_relaxed);
+    const size_t tail = m_tail.load(std::memory_order_acquire);
+    if (head - tail >= m_waypoints.size()) {
+      return false;
+    }
+
+    // Keep consecutive quaternions in the same hemisphere to interpolate
+    // along the shortest arc.
+    waypoint.orientation.normalize();
+    if (m_last_pushed_orientation.dot(waypoint.orientation) < 0.0) {
+      waypoint.orientation.coeffs() *= -1.0;
+    }
+    m_last_pushed_orientation = waypoint.orientation;
+    m_last_pushed_time = waypoint.time;
+
+    at(head) = waypoint;
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Sample the trajectory at the given time (consumer side)
+   *
+   * Waypoints that are no longer needed for interpolation are released.
+   * Once the last waypoint is reached, it is returned a final time and the
+   * queue becomes empty.
+   *
+   * @param time The current time of the control loop in seconds
+   * @param position The interpolated position
+   * @param orientation The interpolated orientation
+   *
+   * @return False if the buffer is empty or the trajectory has not started
+   * yet, true otherwise
+   */
+  bool sample(double time, ctrl::Vector3D &position,
+              Eigen::Quaterniond &orientation) {
+    const size_t head = m_head.load(std::memory_order_acquire);
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    if (head == tail) {
+      return false;
+    }
+
+    // Release everything before the waypoint preceding the active segment
+    while (tail + 2 < head && at(tail + 2).time <= time) {
+      ++tail;
+    }
+    m_tail.store(tail, std::memory_order_release);
+
+    if (time < at(tail).time) {
+      return false;
+    }
+
+    // Find the start of the active segment
+    size_t k = tail;
+    if (tail + 1 < head && at(tail + 1).time <= time) {
+      k = tail + 1;
+    }
+
+    // Return the last waypoint once and release the queue.  Callers keep
+    // their target, so that other setpoint sources can take over afterwards.
+    if (k + 1 >= head) {
+      position = at(k).position;
+      orientation = at(k).orientation;
+      m_tail.store(head, std::memory_order_release);
+      return true;
+    }
+
+    const CartesianWaypoint &w0 = at(k);
+    const CartesianWaypoint &w1 = at(k + 1);
+    const CartesianWaypoint *prev = (k > tail) ? &at(k - 1) : nullptr;
+    const CartesianWaypoint *next = (k + 2 < head) ? &at(k + 2) : nullptr;
+
+    const double dt = w1.time - w0.time;
+    const double s = std::clamp((time - w0.time) / dt, 0.0, 1.0);
+
+    // Cubic Hermite position interpolation
+    const ctrl::Vector3D m0 = tangent(prev, w0, &w1);
+    const ctrl::Vector3D m1 = tangent(&w0, w1, next);
+    const double s2 = s * s;
+    const double s3 = s2 * s;
+    position = (2 * s3 - 3 * s2 + 1) * w0.position +
+               (s3 - 2 * s2 + s) * dt * m0 +
+               (-2 * s3 + 3 * s2) * w1.position + (s3 - s2) * dt * m1;
+
+    // SQUAD orientation interpolation
+    const Eigen::Quaterniond a0 = squadControlPoint(prev, w0, &w1);
+    const Eigen::Quaterniond a1 = squadControlPoint(&w0, w1, next);
+    orientation = w0.orientation.slerp(s, w1.orientation)
+                      .slerp(2 * s * (1 - s), a0.slerp(s, a1));
+    orientation.normalize();
+    return true;
+  }
+
+  /**
+   * @brief Number of currently buffered waypoints
+   */
+  size_t size() const {
+    return m_head.load(std::memory_order_acquire) -
+           m_tail.load(std::memory_order_acquire);
+  }
+
+  size_t capacity() const { return m_waypoints.size(); }
+
+  /**
+   * @brief Number of waypoints that can be pushed now (producer side)
+   *
+   * The consumer only ever frees space, so that this many pushes succeed.
+   */
+  size_t space() const { return capacity() - size(); }
+
+  /**
+   * @brief Time of the last queued waypoint (producer side)
+   *
+   * Waypoints up to this time are discarded by \ref push.
+   */
+  double lastPushedTime() const { return m_last_pushed_time; }
+
+ private:
+  CartesianWaypoint &at(size_t i) {
+    return m_waypoints[i % m_waypoints.size()];
+  }
+
+  /**
+   * @brief Velocity at waypoint \a curr from averaged finite differences
+   *
+   * Zero if a neighbour is missing.
+   */
+  static ctrl::Vector3D tangent(const CartesianWaypoint *prev,
+                                const CartesianWaypoint &curr,
+                                const CartesianWaypoint *next) {
+    if (!prev || !next) {
+      return ctrl::Vector3D::Zero();
+    }
+    return 0.5 * ((curr.position - prev->position) / (curr.time - prev->time) +
+                  (next->position - curr.position) / (next->time - curr.time));
+  }
+
+  static Eigen::Quaterniond squadControlPoint(const CartesianWaypoint *prev,
+                                              const CartesianWaypoint &curr,
+                                              const CartesianWaypoint *next) {
+    if (!prev || !next) {
+      return curr.orientation;
+    }
+    const Eigen::Quaterniond inv = curr.orientation.conjugate();
+    const ctrl::Vector3D log_sum = quaternionLog(inv * next->orientation) +
+                                   quaternionLog(inv * prev->orientation);
+    return curr.orientation * quaternionExp(-0.25 * log_sum);
+  }
+
+  static ctrl::Vector3D quaternionLog(const Eigen::Quaterniond &q) {
+    const double norm = q.vec().norm();
+    if (norm < 1e-12) {
+      return ctrl::Vector3D::Zero();
+    }
+    return std::atan2(norm, q.w()) / norm * q.vec();
+  }
+
+  static Eigen::Quaterniond quaternionExp(const ctrl::Vector3D &v) {
+    const double angle = v.norm();
+    if (angle < 1e-12) {
+      return Eigen::Quaterniond::Identity();
+    }
+    const ctrl::Vector3D axis = std::sin(angle) / angle * v;
+    return Eigen::Quaterniond(std::cos(angle), axis.x(), axis.y(), axis.z());
+  }
+
+  std::vector<CartesianWaypoint> m_waypoints;
+  std::atomic<size_t> m_head = {0};
+  std::atomic<size_t> m_tail = {0};
+
+  // Producer-side bookkeeping
+  double m_last_pushed_time = -std::numeric_limits<double>::infinity();
+  Eigen::Quaterniond m_last_pushed_orientation =
+      Eigen::Quaterniond::Identity();
+};
+
+}  // namespace effort_controller_base
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef DYNAMICS_WORKER_H_INCLUDED
+#define DYNAMICS_WORKER_H_INCLUDED
+
+#include <effort_controller_base/TripleBuffer.h>
+#include <effort_controller_base/Utility.h>
+
+#include <atomic>
+#include <kdl/chain.hpp>
+#include <kdl/chaindynparam.hpp>
+#include <kdl/jntarray.hpp>
+#include <kdl/jntspaceinertiamatrix.hpp>
+#include <memory>
+#include <thread>
+
+namespace effort_controller_base {
+
+/**
+ * @brief Computes the joint space dynamics at a lower rate on a worker thread
+ *
+ * The control loop hands over its joint state with \ref setJointState.  The
+ * worker periodically picks up the latest state and computes
+ *
+ * - the gravity torques g(q0) and their gradient dg/dq at q0,
+ * - the Coriolis tensor, so that C(q0, q_dot) q_dot is exact for any q_dot,
+ * - the mass matrix M(q0) and its gradient dM/dq at q0.
+ *
+ * The results are handed back lock-free.  The control loop then evaluates
+ * gravity and the mass matrix to first order around q0 and Coriolis torques
+ * with the current velocities.  Each of these is a small matrix-vector
+ * product, O(n^3) for the Coriolis torques and the mass matrix, without any
+ * traversal of the chain.  Results older than the configured staleness bound are
+ * rejected, so that callers can fall back to a synchronous computation.
+ */
+class DynamicsWorker {
+ public:
+  DynamicsWorker() = default;
+  DynamicsWorker(const DynamicsWorker &) = delete;
+  DynamicsWorker &operator=(const DynamicsWorker &) = delete;
+  ~DynamicsWorker() { stop(); }
+
+  /**
+   * @brief Set up solver and buffers.  Not real-time safe.
+   *
+   * @param chain The robot chain
+   * @param gravity The gravity vector in the robot base frame
+   * @param rate The update rate of the worker in Hz
+   * @param max_staleness The maximal age in seconds of usable results
+   */
+  void init(const KDL::Chain &chain, const KDL::Vector &gravity, double rate,
+            double max_staleness);
+
+  /**
+   * @brief Start the worker thread.  Not real-time safe.
+   */
+  void start();
+
+  /**
+   * @brief Stop and join the worker thread.  Not real-time safe.
+   */
+  void stop();
+
+  /**
+   * @brief Hand the current joint state over to the worker (control loop)
+   */
+  void setJointState(const KDL::JntArray &q, const KDL::JntArray &q_dot);
+
+  /**
+   * @brief Fetch the latest results and check their age (control loop)
+   *
+   * @return True if results exist that are not older than the staleness
+   * bound, with respect to the last \ref setJointState
+   */
+  bool fetch();
+
+  /**
+   * @brief Gravity torques, extrapolated to first order in q (control loop)
+   */
+  void gravity(const KDL::JntArray &q, KDL::JntArray &gravity);
+
+  /**
+   * @brief Coriolis and centrifugal torques for the given velocities
+   * (control loop)
+   */
+  void coriolis(const KDL::JntArray &q_dot, KDL::JntArray &coriolis);
+
+  /**
+   * @brief Mass matrix, extrapolated to first order in q (control loop)
+   */
+  void massMatrix(const KDL::JntArray &q,
+                  KDL::JntSpaceInertiaMatrix &mass) const;
+
+  /**
+   * @brief Age in seconds of the latest results (control loop)
+   */
+  double age() const { return m_age; }
+
+ private:
+  struct JointState {
+    ctrl::VectorND q;
+    ctrl::VectorND q_dot;
+    double stamp = -1.0;
+  };
+
+  struct Dynamics {
+    ctrl::VectorND q;
+    ctrl::VectorND gravity;
+    ctrl::MatrixND gravity_jacobian;
+    // Row k holds the symmetric matrix Gamma_k, column-major, such that
+    // (C(q, q_dot) q_dot)_k = q_dot^T Gamma_k q_dot.
+    ctrl::MatrixND coriolis_tensor;
+    ctrl::MatrixND mass;
+    // Column j holds dM/dq_j, column-major
+    ctrl::MatrixND mass_jacobian;
+    double stamp = -1.0;
+  };
+
+  static double now();
+  void run();
+  void compute(const JointState &state, Dynamics &dynamics);
+
+  // Worker side
+  std::unique_ptr<KDL::ChainDynParam> m_dyn_solver;
+  KDL::JntArray m_q;
+  KDL::JntArray m_q_dot;
+  KDL::JntArray m_tau;
+  KDL::JntArray m_tau_plus;
+  KDL::JntArray m_tau_minus;
+  KDL::JntSpaceInertiaMatrix m_mass;
+  KDL::JntSpaceInertiaMatrix m_mass_plus;
+  KDL::JntSpaceInertiaMatrix m_mass_minus;
+  double m_period = 0.0;
+
+  // Shared
+  TripleBuffer<JointState> m_joint_state;
+  TripleBuffer<Dynamics> m_dynamics;
+  std::atomic<bool> m_running = {false};
+  std::thread m_thread;
+
+  // Control loop side
+  double m_max_staleness = 0.0;
+  double m_last_stamp = -1.0;
+  double m_age = 0.0;
+  ctrl::VectorND m_velocity_products;
+};
+
+}  // namespace effort_controller_base
+
+#endif
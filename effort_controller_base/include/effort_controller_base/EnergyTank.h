@@ -0,0 +1,85 @@
+#ifndef ENERGY_TANK_H_INCLUDED
+#define ENERGY_TANK_H_INCLUDED
+
+namespace effort_controller_base {
+
+/**
+ * @brief Energy budget that keeps a controller passive
+ *
+ * The tank is filled with the energy the controller dissipates, e.g. through
+ * its damping, and drained by the energy its non-passive components inject,
+ * e.g. stiffness increases and wrench feedforward.  Once the tank would fall
+ * below its minimum, the non-passive components are scaled down so that
+ * they inject no more than what is left.  Energy they extract refills the
+ * tank.  The tank is capped at its maximum, so that a long dissipative phase
+ * cannot save up energy for a large injection later.
+ *
+ * With this bookkeeping, the controller never releases more energy than it
+ * has dissipated, plus the initial budget.  Each update is a few scalar
+ * operations, the callers compute the energies in O(n).
+ */
+class EnergyTank {
+ public:
+  struct Settings {
+    double initial;  // Energy at reset in J
+    double minimum;  // Energy that is never released in J
+    double maximum;  // Cap in J
+  };
+
+  void init(const Settings &settings) {
+    m_settings = settings;
+    reset();
+  }
+
+  /**
+   * @brief Refill the tank to its initial energy
+   */
+  void reset() {
+    m_energy = m_settings.initial;
+    m_scale = 1.0;
+  }
+
+  /**
+   * @brief Book the energies of one cycle
+   *
+   * @param dissipated Energy dissipated over the last cycle in J, >= 0
+   * @param injected Energy the non-passive components would inject in this
+   * cycle at full scale in J, negative if they extract energy
+   *
+   * @return The scale in [0, 1] to apply to the non-passive components
+   */
+  double update(double dissipated, double injected) {
+    m_scale = 1.0;
+    if (injected > 0.0) {
+      const double available = m_energy - m_settings.minimum;
+      if (available < injected) {
+        m_scale = available > 0.0 ? available / injected : 0.0;
+      }
+    }
+    m_energy -= m_scale * injected;
+    m_energy += dissipated;
+    if (m_energy > m_settings.maximum) {
+      m_energy = m_settings.maximum;
+    }
+    return m_scale;
+  }
+
+  /**
+   * @brief Energy left in the tank in J
+   */
+  double energy() const { return m_energy; }
+
+  /**
+   * @brief Scale of the last update
+   */
+  double scale() const { return m_scale; }
+
+ private:
+  Settings m_settings = {0.0, 0.0, 0.0};
+  double m_energy = {0.0};
+  double m_scale = {1.0};
+};
+
+}  // namespace effort_controller_base
+
+#endif
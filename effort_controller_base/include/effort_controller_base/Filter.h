@@ -1,121 +1,313 @@
-////////////////////////////////////////////////////////////////////////////////
-// Copyright 2019 FZI Research Center for Information Technology
-//
-// Redistribution and use in source and binary forms, with or without
-// modification, are permitted provided that the following conditions are met:
-//
-// 1. Redistributions of source code must retain the above copyright notice,
-// this list of conditions and the following disclaimer.
-//
-// 2. Redistributions in binary form must reproduce the above copyright notice,
-// this list of conditions and the following disclaimer in the documentation
-// and/or other materials provided with the distribution.
-//
-// 3. Neither the name of the copyright holder nor the names of its
-// contributors may be used to endorse or promote products derived from this
-// software without specific prior written permission.
-//
-// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
-// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
-// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
-// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
-// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
-// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
-// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
-// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
-// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
-// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
-// POSSIBILITY OF SUCH DAMAGE.
-////////////////////////////////////////////////////////////////////////////////
-
-//-----------------------------------------------------------------------------
-/*!\file    ForwardDynamicsSolver.h
- *
- * \author  Stefan Scherzinger <scherzin@fzi.de>
- * \date    2016/02/14
- *
- */
-//-----------------------------------------------------------------------------
-
-#ifndef FORWARD_DYNAMICS_SOLVER_H_INCLUDED
-#define FORWARD_DYNAMICS_SOLVER_H_INCLUDED
-
-#include "rclcpp/node.hpp"
-#include <effort_controller_base/IKSolver.h>
-#include <effort_controller_base/Utility.h>
-#include <kdl/chain.hpp>
-#include <kdl/chaindynparam.hpp>
-#include <kdl/chainfksolverpos_recursive.hpp>
-#include <kdl/chainfksolvervel_recursive.hpp>
-#include <kdl/chainjnttojacsolver.hpp>
-#include <kdl/frames.hpp>
-#include <kdl/jacobian.hpp>
+#ifndef FILTER_H_INCLUDED
+#define FILTER_H_INCLUDED
+
+#include <Eigen/Dense>
+#include <cmath>
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace effort_controller_base {
 
-template <class T> class LowPassFilter {
-public:
-  LowPassFilter();
-  ~LowPassFilter();
+/**
+ * @brief Common interface of the multi-channel filters
+ *
+ * Each filter processes all channels, e.g. all joints, in a single call.  The
+ * state is stored as one array per state variable across all channels
+ * (structure of arrays), so that each step is a handful of vectorized array
+ * operations.  All storage is allocated in the constructor.
+ */
+class ChannelFilter {
+ public:
+  using Array = Eigen::ArrayXd;
+  using Input = Eigen::Ref<const Array>;
+
+  virtual ~ChannelFilter() = default;
+
+  /**
+   * @brief Set the filter to steady state at the given value
+   */
+  virtual void reset(const Input &value) = 0;
 
   /**
-   * @brief Initializes the filter with the given parameters.
+   * @brief Filter one sample of all channels
+   *
+   * @param value The new sample
    *
-   * @param nh Shared pointer to the lifecycle node.
-   * @param alpha Smoothing factor for the filter, must be in the range [0, 1].
-   * @param step Time step for the filter.
-   * @return true if initialization is successful, false otherwise.
+   * @return The filtered value, valid until the next call
+   */
+  virtual const Array &update(const Input &value) = 0;
+};
+
+/**
+ * @brief First order low-pass filter (exponential moving average)
+ *
+ *   y += alpha (x - y),   alpha = 1 - exp(-2 pi f_c T)
+ */
+class EmaFilter : public ChannelFilter {
+ public:
+  /**
+   * @param channels The number of channels
+   * @param cutoff The cutoff frequency in Hz, must be positive
+   * @param period The sampling period in s, must be positive
+   */
+  EmaFilter(size_t channels, double cutoff, double period)
+      : m_alpha(1.0 - std::exp(-2 * M_PI * cutoff * period)),
+        m_output(Array::Zero(channels)) {}
+
+  void reset(const Input &value) override { m_output = value; }
+
+  const Array &update(const Input &value) override {
+    m_output += m_alpha * (value - m_output);
+    return m_output;
+  }
+
+ private:
+  double m_alpha;
+  Array m_output;
+};
+
+/**
+ * @brief Butterworth low-pass filter of even order
+ *
+ * Implemented as a cascade of second order sections (biquads) in transposed
+ * direct form II, designed with the bilinear transform and a prewarped
+ * cutoff frequency.
+ */
+class ButterworthFilter : public ChannelFilter {
+ public:
+  /**
+   * @param channels The number of channels
+   * @param cutoff The cutoff frequency in Hz, must be below the Nyquist
+   * frequency
+   * @param period The sampling period in s, must be positive
+   * @param order The filter order, must be even and positive
    */
-  bool init(std::shared_ptr<rclcpp_lifecycle::LifecycleNode> nh, double alpha,
-            double step) {
-    if (!setAlpha(alpha)) {
-      RCLCPP_ERROR(nh->get_logger(), "Alpha value must be in the range [0, 1]");
-      return false;
+  ButterworthFilter(size_t channels, double cutoff, double period,
+                    int order = 2) {
+    const double k = std::tan(M_PI * cutoff * period);
+    for (int i = 1; i <= order / 2; ++i) {
+      const double q = 1.0 / (2 * std::sin((2 * i - 1) * M_PI / (2 * order)));
+      const double norm = 1.0 / (1.0 + k / q + k * k);
+      Section section;
+      section.b0 = k * k * norm;
+      section.b1 = 2 * section.b0;
+      section.b2 = section.b0;
+      section.a1 = 2 * (k * k - 1.0) * norm;
+      section.a2 = (1.0 - k / q + k * k) * norm;
+      section.z1 = Array::Zero(channels);
+      section.z2 = Array::Zero(channels);
+      m_sections.push_back(std::move(section));
     }
-    m_time_step = step;
-    m_current_value = 0.0;
+    m_input = Array::Zero(channels);
+    m_output = Array::Zero(channels);
   }
 
+  void reset(const Input &value) override {
+    // Each section has unit DC gain
+    for (auto &s : m_sections) {
+      s.z1 = (1.0 - s.b0) * value;
+      s.z2 = (s.b2 - s.a2) * value;
+    }
+    m_output = value;
+  }
+
+  const Array &update(const Input &value) override {
+    m_output = value;
+    for (auto &s : m_sections) {
+      // The output of each section is the input of the next
+      m_input = m_output;
+      m_output = s.b0 * m_input + s.z1;
+      s.z1 = s.b1 * m_input - s.a1 * m_output + s.z2;
+      s.z2 = s.b2 * m_input - s.a2 * m_output;
+    }
+    return m_output;
+  }
+
+ private:
+  struct Section {
+    double b0, b1, b2, a1, a2;
+    Array z1, z2;
+  };
+  std::vector<Section> m_sections;
+  Array m_input;
+  Array m_output;
+};
+
+/**
+ * @brief Causal Savitzky-Golay smoothing filter
+ *
+ * Fits a polynomial to the last samples of each channel in the least squares
+ * sense and evaluates it at the newest sample.  The fit reduces to a fixed
+ * weighted sum of the window, whose weights are computed once.
+ */
+class SavitzkyGolayFilter : public ChannelFilter {
+ public:
   /**
-   * @brief Sets the alpha value for the filter.
-   *
-   * This function sets the alpha value, which must be between 0.0 and 1.0
-   * inclusive. The alpha value is used to control the filter's behavior.
-   *
-   * @param alpha The alpha value to set. Must be between 0.0 and 1.0.
-   * @return true if the alpha value is valid and has been set, false otherwise.
+   * @param channels The number of channels
+   * @param window The number of samples, must exceed the order
+   * @param order The polynomial order
    */
-  bool setAlpha(double alpha) {
-    if (alpha < 0.0 || alpha > 1.0) {
-      return false;
+  SavitzkyGolayFilter(size_t channels, int window, int order)
+      : m_history(Eigen::MatrixXd::Zero(channels, window)),
+        m_output(Array::Zero(channels)) {
+    // Vandermonde matrix of the sample times -k / window, newest first
+    Eigen::MatrixXd vandermonde(window, order + 1);
+    for (int k = 0; k < window; ++k) {
+      for (int j = 0; j <= order; ++j) {
+        vandermonde(k, j) = std::pow(-static_cast<double>(k) / window, j);
+      }
     }
+    // The constant coefficient of the fit is the value at the newest sample
+    const Eigen::MatrixXd pinv =
+        (vandermonde.transpose() * vandermonde)
+            .ldlt()
+            .solve(vandermonde.transpose());
+    m_weights = pinv.row(0).transpose();
+  }
 
-    m_alpha = alpha;
-    return true;
+  void reset(const Input &value) override {
+    m_history.colwise() = value.matrix();
+    m_output = value;
   }
 
+  const Array &update(const Input &value) override {
+    const int window = m_history.cols();
+    m_newest = (m_newest + 1) % window;
+    m_history.col(m_newest) = value.matrix();
+    m_output.setZero();
+    for (int k = 0; k < window; ++k) {
+      const int sample = (m_newest - k + window) % window;
+      m_output += m_weights[k] * m_history.col(sample).array();
+    }
+    return m_output;
+  }
+
+ private:
+  Eigen::MatrixXd m_history;  // One column per sample
+  Eigen::VectorXd m_weights;  // Newest sample first
+  Array m_output;
+  int m_newest = 0;
+};
+
+/**
+ * @brief Moving median filter
+ *
+ * Sorts the window of all channels at once with an odd-even transposition
+ * network of element-wise min/max operations on whole columns.
+ */
+class MedianFilter : public ChannelFilter {
+ public:
   /**
-   * @brief Updates the filter with a new value.
-   *
-   * This function updates the filter with a new value and returns the filtered
-   * value.
-   *
-   * @param new_value The new value to update the filter with.
-   * @return The filtered value.
+   * @param channels The number of channels
+   * @param window The number of samples, must be odd
    */
-  T update(T new_value) {
-    m_current_value = m_alpha * new_value + (1 - m_alpha) * m_current_value;
-    return m_current_value;
+  MedianFilter(size_t channels, int window)
+      : m_history(Eigen::MatrixXd::Zero(channels, window)),
+        m_sorted(Eigen::MatrixXd::Zero(channels, window)),
+        m_swap(Array::Zero(channels)),
+        m_output(Array::Zero(channels)) {}
+
+  void reset(const Input &value) override {
+    m_history.colwise() = value.matrix();
+    m_output = value;
   }
 
-private:
-  double m_alpha;
-  T m_current_value;
-  double m_time_step;
+  const Array &update(const Input &value) override {
+    const int window = m_history.cols();
+    m_newest = (m_newest + 1) % window;
+    m_history.col(m_newest) = value.matrix();
+    m_sorted = m_history;
+    for (int pass = 0; pass < window; ++pass) {
+      for (int k = pass % 2; k + 1 < window; k += 2) {
+        m_swap = m_sorted.col(k).array();
+        m_sorted.col(k) = m_sorted.col(k).cwiseMin(m_sorted.col(k + 1));
+        m_sorted.col(k + 1) = m_sorted.col(k + 1).cwiseMax(m_swap.matrix());
+      }
+    }
+    m_output = m_sorted.col(window / 2).array();
+    return m_output;
+  }
+
+ private:
+  Eigen::MatrixXd m_history;  // One column per sample
+  Eigen::MatrixXd m_sorted;
+  Array m_swap;
+  Array m_output;
+  int m_newest = 0;
 };
 
-} // namespace effort_controller_base
+/**
+ * @brief Settings of a filter, typically read from parameters
+ */
+struct FilterSettings {
+  /// none, ema, butterworth, savitzky_golay or median
+  std::string type = "none";
+  /// Cutoff frequency in Hz of ema and butterworth
+  double cutoff = 50.0;
+  /// Order of butterworth and polynomial order of savitzky_golay
+  int order = 2;
+  /// Number of samples of savitzky_golay and median
+  int window = 9;
+};
+
+/**
+ * @brief Create a filter from its settings
+ *
+ * @param settings The filter settings
+ * @param channels The number of channels
+ * @param period The sampling period in s
+ * @param error Describes the problem if the settings are invalid
+ *
+ * @return The filter, or nullptr for type none or invalid settings
+ */
+inline std::unique_ptr<ChannelFilter> makeFilter(
+    const FilterSettings &settings, size_t channels, double period,
+    std::string &error) {
+  error.clear();
+  const double nyquist = period > 0.0 ? 0.5 / period : 0.0;
+  if (settings.type == "none") {
+    return nullptr;
+  }
+  if (settings.type == "ema" || settings.type == "butterworth") {
+    if (period <= 0.0) {
+      error = "the update rate is unknown";
+      return nullptr;
+    }
+    if (settings.cutoff <= 0.0 || settings.cutoff >= nyquist) {
+      error = "cutoff must be positive and below the Nyquist frequency";
+      return nullptr;
+    }
+    if (settings.type == "ema") {
+      return std::make_unique<EmaFilter>(channels, settings.cutoff, period);
+    }
+    if (settings.order < 2 || settings.order % 2 != 0) {
+      error = "order must be even and positive";
+      return nullptr;
+    }
+    return std::make_unique<ButterworthFilter>(channels, settings.cutoff,
+                                               period, settings.order);
+  }
+  if (settings.type == "savitzky_golay") {
+    if (settings.order < 0 || settings.window <= settings.order) {
+      error = "order must not be negative and below window";
+      return nullptr;
+    }
+    return std::make_unique<SavitzkyGolayFilter>(channels, settings.window,
+                                                 settings.order);
+  }
+  if (settings.type == "median") {
+    if (settings.window < 1 || settings.window % 2 == 0) {
+      error = "window must be odd and positive";
+      return nullptr;
+    }
+    return std::make_unique<MedianFilter>(channels, settings.window);
+  }
+  error = "unsupported type " + settings.type +
+          ". Choose none, ema, butterworth, savitzky_golay or median";
+  return nullptr;
+}
+
+}  // namespace effort_controller_base
 
 #endif
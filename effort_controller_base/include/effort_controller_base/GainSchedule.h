@@ -0,0 +1,122 @@
+#ifndef GAIN_SCHEDULE_H_INCLUDED
+#define GAIN_SCHEDULE_H_INCLUDED
+
+#include <effort_controller_base/Utility.h>
+
+#include <string>
+#include <vector>
+
+namespace effort_controller_base {
+
+/**
+ * @brief Gains interpolated from lookup tables over the robot state
+ *
+ * Each table is a rectilinear grid over up to \ref kMaxAxes scheduling keys,
+ * e.g. the manipulability or the end effector position, with a vector of
+ * gains at each grid point.  A lookup interpolates multilinearly between the
+ * 2^d corners of the grid cell that contains the keys.  Keys outside the grid
+ * are clamped to its border.
+ *
+ * One table is active at a time.  Switching to another one, e.g. at a new
+ * task phase, blends linearly from the gains at the switch to the new table
+ * over a blend time, so that the gains never jump.
+ *
+ * All tables are compiled into one flat array in \ref init.  A lookup finds
+ * the cell with a binary search per axis and touches at most 2^d gain
+ * vectors.  It does not allocate.
+ */
+class GainSchedule {
+ public:
+  static constexpr size_t kMaxAxes = 4;
+
+  struct Table {
+    std::string name;
+    std::vector<size_t> keys;  // Index of each axis' key in the key values
+    std::vector<std::vector<double>> breakpoints;  // Per axis, increasing
+    // The gains at each grid point, row-major with the last axis fastest
+    std::vector<double> gains;
+  };
+
+  /**
+   * @brief Compile the tables.  The first table is active.  Not real-time
+   * safe.
+   *
+   * @param tables The tables, at least one
+   * @param gains The number of gains per grid point
+   * @param error The reason for failure
+   *
+   * @return False if a table is malformed
+   */
+  bool init(const std::vector<Table> &tables, size_t gains,
+            std::string &error);
+
+  /**
+   * @brief Id of the table with the given name, -1 if there is none
+   */
+  int tableId(const std::string &name) const;
+
+  /**
+   * @brief Switch to another table
+   *
+   * @param table The table id, see \ref tableId
+   * @param blend_time The time to blend from the current gains in s, 0 to
+   * switch at once
+   */
+  void select(size_t table, double blend_time);
+
+  /**
+   * @brief Look up the gains of the current cycle
+   *
+   * @param keys The values of all scheduling keys
+   * @param period The period of this cycle in s
+   *
+   * @return The gains
+   */
+  const ctrl::VectorND &update(const ctrl::VectorND &keys, double period);
+
+  /**
+   * @brief The gains of the last update
+   */
+  const ctrl::VectorND &gains() const { return m_gains; }
+
+  /**
+   * @brief Id of the active table
+   */
+  size_t active() const { return m_active; }
+
+  /**
+   * @brief Progress of the current blend in [0, 1], 1 when done
+   */
+  double blend() const { return m_blend; }
+
+ private:
+  struct CompiledTable {
+    std::string name;
+    size_t axes;
+    size_t keys[kMaxAxes];
+    size_t sizes[kMaxAxes];    // Breakpoints per axis
+    size_t offsets[kMaxAxes];  // Of the breakpoints in m_data
+    size_t strides[kMaxAxes];  // Of the grid points
+    size_t gains_offset;       // Of the gains in m_data
+  };
+
+  /**
+   * @brief Interpolate the gains of a table
+   */
+  void lookup(const CompiledTable &table, const ctrl::VectorND &keys,
+              ctrl::VectorND &gains) const;
+
+  std::vector<CompiledTable> m_tables;
+  std::vector<double> m_data;  // Breakpoints and gains of all tables
+  size_t m_active = 0;
+  double m_blend = 1.0;
+  double m_blend_rate = 0.0;
+  bool m_initialized = false;
+  ctrl::VectorND m_gains;
+  ctrl::VectorND m_blend_start;  // Gains at the last switch
+  ctrl::VectorND m_lookup;
+};
+
+}  // namespace effort_controller_base
+
+#endif
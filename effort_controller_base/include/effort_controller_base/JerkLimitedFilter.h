@@ -0,0 +1,263 @@
+#ifndef JERK_LIMITED_FILTER_H_INCLUDED
+#define JERK_LIMITED_FILTER_H_INCLUDED
+
+#include <effort_controller_base/Utility.h>
+
+#include <Eigen/Dense>
+#include <cmath>
+#include <kdl/frames.hpp>
+
+namespace effort_controller_base {
+
+/**
+ * @brief Jerk-limited online tracking of a set of independent axes
+ *
+ * Each axis is a triple integrator whose jerk is bounded.  In every step the
+ * axis tracks the jerk-limited stopping curve towards the current error,
+ * evaluated at the state it reaches once its acceleration is ramped down.  It
+ * thus accelerates as fast as the limits allow and starts decelerating just
+ * in time.  This yields a near time-optimal, overshoot-free response to
+ * setpoint steps with a bounded, closed-form computation per axis.
+ *
+ * The filter only stores velocities and accelerations.  Positions are kept by
+ * the caller, who passes the remaining error and applies the returned
+ * displacement.  This allows using the same filter on rotation vectors.
+ */
+template <int Dim>
+class JerkLimitedAxes {
+ public:
+  using Array = Eigen::Array<double, Dim, 1>;
+
+  JerkLimitedAxes() { reset(); }
+
+  /**
+   * @brief Set the motion limits, shared by all axes
+   *
+   * @param max_velocity Maximal velocity, must be positive
+   * @param max_acceleration Maximal acceleration, must be positive
+   * @param max_jerk Maximal jerk, must be positive
+   */
+  void setLimits(double max_velocity, double max_acceleration,
+                 double max_jerk) {
+    m_max_velocity = max_velocity;
+    m_max_acceleration = max_acceleration;
+    m_max_jerk = max_jerk;
+
+    // Velocity from which the axis can stop within a distance d:
+    // v(d) = sqrt(c^2 + 2 a d) - c with c = a^2 / (2 j)
+    m_velocity_offset = max_acceleration * max_acceleration / (2 * max_jerk);
+
+    // Small safety horizon that compensates the tracking lag of the
+    // acceleration loop while braking.
+    m_horizon_scale = 0.1 * max_acceleration / max_jerk;
+  }
+
+  /**
+   * @brief Bring all axes to rest
+   */
+  void reset() {
+    m_velocity.setZero();
+    m_acceleration.setZero();
+  }
+
+  /**
+   * @brief Continue from the given velocities and accelerations
+   */
+  void setState(const Array &velocity, const Array &acceleration) {
+    m_velocity = velocity;
+    m_acceleration = acceleration;
+  }
+
+  /**
+   * @brief Advance all axes by one control cycle
+   *
+   * @param error Remaining distance to the target for each axis
+   * @param dt The period of the control cycle
+   *
+   * @return The displacement of each axis during this cycle
+   */
+  Array step(const Array &error, double dt) {
+    // Predict the state after bringing the acceleration to zero with maximal
+    // jerk.  Braking must start from there, otherwise the axis overshoots.
+    const Array t_zero = m_acceleration.abs() / m_max_jerk;
+    const Array v_pred =
+        m_velocity + m_acceleration * m_acceleration.abs() / (2 * m_max_jerk);
+    const Array e_pred = error - m_velocity * t_zero -
+                         m_acceleration * t_zero.square() / 3 -
+                         v_pred * (m_horizon_scale + dt);
+
+    // Velocity that still allows stopping at the target
+    const Array v_ref =
+        e_pred.sign() * ((m_velocity_offset * m_velocity_offset +
+                          2 * m_max_acceleration * e_pred.abs())
+                             .sqrt() -
+                         m_velocity_offset)
+                            .min(m_max_velocity);
+
+    // Acceleration that still allows reaching v_ref without overshoot,
+    // discretized so that it settles without chattering.
+    const double jerk_step = 0.5 * m_max_jerk * dt;
+    const Array velocity_error = v_ref - v_pred;
+    const Array a_ref =
+        velocity_error.sign() *
+        ((jerk_step * jerk_step + 2 * m_max_jerk * velocity_error.abs())
+             .sqrt() -
+         jerk_step)
+            .min(m_max_acceleration);
+
+    // Bounded jerk towards a_ref
+    const Array jerk =
+        ((a_ref - m_acceleration) / dt).max(-m_max_jerk).min(m_max_jerk);
+
+    const Array displacement = m_velocity * dt +
+                               m_acceleration * (dt * dt / 2) +
+                               jerk * (dt * dt * dt / 6);
+    m_velocity += m_acceleration * dt + jerk * (dt * dt / 2);
+    m_acceleration += jerk * dt;
+    return displacement;
+  }
+
+  const Array &velocity() const { return m_velocity; }
+  const Array &acceleration() const { return m_acceleration; }
+
+ private:
+  Array m_velocity;
+  Array m_acceleration;
+  double m_max_velocity = 1.0;
+  double m_max_acceleration = 1.0;
+  double m_max_jerk = 1.0;
+  double m_velocity_offset = 0.5;
+  double m_horizon_scale = 0.05;
+};
+
+/**
+ * @brief Jerk-limited smoothing of sparse Cartesian setpoints
+ *
+ * Produces a smooth reference pose in every control cycle from the latest
+ * target pose.  Translation and rotation are limited independently.  The
+ * rotation is filtered on the rotation vector between the reference and the
+ * target, expressed in the base frame.
+ *
+ * Each part runs one jerk-limited profile on the norm of its error, along
+ * the error direction, so that the limits bound the norm of the velocity,
+ * acceleration and jerk and a step is followed along the straight line.
+ * When the target moves sideways, the velocity and acceleration are turned
+ * towards the new error direction, keeping their component along it.
+ *
+ * All storage is fixed-size, so \ref update is allocation-free.
+ */
+class CartesianTargetFilter {
+ public:
+  void setLinearLimits(double max_velocity, double max_acceleration,
+                       double max_jerk) {
+    m_linear.profile.setLimits(max_velocity, max_acceleration, max_jerk);
+  }
+
+  void setAngularLimits(double max_velocity, double max_acceleration,
+                        double max_jerk) {
+    m_angular.profile.setLimits(max_velocity, max_acceleration, max_jerk);
+  }
+
+  /**
+   * @brief Restart the filter at rest in the given pose
+   */
+  void reset(const KDL::Frame &pose) {
+    m_reference = pose;
+    m_linear.reset();
+    m_angular.reset();
+  }
+
+  /**
+   * @brief Move the reference one control cycle towards the target
+   *
+   * @param target The latest target pose
+   * @param dt The period of the control cycle
+   *
+   * @return The new reference pose
+   */
+  const KDL::Frame &update(const KDL::Frame &target, double dt) {
+    if (dt <= 0.0) {
+      return m_reference;
+    }
+
+    const KDL::Vector p_error = target.p - m_reference.p;
+    const KDL::Vector r_error = (target.M * m_reference.M.Inverse()).GetRot();
+
+    const ctrl::Vector3D dp = m_linear.step(
+        ctrl::Vector3D(p_error.x(), p_error.y(), p_error.z()), dt);
+    const ctrl::Vector3D dr = m_angular.step(
+        ctrl::Vector3D(r_error.x(), r_error.y(), r_error.z()), dt);
+
+    m_reference.p += KDL::Vector(dp.x(), dp.y(), dp.z());
+    const double angle = dr.norm();
+    if (angle > 1e-12) {
+      m_reference.M =
+          KDL::Rotation::Rot2(KDL::Vector(dr.x() / angle, dr.y() / angle,
+                                          dr.z() / angle),
+                              angle) *
+          m_reference.M;
+    }
+    return m_reference;
+  }
+
+  /**
+   * @brief Twist of the reference in the base frame, linear first
+   */
+  ctrl::Vector6D twist() const {
+    ctrl::Vector6D twist;
+    twist << m_linear.velocity, m_angular.velocity;
+    return twist;
+  }
+
+  /**
+   * @brief Acceleration of the reference in the base frame, linear first
+   */
+  ctrl::Vector6D acceleration() const {
+    ctrl::Vector6D acceleration;
+    acceleration << m_linear.acceleration, m_angular.acceleration;
+    return acceleration;
+  }
+
+  const KDL::Frame &reference() const { return m_reference; }
+
+ private:
+  /**
+   * @brief A jerk-limited profile along the direction of a 3D error
+   */
+  struct DirectedProfile {
+    JerkLimitedAxes<1> profile;
+    ctrl::Vector3D direction = ctrl::Vector3D::UnitX();
+    ctrl::Vector3D velocity = ctrl::Vector3D::Zero();
+    ctrl::Vector3D acceleration = ctrl::Vector3D::Zero();
+
+    void reset() {
+      profile.reset();
+      velocity.setZero();
+      acceleration.setZero();
+    }
+
+    // Displacement during this cycle
+    ctrl::Vector3D step(const ctrl::Vector3D &error, double dt) {
+      const double distance = error.norm();
+      if (distance > 1e-12) {
+        direction = error / distance;
+      }
+      profile.setState(
+          JerkLimitedAxes<1>::Array(velocity.dot(direction)),
+          JerkLimitedAxes<1>::Array(acceleration.dot(direction)));
+      const double ds =
+          profile.step(JerkLimitedAxes<1>::Array(distance), dt)[0];
+      velocity = profile.velocity()[0] * direction;
+      acceleration = profile.acceleration()[0] * direction;
+      return ds * direction;
+    }
+  };
+
+  KDL::Frame m_reference;
+  DirectedProfile m_linear;
+  DirectedProfile m_angular;
+};
+
+}  // namespace effort_controller_base
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef JOINT_LIMIT_REPULSION_H_INCLUDED
+#define JOINT_LIMIT_REPULSION_H_INCLUDED
+
+#include <effort_controller_base/Utility.h>
+
+#include <kdl/jntarray.hpp>
+
+namespace effort_controller_base {
+
+/**
+ * @brief Repulsion from the joint position limits and damping near the
+ * joint velocity limits
+ *
+ * Within margin m of a position limit, a spring pushes the joint back with
+ * the penetration p of the margin.  The motion towards the limit is damped
+ * with a gain that ramps up with the activation a = min(p / m, 1):
+ *
+ *   tau = +-k p - a d q_dot_towards
+ *
+ * Above a fraction r of the velocity limit v, damping ramps up until the
+ * limit is reached:
+ *
+ *   tau = -min(max((|q_dot| - r v) / ((1 - r) v), 0), 1) c q_dot
+ *
+ * Both terms are continuous in the joint state.  All per-joint constants
+ * are computed in \ref init, with infinite bounds for joints without limits,
+ * so that an update is a handful of array operations over all joints and
+ * does not branch.
+ */
+class JointLimitRepulsion {
+ public:
+  struct Settings {
+    double margin;            // Distance m to the position limits in rad
+    double stiffness;         // k in Nm/rad
+    double damping;           // d in Nms/rad
+    double velocity_ratio;    // r in [0, 1)
+    double velocity_damping;  // c in Nms/rad, 0 disables the velocity term
+  };
+
+  /**
+   * @brief Precompute the per-joint bounds.  Not real-time safe.
+   *
+   * @param lower The lower position limits, NaN for continuous joints
+   * @param upper The upper position limits, NaN for continuous joints
+   * @param velocity The velocity limits, NaN for unlimited joints
+   * @param settings The repulsion settings
+   */
+  void init(const KDL::JntArray &lower, const KDL::JntArray &upper,
+            const KDL::JntArray &velocity, const Settings &settings);
+
+  /**
+   * @brief Compute the repulsive torques of the current cycle
+   *
+   * @param q The joint positions
+   * @param q_dot The joint velocities
+   * @param tau The repulsive joint torques
+   */
+  void update(const ctrl::VectorND &q, const ctrl::VectorND &q_dot,
+              ctrl::VectorND &tau);
+
+  /**
+   * @brief Activation of each joint in [0, 1] after the last update
+   *
+   * Zero far from all limits and one at a position limit or the velocity
+   * limit.  Suited to ramp in task rows, so that the nullspace of lower
+   * priority tasks changes continuously.
+   */
+  const ctrl::VectorND &activation() const { return m_activation; }
+
+ private:
+  Settings m_settings;
+
+  // Positions and speeds where the repulsion starts, infinite if unlimited
+  Eigen::ArrayXd m_lower_start;
+  Eigen::ArrayXd m_upper_start;
+  Eigen::ArrayXd m_velocity_start;
+  Eigen::ArrayXd m_inverse_velocity_band;
+  double m_inverse_margin;
+
+  Eigen::ArrayXd m_lower_activation;
+  Eigen::ArrayXd m_upper_activation;
+  Eigen::ArrayXd m_velocity_activation;
+  ctrl::VectorND m_activation;
+};
+
+}  // namespace effort_controller_base
+
+#endif
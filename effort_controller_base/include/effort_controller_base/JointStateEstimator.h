@@ -0,0 +1,76 @@
+#ifndef JOINT_STATE_ESTIMATOR_H_INCLUDED
+#define JOINT_STATE_ESTIMATOR_H_INCLUDED
+
+#include <effort_controller_base/Utility.h>
+
+#include <Eigen/Dense>
+#include <kdl/jntarray.hpp>
+
+namespace effort_controller_base {
+
+/**
+ * @brief Kalman filter of joint positions, velocities and accelerations
+ *
+ * Each joint follows a constant acceleration model driven by white jerk
+ * noise and is measured in position and velocity.  All joints share the
+ * noise settings and the period, so that covariance and Kalman gain are the
+ * same for all joints.  They are propagated once per cycle as 3x3 matrices,
+ * while the states of all joints are updated with a few array operations.
+ *
+ * Optionally, callers provide the joint accelerations predicted by a model,
+ * e.g. from the commanded torques and the mass matrix.  They replace the
+ * estimated accelerations in the prediction step, so that the filter only
+ * corrects the model error.
+ */
+class JointStateEstimator {
+ public:
+  /**
+   * @brief Set up the filter.  Not real-time safe.
+   *
+   * @param joints The number of joints
+   * @param period The sampling period in s
+   * @param position_noise Standard deviation of the position measurements
+   * @param velocity_noise Standard deviation of the velocity measurements
+   * @param jerk_noise Spectral density of the white jerk process noise
+   */
+  void init(size_t joints, double period, double position_noise,
+            double velocity_noise, double jerk_noise);
+
+  /**
+   * @brief Start at the measured state at rest in acceleration
+   */
+  void reset(const KDL::JntArray &q, const KDL::JntArray &q_dot);
+
+  /**
+   * @brief Predict the state of this cycle and correct it with measurements
+   *
+   * @param q The measured joint positions
+   * @param q_dot The measured joint velocities
+   * @param acceleration Model accelerations over the last period, or nullptr
+   */
+  void update(const KDL::JntArray &q, const KDL::JntArray &q_dot,
+              const ctrl::VectorND *acceleration = nullptr);
+
+  const ctrl::VectorND &positions() const { return m_position; }
+  const ctrl::VectorND &velocities() const { return m_velocity; }
+  const ctrl::VectorND &accelerations() const { return m_acceleration; }
+
+ private:
+  using Matrix3 = Eigen::Matrix3d;
+
+  Matrix3 m_transition;
+  Matrix3 m_process_noise;
+  Eigen::Matrix2d m_measurement_noise;
+  Matrix3 m_covariance;
+  Eigen::Matrix<double, 3, 2> m_gain;
+
+  ctrl::VectorND m_position;
+  ctrl::VectorND m_velocity;
+  ctrl::VectorND m_acceleration;
+  ctrl::VectorND m_position_innovation;
+  ctrl::VectorND m_velocity_innovation;
+};
+
+}  // namespace effort_controller_base
+
+#endif
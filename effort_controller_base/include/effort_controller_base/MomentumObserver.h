@@ -0,0 +1,68 @@
+#ifndef MOMENTUM_OBSERVER_H_INCLUDED
+#define MOMENTUM_OBSERVER_H_INCLUDED
+
+#include <effort_controller_base/Utility.h>
+
+namespace effort_controller_base {
+
+/**
+ * @brief Generalized momentum observer of external joint torques
+ *
+ * With the generalized momentum p = M(q) q_dot, the rigid body dynamics give
+ *
+ *   p_dot = tau_m + tau_ext + C^T q_dot - g,   C^T q_dot = M_dot q_dot - C q_dot
+ *
+ * The residual
+ *
+ *   r = K (p - p(0) - int(tau_m - C q_dot - g + M_dot q_dot + r) dt)
+ *
+ * then follows the external torques as a first order low-pass filter with
+ * bandwidth K, without joint accelerations.  M_dot q_dot is integrated
+ * exactly as the change of M between cycles times q_dot.  All inputs are
+ * results the controllers compute anyway, so each update only adds a few
+ * matrix-vector products.
+ */
+class MomentumObserver {
+ public:
+  /**
+   * @brief Set up the buffers.  Not real-time safe.
+   *
+   * @param joints The number of joints
+   * @param gain The observer bandwidth K in 1/s
+   */
+  void init(size_t joints, double gain);
+
+  /**
+   * @brief Start observing at the given state, assuming no external torques
+   */
+  void reset(const ctrl::MatrixND &mass, const ctrl::VectorND &q_dot);
+
+  /**
+   * @brief Advance the observer by one cycle
+   *
+   * @param mass The mass matrix M(q)
+   * @param q_dot The joint velocities
+   * @param torque The known torques tau_m - C q_dot - g over the last period
+   * @param period The period in s
+   */
+  void update(const ctrl::MatrixND &mass, const ctrl::VectorND &q_dot,
+              const ctrl::VectorND &torque, double period);
+
+  /**
+   * @brief The estimated external joint torques acting on the robot
+   */
+  const ctrl::VectorND &externalTorques() const { return m_residual; }
+
+ private:
+  double m_gain;
+  ctrl::MatrixND m_last_mass;
+  ctrl::MatrixND m_mass_change;
+  ctrl::VectorND m_initial_momentum;
+  ctrl::VectorND m_momentum;
+  ctrl::VectorND m_integral;
+  ctrl::VectorND m_residual;
+};
+
+}  // namespace effort_controller_base
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef NULLSPACE_PROJECTOR_H_INCLUDED
+#define NULLSPACE_PROJECTOR_H_INCLUDED
+
+#include <effort_controller_base/RobotModel.h>
+#include <effort_controller_base/Utility.h>
+
+#include <string>
+
+namespace effort_controller_base {
+
+/**
+ * @brief Projects joint torques into the nullspace of the end effector task
+ *
+ * Two projectors are supported:
+ *
+ * - Kinematic: I - J^T pinv(J^T).  With the thin SVD J = U S V^T of \ref
+ *   RobotModel::jacobianSVD this is I - V W V^T, where W holds the damped
+ *   weights s^2 / (s^2 + lambda^2) of the pseudo-inverse.
+ * - Dynamically consistent: I - J^T J_bar^T with J_bar = M^-1 J^T Lambda
+ *   from \ref RobotModel::dynamicallyConsistentInverse.  Nullspace torques
+ *   then do not accelerate the end effector.
+ *
+ * Both reuse the decompositions the robot model already holds for the
+ * current cycle.  The projector matrix is never formed, the projection is a
+ * short sequence of matrix-vector products.
+ */
+class NullspaceProjector {
+ public:
+  enum class Type { Kinematic, DynamicallyConsistent };
+
+  /**
+   * @brief Parse a projector type
+   *
+   * @param name Either "kinematic" or "dynamically_consistent"
+   * @param type The parsed type
+   *
+   * @return False if the name is unknown
+   */
+  static bool parse(const std::string &name, Type &type) {
+    if (name == "kinematic") {
+      type = Type::Kinematic;
+      return true;
+    }
+    if (name == "dynamically_consistent") {
+      type = Type::DynamicallyConsistent;
+      return true;
+    }
+    return false;
+  }
+
+  void setType(Type type) { m_type = type; }
+  Type type() const { return m_type; }
+
+  /**
+   * @brief Project torques into the nullspace of the end effector Jacobian
+   *
+   * @param model The robot model of the current cycle
+   * @param tau The torques to project
+   * @param tau_null The projected torques
+   */
+  void project(const RobotModel &model, const ctrl::VectorND &tau,
+               ctrl::VectorND &tau_null) {
+    if (m_type == Type::DynamicallyConsistent) {
+      m_task.noalias() =
+          model.dynamicallyConsistentInverse().transpose() * tau;
+      tau_null = tau;
+      tau_null.noalias() -= model.jacobian().data.transpose() * m_task;
+      return;
+    }
+
+    const auto &svd = model.jacobianSVD();
+    const double lambda = model.pseudoInverseDamping();
+    const auto s2 = svd.singularValues().array().square();
+    m_task.noalias() = svd.matrixV().transpose() * tau;
+    m_task.array() *= s2 / (s2 + lambda * lambda);
+    tau_null = tau;
+    tau_null.noalias() -= svd.matrixV() * m_task;
+  }
+
+ private:
+  Type m_type = Type::Kinematic;
+
+  // At most six task space coordinates, without heap allocation
+  Eigen::Matrix<double, Eigen::Dynamic, 1, 0, 6, 1> m_task;
+};
+
+}  // namespace effort_controller_base
+
+#endif
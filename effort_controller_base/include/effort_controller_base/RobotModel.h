@@ -0,0 +1,312 @@
+#ifndef ROBOT_MODEL_H_INCLUDED
+#define ROBOT_MODEL_H_INCLUDED
+
+#include <effort_controller_base/DynamicsWorker.h>
+#include <effort_controller_base/Utility.h>
+
+#include <Eigen/Cholesky>
+#include <Eigen/SVD>
+#include <cstdint>
+#include <functional>
+#include <kdl/chain.hpp>
+#include <kdl/chaindynparam.hpp>
+#include <kdl/chainjnttojacsolver.hpp>
+#include <kdl/frames.hpp>
+#include <kdl/jacobian.hpp>
+#include <kdl/jntarray.hpp>
+#include <kdl/jntspaceinertiamatrix.hpp>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace effort_controller_base {
+
+class TreeModel;
+
+/**
+ * @brief A quantity that is computed at most once per control cycle
+ *
+ * The node is stale whenever the shared epoch counter differs from the epoch
+ * of its last evaluation.  It is then recomputed on the next \ref get.  Nodes
+ * that depend on other nodes simply call their \ref get inside the compute
+ * function, so dependencies are evaluated on demand as well.
+ */
+template <class T>
+class LazyNode {
+ public:
+  /**
+   * @brief Set up the node.  Not real-time safe.
+   *
+   * @param epoch The epoch counter shared by all nodes of a model
+   * @param initial The initial value.  Should have the final size, so that
+   * \ref get does not allocate.
+   * @param compute Computes the value in place
+   */
+  void init(const uint64_t *epoch, T initial,
+            std::function<void(T &)> compute) {
+    m_epoch = epoch;
+    m_value = std::move(initial);
+    m_compute = std::move(compute);
+    m_stamp = *epoch - 1;
+  }
+
+  /**
+   * @brief The value for the current epoch, computed if needed
+   */
+  const T &get() const {
+    if (m_stamp != *m_epoch) {
+      m_compute(m_value);
+      m_stamp = *m_epoch;
+    }
+    return m_value;
+  }
+
+  /**
+   * @brief Whether the value is up to date for the current epoch
+   */
+  bool evaluated() const { return m_stamp == *m_epoch; }
+
+ private:
+  const uint64_t *m_epoch = nullptr;
+  mutable uint64_t m_stamp = 0;
+  mutable T m_value;
+  std::function<void(T &)> m_compute;
+};
+
+/**
+ * @brief Kinematic and dynamic quantities of the robot chain
+ *
+ * All quantities are lazy: they are computed on first request within a
+ * control cycle and reused for the rest of it.  Call \ref invalidate whenever
+ * the joint state changes.  Controllers thus only pay for the quantities
+ * their current configuration actually uses.
+ */
+class RobotModel {
+ public:
+  RobotModel() = default;
+  RobotModel(const RobotModel &) = delete;
+  RobotModel &operator=(const RobotModel &) = delete;
+
+  /**
+   * @brief Set up solvers and preallocate all quantities
+   *
+   * @param chain The robot chain.  Its first segment is attached to the
+   * robot base link.
+   * @param base_link The name of the robot base link
+   * @param joint_positions The joint positions, owned by the caller
+   * @param joint_velocities The joint velocities, owned by the caller
+   * @param gravity The gravity vector in the robot base frame
+   */
+  void init(const KDL::Chain &chain, const std::string &base_link,
+            const KDL::JntArray *joint_positions,
+            const KDL::JntArray *joint_velocities,
+            const KDL::Vector &gravity);
+
+  /**
+   * @brief Take the link poses and the Jacobian from a tree model
+   *
+   * For chains that are a branch of a \ref TreeModel, so that the kinematics
+   * of a shared trunk are computed once for all branches.  Call after
+   * \ref init.  The tree model's link poses must be evaluated before this
+   * model's, and the tree model must outlive it.  The remaining quantities
+   * build on these as before.
+   *
+   * @param tree The tree model
+   * @param end_effector The index of the chain tip among the tree model's end
+   * effectors
+   * @param joints Index of each chain joint among the tree model's joints
+   */
+  void useTreeKinematics(const TreeModel &tree, size_t end_effector,
+                         const std::vector<size_t> &joints);
+
+  /**
+   * @brief Compute gravity, Coriolis torques and mass matrix at a lower rate
+   *
+   * Not real-time safe.  See \ref DynamicsWorker.  Whenever the worker's
+   * results are older than max_staleness, the quantities are computed
+   * synchronously instead.
+   *
+   * @param rate The update rate of the worker in Hz
+   * @param max_staleness The maximal age in seconds of usable results
+   */
+  void enableDynamicsWorker(double rate, double max_staleness);
+
+  /**
+   * @brief Start the dynamics worker, if enabled.  Not real-time safe.
+   */
+  void startDynamicsWorker();
+
+  /**
+   * @brief Stop the dynamics worker, if enabled.  Not real-time safe.
+   */
+  void stopDynamicsWorker();
+
+  /**
+   * @brief Mark all quantities as stale
+   *
+   * Call after each joint state update.  Also hands the joint state over to
+   * the dynamics worker, if enabled.
+   */
+  void invalidate();
+
+  /**
+   * @brief Whether the dynamics of this cycle come from the worker
+   */
+  bool dynamicsFromWorker() const { return m_dynamics_from_worker; }
+
+  /**
+   * @brief Age in seconds of the worker's latest dynamics
+   */
+  double dynamicsAge() const { return m_worker ? m_worker->age() : 0.0; }
+
+  /**
+   * @brief Number of cycles that fell back to synchronous dynamics
+   */
+  uint64_t dynamicsFallbacks() const { return m_dynamics_fallbacks; }
+
+  /**
+   * @brief Resolve a link name to its id
+   *
+   * The robot base link has id 0.  Each segment of the robot chain has the id
+   * of its index plus one.
+   *
+   * @return The link id or -1 if the link is not part of the robot chain
+   */
+  int linkId(const std::string &name) const {
+    const auto it = m_link_ids.find(name);
+    return it == m_link_ids.end() ? -1 : it->second;
+  }
+
+  /**
+   * @brief Poses of all links in the robot base frame, indexed by link id
+   */
+  const std::vector<KDL::Frame> &linkPoses() const {
+    return m_link_poses.get();
+  }
+
+  /**
+   * @brief Jacobian of the chain tip, in the robot base frame
+   */
+  const KDL::Jacobian &jacobian() const { return m_jacobian.get(); }
+
+  /**
+   * @brief Jacobian of an arbitrary link, in the robot base frame
+   *
+   * Computed on every call, not cached.  Columns of joints after the link are
+   * zero.
+   *
+   * @param id The link id, see \ref linkId
+   * @param jacobian Preallocated with the number of joints
+   */
+  void linkJacobian(int id, KDL::Jacobian &jacobian) const {
+    m_jnt_to_jac_solver->JntToJac(*m_joint_positions, jacobian, id);
+  }
+
+  /**
+   * @brief Thin singular value decomposition of \ref jacobian
+   */
+  const Eigen::JacobiSVD<ctrl::MatrixND> &jacobianSVD() const {
+    return m_jacobian_svd.get();
+  }
+
+  /**
+   * @brief Product of the singular values of \ref jacobian
+   *
+   * The manipulability sqrt(det(J J^T)) for chains with six or more joints,
+   * and sqrt(det(J^T J)) for fewer, which would otherwise be zero everywhere.
+   */
+  double manipulability() const {
+    return m_jacobian_svd.get().singularValues().prod();
+  }
+
+  /**
+   * @brief Damped pseudo-inverse of the transposed Jacobian
+   */
+  const ctrl::MatrixND &jacobianTransposePseudoInverse() const {
+    return m_jacobian_transpose_pinv.get();
+  }
+
+  /**
+   * @brief Joint space mass matrix M(q)
+   */
+  const KDL::JntSpaceInertiaMatrix &massMatrix() const {
+    return m_mass_matrix.get();
+  }
+
+  /**
+   * @brief Cholesky factorization M = L L^T of the mass matrix
+   *
+   * Shared by all quantities that need the inverse of M.
+   */
+  const Eigen::LLT<ctrl::MatrixND> &massMatrixLLT() const {
+    return m_mass_llt.get();
+  }
+
+  /**
+   * @brief Operational space inertia of the chain tip
+   *
+   * Lambda = (J M^-1 J^T)^-1, computed from the factor L of \ref massMatrixLLT
+   * as Lambda^-1 = (L^-1 J^T)^T (L^-1 J^T).  Slightly regularized, so that it
+   * stays bounded close to singularities.
+   */
+  const ctrl::Matrix6D &taskInertia() const { return m_task_inertia.get(); }
+
+  /**
+   * @brief Dynamically consistent generalized inverse of the Jacobian
+   *
+   * J_bar = M^-1 J^T Lambda, an n x 6 matrix.  The nullspace projector
+   * I - J^T J_bar^T leaves the task space dynamics unaffected.
+   */
+  const ctrl::MatrixND &dynamicallyConsistentInverse() const {
+    return m_dynamically_consistent_inverse.get();
+  }
+
+  /**
+   * @brief Gravity torques g(q)
+   */
+  const KDL::JntArray &gravity() const { return m_gravity.get(); }
+
+  /**
+   * @brief Coriolis and centrifugal torques C(q, q_dot) q_dot
+   */
+  const KDL::JntArray &coriolis() const { return m_coriolis.get(); }
+
+  /**
+   * @brief Damping of the pseudo-inverse close to singularities
+   */
+  double pseudoInverseDamping() const { return m_pinv_damping; }
+
+ private:
+  uint64_t m_epoch = 0;
+
+  KDL::Chain m_chain;
+  const KDL::JntArray *m_joint_positions = nullptr;
+  const KDL::JntArray *m_joint_velocities = nullptr;
+  std::unique_ptr<KDL::ChainJntToJacSolver> m_jnt_to_jac_solver;
+  std::unique_ptr<KDL::ChainDynParam> m_dyn_solver;
+  KDL::Vector m_gravity_vector;
+  std::unordered_map<std::string, int> m_link_ids;
+  double m_pinv_damping = 0.2;
+  double m_task_inertia_regularization = 1e-4;
+
+  std::unique_ptr<DynamicsWorker> m_worker;
+  bool m_dynamics_from_worker = false;
+  uint64_t m_dynamics_fallbacks = 0;
+
+  LazyNode<std::vector<KDL::Frame>> m_link_poses;
+  LazyNode<KDL::Jacobian> m_jacobian;
+  LazyNode<Eigen::JacobiSVD<ctrl::MatrixND>> m_jacobian_svd;
+  LazyNode<ctrl::MatrixND> m_jacobian_transpose_pinv;
+  LazyNode<KDL::JntSpaceInertiaMatrix> m_mass_matrix;
+  LazyNode<Eigen::LLT<ctrl::MatrixND>> m_mass_llt;
+  LazyNode<ctrl::MatrixND> m_scaled_jacobian_transpose;  // L^-1 J^T
+  LazyNode<ctrl::Matrix6D> m_task_inertia;
+  LazyNode<ctrl::MatrixND> m_dynamically_consistent_inverse;
+  LazyNode<KDL::JntArray> m_gravity;
+  LazyNode<KDL::JntArray> m_coriolis;
+};
+
+}  // namespace effort_controller_base
+
+#endif
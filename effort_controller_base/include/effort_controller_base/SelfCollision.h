@@ -0,0 +1,146 @@
+#ifndef SELF_COLLISION_H_INCLUDED
+#define SELF_COLLISION_H_INCLUDED
+
+#include <effort_controller_base/RobotModel.h>
+#include <effort_controller_base/Utility.h>
+#include <urdf_model/link.h>
+
+#include <kdl/frames.hpp>
+#include <kdl/jacobian.hpp>
+#include <utility>
+#include <vector>
+
+namespace effort_controller_base {
+
+/**
+ * @brief Repulsion between the links of the robot chain
+ *
+ * Each link is approximated by capsules, i.e. line segments with a radius.
+ * Spheres are capsules of zero length.  Each cycle, a broadphase drops all
+ * pairs whose bounding spheres are further apart than the activation
+ * distance.  The segment distances of the remaining pairs are then computed
+ * in one batch, with the pairs as lanes of structure-of-arrays buffers, so
+ * that the kernel vectorizes without branches.
+ *
+ * Each pair closer than the activation distance d_0 pushes its witness
+ * points apart along their normal n with
+ *
+ *   F = max(0, k (d_0 - d) - D d_dot),   tau = J_d^T F,   J_d = n^T (J_1 - J_2)
+ *
+ * where J_1 and J_2 are the Jacobians of the witness points.  Pairs of links
+ * that are at most a given number of joints apart never collide by design
+ * and are excluded once at configuration time.
+ */
+class SelfCollision {
+ public:
+  struct Capsule {
+    int link;   // Link id in the robot model
+    int depth;  // Number of joints from the robot base to the link
+    KDL::Vector start;  // Segment in the link frame
+    KDL::Vector end;
+    double radius;
+  };
+
+  struct Settings {
+    double distance;    // Activation distance d_0 in m
+    double stiffness;   // k in N/m
+    double damping;     // D in Ns/m
+    int ignore_adjacent;  // Exclude links at most this many joints apart
+  };
+
+  /**
+   * @brief Approximate the collision geometry of a URDF link by capsules
+   *
+   * Cylinders become capsules along their axis and spheres capsules of zero
+   * length.  Spheres that a capsule of the same link already covers, such as
+   * the caps of a cylinder, are dropped.
+   *
+   * @param link The URDF link
+   * @param id The link id in the robot model
+   * @param depth Number of joints from the robot base to the link
+   * @param capsules The capsules to append to
+   *
+   * @return The number of skipped geometries, e.g. boxes and meshes
+   */
+  static size_t appendUrdfCapsules(const urdf::Link &link, int id, int depth,
+                                   std::vector<Capsule> &capsules);
+
+  /**
+   * @brief Set up the pairs and preallocate all buffers.  Not real-time safe.
+   *
+   * @param capsules The capsules of all links
+   * @param ignored_links Pairs of link ids that never collide
+   * @param joints The number of joints
+   * @param settings The repulsion settings
+   */
+  void init(const std::vector<Capsule> &capsules,
+            const std::vector<std::pair<int, int>> &ignored_links,
+            size_t joints, const Settings &settings);
+
+  /**
+   * @brief Compute the repulsive torques for the current cycle
+   *
+   * Uses the link poses of the model and the Jacobians of the links involved
+   * in close pairs.  Does not allocate.
+   *
+   * @param model The robot model of the current cycle
+   * @param q_dot The joint velocities
+   * @param tau The repulsive joint torques
+   */
+  void update(const RobotModel &model, const ctrl::VectorND &q_dot,
+              ctrl::VectorND &tau);
+
+  /**
+   * @brief Number of capsule pairs that are checked in each cycle
+   */
+  size_t pairs() const { return m_pairs.size(); }
+
+  /**
+   * @brief Number of pairs that passed the broadphase in the last cycle
+   */
+  size_t closePairs() const { return m_close; }
+
+  /**
+   * @brief Smallest distance of the last cycle
+   *
+   * The activation distance if no pair passed the broadphase.
+   */
+  double minimumDistance() const { return m_minimum_distance; }
+
+ private:
+  /**
+   * @brief Closest points and distances of the first count batch lanes
+   */
+  void computeDistances(size_t count);
+
+  Settings m_settings;
+  std::vector<Capsule> m_capsules;
+  std::vector<std::pair<size_t, size_t>> m_pairs;
+
+  // World segments and bounding spheres of the current cycle
+  std::vector<ctrl::Vector3D> m_starts;
+  std::vector<ctrl::Vector3D> m_directions;
+  std::vector<ctrl::Vector3D> m_centers;
+  std::vector<double> m_bounds;
+
+  // Batch lanes, one row per close pair, coordinates in columns
+  using Lanes3 = Eigen::Array<double, Eigen::Dynamic, 3>;
+  std::vector<size_t> m_batch;  // Pair index of each lane
+  Lanes3 m_start_1, m_direction_1, m_start_2, m_direction_2;
+  Lanes3 m_closest_1, m_closest_2, m_offset;
+  Eigen::ArrayXd m_a, m_b, m_c, m_e, m_f, m_denominator, m_s, m_t;
+  Eigen::ArrayXd m_radii, m_distances;
+
+  // Link Jacobians, computed once per cycle for links in close pairs
+  std::vector<int> m_link_slots;  // Indexed by link id
+  std::vector<KDL::Jacobian> m_link_jacobians;
+  std::vector<char> m_link_jacobian_ready;
+  ctrl::VectorND m_row;
+
+  size_t m_close = 0;
+  double m_minimum_distance = 0.0;
+};
+
+}  // namespace effort_controller_base
+
+#endif
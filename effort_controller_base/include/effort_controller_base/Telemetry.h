@@ -0,0 +1,119 @@
+#ifndef TELEMETRY_H_INCLUDED
+#define TELEMETRY_H_INCLUDED
+
+#include <memory>
+#include <rclcpp/rclcpp.hpp>
+#include <realtime_tools/realtime_publisher.h>
+#include <std_msgs/msg/float64_multi_array.hpp>
+#include <string>
+#include <vector>
+
+#include "rclcpp_lifecycle/lifecycle_node.hpp"
+
+namespace effort_controller_base {
+
+/**
+ * @brief Real-time safe publisher for named scalar controller signals
+ *
+ * Channels are registered at configure time with \ref addChannel.  The control
+ * loop sets their values with \ref set and calls \ref publish once per cycle.
+ * Messages are published as std_msgs::msg::Float64MultiArray at a decimated
+ * rate.  The label of the first layout dimension holds the channel names,
+ * separated by commas.
+ */
+class Telemetry {
+ public:
+  using Message = std_msgs::msg::Float64MultiArray;
+
+  /**
+   * @brief Create the publisher
+   *
+   * @param node The controller's node
+   * @param topic The topic to publish on
+   * @param publish_rate The publishing rate in Hz.  Non-positive values
+   * disable publishing.
+   */
+  void init(const std::shared_ptr<rclcpp_lifecycle::LifecycleNode> &node,
+            const std::string &topic, double publish_rate) {
+    m_publish_period = publish_rate > 0.0 ? 1.0 / publish_rate : -1.0;
+    m_publisher = node->create_publisher<Message>(topic, 10);
+    m_rt_publisher =
+        std::make_unique<realtime_tools::RealtimePublisher<Message>>(
+            m_publisher);
+    m_rt_publisher->lock();
+    m_rt_publisher->msg_.layout.dim.resize(1);
+    m_rt_publisher->unlock();
+    updateLayout();
+  }
+
+  /**
+   * @brief Register a new channel.  Not real-time safe.
+   *
+   * @param name The name of the channel
+   *
+   * @return The index to use with \ref set
+   */
+  size_t addChannel(const std::string &name) {
+    m_names.push_back(name);
+    m_values.push_back(0.0);
+    updateLayout();
+    return m_values.size() - 1;
+  }
+
+  /**
+   * @brief Set the current value of a channel
+   */
+  void set(size_t channel, double value) { m_values[channel] = value; }
+
+  /**
+   * @brief Publish all channels if the publishing period has elapsed
+   *
+   * Never blocks.  A sample is skipped if the publisher is busy.
+   *
+   * @param time The current time of the control loop
+   */
+  void publish(const rclcpp::Time &time) {
+    if (!m_rt_publisher || m_publish_period <= 0.0) {
+      return;
+    }
+    const double now = time.seconds();
+    if (now - m_last_publish_time < m_publish_period) {
+      return;
+    }
+    if (m_rt_publisher->trylock()) {
+      m_last_publish_time = now;
+      std::copy(m_values.begin(), m_values.end(),
+                m_rt_publisher->msg_.data.begin());
+      m_rt_publisher->unlockAndPublish();
+    }
+  }
+
+ private:
+  void updateLayout() {
+    if (!m_rt_publisher) {
+      return;
+    }
+    std::string label;
+    for (const auto &name : m_names) {
+      label += label.empty() ? name : "," + name;
+    }
+    m_rt_publisher->lock();
+    auto &msg = m_rt_publisher->msg_;
+    msg.layout.dim[0].label = label;
+    msg.layout.dim[0].size = m_names.size();
+    msg.layout.dim[0].stride = m_names.size();
+    msg.data.resize(m_names.size(), 0.0);
+    m_rt_publisher->unlock();
+  }
+
+  std::shared_ptr<rclcpp::Publisher<Message>> m_publisher;
+  std::unique_ptr<realtime_tools::RealtimePublisher<Message>> m_rt_publisher;
+  std::vector<std::string> m_names;
+  std::vector<double> m_values;
+  double m_publish_period = -1.0;
+  double m_last_publish_time = -1.0e9;
+};
+
+}  // namespace effort_controller_base
+
+#endif
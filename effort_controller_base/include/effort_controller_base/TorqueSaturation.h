@@ -0,0 +1,127 @@
+#ifndef TORQUE_SATURATION_H_INCLUDED
+#define TORQUE_SATURATION_H_INCLUDED
+
+#include <effort_controller_base/Utility.h>
+
+#include <Eigen/Dense>
+#include <algorithm>
+
+namespace effort_controller_base {
+
+/**
+ * @brief Feasible torques around the last command
+ *
+ * Intersects the effort limits with the rate limits around the last
+ * command.  Effort limits take precedence if both contradict.  Does not
+ * allocate once lower and upper have the right size.
+ *
+ * @param previous The last command
+ * @param rate_limits The effort rate limits per cycle
+ * @param effort_limits The effort limits, infinite if unlimited
+ * @param lower The resulting lower bounds
+ * @param upper The resulting upper bounds
+ */
+inline void saturationBox(const ctrl::VectorND &previous,
+                          const Eigen::ArrayXd &rate_limits,
+                          const Eigen::ArrayXd &effort_limits,
+                          Eigen::ArrayXd &lower, Eigen::ArrayXd &upper) {
+  upper = (previous.array() + rate_limits).min(effort_limits);
+  lower = (previous.array() - rate_limits).max(-effort_limits).min(upper);
+}
+
+/**
+ * @brief Largest step in [0, 1] along direction from start that stays within
+ * the box [lower, upper].  Assumes start to be inside the box.
+ */
+template <typename Start, typename Direction>
+double maxStep(const Start &start, const Direction &direction,
+               const Eigen::ArrayXd &lower, const Eigen::ArrayXd &upper) {
+  const double step =
+      (direction > 0.0)
+          .select((upper - start) / direction,
+                  (direction < 0.0).select((lower - start) / direction, 1.0))
+          .minCoeff();
+  return std::clamp(step, 0.0, 1.0);
+}
+
+/**
+ * @brief Clip each joint torque to its bounds
+ *
+ * The Euclidean projection onto the box.  Changes the direction of the
+ * command if only some joints saturate.
+ *
+ * @param tau The commanded torques
+ * @param lower The lower bounds, see \ref saturationBox
+ * @param upper The upper bounds
+ * @param efforts The resulting torques
+ */
+inline void clipTorques(const ctrl::VectorND &tau, const Eigen::ArrayXd &lower,
+                        const Eigen::ArrayXd &upper, ctrl::VectorND &efforts) {
+  efforts.array() = tau.array().max(lower).min(upper);
+}
+
+/**
+ * @brief Move from the last command towards the commanded torques as far as
+ * the bounds allow
+ *
+ * Keeps the direction of the change of all joints at once.
+ *
+ * @param tau The commanded torques
+ * @param lower The lower bounds, see \ref saturationBox
+ * @param upper The upper bounds
+ * @param efforts The last command, replaced by the resulting torques
+ *
+ * @return The share of the change that was applied
+ */
+inline double scaleTorques(const ctrl::VectorND &tau,
+                           const Eigen::ArrayXd &lower,
+                           const Eigen::ArrayXd &upper,
+                           ctrl::VectorND &efforts) {
+  const double scale =
+      maxStep(efforts.array(), tau.array() - efforts.array(), lower, upper);
+  efforts.array() += scale * (tau.array() - efforts.array());
+  return scale;
+}
+
+/**
+ * @brief Scale a lower priority share of the commanded torques first
+ *
+ * If the primary torques tau - secondary are feasible on their own, they are
+ * applied in full and the secondary torques are added as far as the bounds
+ * allow.  Otherwise the secondary torques are dropped and the primary ones
+ * are scaled as in \ref scaleTorques.
+ *
+ * @param tau The commanded torques
+ * @param secondary The lower priority share of tau
+ * @param lower The lower bounds, see \ref saturationBox
+ * @param upper The upper bounds
+ * @param efforts The last command, replaced by the resulting torques
+ * @param secondary_scale The share of the secondary torques that was applied
+ *
+ * @return The share of the change towards the primary torques that was
+ * applied
+ */
+inline double prioritizeTorques(const ctrl::VectorND &tau,
+                                const ctrl::VectorND &secondary,
+                                const Eigen::ArrayXd &lower,
+                                const Eigen::ArrayXd &upper,
+                                ctrl::VectorND &efforts,
+                                double &secondary_scale) {
+  const auto primary = tau.array() - secondary.array();
+  const double scale =
+      maxStep(efforts.array(), primary - efforts.array(), lower, upper);
+  secondary_scale = 0.0;
+  if (scale < 1.0) {
+    efforts.array() += scale * (primary - efforts.array());
+  } else {
+    efforts.array() = primary;
+    secondary_scale =
+        maxStep(efforts.array(), secondary.array(), lower, upper);
+    efforts += secondary_scale * secondary;
+  }
+  return scale;
+}
+
+}  // namespace effort_controller_base
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef TREE_MODEL_H_INCLUDED
+#define TREE_MODEL_H_INCLUDED
+
+#include <effort_controller_base/RobotModel.h>
+#include <effort_controller_base/Utility.h>
+
+#include <cstdint>
+#include <kdl/frames.hpp>
+#include <kdl/jacobian.hpp>
+#include <kdl/jntarray.hpp>
+#include <kdl/jntspaceinertiamatrix.hpp>
+#include <kdl/tree.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace effort_controller_base {
+
+/**
+ * @brief Kinematic and dynamic quantities of a branched robot
+ *
+ * Covers the whole subtree below the robot base link, e.g. a torso with two
+ * arms or an arm with an actuated gripper, and several end effectors on
+ * different branches.  The bodies are stored in topological order, so that
+ * the kinematics are one forward pass over the tree and the dynamics of the
+ * whole tree one forward and one backward pass.  All spatial quantities are
+ * expressed in the robot base frame with linear parts first.
+ *
+ * Like \ref RobotModel, all quantities are lazy and computed at most once per
+ * cycle.  Joints of the subtree that are not among the controller's joints
+ * are held at zero.  Their links still count for the dynamics.
+ *
+ * Once \ref linkPoses is evaluated, the Jacobians of different end effectors
+ * only read shared state and may be evaluated concurrently, e.g. on the arm
+ * worker pool.  Everything else must be evaluated by one thread at a time.
+ */
+class TreeModel {
+ public:
+  TreeModel() = default;
+  TreeModel(const TreeModel &) = delete;
+  TreeModel &operator=(const TreeModel &) = delete;
+
+  /**
+   * @brief Flatten the tree and preallocate all quantities
+   *
+   * @param tree The robot tree
+   * @param base_link The link the subtree starts at
+   * @param joint_names The controller's joints, in the order of the joint
+   * state
+   * @param end_effectors The links to compute Jacobians for
+   * @param joint_positions The joint positions, owned by the caller
+   * @param joint_velocities The joint velocities, owned by the caller
+   * @param gravity The gravity vector in the robot base frame
+   *
+   * @return False if the base link, a joint or an end effector is not part of
+   * the subtree
+   */
+  bool init(const KDL::Tree &tree, const std::string &base_link,
+            const std::vector<std::string> &joint_names,
+            const std::vector<std::string> &end_effectors,
+            const KDL::JntArray *joint_positions,
+            const KDL::JntArray *joint_velocities,
+            const KDL::Vector &gravity);
+
+  /**
+   * @brief Mark all quantities as stale
+   *
+   * Call after each joint state update.
+   */
+  void invalidate() { ++m_epoch; }
+
+  /**
+   * @brief Resolve a link name to its id
+   *
+   * The robot base link has id 0.  Parents have smaller ids than their
+   * children.
+   *
+   * @return The link id or -1 if the link is not part of the subtree
+   */
+  int linkId(const std::string &name) const {
+    const auto it = m_link_ids.find(name);
+    return it == m_link_ids.end() ? -1 : it->second;
+  }
+
+  /**
+   * @brief Poses of all links in the robot base frame, indexed by link id
+   */
+  const std::vector<KDL::Frame> &linkPoses() const {
+    return m_kinematics.get().poses;
+  }
+
+  /**
+   * @brief Number of end effectors passed to \ref init
+   */
+  size_t endEffectors() const { return m_jacobians.size(); }
+
+  /**
+   * @brief Jacobian of end effector k in the robot base frame
+   *
+   * Has a column for each of the controller's joints.  Columns of joints that
+   * do not move the end effector are zero.
+   */
+  const KDL::Jacobian &jacobian(size_t k) const {
+    return m_jacobians[k].get();
+  }
+
+  /**
+   * @brief Joint space mass matrix M(q) of the whole tree
+   */
+  const KDL::JntSpaceInertiaMatrix &massMatrix() const {
+    return m_mass_matrix.get();
+  }
+
+  /**
+   * @brief Gravity torques g(q) of the whole tree
+   *
+   * Computed in the same traversal as \ref coriolis.
+   */
+  const KDL::JntArray &gravity() const { return m_bias.get().gravity; }
+
+  /**
+   * @brief Coriolis and centrifugal torques C(q, q_dot) q_dot of the whole
+   * tree
+   */
+  const KDL::JntArray &coriolis() const { return m_bias.get().coriolis; }
+
+ private:
+  // Per-cycle quantities that only depend on the joint positions
+  struct Kinematics {
+    std::vector<KDL::Frame> poses;
+    std::vector<ctrl::Vector6D> motions;   // Joint motion subspaces
+    std::vector<ctrl::Matrix6D> inertias;  // Spatial inertias
+  };
+
+  // Gravity and velocity product torques with their per-body intermediates
+  struct Bias {
+    KDL::JntArray gravity;
+    KDL::JntArray coriolis;
+    std::vector<ctrl::Vector6D> velocities;
+    std::vector<ctrl::Vector6D> accelerations;
+    std::vector<ctrl::Vector6D> gravity_forces;
+    std::vector<ctrl::Vector6D> coriolis_forces;
+  };
+
+  void computeKinematics(Kinematics &kinematics) const;
+  void computeBias(Bias &bias) const;
+  void computeMassMatrix(KDL::JntSpaceInertiaMatrix &mass) const;
+  void computeJacobian(size_t k, KDL::Jacobian &jacobian) const;
+
+  uint64_t m_epoch = 0;
+
+  // Bodies in topological order.  Body 0 is the robot base link.
+  std::vector<KDL::Segment> m_segments;
+  std::vector<int> m_parents;
+  std::vector<int> m_joints;  // Controller joint index or -1
+  std::vector<double> m_masses;
+  std::vector<KDL::Vector> m_centers_of_mass;  // In the link frame
+  std::vector<ctrl::Matrix3D> m_central_inertias;  // About the center of mass
+
+  // Bodies with a controller joint from each end effector to the base
+  std::vector<std::vector<int>> m_end_effector_paths;
+  std::vector<int> m_end_effector_ids;
+
+  const KDL::JntArray *m_joint_positions = nullptr;
+  const KDL::JntArray *m_joint_velocities = nullptr;
+  ctrl::Vector3D m_gravity_vector;
+  std::unordered_map<std::string, int> m_link_ids;
+
+  LazyNode<Kinematics> m_kinematics;
+  LazyNode<Bias> m_bias;
+  LazyNode<KDL::JntSpaceInertiaMatrix> m_mass_matrix;
+  std::vector<LazyNode<KDL::Jacobian>> m_jacobians;
+  mutable std::vector<ctrl::Matrix6D> m_composite_inertias;
+};
+
+}  // namespace effort_controller_base
+
+#endif
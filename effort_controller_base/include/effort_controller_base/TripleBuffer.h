@@ -0,0 +1,93 @@
+#ifndef TRIPLE_BUFFER_H_INCLUDED
+#define TRIPLE_BUFFER_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+
+namespace effort_controller_base {
+
+/**
+ * @brief Lock-free single-producer/single-consumer latest-value buffer
+ *
+ * The producer fills \ref writeBuffer and calls \ref publish.  The consumer
+ * calls \ref update and then reads \ref readBuffer.  Neither side ever waits
+ * for the other, and the consumer always sees the most recently published
+ * value.  Intermediate values may be skipped.  Concurrent calls to
+ * \ref publish corrupt the buffer, so that values from two callbacks that
+ * may run concurrently need a buffer each.
+ *
+ * T should have a fixed size so that copies do not allocate.
+ */
+template <class T>
+class TripleBuffer {
+ public:
+  TripleBuffer() = default;
+
+  /**
+   * @brief Set all three slots to the given value.  Not thread-safe.
+   */
+  void init(const T &value) {
+    for (auto &buffer : m_buffers) {
+      buffer = value;
+    }
+    m_write_index = 0;
+    m_shared.store(1, std::memory_order_relaxed);
+    m_read_index = 2;
+  }
+
+  /**
+   * @brief The slot the producer may write into
+   */
+  T &writeBuffer() { return m_buffers[m_write_index]; }
+
+  /**
+   * @brief Hand the write slot over to the consumer (producer side)
+   */
+  void publish() {
+    const uint8_t previous =
+        m_shared.exchange(static_cast<uint8_t>(m_write_index | s_fresh),
+                          std::memory_order_acq_rel);
+    m_write_index = previous & s_index_mask;
+  }
+
+  /**
+   * @brief Convenience to copy and publish a value (producer side)
+   */
+  void write(const T &value) {
+    writeBuffer() = value;
+    publish();
+  }
+
+  /**
+   * @brief Fetch the latest published value, if any (consumer side)
+   *
+   * @return True if a new value was published since the last call
+   */
+  bool update() {
+    if (!(m_shared.load(std::memory_order_relaxed) & s_fresh)) {
+      return false;
+    }
+    const uint8_t previous = m_shared.exchange(
+        static_cast<uint8_t>(m_read_index), std::memory_order_acq_rel);
+    m_read_index = previous & s_index_mask;
+    return true;
+  }
+
+  /**
+   * @brief The latest value fetched with \ref update (consumer side)
+   */
+  const T &readBuffer() const { return m_buffers[m_read_index]; }
+
+ private:
+  static constexpr uint8_t s_fresh = 0x4;
+  static constexpr uint8_t s_index_mask = 0x3;
+
+  T m_buffers[3];
+  uint8_t m_write_index = 0;            // Producer only
+  std::atomic<uint8_t> m_shared = {1};  // Index of the spare slot | s_fresh
+  uint8_t m_read_index = 2;             // Consumer only
+};
+
+}  // namespace effort_controller_base
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef VIRTUAL_FIXTURES_H_INCLUDED
+#define VIRTUAL_FIXTURES_H_INCLUDED
+
+#include <effort_controller_base/RobotModel.h>
+#include <effort_controller_base/Utility.h>
+
+#include <Eigen/Geometry>
+#include <kdl/frames.hpp>
+#include <kdl/jacobian.hpp>
+#include <string>
+#include <vector>
+
+namespace effort_controller_base {
+
+/**
+ * @brief Walls around the workspace and around fixtures in it
+ *
+ * Links are approximated by spheres around their origins.  A sphere that
+ * penetrates a fixture by p is pushed out along the fixture's surface normal
+ * n with
+ *
+ *   F = max(0, k p - D n^T v),   tau = J_v^T F
+ *
+ * where v is the velocity of the link origin and J_v the linear part of the
+ * link Jacobian.  Fixtures are
+ *
+ * - planes, which keep links on the side their z axis points to,
+ * - boxes, which keep links either inside, e.g. a work cell, or outside,
+ * - cylinders along their z axis, which keep links outside,
+ * - triangle meshes, which keep links away from their surface.
+ *
+ * Planes and the walls of inside boxes are unbounded and checked one by one.
+ * All other primitives, including each mesh triangle, are sorted into an
+ * axis-aligned bounding box hierarchy once in \ref init, so that a query
+ * only visits the primitives near the link.  Of the primitives of one
+ * fixture, only the deepest contact counts, so that adjacent mesh triangles
+ * do not push twice.
+ */
+class VirtualFixtures {
+ public:
+  enum class Type { Plane, Box, Cylinder, Mesh };
+
+  struct Fixture {
+    Type type;
+    KDL::Frame pose;  // In the robot base frame
+    // Box: edge lengths.  Cylinder: radius, length.  Mesh: scale.
+    KDL::Vector size;
+    bool inside;  // Box only: keep links inside
+    std::vector<KDL::Vector> vertices;  // Mesh only: three per triangle
+  };
+
+  struct Settings {
+    double stiffness;  // k in N/m
+    double damping;    // D in Ns/m
+  };
+
+  /**
+   * @brief Read the triangles of a binary or ASCII STL file
+   *
+   * @param filename The file name, optionally prefixed with file://
+   * @param vertices Three vertices per triangle, appended to
+   * @param error The reason for failure
+   *
+   * @return False if the file cannot be read
+   */
+  static bool loadStl(const std::string &filename,
+                      std::vector<KDL::Vector> &vertices, std::string &error);
+
+  /**
+   * @brief Build the bounding volume hierarchy and preallocate all buffers.
+   * Not real-time safe.
+   *
+   * @param fixtures The fixtures in the robot base frame
+   * @param links The link ids to keep out of the fixtures
+   * @param radii The sphere radius of each link
+   * @param joints The number of joints
+   * @param settings The wall settings
+   */
+  void init(const std::vector<Fixture> &fixtures, const std::vector<int> &links,
+            const std::vector<double> &radii, size_t joints,
+            const Settings &settings);
+
+  /**
+   * @brief Compute the wall torques of the current cycle
+   *
+   * Link Jacobians are only computed for links in contact.  Does not
+   * allocate.
+   *
+   * @param model The robot model of the current cycle
+   * @param q_dot The joint velocities
+   * @param tau The wall joint torques
+   */
+  void update(const RobotModel &model, const ctrl::VectorND &q_dot,
+              ctrl::VectorND &tau);
+
+  /**
+   * @brief Wall wrench on link k of \ref init in the last cycle
+   *
+   * In the robot base frame with the link origin as reference point.
+   */
+  const ctrl::Vector6D &wrench(size_t k) const { return m_wrenches[k]; }
+
+  /**
+   * @brief Deepest penetration of the last cycle, zero without contact
+   */
+  double maximumPenetration() const { return m_maximum_penetration; }
+
+  /**
+   * @brief Number of contacts of the last cycle
+   */
+  size_t contacts() const { return m_contacts; }
+
+  /**
+   * @brief Number of bounded primitives in the hierarchy
+   */
+  size_t primitives() const { return m_primitives.size(); }
+
+ private:
+  struct HalfSpace {
+    ctrl::Vector3D normal;  // Towards the allowed side
+    double offset;
+    int slot;
+  };
+
+  struct Primitive {
+    Type type;
+    int slot;
+    ctrl::Matrix3D rotation;  // Box and cylinder frame in the base frame
+    ctrl::Vector3D origin;
+    ctrl::Vector3D a, b, c;  // Triangle corners, or box and cylinder sizes
+  };
+
+  struct Node {
+    Eigen::AlignedBox3d bounds;
+    int left;  // Child nodes, -1 for leaves
+    int right;
+    int first;  // Primitives of leaves
+    int count;
+  };
+
+  /**
+   * @brief Sort a range of primitives into a subtree
+   *
+   * @return The id of the subtree's root node
+   */
+  int build(int first, int count, std::vector<Eigen::AlignedBox3d> &bounds);
+
+  /**
+   * @brief Signed distance from the surface, positive on the allowed side
+   */
+  static double distance(const Primitive &primitive,
+                         const ctrl::Vector3D &point, ctrl::Vector3D &normal);
+
+  /**
+   * @brief Keep the deeper contact of a slot
+   */
+  void addContact(int slot, double penetration, const ctrl::Vector3D &normal);
+
+  Settings m_settings;
+  std::vector<HalfSpace> m_half_spaces;
+  std::vector<Primitive> m_primitives;
+  std::vector<Node> m_nodes;
+
+  std::vector<int> m_links;
+  std::vector<double> m_radii;
+  std::vector<ctrl::Vector6D> m_wrenches;
+
+  // Deepest contact of each slot for the current link
+  std::vector<double> m_slot_penetrations;
+  std::vector<ctrl::Vector3D> m_slot_normals;
+  std::vector<int> m_touched_slots;
+
+  KDL::Jacobian m_jacobian;
+  double m_maximum_penetration = 0.0;
+  size_t m_contacts = 0;
+};
+
+}  // namespace effort_controller_base
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef WORKER_POOL_H_INCLUDED
+#define WORKER_POOL_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace effort_controller_base {
+
+/**
+ * @brief A small pool of threads that runs independent jobs within a cycle
+ *
+ * \ref run executes jobs 0 to count - 1 on the worker threads and the calling
+ * thread and returns once all of them are done, so that the call is a
+ * barrier.  Jobs are assigned statically: job k runs on thread k modulo the
+ * number of threads, with the calling thread first.  Thus each job always
+ * runs on the same thread and core and no job is ever claimed twice.
+ *
+ * \ref run hands a job over by advancing an atomic generation counter and
+ * never takes a lock, so that the calling control loop cannot block on a
+ * worker.  Idle workers poll the counter for a bounded number of rounds and
+ * then sleep on it with a futex, which \ref run only wakes if a worker is
+ * asleep.  With busy waiting, they poll on their pinned cores indefinitely
+ * for the lowest wake-up latency.
+ */
+class WorkerPool {
+ public:
+  using Job = std::function<void(size_t)>;
+
+  WorkerPool() = default;
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+  ~WorkerPool() { stop(); }
+
+  /**
+   * @brief Start the worker threads.  Not real-time safe.
+   *
+   * @param threads The number of worker threads besides the calling thread
+   * @param cpus Worker i is pinned to cpus[i], if given
+   * @param priority SCHED_FIFO priority of the workers, 0 to inherit
+   * @param busy_wait Whether idle workers poll instead of blocking
+   *
+   * @return False if pinning or the priority could not be applied.  The
+   * workers run regardless.
+   */
+  bool start(size_t threads, const std::vector<int> &cpus, int priority,
+             bool busy_wait);
+
+  /**
+   * @brief Stop and join the worker threads.  Not real-time safe.
+   */
+  void stop();
+
+  /**
+   * @brief The number of worker threads besides the calling thread
+   */
+  size_t threads() const { return m_threads.size(); }
+
+  /**
+   * @brief Run job(0) ... job(count - 1) and wait until all are done
+   *
+   * Does not allocate.  The job must outlive the call.
+   */
+  void run(size_t count, const Job &job);
+
+ private:
+  void work(size_t first, uint32_t seen);
+
+  /**
+   * @brief Wait until the generation differs from seen
+   */
+  void wait(uint32_t seen);
+
+  /**
+   * @brief Advance the generation and wake sleeping workers
+   */
+  void advance();
+
+  std::vector<std::thread> m_threads;
+  size_t m_stride = 1;  // Threads including the calling one
+  bool m_busy_wait = false;
+  std::atomic<bool> m_stopping = {false};
+
+  // Written by run before the generation is advanced
+  const Job *m_job = nullptr;
+  size_t m_count = 0;
+
+  // 32 bits, the size of a futex word
+  std::atomic<uint32_t> m_generation = {0};
+  std::atomic<size_t> m_sleepers = {0};
+  std::atomic<size_t> m_pending = {0};
+};
+
+}  // namespace effort_controller_base
+
+#endif
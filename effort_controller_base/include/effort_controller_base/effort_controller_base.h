@@ -1,11 +1,27 @@
 #ifndef EFFORT_CONTROLLER_BASE_H_INCLUDED
 #define EFFORT_CONTROLLER_BASE_H_INCLUDED
 
+#include <effort_controller_base/Arm.h>
+#include <effort_controller_base/BoxQP.h>
+#include <effort_controller_base/EnergyTank.h>
+#include <effort_controller_base/Filter.h>
+#include <effort_controller_base/JointLimitRepulsion.h>
+#include <effort_controller_base/JointStateEstimator.h>
+#include <effort_controller_base/MomentumObserver.h>
+#include <effort_controller_base/RobotModel.h>
+#include <effort_controller_base/SelfCollision.h>
+#include <effort_controller_base/Telemetry.h>
+#include <effort_controller_base/TorqueSaturation.h>
+#include <effort_controller_base/TreeModel.h>
+#include <effort_controller_base/TripleBuffer.h>
 #include <effort_controller_base/Utility.h>
+#include <effort_controller_base/VirtualFixtures.h>
+#include <effort_controller_base/WorkerPool.h>
 #include <urdf/model.h>
 #include <urdf_model/joint.h>
 
 #include <cmath>
+#include <cstdint>
 #include <controller_interface/controller_interface.hpp>
 #include <functional>
 #include <geometry_msgs/msg/wrench_stamped.hpp>
@@ -23,13 +39,13 @@
 #include <kdl/jntarray.hpp>
 #include <kdl/solveri.hpp>
 #include <kdl/tree.hpp>
-#include <kdl/treefksolverpos_recursive.hpp>
 #include <kdl_parser/kdl_parser.hpp>
 #include <memory>
 #include <pluginlib/class_loader.hpp>
 #include <rclcpp/rclcpp.hpp>
 #include <string>
 #include <trajectory_msgs/msg/joint_trajectory_point.hpp>
+#include <unordered_map>
 #include <vector>
 
 #include "controller_interface/controller_interface.hpp"
@@ -96,17 +112,45 @@ class EffortControllerBase : public controller_interface::ControllerInterface {
   /**
    * @brief Compute one control step using forward dynamics simulation
    *
-   * Check \ref ForwardDynamicsSolver for details.
+   * Check \ref ForwardDynamicsSolver for details.  The torques are saturated
+   * according to `saturation.policy`, see \ref saturateTorques.
    *
    * @param error The error to minimize
    * @param period The period for this control cycle
    */
   void computeJointEffortCmds(const ctrl::VectorND &error);
 
+  /**
+   * @brief Compute one control step with a lower priority share
+   *
+   * Like \ref computeJointEffortCmds, but the `priority` saturation policy
+   * gives way in the secondary torques, e.g. the nullspace torques, first.
+   *
+   * @param tau The commanded torques, including the secondary torques
+   * @param secondary The secondary share of tau
+   */
+  void computeJointEffortCmds(const ctrl::VectorND &tau,
+                              const ctrl::VectorND &secondary);
+
   /**
    * @brief Display the given vector in the given robot base link
    *
    * @param vector The quantity to transform
+   * @param from The link id, see \ref linkId, of the reference frame where the
+   * quantity was formulated
+   *
+   * @return The quantity in the robot base frame
+   */
+  ctrl::Vector6D displayInBaseLink(const ctrl::Vector6D &vector,
+                                   int from) const;
+
+  /**
+   * @brief Display the given vector in the given robot base link
+   *
+   * Convenience overload that resolves the link name.  Prefer the link id
+   * version in the control loop.
+   *
+   * @param vector The quantity to transform
    * @param from The reference frame where the quantity was formulated
    *
    * @return The quantity in the robot base frame
@@ -114,6 +158,18 @@ class EffortControllerBase : public controller_interface::ControllerInterface {
   ctrl::Vector6D displayInBaseLink(const ctrl::Vector6D &vector,
                                    const std::string &from);
 
+  /**
+   * @brief Display the given tensor in the robot base frame
+   *
+   * @param tensor The quantity to transform
+   * @param from The link id of the reference frame where the quantity was
+   * formulated
+   *
+   * @return The quantity in the robot base frame
+   */
+  ctrl::Matrix6D displayInBaseLink(const ctrl::Matrix6D &tensor,
+                                   int from) const;
+
   /**
    * @brief Display the given tensor in the robot base frame
    *
@@ -125,6 +181,35 @@ class EffortControllerBase : public controller_interface::ControllerInterface {
   ctrl::Matrix6D displayInBaseLink(const ctrl::Matrix6D &tensor,
                                    const std::string &from);
 
+  /**
+   * @brief Display the given tensor in a frame rotated by R
+   *
+   * All four 3x3 blocks are rotated, so that coupling between translation and
+   * rotation is preserved.  Use this to rotate several tensors with a single
+   * rotation.
+   *
+   * @param tensor The quantity to transform
+   * @param R The rotation from the frame where the quantity was formulated to
+   * the new frame
+   *
+   * @return The quantity in the new frame
+   */
+  static ctrl::Matrix6D rotateTensor(const ctrl::Matrix6D &tensor,
+                                     const ctrl::Matrix3D &R);
+
+  /**
+   * @brief Display a given vector in a new reference frame
+   *
+   * The vector is assumed to be given in the robot base frame.
+   *
+   * @param vector The quantity to transform
+   * @param to The link id of the reference frame in which to formulate the
+   * quantity
+   *
+   * @return The quantity in the new frame
+   */
+  ctrl::Vector6D displayInTipLink(const ctrl::Vector6D &vector, int to) const;
+
   /**
    * @brief Display a given vector in a new reference frame
    *
@@ -138,8 +223,83 @@ class EffortControllerBase : public controller_interface::ControllerInterface {
   ctrl::Vector6D displayInTipLink(const ctrl::Vector6D &vector,
                                   const std::string &to);
 
+  /**
+   * @brief Resolve a link name to its id in the per-cycle robot model
+   *
+   * The robot base link has id 0.  Each segment of the robot chain has the id
+   * of its index plus one.  Resolve names at configure time and use the ids in
+   * the control loop.
+   *
+   * @param name The link name
+   *
+   * @return The link id or -1 if the link is not part of the robot chain
+   */
+  int linkId(const std::string &name) const { return m_model.linkId(name); }
+
+  /**
+   * @brief Pose of the given link in the robot base frame
+   *
+   * Computed at most once per cycle, see \ref RobotModel.
+   *
+   * @param id The link id, see \ref linkId
+   */
+  const KDL::Frame &linkPose(int id) const { return m_model.linkPoses()[id]; }
+
+  /**
+   * @brief Read the joint states and invalidate the per-cycle robot model
+   *
+   * With `state_estimator.type` set, the joint positions and velocities are
+   * replaced by their estimates.  Also updates \ref
+   * m_joint_accelerations, \ref m_filtered_joint_velocities and, if enabled,
+   * the external torque observer.  With \ref m_arms, hands each arm its share
+   * of the joint state and invalidates the arm models and the tree model
+   * instead.
+   */
   void updateJointStates();
 
+  /**
+   * @brief Whether the controller drives several arms
+   *
+   * Controllers that support the `arms` parameter override this.  All other
+   * controllers reject it at configure time.
+   */
+  virtual bool supportsArms() const { return false; }
+
+  /**
+   * @brief Validate runtime changes of the controller's own parameters
+   *
+   * Called outside the control loop with the parameters about to change.
+   * Controllers that hot-reload parameters override this to build a complete
+   * snapshot of them, without handing it to the control loop yet.
+   *
+   * @param parameters The changed parameters
+   * @param reason The reason for rejecting the change
+   *
+   * @return False to reject the whole change
+   */
+  virtual bool stageParameters(const std::vector<rclcpp::Parameter> &parameters,
+                               std::string &reason) {
+    return true;
+  }
+
+  /**
+   * @brief Hand the snapshot of \ref stageParameters to the control loop
+   *
+   * Called once the whole change was accepted.
+   */
+  virtual void publishParameters() {}
+
+  /**
+   * @brief Run job(k) for each arm k in parallel and wait until all are done
+   *
+   * The jobs run on the worker pool configured with `arm_pool.*` and the
+   * calling thread, so that the call takes as long as the slowest arm.  Jobs
+   * must only touch the state of their own arm.  Of \ref m_tree_model, they
+   * may only evaluate their own end effector's Jacobian, and only once the
+   * link poses are evaluated.  Does not allocate.
+   */
+  void forEachArm(const WorkerPool::Job &job);
+
   /**
    * @brief Check if specified links are part of the robot chain
    *
@@ -171,14 +331,37 @@ class EffortControllerBase : public controller_interface::ControllerInterface {
                          ctrl::VectorND &simulated_joint_positions);
 
   KDL::Chain m_robot_chain;
-  KDL::Jacobian m_jacobian;  // Jacobian
 
-  std::shared_ptr<KDL::ChainJntToJacSolver> m_jnt_to_jac_solver;
-  std::shared_ptr<KDL::TreeFkSolverPos_recursive> m_forward_kinematics_solver;
+  /**
+   * @brief The arms configured with `arms`, empty for a single chain
+   *
+   * Each arm is a chain from robot_base_link to its own end effector with its
+   * own \ref RobotModel for the chain's kinematics.  Arms may share the joints
+   * of a common trunk, e.g. a torso.  Together, the arms cover all joints of
+   * the controller.  m_robot_chain and m_model are not used then.
+   */
+  std::vector<std::unique_ptr<Arm>> m_arms;
+
+  /**
+   * @brief Lazily evaluated kinematics and dynamics of the current cycle
+   *
+   * Link poses, Jacobian, pseudo-inverse, mass matrix, gravity and Coriolis
+   * torques are computed on first use after \ref updateJointStates.
+   */
+  RobotModel m_model;
+
+  /**
+   * @brief Lazily evaluated kinematics and dynamics of the whole robot tree
+   *
+   * Only set up with \ref m_arms.  Has one end effector per arm.  The arms'
+   * chain models do not know about each other, so that the dynamics of
+   * shared joints must come from here.
+   */
+  TreeModel m_tree_model;
+
   std::shared_ptr<KDL::ChainFkSolverPos_recursive> m_fk_solver;
   std::shared_ptr<KDL::ChainIkSolverPos_NR_JL> m_ik_solver;
   std::shared_ptr<KDL::ChainIkSolverVel_pinv> m_ik_solver_vel;
-  std::shared_ptr<KDL::ChainDynParam> m_dyn_solver;
 
   /**
    * @brief Allow users to choose the IK solver type on startup
@@ -192,6 +375,7 @@ class EffortControllerBase : public controller_interface::ControllerInterface {
   std::string m_robot_base_link;
   bool m_compensate_gravity;
   bool m_compensate_coriolis;
+  bool m_hardware_compensates_gravity;
   std::vector<std::reference_wrapper<hardware_interface::LoanedStateInterface>>
       m_joint_state_pos_handles;
   std::vector<std::reference_wrapper<hardware_interface::LoanedStateInterface>>
@@ -199,10 +383,112 @@ class EffortControllerBase : public controller_interface::ControllerInterface {
 
   size_t m_joint_number;
 
+  // Link ids of frequently used links
+  int m_end_effector_link_id;
+  int m_compliance_ref_link_id;
+
   KDL::JntArray m_joint_positions;
   KDL::JntArray m_joint_velocities;
+
+  // Estimated joint accelerations, zero without state estimator
+  KDL::JntArray m_joint_accelerations;
+
+  /**
+   * @brief Joint velocities filtered as configured with `velocity_filter.*`
+   *
+   * Use these for damping terms.  The robot model uses the raw velocities.
+   */
+  ctrl::VectorND m_filtered_joint_velocities;
+
+  // Joint position limits from the URDF, NaN for continuous joints
+  KDL::JntArray m_joint_lower_limits;
+  KDL::JntArray m_joint_upper_limits;
+  KDL::JntArray m_joint_velocity_limits;  // NaN for unlimited joints
   KDL::JntArray m_simulated_joint_motion;
 
+  /**
+   * @brief Output of the external torque observer
+   *
+   * External joint torques and the equivalent wrench at the end effector in
+   * the robot base frame, both acting on the robot.  Zero unless
+   * `external_torque_observer.enabled`.  m_contact is set while any external
+   * joint torque exceeds `external_torque_observer.contact_threshold` and
+   * released below half of it.
+   */
+  bool m_external_torque_observer_enabled = {false};
+  ctrl::VectorND m_external_torques;
+  ctrl::Vector6D m_external_wrench;
+  bool m_contact = {false};
+
+  /**
+   * @brief Wrench measured by the force/torque sensor, acting on the robot
+   *
+   * Read from the `force.*` and `torque.*` state interfaces of the sensor
+   * `ft_sensor.name` in each cycle.  Compensated for bias and tool gravity,
+   * filtered, displayed in the robot base frame and with the end effector as
+   * reference point.  With a sensor, m_contact is detected from the measured
+   * force instead of the observer.  Zero without sensor.
+   */
+  bool m_ft_sensor_enabled = {false};
+  ctrl::Vector6D m_ft_sensor_wrench;
+
+  /**
+   * @brief Joint torques that push the robot's links apart
+   *
+   * Computed in each cycle from the capsules of the links' URDF collision
+   * geometry, see \ref SelfCollision.  Controllers add them in the nullspace
+   * of their task.  Zero unless `self_collision.enabled`.
+   */
+  bool m_self_collision_enabled = {false};
+  ctrl::VectorND m_self_collision_torque;
+
+  /**
+   * @brief Joint torques that keep the joints away from their limits
+   *
+   * Repulsion near the URDF position limits and damping near the velocity
+   * limits, see \ref JointLimitRepulsion.  Controllers add them in the
+   * nullspace of their task.  Zero unless `joint_limit_avoidance.enabled`.
+   */
+  bool m_joint_limit_avoidance_enabled = {false};
+  ctrl::VectorND m_joint_limit_torque;
+
+  /**
+   * @brief Joint torques that keep links out of the virtual fixtures
+   *
+   * Walls of the work cell and of the fixtures in it, see \ref
+   * VirtualFixtures.  Controllers add them to their command, outside the
+   * nullspace, since walls take precedence over the task.  Zero unless
+   * `virtual_fixtures.names` is set.
+   */
+  bool m_virtual_fixtures_enabled = {false};
+  ctrl::VectorND m_virtual_fixture_torque;
+
+  /**
+   * @brief Scale the non-passive torques of this cycle with the energy tank
+   *
+   * Books the energy the controller dissipated over the last cycle and the
+   * energy its non-passive components, such as stiffness increases and
+   * wrench feedforward, would inject in this cycle, see \ref EnergyTank.
+   * Call at most once per cycle.
+   *
+   * @param dissipated The dissipated energy in J
+   * @param injected The energy to inject at full scale in J, negative if it
+   * is extracted
+   *
+   * @return The scale in [0, 1] for the non-passive components, always 1
+   * unless `energy_tank.enabled`
+   */
+  double passivityScale(double dissipated, double injected);
+  bool m_energy_tank_enabled = {false};
+
+  /**
+   * @brief Controller signals published on the telemetry topic
+   *
+   * Child controllers register their channels in on_configure and call
+   * Telemetry::publish at the end of each update.
+   */
+  Telemetry m_telemetry;
+
  private:
   std::vector<std::string> m_cmd_interface_types;
   std::vector<std::string> m_state_interface_types;
@@ -213,6 +499,92 @@ class EffortControllerBase : public controller_interface::ControllerInterface {
       std::reference_wrapper<hardware_interface::LoanedCommandInterface>>
       m_joint_cmd_pos_handles;
 
+  /**
+   * @brief Find the feasible torques closest to the commanded ones
+   *
+   * Solves
+   *
+   *   min 1/2 |P (tau - tau_d)|^2 + r/2 |tau - tau_d|^2
+   *
+   * subject to the effort limits, the effort rate limit around the last
+   * command and the torques that keep the joints within their position and
+   * velocity limits in the next cycle.  P is the pseudo-inverse of J^T, so
+   * that saturation preserves the commanded end effector wrench as far as
+   * possible.  The nullspace share of tau - secondary, which carries the
+   * self-collision and joint limit avoidance, is added to the Hessian as a
+   * rank one term weighted like the whole wrench, so that only the secondary
+   * task gives way cheaply in the nullspace.  The joint limits are
+   * mapped to torques with the diagonal of the mass matrix and the model bias.
+   * A bound that contradicts the bounds before it, in the order effort limits,
+   * joint limits, rate limit, is clamped to their nearest end, so that the
+   * effort limits always hold and the joint limits take precedence over the
+   * rate limit, see \ref torqueBounds.  The number of such conflicts is
+   * published as telemetry.
+   *
+   * @param tau The commanded torques tau_d
+   * @param secondary The share of tau that may give way in the nullspace, or
+   * nullptr
+   */
+  void resolveTorqueQP(const ctrl::VectorND &tau,
+                       const ctrl::VectorND *secondary);
+
+  /**
+   * @brief Saturate the commanded torques to the effort and rate limits
+   *
+   * The torques are kept within the effort limits and within the rate limits
+   * around the last command.  Depending on `saturation.policy`, they are
+   *
+   * - clip: clamped per joint, the Euclidean projection onto the limits,
+   * - scale: moved from the last command towards tau as far as the limits
+   *   allow, which preserves the direction of the change,
+   * - priority: scaled like `scale`, but the secondary torques are scaled
+   *   down to zero before the rest is,
+   * - qp: projected in the wrench metric, see \ref resolveTorqueQP.
+   *
+   * Saturated joints are counted in the telemetry instead of logged.
+   *
+   * @param tau The commanded torques
+   * @param secondary The secondary share of tau, nullptr if none
+   */
+  void saturateTorques(const ctrl::VectorND &tau,
+                       const ctrl::VectorND *secondary);
+
+  /**
+   * @brief Advance the external torque observer with the current joint state
+   */
+  void updateExternalTorques();
+
+  /**
+   * @brief Joint torques the command works against, C q_dot + g
+   *
+   * Gravity is left out with `hardware_compensates_gravity`, since the
+   * hardware then adds it to the command.  Coriolis torques are always
+   * included, whether or not the controllers compensate them.
+   *
+   * @return The torques, evaluated with the current robot model
+   */
+  const ctrl::VectorND &modelBias();
+
+  /**
+   * @brief Read and compensate the force/torque sensor
+   */
+  void updateFtSensor();
+
+  /**
+   * @brief Compute the self-collision torques of the current cycle
+   */
+  void updateSelfCollision();
+
+  /**
+   * @brief Compute the virtual fixture torques of the current cycle
+   */
+  void updateVirtualFixtures();
+
+  /**
+   * @brief Update m_contact from a magnitude, with hysteresis
+   */
+  void detectContact(double magnitude, double threshold);
+
   std::vector<std::string> m_joint_names;
   ctrl::VectorND m_efforts;
   std::string m_controller_name;
@@ -225,10 +597,132 @@ class EffortControllerBase : public controller_interface::ControllerInterface {
   // Dynamic parameters
   std::string m_robot_description;
 
-  // Effort limits
+  // Background dynamics
+  bool m_dynamics_worker_enabled = {false};
+  size_t m_dynamics_age_channel;
+  size_t m_dynamics_fallbacks_channel;
+
+  // Effort limits, NaN if unlimited in the URDF
   KDL::JntArray m_joint_effort_limits;
   double m_delta_tau_max;
 
+  // Joint state estimator
+  enum class EstimatorType { None, Kalman, Model };
+  EstimatorType m_estimator_type = {EstimatorType::None};
+  JointStateEstimator m_estimator;
+  ctrl::VectorND m_model_acceleration;
+  bool m_reset_estimator = {true};
+
+  // External torque observer
+  MomentumObserver m_momentum_observer;
+  ctrl::VectorND m_observer_torque;
+  ctrl::VectorND m_model_bias;
+  double m_contact_threshold;
+  double m_period;
+  bool m_reset_momentum_observer = {true};
+  size_t m_contact_channel;
+  size_t m_external_force_channel;
+
+  // Force/torque sensor
+  std::string m_ft_sensor_name;
+  int m_ft_sensor_link_id;
+  std::vector<std::reference_wrapper<hardware_interface::LoanedStateInterface>>
+      m_ft_sensor_handles;
+  ctrl::Vector6D m_ft_sensor_bias;
+  ctrl::Vector6D m_ft_sensor_measurement;
+  double m_ft_tool_mass;
+  KDL::Vector m_ft_tool_center_of_mass;
+  bool m_ft_zero_on_activate;
+  bool m_reset_ft_sensor = {true};
+  double m_ft_contact_threshold;
+  std::unique_ptr<ChannelFilter> m_ft_filter;
+  size_t m_ft_force_channel;
+
+  // Self-collision avoidance
+  SelfCollision m_self_collision;
+  size_t m_self_collision_distance_channel;
+  size_t m_self_collision_pairs_channel;
+  size_t m_self_collision_time_channel;
+
+  // Joint limit avoidance
+  JointLimitRepulsion m_joint_limit_repulsion;
+  size_t m_joint_limit_activation_channel;
+
+  // Virtual fixtures
+  VirtualFixtures m_virtual_fixtures;
+  size_t m_virtual_fixture_penetration_channel;
+  size_t m_virtual_fixture_contacts_channel;
+  size_t m_virtual_fixture_time_channel;
+
+  // Energy tank
+  EnergyTank m_energy_tank;
+  size_t m_energy_tank_energy_channel;
+  size_t m_energy_tank_scale_channel;
+
+  // Multiple arms
+  WorkerPool m_arm_pool;
+  size_t m_arm_threads;
+  std::vector<int> m_arm_cpus;
+  int m_arm_priority;
+  bool m_arm_busy_wait;
+  const WorkerPool::Job *m_arm_job = nullptr;
+  WorkerPool::Job m_timed_arm_job;  // Runs m_arm_job and times it
+  double m_arms_time = 0.0;
+  size_t m_arms_time_channel;
+  std::vector<size_t> m_arm_time_channels;
+
+  // Joint velocity filter, nullptr if unfiltered
+  std::unique_ptr<ChannelFilter> m_velocity_filter;
+  bool m_reset_velocity_filter = {true};
+
+  /**
+   * @brief Validate parameter changes and hand accepted ones to the control
+   * loop.  Runs in the parameter service, outside the control loop.
+   */
+  rcl_interfaces::msg::SetParametersResult
+  onSetParameters(const std::vector<rclcpp::Parameter> &parameters);
+
+  /**
+   * Parameters that can be changed at runtime.  Complete snapshots are handed
+   * to the control loop without locks and taken over at the start of
+   * \ref updateJointStates.
+   */
+  struct RuntimeParameters {
+    double delta_tau_max;
+    bool compensate_gravity;
+    bool compensate_coriolis;
+  };
+  TripleBuffer<RuntimeParameters> m_runtime_parameters;
+  RuntimeParameters m_staged_parameters;  // Parameter callback only
+  bool m_uniform_rate_limits;             // Rate limits from delta_tau_max
+  rclcpp::node_interfaces::OnSetParametersCallbackHandle::SharedPtr
+      m_parameter_callback;
+
+  // Torque saturation
+  enum class SaturationPolicy { Clip, Scale, Priority, QP };
+  SaturationPolicy m_saturation_policy = {SaturationPolicy::Clip};
+  Eigen::ArrayXd m_rate_limits;
+  Eigen::ArrayXd m_effort_limits;  // Infinite if unlimited
+  Eigen::ArrayXd m_saturation_lower;
+  Eigen::ArrayXd m_saturation_upper;
+  uint64_t m_saturation_cycles = {0};
+  size_t m_saturated_joints_channel;
+  size_t m_saturation_cycles_channel;
+  size_t m_saturation_scale_channel;
+  size_t m_saturation_secondary_scale_channel;
+  BoxQP<> m_qp;
+  BoxQP<>::Matrix m_qp_hessian;
+  BoxQP<>::Vector m_qp_gradient;
+  BoxQP<>::Vector m_qp_lower;
+  BoxQP<>::Vector m_qp_upper;
+  BoxQP<>::Vector m_qp_solution;
+  ctrl::VectorND m_qp_protected;
+  ctrl::Vector6D m_qp_wrench;
+  double m_qp_regularization;
+  size_t m_qp_time_channel;
+  size_t m_qp_iterations_channel;
+  size_t m_qp_conflicts_channel;
+
   bool m_kuka_hw;
 };
 
@@ -0,0 +1,181 @@
+#include <effort_controller_base/DynamicsWorker.h>
+
+#include <chrono>
+
+namespace effort_controller_base {
+
+void DynamicsWorker::init(const KDL::Chain &chain, const KDL::Vector &gravity,
+                          double rate, double max_staleness) {
+  stop();
+
+  const unsigned int n = chain.getNrOfJoints();
+  m_dyn_solver.reset(new KDL::ChainDynParam(chain, gravity));
+  m_q.resize(n);
+  m_q_dot.resize(n);
+  m_tau.resize(n);
+  m_tau_plus.resize(n);
+  m_tau_minus.resize(n);
+  m_mass.resize(n);
+  m_mass_plus.resize(n);
+  m_mass_minus.resize(n);
+  m_period = 1.0 / rate;
+  m_max_staleness = max_staleness;
+
+  JointState state;
+  state.q = ctrl::VectorND::Zero(n);
+  state.q_dot = ctrl::VectorND::Zero(n);
+  m_joint_state.init(state);
+
+  Dynamics dynamics;
+  dynamics.q = ctrl::VectorND::Zero(n);
+  dynamics.gravity = ctrl::VectorND::Zero(n);
+  dynamics.gravity_jacobian = ctrl::MatrixND::Zero(n, n);
+  dynamics.coriolis_tensor = ctrl::MatrixND::Zero(n, n * n);
+  dynamics.mass = ctrl::MatrixND::Zero(n, n);
+  dynamics.mass_jacobian = ctrl::MatrixND::Zero(n * n, n);
+  m_dynamics.init(dynamics);
+
+  m_last_stamp = -1.0;
+  m_age = 0.0;
+  m_velocity_products = ctrl::VectorND::Zero(n * n);
+}
+
+void DynamicsWorker::start() {
+  if (m_running || !m_dyn_solver) {
+    return;
+  }
+  m_running = true;
+  m_thread = std::thread(&DynamicsWorker::run, this);
+}
+
+void DynamicsWorker::stop() {
+  m_running = false;
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+}
+
+double DynamicsWorker::now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void DynamicsWorker::setJointState(const KDL::JntArray &q,
+                                   const KDL::JntArray &q_dot) {
+  JointState &state = m_joint_state.writeBuffer();
+  state.q = q.data;
+  state.q_dot = q_dot.data;
+  state.stamp = now();
+  m_last_stamp = state.stamp;
+  m_joint_state.publish();
+}
+
+bool DynamicsWorker::fetch() {
+  m_dynamics.update();
+  const Dynamics &dynamics = m_dynamics.readBuffer();
+  if (dynamics.stamp < 0.0) {
+    return false;
+  }
+  m_age = m_last_stamp - dynamics.stamp;
+  return m_age <= m_max_staleness;
+}
+
+void DynamicsWorker::gravity(const KDL::JntArray &q, KDL::JntArray &gravity) {
+  const Dynamics &dynamics = m_dynamics.readBuffer();
+  gravity.data = dynamics.gravity;
+  gravity.data.noalias() += dynamics.gravity_jacobian * (q.data - dynamics.q);
+}
+
+void DynamicsWorker::coriolis(const KDL::JntArray &q_dot,
+                              KDL::JntArray &coriolis) {
+  const Dynamics &dynamics = m_dynamics.readBuffer();
+  const Eigen::Index n = q_dot.data.size();
+  Eigen::Map<ctrl::MatrixND>(m_velocity_products.data(), n, n).noalias() =
+      q_dot.data * q_dot.data.transpose();
+  coriolis.data.noalias() = dynamics.coriolis_tensor * m_velocity_products;
+}
+
+void DynamicsWorker::massMatrix(const KDL::JntArray &q,
+                                KDL::JntSpaceInertiaMatrix &mass) const {
+  const Dynamics &dynamics = m_dynamics.readBuffer();
+  const Eigen::Index n = q.data.size();
+  mass.data = dynamics.mass;
+  Eigen::Map<ctrl::VectorND>(mass.data.data(), n * n).noalias() +=
+      dynamics.mass_jacobian * (q.data - dynamics.q);
+}
+
+void DynamicsWorker::run() {
+  using Clock = std::chrono::steady_clock;
+  const auto period = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(m_period));
+  auto next = Clock::now();
+  while (m_running) {
+    next += period;
+    if (m_joint_state.update()) {
+      compute(m_joint_state.readBuffer(), m_dynamics.writeBuffer());
+      m_dynamics.publish();
+    }
+    std::this_thread::sleep_until(next);
+  }
+}
+
+void DynamicsWorker::compute(const JointState &state, Dynamics &dynamics) {
+  const unsigned int n = m_q.rows();
+  m_q.data = state.q;
+
+  // Gravity and its gradient by central differences
+  constexpr double h = 1e-6;
+  m_dyn_solver->JntToGravity(m_q, m_tau);
+  dynamics.gravity = m_tau.data;
+  for (unsigned int j = 0; j < n; ++j) {
+    m_q(j) = state.q(j) + h;
+    m_dyn_solver->JntToGravity(m_q, m_tau_plus);
+    m_q(j) = state.q(j) - h;
+    m_dyn_solver->JntToGravity(m_q, m_tau_minus);
+    m_q(j) = state.q(j);
+    dynamics.gravity_jacobian.col(j) =
+        (m_tau_plus.data - m_tau_minus.data) / (2 * h);
+  }
+
+  // C(q, q_dot) q_dot is a quadratic form in q_dot.  Recover its symmetric
+  // coefficients by polarization with unit velocities.
+  for (unsigned int i = 0; i < n; ++i) {
+    m_q_dot.data.setZero();
+    m_q_dot(i) = 1.0;
+    m_dyn_solver->JntToCoriolis(m_q, m_q_dot, m_tau);
+    dynamics.coriolis_tensor.col(i * n + i) = m_tau.data;
+  }
+  for (unsigned int i = 0; i < n; ++i) {
+    for (unsigned int j = i + 1; j < n; ++j) {
+      m_q_dot.data.setZero();
+      m_q_dot(i) = 1.0;
+      m_q_dot(j) = 1.0;
+      m_dyn_solver->JntToCoriolis(m_q, m_q_dot, m_tau);
+      m_tau.data -= dynamics.coriolis_tensor.col(i * n + i);
+      m_tau.data -= dynamics.coriolis_tensor.col(j * n + j);
+      dynamics.coriolis_tensor.col(i * n + j) = 0.5 * m_tau.data;
+      dynamics.coriolis_tensor.col(j * n + i) = 0.5 * m_tau.data;
+    }
+  }
+
+  // Mass matrix and its gradient by central differences
+  m_dyn_solver->JntToMass(m_q, m_mass);
+  dynamics.mass = m_mass.data;
+  for (unsigned int j = 0; j < n; ++j) {
+    m_q(j) = state.q(j) + h;
+    m_dyn_solver->JntToMass(m_q, m_mass_plus);
+    m_q(j) = state.q(j) - h;
+    m_dyn_solver->JntToMass(m_q, m_mass_minus);
+    m_q(j) = state.q(j);
+    m_mass_plus.data -= m_mass_minus.data;
+    dynamics.mass_jacobian.col(j) =
+        Eigen::Map<const ctrl::VectorND>(m_mass_plus.data.data(), n * n) /
+        (2 * h);
+  }
+
+  dynamics.q = state.q;
+  dynamics.stamp = state.stamp;
+}
+
+}  // namespace effort_controller_base
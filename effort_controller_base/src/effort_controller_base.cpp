@@ -1,7 +1,19 @@
 #include <effort_controller_base/effort_controller_base.h>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <limits>
+#include <sstream>
+
 namespace effort_controller_base {
 
+namespace {
+// Semantic state interfaces of force/torque sensors
+const std::array<std::string, 6> kFtSensorInterfaces = {
+    "force.x", "force.y", "force.z", "torque.x", "torque.y", "torque.z"};
+}  // namespace
+
 EffortControllerBase::EffortControllerBase() {}
 
 RobotDescriptionListener::RobotDescriptionListener(
@@ -49,6 +61,11 @@ EffortControllerBase::state_interface_configuration() const {
       conf.names.push_back(joint_name + std::string("/").append(type));
     }
   }
+  if (!m_ft_sensor_name.empty()) {
+    for (const auto &type : kFtSensorInterfaces) {
+      conf.names.push_back(m_ft_sensor_name + "/" + type);
+    }
+  }
   return conf;
 }
 
@@ -63,10 +80,76 @@ EffortControllerBase::on_init() {
     auto_declare<bool>("kuka_hw", false);
     auto_declare<bool>("compensate_gravity", false);
     auto_declare<bool>("compensate_coriolis", false);
+    auto_declare<bool>("hardware_compensates_gravity", false);
     auto_declare<double>("delta_tau_max", 1.0);
+    auto_declare<double>("telemetry.publish_rate", 50.0);
+    auto_declare<double>("dynamics.worker_rate", 0.0);
+    auto_declare<double>("dynamics.max_staleness", 0.01);
+    auto_declare<std::string>("state_estimator.type", "none");
+    auto_declare<double>("state_estimator.position_noise", 1e-4);
+    auto_declare<double>("state_estimator.velocity_noise", 1e-2);
+    auto_declare<double>("state_estimator.jerk_noise", 1e4);
+    auto_declare<bool>("external_torque_observer.enabled", false);
+    auto_declare<double>("external_torque_observer.gain", 50.0);
+    auto_declare<double>("external_torque_observer.contact_threshold", 5.0);
+    auto_declare<std::string>("ft_sensor.name", "");
+    auto_declare<std::string>("ft_sensor_ref_link", "");
+    auto_declare<std::vector<double>>("ft_sensor.bias",
+                                      std::vector<double>(6, 0.0));
+    auto_declare<bool>("ft_sensor.zero_on_activate", true);
+    auto_declare<double>("ft_sensor.tool_mass", 0.0);
+    auto_declare<std::vector<double>>("ft_sensor.tool_center_of_mass",
+                                      std::vector<double>(3, 0.0));
+    auto_declare<double>("ft_sensor.contact_threshold", 5.0);
+    auto_declare<std::string>("ft_sensor.filter.type", "none");
+    auto_declare<double>("ft_sensor.filter.cutoff", 100.0);
+    auto_declare<int>("ft_sensor.filter.order", 2);
+    auto_declare<int>("ft_sensor.filter.window", 5);
+    auto_declare<bool>("self_collision.enabled", false);
+    auto_declare<double>("self_collision.distance", 0.05);
+    auto_declare<double>("self_collision.stiffness", 500.0);
+    auto_declare<double>("self_collision.damping", 20.0);
+    auto_declare<int>("self_collision.ignore_adjacent", 1);
+    auto_declare<std::vector<std::string>>("self_collision.ignored_pairs",
+                                           std::vector<std::string>());
+    auto_declare<bool>("joint_limit_avoidance.enabled", false);
+    auto_declare<double>("joint_limit_avoidance.margin", 0.1);
+    auto_declare<double>("joint_limit_avoidance.stiffness", 20.0);
+    auto_declare<double>("joint_limit_avoidance.damping", 5.0);
+    auto_declare<double>("joint_limit_avoidance.velocity_ratio", 0.8);
+    auto_declare<double>("joint_limit_avoidance.velocity_damping", 5.0);
+    auto_declare<std::vector<std::string>>("virtual_fixtures.names",
+                                           std::vector<std::string>());
+    auto_declare<std::vector<std::string>>("virtual_fixtures.links",
+                                           std::vector<std::string>());
+    auto_declare<std::vector<double>>("virtual_fixtures.radii",
+                                      std::vector<double>());
+    auto_declare<double>("virtual_fixtures.stiffness", 2000.0);
+    auto_declare<double>("virtual_fixtures.damping", 50.0);
+    auto_declare<bool>("energy_tank.enabled", false);
+    auto_declare<double>("energy_tank.initial_energy", 5.0);
+    auto_declare<double>("energy_tank.minimum_energy", 0.5);
+    auto_declare<double>("energy_tank.maximum_energy", 10.0);
+    auto_declare<std::string>("velocity_filter.type", "ema");
+    auto_declare<double>("velocity_filter.cutoff", 50.0);
+    auto_declare<int>("velocity_filter.order", 2);
+    auto_declare<int>("velocity_filter.window", 9);
+    auto_declare<std::string>("saturation.policy", "clip");
+    auto_declare<std::vector<double>>("saturation.rate_limits",
+                                      std::vector<double>());
+    auto_declare<std::vector<double>>("saturation.effort_limits",
+                                      std::vector<double>());
+    auto_declare<int>("saturation.qp_max_iterations", 20);
+    auto_declare<double>("saturation.qp_regularization", 1e-3);
 
     auto_declare<std::vector<std::string>>("joints",
                                            std::vector<std::string>());
+    auto_declare<std::vector<std::string>>("arms", std::vector<std::string>());
+    auto_declare<int>("arm_pool.threads", -1);
+    auto_declare<std::vector<int64_t>>("arm_pool.cpus",
+                                       std::vector<int64_t>());
+    auto_declare<int>("arm_pool.thread_priority", 0);
+    auto_declare<bool>("arm_pool.busy_wait", false);
     auto_declare<std::vector<std::string>>("command_interfaces",
                                            {hardware_interface::HW_IF_EFFORT});
     auto_declare<std::vector<std::string>>(
@@ -122,6 +205,8 @@ EffortControllerBase::on_configure(
       get_node()->get_parameter("compensate_gravity").as_bool();
   m_compensate_coriolis =
       get_node()->get_parameter("compensate_coriolis").as_bool();
+  m_hardware_compensates_gravity =
+      get_node()->get_parameter("hardware_compensates_gravity").as_bool();
 
   RCLCPP_WARN_STREAM(get_node()->get_logger(), "Gravity compensation set to "
                                                    << std::boolalpha
@@ -137,6 +222,16 @@ EffortControllerBase::on_configure(
         CallbackReturn::ERROR;
   }
 
+  // Several arms replace the single chain
+  const auto arm_names = get_node()->get_parameter("arms").as_string_array();
+  if (!arm_names.empty() && !supportsArms()) {
+    RCLCPP_ERROR(get_node()->get_logger(),
+                 "This controller drives a single chain and does not support "
+                 "arms");
+    return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+        CallbackReturn::ERROR;
+  }
+
   // Get kinematics specific configuration
   urdf::Model robot_model;
   KDL::Tree robot_tree;
@@ -149,14 +244,14 @@ EffortControllerBase::on_configure(
   }
   m_end_effector_link =
       get_node()->get_parameter("end_effector_link").as_string();
-  if (m_end_effector_link.empty()) {
+  if (m_end_effector_link.empty() && arm_names.empty()) {
     RCLCPP_ERROR(get_node()->get_logger(), "end_effector_link is empty");
     return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
         CallbackReturn::ERROR;
   }
   m_compliance_ref_link =
       get_node()->get_parameter("compliance_ref_link").as_string();
-  if (m_compliance_ref_link.empty()) {
+  if (m_compliance_ref_link.empty() && arm_names.empty()) {
     RCLCPP_ERROR(get_node()->get_logger(), "compliance_ref_link is empty");
     return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
         CallbackReturn::ERROR;
@@ -175,7 +270,8 @@ EffortControllerBase::on_configure(
     return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
         CallbackReturn::ERROR;
   }
-  if (!robot_tree.getChain(m_robot_base_link, m_end_effector_link,
+  if (arm_names.empty() &&
+      !robot_tree.getChain(m_robot_base_link, m_end_effector_link,
                            m_robot_chain)) {
     const std::string error =
         ""
@@ -185,7 +281,7 @@ EffortControllerBase::on_configure(
     return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
         CallbackReturn::ERROR;
   }
-  if (!robotChainContains(m_compliance_ref_link)) {
+  if (arm_names.empty() && !robotChainContains(m_compliance_ref_link)) {
     RCLCPP_ERROR_STREAM(get_node()->get_logger(),
                         m_compliance_ref_link
                             << " is not part of the kinematic chain from "
@@ -205,10 +301,9 @@ EffortControllerBase::on_configure(
   // Initialize joint number
   m_joint_number = m_joint_names.size();
 
-  m_jacobian.resize(m_joint_number);
-
-  // Initialize effort limits
+  // Initialize effort and velocity limits
   m_joint_effort_limits.resize(m_joint_number);
+  m_joint_velocity_limits.resize(m_joint_number);
 
   // Parse joint limits
   KDL::JntArray upper_pos_limits(m_joint_number);
@@ -226,6 +321,7 @@ EffortControllerBase::on_configure(
       upper_pos_limits(i) = std::nan("0");
       lower_pos_limits(i) = std::nan("0");
       m_joint_effort_limits(i) = std::nan("0");
+      m_joint_velocity_limits(i) = std::nan("0");
     } else {
       // Non-existent urdf limits are zero initialized
       upper_pos_limits(i) =
@@ -234,25 +330,653 @@ EffortControllerBase::on_configure(
           robot_model.getJoint(m_joint_names[i])->limits->lower;
       m_joint_effort_limits(i) =
           robot_model.getJoint(m_joint_names[i])->limits->effort;
+      const double velocity =
+          robot_model.getJoint(m_joint_names[i])->limits->velocity;
+      m_joint_velocity_limits(i) = velocity > 0.0 ? velocity : std::nan("0");
     }
   }
 
   // Initialize solvers
   // m_ik_solver->init(get_node(),m_robot_chain,upper_pos_limits,lower_pos_limits);
   KDL::Vector grav(0.0, 0.0, -9.81);
-  KDL::Tree tmp("not_relevant");
-  tmp.addChain(m_robot_chain, "not_relevant");
-  m_forward_kinematics_solver.reset(new KDL::TreeFkSolverPos_recursive(tmp));
   m_fk_solver.reset(new KDL::ChainFkSolverPos_recursive(m_robot_chain));
   m_ik_solver_vel.reset(new KDL::ChainIkSolverVel_pinv(m_robot_chain));
   m_ik_solver.reset(new KDL::ChainIkSolverPos_NR_JL(
       m_robot_chain, lower_pos_limits, upper_pos_limits, *m_fk_solver,
       *m_ik_solver_vel, 100, 1e-6));
-  m_jnt_to_jac_solver.reset(new KDL::ChainJntToJacSolver(m_robot_chain));
-  m_dyn_solver.reset(new KDL::ChainDynParam(m_robot_chain, grav));
+  m_joint_lower_limits = lower_pos_limits;
+  m_joint_upper_limits = upper_pos_limits;
+  m_model.init(m_robot_chain, m_robot_base_link, &m_joint_positions,
+               &m_joint_velocities, grav);
+
+  // Arms from the robot base link to their end effectors.  Arms may share
+  // the joints of a common trunk.
+  m_arms.clear();
+  std::vector<bool> arm_joints(m_joint_number, false);
+  for (const auto &name : arm_names) {
+    auto arm = std::make_unique<Arm>();
+    arm->name = name;
+    auto_declare<std::string>(name + ".end_effector_link", "");
+    arm->end_effector_link =
+        get_node()->get_parameter(name + ".end_effector_link").as_string();
+    if (!robot_tree.getChain(m_robot_base_link, arm->end_effector_link,
+                             arm->chain)) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "Failed to parse the chain of arm %s. Does "
+                   "%s.end_effector_link exist?",
+                   name.c_str(), name.c_str());
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+    for (const auto &segment : arm->chain.segments) {
+      if (segment.getJoint().getType() == KDL::Joint::None) {
+        continue;
+      }
+      const auto it = std::find(m_joint_names.begin(), m_joint_names.end(),
+                                segment.getJoint().getName());
+      const size_t index = it - m_joint_names.begin();
+      if (it == m_joint_names.end()) {
+        RCLCPP_ERROR(get_node()->get_logger(),
+                     "Joint %s of arm %s is not in joints",
+                     segment.getJoint().getName().c_str(), name.c_str());
+        return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+            CallbackReturn::ERROR;
+      }
+      arm_joints[index] = true;
+      arm->joints.push_back(index);
+    }
+    const size_t joints = arm->joints.size();
+    arm->positions.resize(joints);
+    arm->velocities.resize(joints);
+    arm->filtered_velocities = ctrl::VectorND::Zero(joints);
+    arm->model.init(arm->chain, m_robot_base_link, &arm->positions,
+                    &arm->velocities, grav);
+    arm->end_effector_link_id = arm->model.linkId(arm->end_effector_link);
+    RCLCPP_INFO(get_node()->get_logger(), "Arm %s: %zu joints to %s",
+                name.c_str(), joints, arm->end_effector_link.c_str());
+    m_arms.push_back(std::move(arm));
+  }
+  if (!m_arms.empty() &&
+      std::find(arm_joints.begin(), arm_joints.end(), false) !=
+          arm_joints.end()) {
+    RCLCPP_ERROR(get_node()->get_logger(),
+                 "Each of the joints must belong to one of the arms");
+    return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+        CallbackReturn::ERROR;
+  }
+
+  // Dynamics of all arms together, including their common trunk
+  if (!m_arms.empty()) {
+    std::vector<std::string> end_effectors;
+    for (const auto &arm : m_arms) {
+      end_effectors.push_back(arm->end_effector_link);
+    }
+    if (!m_tree_model.init(robot_tree, m_robot_base_link, m_joint_names,
+                           end_effectors, &m_joint_positions,
+                           &m_joint_velocities, grav)) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "Failed to build the kinematic tree below %s",
+                   m_robot_base_link.c_str());
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+
+    // The arms' kinematics come from the same pass over the tree
+    for (size_t k = 0; k < m_arms.size(); ++k) {
+      m_arms[k]->model.useTreeKinematics(m_tree_model, k, m_arms[k]->joints);
+    }
+  }
   RCLCPP_INFO(get_node()->get_logger(),
               "Finished initializing kinematics solvers");
 
+  // Optionally compute the dynamics at a lower rate in the background
+  const double dynamics_worker_rate =
+      get_node()->get_parameter("dynamics.worker_rate").as_double();
+  const double dynamics_max_staleness =
+      get_node()->get_parameter("dynamics.max_staleness").as_double();
+  m_dynamics_worker_enabled = dynamics_worker_rate > 0.0;
+  if (m_dynamics_worker_enabled) {
+    if (dynamics_max_staleness <= 0.0) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "dynamics.max_staleness must be positive");
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+
+    // Results are up to one worker period old, so that a slower worker
+    // would fall back in every cycle
+    if (dynamics_worker_rate * dynamics_max_staleness <= 1.0) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "dynamics.worker_rate of %f Hz cannot meet "
+                   "dynamics.max_staleness of %f s. The worker period must "
+                   "be below the staleness bound",
+                   dynamics_worker_rate, dynamics_max_staleness);
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+    m_model.enableDynamicsWorker(dynamics_worker_rate, dynamics_max_staleness);
+    RCLCPP_INFO(get_node()->get_logger(),
+                "Computing dynamics at %f Hz with a staleness bound of %f s",
+                dynamics_worker_rate, dynamics_max_staleness);
+  }
+
+  // Joint state estimator
+  const std::string estimator_type =
+      get_node()->get_parameter("state_estimator.type").as_string();
+  if (estimator_type == "none") {
+    m_estimator_type = EstimatorType::None;
+  } else if (estimator_type == "kalman") {
+    m_estimator_type = EstimatorType::Kalman;
+  } else if (estimator_type == "model") {
+    m_estimator_type = EstimatorType::Model;
+  } else {
+    RCLCPP_ERROR(get_node()->get_logger(),
+                 "Unsupported state_estimator.type: %s. Choose none, kalman "
+                 "or model",
+                 estimator_type.c_str());
+    return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+        CallbackReturn::ERROR;
+  }
+  if (m_estimator_type != EstimatorType::None) {
+    const double position_noise =
+        get_node()->get_parameter("state_estimator.position_noise").as_double();
+    const double velocity_noise =
+        get_node()->get_parameter("state_estimator.velocity_noise").as_double();
+    const double jerk_noise =
+        get_node()->get_parameter("state_estimator.jerk_noise").as_double();
+    if (get_update_rate() == 0 || position_noise <= 0.0 ||
+        velocity_noise <= 0.0 || jerk_noise <= 0.0) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "state_estimator needs a known update rate and positive "
+                   "noise parameters");
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+    m_estimator.init(m_joint_number, 1.0 / get_update_rate(), position_noise,
+                     velocity_noise, jerk_noise);
+    m_model_acceleration = ctrl::VectorND::Zero(m_joint_number);
+  }
+
+  // External torque observer
+  m_external_torque_observer_enabled =
+      get_node()->get_parameter("external_torque_observer.enabled").as_bool();
+  m_external_torques = ctrl::VectorND::Zero(m_joint_number);
+  m_external_wrench = ctrl::Vector6D::Zero();
+  m_contact = false;
+  m_model_bias = ctrl::VectorND::Zero(m_joint_number);
+  if (m_external_torque_observer_enabled) {
+    const double gain =
+        get_node()->get_parameter("external_torque_observer.gain").as_double();
+    m_contact_threshold =
+        get_node()
+            ->get_parameter("external_torque_observer.contact_threshold")
+            .as_double();
+    if (get_update_rate() == 0 || gain <= 0.0 || m_contact_threshold <= 0.0) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "external_torque_observer needs a known update rate and "
+                   "positive gain and contact_threshold");
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+    m_period = 1.0 / get_update_rate();
+    m_momentum_observer.init(m_joint_number, gain);
+    m_observer_torque = ctrl::VectorND::Zero(m_joint_number);
+  }
+
+  // Joint velocity filter, with cutoffs relative to the update rate
+  FilterSettings velocity_filter;
+  velocity_filter.type =
+      get_node()->get_parameter("velocity_filter.type").as_string();
+  velocity_filter.cutoff =
+      get_node()->get_parameter("velocity_filter.cutoff").as_double();
+  velocity_filter.order =
+      get_node()->get_parameter("velocity_filter.order").as_int();
+  velocity_filter.window =
+      get_node()->get_parameter("velocity_filter.window").as_int();
+  const double period =
+      get_update_rate() > 0 ? 1.0 / get_update_rate() : 0.0;
+  std::string filter_error;
+  m_velocity_filter =
+      makeFilter(velocity_filter, m_joint_number, period, filter_error);
+  if (!filter_error.empty()) {
+    RCLCPP_ERROR(get_node()->get_logger(), "velocity_filter: %s",
+                 filter_error.c_str());
+    return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+        CallbackReturn::ERROR;
+  }
+
+  // Force/torque sensor
+  m_ft_sensor_name = get_node()->get_parameter("ft_sensor.name").as_string();
+  m_ft_sensor_enabled = !m_ft_sensor_name.empty();
+  m_ft_sensor_wrench = ctrl::Vector6D::Zero();
+  if (m_ft_sensor_enabled) {
+    const std::string ft_sensor_ref_link =
+        get_node()->get_parameter("ft_sensor_ref_link").as_string();
+    m_ft_sensor_link_id = linkId(ft_sensor_ref_link);
+    if (m_ft_sensor_link_id < 0) {
+      RCLCPP_ERROR_STREAM(get_node()->get_logger(),
+                          "ft_sensor_ref_link "
+                              << ft_sensor_ref_link
+                              << " is not part of the kinematic chain from "
+                              << m_robot_base_link << " to "
+                              << m_end_effector_link);
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+    const auto bias =
+        get_node()->get_parameter("ft_sensor.bias").as_double_array();
+    const auto com = get_node()
+                         ->get_parameter("ft_sensor.tool_center_of_mass")
+                         .as_double_array();
+    m_ft_tool_mass =
+        get_node()->get_parameter("ft_sensor.tool_mass").as_double();
+    m_ft_contact_threshold =
+        get_node()->get_parameter("ft_sensor.contact_threshold").as_double();
+    if (bias.size() != 6 || com.size() != 3 || m_ft_tool_mass < 0.0 ||
+        m_ft_contact_threshold <= 0.0) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "ft_sensor.bias needs 6 and ft_sensor.tool_center_of_mass "
+                   "3 entries, tool_mass must not be negative and "
+                   "contact_threshold must be positive");
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+    m_ft_sensor_bias = Eigen::Map<const ctrl::Vector6D>(bias.data());
+    m_ft_tool_center_of_mass = KDL::Vector(com[0], com[1], com[2]);
+    m_ft_zero_on_activate =
+        get_node()->get_parameter("ft_sensor.zero_on_activate").as_bool();
+    m_ft_sensor_measurement = ctrl::Vector6D::Zero();
+
+    FilterSettings ft_filter;
+    ft_filter.type =
+        get_node()->get_parameter("ft_sensor.filter.type").as_string();
+    ft_filter.cutoff =
+        get_node()->get_parameter("ft_sensor.filter.cutoff").as_double();
+    ft_filter.order =
+        get_node()->get_parameter("ft_sensor.filter.order").as_int();
+    ft_filter.window =
+        get_node()->get_parameter("ft_sensor.filter.window").as_int();
+    m_ft_filter = makeFilter(ft_filter, 6, period, filter_error);
+    if (!filter_error.empty()) {
+      RCLCPP_ERROR(get_node()->get_logger(), "ft_sensor.filter: %s",
+                   filter_error.c_str());
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+  }
+
+  // Self-collision avoidance with capsules from the URDF collision geometry
+  m_self_collision_enabled =
+      get_node()->get_parameter("self_collision.enabled").as_bool();
+  m_self_collision_torque = ctrl::VectorND::Zero(m_joint_number);
+  if (m_self_collision_enabled) {
+    SelfCollision::Settings settings;
+    settings.distance =
+        get_node()->get_parameter("self_collision.distance").as_double();
+    settings.stiffness =
+        get_node()->get_parameter("self_collision.stiffness").as_double();
+    settings.damping =
+        get_node()->get_parameter("self_collision.damping").as_double();
+    settings.ignore_adjacent =
+        get_node()->get_parameter("self_collision.ignore_adjacent").as_int();
+    if (settings.distance <= 0.0 || settings.stiffness < 0.0 ||
+        settings.damping < 0.0 || settings.ignore_adjacent < 0) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "self_collision needs a positive distance and "
+                   "non-negative stiffness, damping and ignore_adjacent");
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+
+    // The base link and each link of the chain, with the number of joints
+    // from the base
+    std::vector<SelfCollision::Capsule> capsules;
+    size_t skipped = 0;
+    int depth = 0;
+    for (int id = 0; id <= static_cast<int>(m_robot_chain.getNrOfSegments());
+         ++id) {
+      std::string name = m_robot_base_link;
+      if (id > 0) {
+        const KDL::Segment &segment = m_robot_chain.getSegment(id - 1);
+        name = segment.getName();
+        if (segment.getJoint().getType() != KDL::Joint::None) {
+          ++depth;
+        }
+      }
+      const auto link = robot_model.getLink(name);
+      if (link) {
+        skipped +=
+            SelfCollision::appendUrdfCapsules(*link, id, depth, capsules);
+      }
+    }
+    if (skipped > 0) {
+      RCLCPP_WARN(get_node()->get_logger(),
+                  "self_collision ignores %zu collision geometries that are "
+                  "neither cylinders nor spheres",
+                  skipped);
+    }
+
+    // Link pairs as "link_a link_b"
+    std::vector<std::pair<int, int>> ignored_links;
+    for (const auto &entry :
+         get_node()
+             ->get_parameter("self_collision.ignored_pairs")
+             .as_string_array()) {
+      std::istringstream stream(entry);
+      std::string first, second;
+      stream >> first >> second;
+      if (linkId(first) < 0 || linkId(second) < 0) {
+        RCLCPP_ERROR(get_node()->get_logger(),
+                     "self_collision.ignored_pairs: %s does not name two "
+                     "links of the robot chain",
+                     entry.c_str());
+        return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+            CallbackReturn::ERROR;
+      }
+      ignored_links.emplace_back(linkId(first), linkId(second));
+    }
+
+    m_self_collision.init(capsules, ignored_links, m_joint_number, settings);
+    RCLCPP_INFO(get_node()->get_logger(),
+                "Self-collision: %zu capsules, %zu pairs", capsules.size(),
+                m_self_collision.pairs());
+  }
+
+  // Joint limit avoidance
+  m_joint_limit_avoidance_enabled =
+      get_node()->get_parameter("joint_limit_avoidance.enabled").as_bool();
+  m_joint_limit_torque = ctrl::VectorND::Zero(m_joint_number);
+  if (m_joint_limit_avoidance_enabled) {
+    JointLimitRepulsion::Settings settings;
+    settings.margin =
+        get_node()->get_parameter("joint_limit_avoidance.margin").as_double();
+    settings.stiffness = get_node()
+                             ->get_parameter("joint_limit_avoidance.stiffness")
+                             .as_double();
+    settings.damping =
+        get_node()->get_parameter("joint_limit_avoidance.damping").as_double();
+    settings.velocity_ratio =
+        get_node()
+            ->get_parameter("joint_limit_avoidance.velocity_ratio")
+            .as_double();
+    settings.velocity_damping =
+        get_node()
+            ->get_parameter("joint_limit_avoidance.velocity_damping")
+            .as_double();
+    if (settings.margin <= 0.0 || settings.stiffness < 0.0 ||
+        settings.damping < 0.0 || settings.velocity_damping < 0.0 ||
+        settings.velocity_ratio < 0.0 || settings.velocity_ratio >= 1.0) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "joint_limit_avoidance needs a positive margin, "
+                   "non-negative gains and a velocity_ratio in [0, 1)");
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+    m_joint_limit_repulsion.init(m_joint_lower_limits, m_joint_upper_limits,
+                                 m_joint_velocity_limits, settings);
+  }
+
+  // Virtual fixtures in the robot base frame
+  const auto fixture_names =
+      get_node()->get_parameter("virtual_fixtures.names").as_string_array();
+  m_virtual_fixtures_enabled = !fixture_names.empty();
+  m_virtual_fixture_torque = ctrl::VectorND::Zero(m_joint_number);
+  if (m_virtual_fixtures_enabled) {
+    std::vector<VirtualFixtures::Fixture> fixtures;
+    for (const auto &name : fixture_names) {
+      const std::string prefix = "virtual_fixtures." + name;
+      auto_declare<std::string>(prefix + ".type", "");
+      auto_declare<std::vector<double>>(prefix + ".pose",
+                                        std::vector<double>(6, 0.0));
+      auto_declare<std::vector<double>>(prefix + ".size",
+                                        std::vector<double>(3, 1.0));
+      auto_declare<bool>(prefix + ".inside", false);
+      auto_declare<std::string>(prefix + ".mesh", "");
+      const std::string type =
+          get_node()->get_parameter(prefix + ".type").as_string();
+      const auto pose =
+          get_node()->get_parameter(prefix + ".pose").as_double_array();
+      const auto size =
+          get_node()->get_parameter(prefix + ".size").as_double_array();
+
+      VirtualFixtures::Fixture fixture;
+      fixture.inside = get_node()->get_parameter(prefix + ".inside").as_bool();
+      if (type == "plane") {
+        fixture.type = VirtualFixtures::Type::Plane;
+      } else if (type == "box") {
+        fixture.type = VirtualFixtures::Type::Box;
+      } else if (type == "cylinder") {
+        fixture.type = VirtualFixtures::Type::Cylinder;
+      } else if (type == "mesh") {
+        fixture.type = VirtualFixtures::Type::Mesh;
+      } else {
+        RCLCPP_ERROR(get_node()->get_logger(),
+                     "Unsupported %s.type '%s'. Choose plane, box, cylinder "
+                     "or mesh",
+                     prefix.c_str(), type.c_str());
+        return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+            CallbackReturn::ERROR;
+      }
+      if (pose.size() != 6 || size.size() != 3 ||
+          std::any_of(size.begin(), size.end(),
+                      [](double value) { return value <= 0.0; })) {
+        RCLCPP_ERROR(get_node()->get_logger(),
+                     "%s needs a pose [x, y, z, roll, pitch, yaw] and three "
+                     "positive sizes",
+                     prefix.c_str());
+        return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+            CallbackReturn::ERROR;
+      }
+      fixture.pose = KDL::Frame(KDL::Rotation::RPY(pose[3], pose[4], pose[5]),
+                                KDL::Vector(pose[0], pose[1], pose[2]));
+      fixture.size = KDL::Vector(size[0], size[1], size[2]);
+      if (fixture.type == VirtualFixtures::Type::Mesh) {
+        std::string error;
+        if (!VirtualFixtures::loadStl(
+                get_node()->get_parameter(prefix + ".mesh").as_string(),
+                fixture.vertices, error)) {
+          RCLCPP_ERROR(get_node()->get_logger(), "%s.mesh: %s",
+                       prefix.c_str(), error.c_str());
+          return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+              CallbackReturn::ERROR;
+        }
+      }
+      fixtures.push_back(std::move(fixture));
+    }
+
+    // The end effector by default, with one sphere radius per link
+    auto link_names =
+        get_node()->get_parameter("virtual_fixtures.links").as_string_array();
+    if (link_names.empty()) {
+      link_names.push_back(m_end_effector_link);
+    }
+    std::vector<double> radii =
+        get_node()->get_parameter("virtual_fixtures.radii").as_double_array();
+    if (radii.empty()) {
+      radii.assign(link_names.size(), 0.05);
+    }
+    std::vector<int> links;
+    for (const auto &name : link_names) {
+      links.push_back(linkId(name));
+      if (links.back() < 0) {
+        RCLCPP_ERROR(get_node()->get_logger(),
+                     "virtual_fixtures.links: %s is not part of the robot "
+                     "chain",
+                     name.c_str());
+        return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+            CallbackReturn::ERROR;
+      }
+    }
+
+    VirtualFixtures::Settings settings;
+    settings.stiffness =
+        get_node()->get_parameter("virtual_fixtures.stiffness").as_double();
+    settings.damping =
+        get_node()->get_parameter("virtual_fixtures.damping").as_double();
+    if (radii.size() != links.size() ||
+        std::any_of(radii.begin(), radii.end(),
+                    [](double radius) { return radius <= 0.0; }) ||
+        settings.stiffness < 0.0 || settings.damping < 0.0) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "virtual_fixtures needs one positive radius per link and "
+                   "non-negative stiffness and damping");
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+    m_virtual_fixtures.init(fixtures, links, radii, m_joint_number, settings);
+    RCLCPP_INFO(get_node()->get_logger(),
+                "Virtual fixtures: %zu fixtures, %zu bounded primitives",
+                fixtures.size(), m_virtual_fixtures.primitives());
+  }
+
+  // Energy tank
+  m_energy_tank_enabled =
+      get_node()->get_parameter("energy_tank.enabled").as_bool();
+  if (m_energy_tank_enabled) {
+    EnergyTank::Settings settings;
+    settings.initial =
+        get_node()->get_parameter("energy_tank.initial_energy").as_double();
+    settings.minimum =
+        get_node()->get_parameter("energy_tank.minimum_energy").as_double();
+    settings.maximum =
+        get_node()->get_parameter("energy_tank.maximum_energy").as_double();
+    if (settings.minimum < 0.0 || settings.initial < settings.minimum ||
+        settings.maximum < settings.initial) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "energy_tank needs 0 <= minimum_energy <= initial_energy "
+                   "<= maximum_energy");
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+    m_energy_tank.init(settings);
+  }
+
+  // Torque saturation
+  const std::string saturation_policy =
+      get_node()->get_parameter("saturation.policy").as_string();
+  if (saturation_policy == "clip") {
+    m_saturation_policy = SaturationPolicy::Clip;
+  } else if (saturation_policy == "scale") {
+    m_saturation_policy = SaturationPolicy::Scale;
+  } else if (saturation_policy == "priority") {
+    m_saturation_policy = SaturationPolicy::Priority;
+  } else if (saturation_policy == "qp") {
+    m_saturation_policy = SaturationPolicy::QP;
+  } else {
+    RCLCPP_ERROR(get_node()->get_logger(),
+                 "Unsupported saturation.policy: %s. Choose clip, scale, "
+                 "priority or qp",
+                 saturation_policy.c_str());
+    return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+        CallbackReturn::ERROR;
+  }
+
+  // Per-joint rate and effort limits.  The effort limits are the smaller of
+  // the URDF and the parameter, unlimited if neither is positive.
+  constexpr double inf = std::numeric_limits<double>::infinity();
+  const auto rate_limits =
+      get_node()->get_parameter("saturation.rate_limits").as_double_array();
+  const auto effort_limits =
+      get_node()->get_parameter("saturation.effort_limits").as_double_array();
+  if ((!rate_limits.empty() && rate_limits.size() != m_joint_number) ||
+      (!effort_limits.empty() && effort_limits.size() != m_joint_number) ||
+      std::any_of(rate_limits.begin(), rate_limits.end(),
+                  [](double limit) { return limit <= 0.0; }) ||
+      std::any_of(effort_limits.begin(), effort_limits.end(),
+                  [](double limit) { return limit <= 0.0; })) {
+    RCLCPP_ERROR(get_node()->get_logger(),
+                 "saturation.rate_limits and saturation.effort_limits must "
+                 "be empty or have %zu positive entries",
+                 m_joint_number);
+    return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+        CallbackReturn::ERROR;
+  }
+  m_uniform_rate_limits = rate_limits.empty();
+  m_rate_limits.setConstant(m_joint_number, m_delta_tau_max);
+  m_effort_limits.setConstant(m_joint_number, inf);
+  for (size_t i = 0; i < m_joint_number; ++i) {
+    if (!rate_limits.empty()) {
+      m_rate_limits[i] = rate_limits[i];
+    }
+    if (m_joint_effort_limits(i) > 0.0) {
+      m_effort_limits[i] = m_joint_effort_limits(i);
+    }
+    if (!effort_limits.empty()) {
+      m_effort_limits[i] = std::min(m_effort_limits[i], effort_limits[i]);
+    }
+  }
+  m_saturation_lower.setZero(m_joint_number);
+  m_saturation_upper.setZero(m_joint_number);
+  if (m_saturation_policy == SaturationPolicy::QP) {
+    const int max_iterations =
+        get_node()->get_parameter("saturation.qp_max_iterations").as_int();
+    m_qp_regularization =
+        get_node()->get_parameter("saturation.qp_regularization").as_double();
+    if (m_joint_number > static_cast<size_t>(BoxQP<>::maxSize())) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "saturation.policy qp supports at most %d joints",
+                   BoxQP<>::maxSize());
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+    if (max_iterations < 1 || m_qp_regularization <= 0.0) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "saturation.qp_max_iterations and "
+                   "saturation.qp_regularization must be positive");
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+    m_qp.init(m_joint_number, max_iterations);
+    m_qp_hessian.setZero(m_joint_number, m_joint_number);
+    m_qp_gradient.setZero(m_joint_number);
+    m_qp_lower.setZero(m_joint_number);
+    m_qp_upper.setZero(m_joint_number);
+    m_qp_solution.setZero(m_joint_number);
+    m_qp_protected.setZero(m_joint_number);
+    m_qp_wrench.setZero();
+  }
+
+  // Arms only support the features that work on the joints alone
+  if (!m_arms.empty() &&
+      (m_estimator_type == EstimatorType::Model ||
+       m_external_torque_observer_enabled || m_ft_sensor_enabled ||
+       m_saturation_policy == SaturationPolicy::QP ||
+       m_dynamics_worker_enabled || m_self_collision_enabled ||
+       m_virtual_fixtures_enabled)) {
+    RCLCPP_ERROR(get_node()->get_logger(),
+                 "arms do not support state_estimator.type model, "
+                 "external_torque_observer, ft_sensor, saturation.policy qp, "
+                 "dynamics.worker_rate, self_collision and virtual_fixtures");
+    return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+        CallbackReturn::ERROR;
+  }
+
+  // Worker pool for the arms.  By default, the calling thread and one worker
+  // per further arm evaluate all arms at once.
+  if (!m_arms.empty()) {
+    const int threads =
+        get_node()->get_parameter("arm_pool.threads").as_int();
+    const auto cpus =
+        get_node()->get_parameter("arm_pool.cpus").as_integer_array();
+    m_arm_threads =
+        threads < 0 ? m_arms.size() - 1 : static_cast<size_t>(threads);
+    m_arm_cpus.assign(cpus.begin(), cpus.end());
+    m_arm_priority =
+        get_node()->get_parameter("arm_pool.thread_priority").as_int();
+    m_arm_busy_wait = get_node()->get_parameter("arm_pool.busy_wait").as_bool();
+    m_timed_arm_job = [this](size_t k) {
+      using Clock = std::chrono::steady_clock;
+      const auto start = Clock::now();
+      (*m_arm_job)(k);
+      m_arms[k]->time +=
+          std::chrono::duration<double>(Clock::now() - start).count();
+    };
+  }
+
+  // Resolve frequently used links once
+  m_end_effector_link_id = linkId(m_end_effector_link);
+  m_compliance_ref_link_id = linkId(m_compliance_ref_link);
+
   RCLCPP_INFO_STREAM(get_node()->get_logger(), "Robot Chain: ");
   for (unsigned int i = 0; i < m_robot_chain.getNrOfSegments(); ++i) {
     KDL::Segment segment = m_robot_chain.getSegment(i);
@@ -304,8 +1028,85 @@ EffortControllerBase::on_configure(
   // Initialize joint state
   m_joint_positions.resize(m_joint_number);
   m_joint_velocities.resize(m_joint_number);
+  m_joint_accelerations.resize(m_joint_number);
+  m_joint_accelerations.data.setZero();
+  m_filtered_joint_velocities = ctrl::VectorND::Zero(m_joint_number);
   m_simulated_joint_motion.resize(m_joint_number);
 
+  // Initialize telemetry
+  m_telemetry.init(
+      get_node(), get_node()->get_name() + std::string("/telemetry"),
+      get_node()->get_parameter("telemetry.publish_rate").as_double());
+  if (m_saturation_policy == SaturationPolicy::QP) {
+    m_qp_time_channel = m_telemetry.addChannel("qp_solve_time");
+    m_qp_iterations_channel = m_telemetry.addChannel("qp_iterations");
+    m_qp_conflicts_channel = m_telemetry.addChannel("qp_bound_conflicts");
+  }
+  if (m_external_torque_observer_enabled || m_ft_sensor_enabled) {
+    m_contact_channel = m_telemetry.addChannel("contact");
+  }
+  if (m_external_torque_observer_enabled) {
+    m_external_force_channel = m_telemetry.addChannel("external_force");
+  }
+  if (m_ft_sensor_enabled) {
+    m_ft_force_channel = m_telemetry.addChannel("ft_sensor_force");
+  }
+  if (m_self_collision_enabled) {
+    m_self_collision_distance_channel =
+        m_telemetry.addChannel("self_collision_distance");
+    m_self_collision_pairs_channel =
+        m_telemetry.addChannel("self_collision_pairs");
+    m_self_collision_time_channel =
+        m_telemetry.addChannel("self_collision_time");
+  }
+  if (m_joint_limit_avoidance_enabled) {
+    m_joint_limit_activation_channel =
+        m_telemetry.addChannel("joint_limit_activation");
+  }
+  if (m_virtual_fixtures_enabled) {
+    m_virtual_fixture_penetration_channel =
+        m_telemetry.addChannel("virtual_fixture_penetration");
+    m_virtual_fixture_contacts_channel =
+        m_telemetry.addChannel("virtual_fixture_contacts");
+    m_virtual_fixture_time_channel =
+        m_telemetry.addChannel("virtual_fixture_time");
+  }
+  m_saturated_joints_channel = m_telemetry.addChannel("saturated_joints");
+  m_saturation_cycles_channel = m_telemetry.addChannel("saturation_cycles");
+  if (m_saturation_policy == SaturationPolicy::Scale ||
+      m_saturation_policy == SaturationPolicy::Priority) {
+    m_saturation_scale_channel = m_telemetry.addChannel("saturation_scale");
+  }
+  if (m_saturation_policy == SaturationPolicy::Priority) {
+    m_saturation_secondary_scale_channel =
+        m_telemetry.addChannel("saturation_secondary_scale");
+  }
+  if (m_energy_tank_enabled) {
+    m_energy_tank_energy_channel = m_telemetry.addChannel("energy_tank_energy");
+    m_energy_tank_scale_channel = m_telemetry.addChannel("energy_tank_scale");
+  }
+  if (!m_arms.empty()) {
+    m_arms_time_channel = m_telemetry.addChannel("arms_time");
+    m_arm_time_channels.clear();
+    for (const auto &arm : m_arms) {
+      m_arm_time_channels.push_back(
+          m_telemetry.addChannel("arm_" + arm->name + "_time"));
+    }
+  }
+  if (m_dynamics_worker_enabled) {
+    m_dynamics_age_channel = m_telemetry.addChannel("dynamics_age");
+    m_dynamics_fallbacks_channel =
+        m_telemetry.addChannel("dynamics_fallbacks");
+  }
+
+  // Hot-reload of parameters
+  m_staged_parameters = {m_delta_tau_max, m_compensate_gravity,
+                         m_compensate_coriolis};
+  m_runtime_parameters.init(m_staged_parameters);
+  m_parameter_callback = get_node()->add_on_set_parameters_callback(
+      std::bind(&EffortControllerBase::onSetParameters, this,
+                std::placeholders::_1));
+
   RCLCPP_INFO(get_node()->get_logger(), "Finished Base on_configure");
   return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
       CallbackReturn::SUCCESS;
@@ -320,8 +1121,16 @@ EffortControllerBase::on_deactivate(
     // m_joint_cmd_vel_handles.clear();
     m_joint_state_pos_handles.clear();
     m_joint_state_vel_handles.clear();
+    m_ft_sensor_handles.clear();
     this->release_interfaces();
+    m_model.stopDynamicsWorker();
+    m_arm_pool.stop();
     m_active = false;
+    if (m_saturation_cycles > 0) {
+      RCLCPP_INFO(get_node()->get_logger(),
+                  "Torques were saturated in %lu cycles",
+                  static_cast<unsigned long>(m_saturation_cycles));
+    }
   }
   return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
       CallbackReturn::SUCCESS;
@@ -386,6 +1195,29 @@ EffortControllerBase::on_activate(
     return CallbackReturn::ERROR;
   }
 
+  // Force/torque sensor
+  m_ft_sensor_handles.clear();
+  for (const auto &type : kFtSensorInterfaces) {
+    if (!m_ft_sensor_enabled) {
+      break;
+    }
+    const std::string name = m_ft_sensor_name + "/" + type;
+    for (auto &interface : state_interfaces_) {
+      if (interface.get_name() == name) {
+        m_ft_sensor_handles.emplace_back(std::ref(interface));
+        break;
+      }
+    }
+  }
+  if (m_ft_sensor_enabled &&
+      m_ft_sensor_handles.size() != kFtSensorInterfaces.size()) {
+    RCLCPP_ERROR(get_node()->get_logger(),
+                 "Expected %zu state interfaces of sensor %s, got %zu.",
+                 kFtSensorInterfaces.size(), m_ft_sensor_name.c_str(),
+                 m_ft_sensor_handles.size());
+    return CallbackReturn::ERROR;
+  }
+
   RCLCPP_INFO(get_node()->get_logger(), "Finished getting state interfaces");
   // Copy joint state to internal simulation
   // if (!m_ik_solver->setStartState(m_joint_state_pos_handles))
@@ -400,6 +1232,20 @@ EffortControllerBase::on_activate(
   // computeJointEffortCmds(ctrl::VectorND::Zero(m_joint_number));
   // writeJointEffortCmds();
 
+  m_model.startDynamicsWorker();
+  if (!m_arms.empty() &&
+      !m_arm_pool.start(m_arm_threads, m_arm_cpus, m_arm_priority,
+                        m_arm_busy_wait)) {
+    RCLCPP_WARN(get_node()->get_logger(),
+                "Could not pin the arm workers or set their priority");
+  }
+  m_reset_velocity_filter = true;
+  m_reset_estimator = true;
+  m_reset_momentum_observer = true;
+  m_reset_ft_sensor = true;
+  m_energy_tank.reset();
+  m_saturation_cycles = 0;
+
   m_active = true;
   RCLCPP_INFO(get_node()->get_logger(), "Finished Base on_activate");
   return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
@@ -410,10 +1256,10 @@ void EffortControllerBase::writeJointEffortCmds() {
   // Write all available types.
   for (const auto &type : m_cmd_interface_types) {
     if (type == hardware_interface::HW_IF_EFFORT) {
+      // Effort saturation
+      m_efforts.array() =
+          m_efforts.array().max(-m_effort_limits).min(m_effort_limits);
       for (size_t i = 0; i < m_joint_number; ++i) {
-        // Effort saturation
-        m_efforts[i] = std::clamp(m_efforts[i], -m_joint_effort_limits(i),
-                                  m_joint_effort_limits(i));
         m_joint_cmd_eff_handles[i].get().set_value(m_efforts[i]);
       }
     }
@@ -426,17 +1272,146 @@ void EffortControllerBase::writeJointEffortCmds() {
 }
 
 void EffortControllerBase::computeJointEffortCmds(const ctrl::VectorND &tau) {
-  // Saturation of torque rate
-  for (size_t i = 0; i < m_joint_number; i++) {
-    const double difference = tau[i] - m_efforts[i];
-    m_efforts[i] +=
-        std::min(std::max(difference, -m_delta_tau_max), m_delta_tau_max);
-    if (std::abs(difference) > m_delta_tau_max) {
-      RCLCPP_WARN(get_node()->get_logger(),
-                  "Joint %s effort rate saturated, was: %f",
-                  m_joint_names[i].c_str(), tau[i]);
+  saturateTorques(tau, nullptr);
+}
+
+void EffortControllerBase::computeJointEffortCmds(
+    const ctrl::VectorND &tau, const ctrl::VectorND &secondary) {
+  saturateTorques(tau, &secondary);
+}
+
+void EffortControllerBase::saturateTorques(const ctrl::VectorND &tau,
+                                           const ctrl::VectorND *secondary) {
+  if (m_saturation_policy == SaturationPolicy::QP) {
+    resolveTorqueQP(tau, secondary);
+  } else {
+    saturationBox(m_efforts, m_rate_limits, m_effort_limits,
+                  m_saturation_lower, m_saturation_upper);
+
+    switch (m_saturation_policy) {
+      case SaturationPolicy::Clip:
+        clipTorques(tau, m_saturation_lower, m_saturation_upper, m_efforts);
+        break;
+      case SaturationPolicy::Scale: {
+        const double scale = scaleTorques(tau, m_saturation_lower,
+                                          m_saturation_upper, m_efforts);
+        m_telemetry.set(m_saturation_scale_channel, scale);
+        break;
+      }
+      case SaturationPolicy::Priority: {
+        // Scale the secondary torques first, the primary ones only if they
+        // are infeasible on their own
+        double scale;
+        double secondary_scale = 0.0;
+        if (secondary) {
+          scale = prioritizeTorques(tau, *secondary, m_saturation_lower,
+                                    m_saturation_upper, m_efforts,
+                                    secondary_scale);
+        } else {
+          scale = scaleTorques(tau, m_saturation_lower, m_saturation_upper,
+                               m_efforts);
+        }
+        m_telemetry.set(m_saturation_scale_channel, scale);
+        m_telemetry.set(m_saturation_secondary_scale_channel, secondary_scale);
+        break;
+      }
+      case SaturationPolicy::QP:
+        break;
     }
   }
+
+  // Count instead of logging in the control loop
+  const auto saturated = ((m_efforts - tau).array().abs() > 1e-9).count();
+  if (saturated > 0) {
+    ++m_saturation_cycles;
+  }
+  m_telemetry.set(m_saturated_joints_channel, static_cast<double>(saturated));
+  m_telemetry.set(m_saturation_cycles_channel,
+                  static_cast<double>(m_saturation_cycles));
+}
+
+void EffortControllerBase::resolveTorqueQP(const ctrl::VectorND &tau,
+                                          const ctrl::VectorND *secondary) {
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  constexpr double inf = std::numeric_limits<double>::infinity();
+
+  // Torques that give zero joint acceleration
+  const unsigned int rate = get_update_rate();
+  const double dt = rate > 0 ? 1.0 / rate : 0.0;
+  const bool joint_limits = dt > 0.0;
+  const ctrl::VectorND *bias = joint_limits ? &modelBias() : nullptr;
+
+  size_t conflicts = 0;
+  for (size_t i = 0; i < m_joint_number; ++i) {
+    // Joint accelerations that keep position and velocity within limits at
+    // the end of the next cycle
+    double joint_lower = -inf;
+    double joint_upper = inf;
+    if (joint_limits) {
+      const double q = m_joint_positions(i);
+      const double q_dot = m_joint_velocities(i);
+      double acc_lower = -inf;
+      double acc_upper = inf;
+      if (!std::isnan(m_joint_lower_limits(i)) &&
+          m_joint_upper_limits(i) > m_joint_lower_limits(i)) {
+        acc_lower = 2 * (m_joint_lower_limits(i) - q - q_dot * dt) / (dt * dt);
+        acc_upper = 2 * (m_joint_upper_limits(i) - q - q_dot * dt) / (dt * dt);
+      }
+      const double velocity = m_joint_velocity_limits(i);
+      if (!std::isnan(velocity)) {
+        acc_lower = std::max(acc_lower, (-velocity - q_dot) / dt);
+        acc_upper = std::min(acc_upper, (velocity - q_dot) / dt);
+      }
+      const double inertia = m_model.massMatrix()(i, i);
+      if (std::isfinite(acc_lower)) {
+        joint_lower = inertia * acc_lower + (*bias)[i];
+      }
+      if (std::isfinite(acc_upper)) {
+        joint_upper = inertia * acc_upper + (*bias)[i];
+      }
+    }
+
+    // Effort limits first, then joint limits, then the rate limit
+    double lower, upper;
+    conflicts += torqueBounds(m_effort_limits[i], joint_lower, joint_upper,
+                              m_efforts[i] - m_rate_limits[i],
+                              m_efforts[i] + m_rate_limits[i], lower, upper);
+
+    m_qp_lower[i] = lower;
+    m_qp_upper[i] = upper;
+  }
+
+  // Objective in the commanded end effector wrench
+  const ctrl::MatrixND &P = m_model.jacobianTransposePseudoInverse();
+  m_qp_hessian.noalias() = P.transpose() * P;
+
+  // The nullspace share of everything but the secondary task, such as
+  // self-collision and joint limit avoidance, is invisible to P.  Weight its
+  // direction as heavily as the whole wrench so that it is not dropped first.
+  m_qp_protected = tau;
+  if (secondary) {
+    m_qp_protected -= *secondary;
+  }
+  m_qp_wrench.noalias() = P * m_qp_protected;
+  m_qp_protected.noalias() -= m_model.jacobian().data.transpose() * m_qp_wrench;
+  const double protected_norm = m_qp_protected.squaredNorm();
+  if (protected_norm > std::numeric_limits<double>::epsilon()) {
+    m_qp_hessian.noalias() += (m_qp_hessian.trace() / protected_norm) *
+                              m_qp_protected * m_qp_protected.transpose();
+  }
+  m_qp_hessian.diagonal().array() += m_qp_regularization;
+  m_qp_gradient.noalias() = -m_qp_hessian * tau;
+
+  m_qp_solution = m_efforts;
+  m_qp.solve(m_qp_hessian, m_qp_gradient, m_qp_lower, m_qp_upper,
+             m_qp_solution);
+  m_efforts = m_qp_solution;
+
+  m_telemetry.set(m_qp_time_channel,
+                  std::chrono::duration<double>(Clock::now() - start).count());
+  m_telemetry.set(m_qp_iterations_channel, m_qp.iterations());
+  m_telemetry.set(m_qp_conflicts_channel, static_cast<double>(conflicts));
 }
 
 void EffortControllerBase::computeIKSolution(
@@ -455,19 +1430,15 @@ void EffortControllerBase::computeIKSolution(
 }
 
 ctrl::Vector6D EffortControllerBase::displayInBaseLink(
-    const ctrl::Vector6D &vector, const std::string &from) {
+    const ctrl::Vector6D &vector, int from) const {
   // Adjust format
   KDL::Wrench wrench_kdl;
   for (int i = 0; i < 6; ++i) {
     wrench_kdl(i) = vector[i];
   }
 
-  KDL::Frame transform_kdl;
-  m_forward_kinematics_solver->JntToCart(m_joint_positions, transform_kdl,
-                                         from);
-
   // Rotate into new reference frame
-  wrench_kdl = transform_kdl.M * wrench_kdl;
+  wrench_kdl = linkPose(from).M * wrench_kdl;
 
   // Reassign
   ctrl::Vector6D out;
@@ -478,22 +1449,51 @@ ctrl::Vector6D EffortControllerBase::displayInBaseLink(
   return out;
 }
 
+ctrl::Vector6D EffortControllerBase::displayInBaseLink(
+    const ctrl::Vector6D &vector, const std::string &from) {
+  const int id = linkId(from);
+  if (id < 0) {
+    RCLCPP_ERROR(get_node()->get_logger(), "%s is not part of the robot chain",
+                 from.c_str());
+    return vector;
+  }
+  return displayInBaseLink(vector, id);
+}
+
 ctrl::Matrix6D EffortControllerBase::displayInBaseLink(
-    const ctrl::Matrix6D &tensor, const std::string &from) {
+    const ctrl::Matrix6D &tensor, int from) const {
   // Get rotation to base
-  KDL::Frame R_kdl;
-  m_forward_kinematics_solver->JntToCart(m_joint_positions, R_kdl, from);
+  const KDL::Rotation &R_kdl = linkPose(from).M;
 
   // Adjust format
   ctrl::Matrix3D R;
-  R << R_kdl.M.data[0], R_kdl.M.data[1], R_kdl.M.data[2], R_kdl.M.data[3],
-      R_kdl.M.data[4], R_kdl.M.data[5], R_kdl.M.data[6], R_kdl.M.data[7],
-      R_kdl.M.data[8];
+  R << R_kdl.data[0], R_kdl.data[1], R_kdl.data[2], R_kdl.data[3],
+      R_kdl.data[4], R_kdl.data[5], R_kdl.data[6], R_kdl.data[7],
+      R_kdl.data[8];
+
+  return rotateTensor(tensor, R);
+}
+
+ctrl::Matrix6D EffortControllerBase::displayInBaseLink(
+    const ctrl::Matrix6D &tensor, const std::string &from) {
+  const int id = linkId(from);
+  if (id < 0) {
+    RCLCPP_ERROR(get_node()->get_logger(), "%s is not part of the robot chain",
+                 from.c_str());
+    return tensor;
+  }
+  return displayInBaseLink(tensor, id);
+}
 
-  // Treat diagonal blocks as individual 2nd rank tensors.
-  // Display in base frame.
-  ctrl::Matrix6D tmp = ctrl::Matrix6D::Zero();
+ctrl::Matrix6D EffortControllerBase::rotateTensor(const ctrl::Matrix6D &tensor,
+                                                  const ctrl::Matrix3D &R) {
+  // Rotate each block as an individual 2nd rank tensor.
+  ctrl::Matrix6D tmp;
   tmp.topLeftCorner<3, 3>() = R * tensor.topLeftCorner<3, 3>() * R.transpose();
+  tmp.topRightCorner<3, 3>() =
+      R * tensor.topRightCorner<3, 3>() * R.transpose();
+  tmp.bottomLeftCorner<3, 3>() =
+      R * tensor.bottomLeftCorner<3, 3>() * R.transpose();
   tmp.bottomRightCorner<3, 3>() =
       R * tensor.bottomRightCorner<3, 3>() * R.transpose();
 
@@ -501,18 +1501,15 @@ ctrl::Matrix6D EffortControllerBase::displayInBaseLink(
 }
 
 ctrl::Vector6D EffortControllerBase::displayInTipLink(
-    const ctrl::Vector6D &vector, const std::string &to) {
+    const ctrl::Vector6D &vector, int to) const {
   // Adjust format
   KDL::Wrench wrench_kdl;
   for (int i = 0; i < 6; ++i) {
     wrench_kdl(i) = vector[i];
   }
 
-  KDL::Frame transform_kdl;
-  m_forward_kinematics_solver->JntToCart(m_joint_positions, transform_kdl, to);
-
   // Rotate into new reference frame
-  wrench_kdl = transform_kdl.M.Inverse() * wrench_kdl;
+  wrench_kdl = linkPose(to).M.Inverse() * wrench_kdl;
 
   // Reassign
   ctrl::Vector6D out;
@@ -523,7 +1520,88 @@ ctrl::Vector6D EffortControllerBase::displayInTipLink(
   return out;
 }
 
+ctrl::Vector6D EffortControllerBase::displayInTipLink(
+    const ctrl::Vector6D &vector, const std::string &to) {
+  const int id = linkId(to);
+  if (id < 0) {
+    RCLCPP_ERROR(get_node()->get_logger(), "%s is not part of the robot chain",
+                 to.c_str());
+    return vector;
+  }
+  return displayInTipLink(vector, id);
+}
+
+rcl_interfaces::msg::SetParametersResult
+EffortControllerBase::onSetParameters(
+    const std::vector<rclcpp::Parameter> &parameters) {
+  rcl_interfaces::msg::SetParametersResult result;
+  result.successful = true;
+
+  // Build the complete snapshot first, so that a rejected change publishes
+  // nothing
+  RuntimeParameters staged = m_staged_parameters;
+  bool changed = false;
+  for (const auto &parameter : parameters) {
+    if (parameter.get_name() == "delta_tau_max") {
+      staged.delta_tau_max = parameter.as_double();
+      if (staged.delta_tau_max < 1.0) {
+        result.successful = false;
+        result.reason = "delta_tau_max must be greater than 1.0 Nm";
+        return result;
+      }
+      changed = true;
+    } else if (parameter.get_name() == "compensate_gravity") {
+      staged.compensate_gravity = parameter.as_bool();
+      changed = true;
+    } else if (parameter.get_name() == "compensate_coriolis") {
+      staged.compensate_coriolis = parameter.as_bool();
+      changed = true;
+    }
+  }
+  if (!stageParameters(parameters, result.reason)) {
+    result.successful = false;
+    return result;
+  }
+
+  if (changed) {
+    m_staged_parameters = staged;
+    m_runtime_parameters.write(staged);
+  }
+  publishParameters();
+  return result;
+}
+
 void EffortControllerBase::updateJointStates() {
+  // Take over parameters changed at runtime
+  if (m_runtime_parameters.update()) {
+    const RuntimeParameters &parameters = m_runtime_parameters.readBuffer();
+    m_delta_tau_max = parameters.delta_tau_max;
+    if (m_uniform_rate_limits) {
+      m_rate_limits.setConstant(m_delta_tau_max);
+    }
+
+    // The commanded torques jump with the compensation, which the observers
+    // and the model estimator would attribute to contact or motion
+    if (parameters.compensate_gravity != m_compensate_gravity ||
+        parameters.compensate_coriolis != m_compensate_coriolis) {
+      m_reset_momentum_observer = true;
+      m_reset_ft_sensor = true;
+      m_reset_estimator = true;
+    }
+    m_compensate_gravity = parameters.compensate_gravity;
+    m_compensate_coriolis = parameters.compensate_coriolis;
+  }
+
+  // Accelerations of the last command for the model estimator.  The robot
+  // model still holds the last cycle's state, which the new measurements
+  // below overwrite, so the dynamics are evaluated consistently here.
+  const bool model_prediction =
+      m_estimator_type == EstimatorType::Model && !m_reset_estimator;
+  if (model_prediction) {
+    m_model_acceleration = m_efforts - modelBias();
+    m_model.massMatrixLLT().solveInPlace(m_model_acceleration);
+  }
+
   for (size_t i = 0; i < m_joint_number; ++i) {
     const auto &position_interface = m_joint_state_pos_handles[i].get();
     const auto &velocity_interface = m_joint_state_vel_handles[i].get();
@@ -539,6 +1617,212 @@ void EffortControllerBase::updateJointStates() {
     // Rount to 4 decimal places
     // m_joint_positions(i) = std::round(m_joint_positions(i) * 10000) / 10000;
   }
+
+  if (m_estimator_type != EstimatorType::None) {
+    if (m_reset_estimator) {
+      m_estimator.reset(m_joint_positions, m_joint_velocities);
+      m_reset_estimator = false;
+    } else if (model_prediction) {
+      m_estimator.update(m_joint_positions, m_joint_velocities,
+                         &m_model_acceleration);
+    } else {
+      m_estimator.update(m_joint_positions, m_joint_velocities);
+    }
+    m_joint_positions.data = m_estimator.positions();
+    m_joint_velocities.data = m_estimator.velocities();
+    m_joint_accelerations.data = m_estimator.accelerations();
+  }
+
+  if (m_velocity_filter) {
+    if (m_reset_velocity_filter) {
+      m_velocity_filter->reset(m_joint_velocities.data.array());
+      m_reset_velocity_filter = false;
+    }
+    m_filtered_joint_velocities =
+        m_velocity_filter->update(m_joint_velocities.data.array()).matrix();
+  } else {
+    m_filtered_joint_velocities = m_joint_velocities.data;
+  }
+
+  if (m_arms.empty()) {
+    m_model.invalidate();
+  } else {
+    // One pass over the tree for all arms, before the arm jobs read it in
+    // parallel
+    m_tree_model.invalidate();
+    m_tree_model.linkPoses();
+  }
+  for (auto &arm : m_arms) {
+    arm->readJointState(m_joint_positions, m_joint_velocities,
+                        m_filtered_joint_velocities);
+    arm->time = 0.0;
+  }
+  m_arms_time = 0.0;
+  if (m_external_torque_observer_enabled) {
+    updateExternalTorques();
+  }
+  if (m_ft_sensor_enabled) {
+    updateFtSensor();
+  }
+  if (m_self_collision_enabled) {
+    updateSelfCollision();
+  }
+  if (m_joint_limit_avoidance_enabled) {
+    m_joint_limit_repulsion.update(m_joint_positions.data,
+                                   m_filtered_joint_velocities,
+                                   m_joint_limit_torque);
+    m_telemetry.set(m_joint_limit_activation_channel,
+                    m_joint_limit_repulsion.activation().maxCoeff());
+  }
+  if (m_virtual_fixtures_enabled) {
+    updateVirtualFixtures();
+  }
+  if (m_external_torque_observer_enabled || m_ft_sensor_enabled) {
+    m_telemetry.set(m_contact_channel, m_contact ? 1.0 : 0.0);
+  }
+  if (m_dynamics_worker_enabled) {
+    m_telemetry.set(m_dynamics_age_channel, m_model.dynamicsAge());
+    m_telemetry.set(m_dynamics_fallbacks_channel,
+                    static_cast<double>(m_model.dynamicsFallbacks()));
+  }
+}
+
+void EffortControllerBase::forEachArm(const WorkerPool::Job &job) {
+  if (m_arms.empty()) {
+    return;
+  }
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  m_arm_job = &job;
+  m_arm_pool.run(m_arms.size(), m_timed_arm_job);
+
+  // Accumulated over all calls of this cycle
+  m_arms_time += std::chrono::duration<double>(Clock::now() - start).count();
+  m_telemetry.set(m_arms_time_channel, m_arms_time);
+  for (size_t k = 0; k < m_arms.size(); ++k) {
+    m_telemetry.set(m_arm_time_channels[k], m_arms[k]->time);
+  }
+}
+
+void EffortControllerBase::updateSelfCollision() {
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  m_self_collision.update(m_model, m_filtered_joint_velocities,
+                          m_self_collision_torque);
+  m_telemetry.set(m_self_collision_time_channel,
+                  std::chrono::duration<double>(Clock::now() - start).count());
+  m_telemetry.set(m_self_collision_distance_channel,
+                  m_self_collision.minimumDistance());
+  m_telemetry.set(m_self_collision_pairs_channel,
+                  static_cast<double>(m_self_collision.closePairs()));
+}
+
+double EffortControllerBase::passivityScale(double dissipated,
+                                           double injected) {
+  if (!m_energy_tank_enabled) {
+    return 1.0;
+  }
+  const double scale = m_energy_tank.update(dissipated, injected);
+  m_telemetry.set(m_energy_tank_energy_channel, m_energy_tank.energy());
+  m_telemetry.set(m_energy_tank_scale_channel, scale);
+  return scale;
+}
+
+void EffortControllerBase::updateVirtualFixtures() {
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  m_virtual_fixtures.update(m_model, m_filtered_joint_velocities,
+                            m_virtual_fixture_torque);
+  m_telemetry.set(m_virtual_fixture_time_channel,
+                  std::chrono::duration<double>(Clock::now() - start).count());
+  m_telemetry.set(m_virtual_fixture_penetration_channel,
+                  m_virtual_fixtures.maximumPenetration());
+  m_telemetry.set(m_virtual_fixture_contacts_channel,
+                  static_cast<double>(m_virtual_fixtures.contacts()));
+}
+
+void EffortControllerBase::updateExternalTorques() {
+  const ctrl::MatrixND &mass = m_model.massMatrix().data;
+  if (m_reset_momentum_observer) {
+    m_momentum_observer.reset(mass, m_joint_velocities.data);
+    m_reset_momentum_observer = false;
+  } else {
+    // Known torques tau_m - C q_dot - g of the last command
+    m_observer_torque = m_efforts - modelBias();
+    m_momentum_observer.update(mass, m_joint_velocities.data,
+                               m_observer_torque, m_period);
+  }
+  m_external_torques = m_momentum_observer.externalTorques();
+  m_external_wrench.noalias() =
+      m_model.jacobianTransposePseudoInverse() * m_external_torques;
+
+  detectContact(m_external_torques.cwiseAbs().maxCoeff(),
+                m_contact_threshold);
+  m_telemetry.set(m_external_force_channel,
+                  m_external_wrench.head<3>().norm());
+}
+
+const ctrl::VectorND &EffortControllerBase::modelBias() {
+  m_model_bias = m_model.coriolis().data;
+  if (!m_hardware_compensates_gravity) {
+    m_model_bias += m_model.gravity().data;
+  }
+  return m_model_bias;
+}
+
+void EffortControllerBase::updateFtSensor() {
+  for (size_t i = 0; i < m_ft_sensor_handles.size(); ++i) {
+    m_ft_sensor_measurement[i] = m_ft_sensor_handles[i].get().get_value();
+  }
+
+  // Remove the weight of the tool, in the sensor frame
+  const KDL::Frame &sensor_pose = linkPose(m_ft_sensor_link_id);
+  const KDL::Vector tool_force =
+      sensor_pose.M.Inverse(KDL::Vector(0.0, 0.0, -9.81 * m_ft_tool_mass));
+  const KDL::Vector tool_torque = m_ft_tool_center_of_mass * tool_force;
+  m_ft_sensor_measurement.head<3>() -=
+      Eigen::Vector3d(tool_force.x(), tool_force.y(), tool_force.z());
+  m_ft_sensor_measurement.tail<3>() -=
+      Eigen::Vector3d(tool_torque.x(), tool_torque.y(), tool_torque.z());
+
+  // Remove the bias, optionally measured at activation without contact
+  if (m_reset_ft_sensor) {
+    if (m_ft_zero_on_activate) {
+      m_ft_sensor_bias = m_ft_sensor_measurement;
+    }
+    m_ft_sensor_measurement -= m_ft_sensor_bias;
+    if (m_ft_filter) {
+      m_ft_filter->reset(m_ft_sensor_measurement.array());
+    }
+    m_reset_ft_sensor = false;
+  } else {
+    m_ft_sensor_measurement -= m_ft_sensor_bias;
+  }
+  if (m_ft_filter) {
+    m_ft_sensor_measurement =
+        m_ft_filter->update(m_ft_sensor_measurement.array()).matrix();
+  }
+
+  // Display in the base frame and move the reference point to the end
+  // effector, where the controllers apply their wrenches
+  m_ft_sensor_wrench =
+      displayInBaseLink(m_ft_sensor_measurement, m_ft_sensor_link_id);
+  const KDL::Vector offset =
+      sensor_pose.p - linkPose(m_end_effector_link_id).p;
+  const Eigen::Vector3d lever(offset.x(), offset.y(), offset.z());
+  m_ft_sensor_wrench.tail<3>() +=
+      lever.cross(Eigen::Vector3d(m_ft_sensor_wrench.head<3>()));
+
+  detectContact(m_ft_sensor_wrench.head<3>().norm(), m_ft_contact_threshold);
+  m_telemetry.set(m_ft_force_channel, m_ft_sensor_wrench.head<3>().norm());
+}
+
+void EffortControllerBase::detectContact(double magnitude, double threshold) {
+  if (magnitude > threshold) {
+    m_contact = true;
+  } else if (magnitude < 0.5 * threshold) {
+    m_contact = false;
+  }
 }
 
-}  // namespace effort_controller_base
\ No newline at end of file
+}  // namespace effort_controller_base
@@ -0,0 +1,144 @@
+#include <effort_controller_base/GainSchedule.h>
+
+#include <algorithm>
+#include <functional>
+
+namespace effort_controller_base {
+
+bool GainSchedule::init(const std::vector<Table> &tables, size_t gains,
+                        std::string &error) {
+  if (tables.empty() || gains == 0) {
+    error = "needs at least one table and one gain";
+    return false;
+  }
+  m_tables.clear();
+  m_data.clear();
+  for (const auto &table : tables) {
+    const size_t axes = table.keys.size();
+    if (axes == 0 || axes > kMaxAxes || table.breakpoints.size() != axes) {
+      error = table.name + " needs one to " + std::to_string(kMaxAxes) +
+              " keys with breakpoints each";
+      return false;
+    }
+    CompiledTable compiled;
+    compiled.name = table.name;
+    compiled.axes = axes;
+    size_t points = 1;
+    for (size_t a = 0; a < axes; ++a) {
+      const auto &breakpoints = table.breakpoints[a];
+      if (breakpoints.size() < 2 ||
+          std::adjacent_find(breakpoints.begin(), breakpoints.end(),
+                             std::greater_equal<double>()) !=
+              breakpoints.end()) {
+        error = table.name +
+                " needs at least two strictly increasing breakpoints per key";
+        return false;
+      }
+      compiled.keys[a] = table.keys[a];
+      compiled.sizes[a] = breakpoints.size();
+      compiled.offsets[a] = m_data.size();
+      m_data.insert(m_data.end(), breakpoints.begin(), breakpoints.end());
+      points *= breakpoints.size();
+    }
+    if (table.gains.size() != points * gains) {
+      error = table.name + " needs " + std::to_string(points * gains) +
+              " gains, " + std::to_string(gains) + " per grid point";
+      return false;
+    }
+    size_t stride = gains;
+    for (size_t a = axes; a-- > 0;) {
+      compiled.strides[a] = stride;
+      stride *= compiled.sizes[a];
+    }
+    compiled.gains_offset = m_data.size();
+    m_data.insert(m_data.end(), table.gains.begin(), table.gains.end());
+    m_tables.push_back(compiled);
+  }
+
+  m_active = 0;
+  m_blend = 1.0;
+  m_blend_rate = 0.0;
+  m_initialized = false;
+  m_gains = ctrl::VectorND::Zero(gains);
+  m_blend_start = ctrl::VectorND::Zero(gains);
+  m_lookup = ctrl::VectorND::Zero(gains);
+  return true;
+}
+
+int GainSchedule::tableId(const std::string &name) const {
+  for (size_t i = 0; i < m_tables.size(); ++i) {
+    if (m_tables[i].name == name) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+void GainSchedule::select(size_t table, double blend_time) {
+  if (table == m_active || table >= m_tables.size()) {
+    return;
+  }
+  m_active = table;
+  if (blend_time > 0.0 && m_initialized) {
+    m_blend_start = m_gains;
+    m_blend = 0.0;
+    m_blend_rate = 1.0 / blend_time;
+  } else {
+    m_blend = 1.0;
+  }
+}
+
+const ctrl::VectorND &GainSchedule::update(const ctrl::VectorND &keys,
+                                           double period) {
+  lookup(m_tables[m_active], keys, m_lookup);
+  m_blend = std::min(1.0, m_blend + m_blend_rate * period);
+  if (m_blend < 1.0) {
+    m_gains = m_blend_start + m_blend * (m_lookup - m_blend_start);
+  } else {
+    m_gains = m_lookup;
+  }
+  m_initialized = true;
+  return m_gains;
+}
+
+void GainSchedule::lookup(const CompiledTable &table,
+                          const ctrl::VectorND &keys,
+                          ctrl::VectorND &gains) const {
+  // Locate the cell and the position within it along each axis
+  size_t base = table.gains_offset;
+  double fractions[kMaxAxes];
+  for (size_t a = 0; a < table.axes; ++a) {
+    const double *breakpoints = m_data.data() + table.offsets[a];
+    const size_t size = table.sizes[a];
+    const double key =
+        std::clamp(keys[table.keys[a]], breakpoints[0], breakpoints[size - 1]);
+    const size_t cell =
+        std::upper_bound(breakpoints + 1, breakpoints + size - 1, key) -
+        breakpoints - 1;
+    fractions[a] = (key - breakpoints[cell]) /
+                   (breakpoints[cell + 1] - breakpoints[cell]);
+    base += cell * table.strides[a];
+  }
+
+  // Weighted sum over the corners of the cell
+  const Eigen::Index size = gains.size();
+  gains.setZero();
+  for (size_t corner = 0; corner < (size_t(1) << table.axes); ++corner) {
+    double weight = 1.0;
+    size_t offset = base;
+    for (size_t a = 0; a < table.axes; ++a) {
+      if (corner & (size_t(1) << a)) {
+        weight *= fractions[a];
+        offset += table.strides[a];
+      } else {
+        weight *= 1.0 - fractions[a];
+      }
+    }
+    if (weight != 0.0) {
+      gains += weight * Eigen::Map<const ctrl::VectorND>(
+                            m_data.data() + offset, size);
+    }
+  }
+}
+
+}  // namespace effort_controller_base
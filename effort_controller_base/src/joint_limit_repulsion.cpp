@@ -0,0 +1,70 @@
+#include <effort_controller_base/JointLimitRepulsion.h>
+
+#include <cmath>
+#include <limits>
+
+namespace effort_controller_base {
+
+void JointLimitRepulsion::init(const KDL::JntArray &lower,
+                               const KDL::JntArray &upper,
+                               const KDL::JntArray &velocity,
+                               const Settings &settings) {
+  constexpr double inf = std::numeric_limits<double>::infinity();
+  const size_t joints = lower.rows();
+  m_settings = settings;
+  m_inverse_margin = 1.0 / settings.margin;
+  m_lower_start.setConstant(joints, -inf);
+  m_upper_start.setConstant(joints, inf);
+  m_velocity_start.setConstant(joints, inf);
+  m_inverse_velocity_band.setOnes(joints);
+  for (size_t i = 0; i < joints; ++i) {
+    // Continuous joints and joints without limits are never repelled
+    if (!std::isnan(lower(i)) && !std::isnan(upper(i)) &&
+        upper(i) > lower(i)) {
+      m_lower_start[i] = lower(i) + settings.margin;
+      m_upper_start[i] = upper(i) - settings.margin;
+    }
+    if (!std::isnan(velocity(i)) && settings.velocity_damping > 0.0) {
+      m_velocity_start[i] = settings.velocity_ratio * velocity(i);
+      m_inverse_velocity_band[i] =
+          1.0 / ((1.0 - settings.velocity_ratio) * velocity(i));
+    }
+  }
+  m_lower_activation.setZero(joints);
+  m_upper_activation.setZero(joints);
+  m_velocity_activation.setZero(joints);
+  m_activation = ctrl::VectorND::Zero(joints);
+}
+
+void JointLimitRepulsion::update(const ctrl::VectorND &q,
+                                 const ctrl::VectorND &q_dot,
+                                 ctrl::VectorND &tau) {
+  const auto position = q.array();
+  const auto velocity = q_dot.array();
+
+  // Penetration of the margins, zero outside.  Unlimited joints have
+  // infinite starts and stay at zero.
+  m_lower_activation = (m_lower_start - position).max(0.0);
+  m_upper_activation = (position - m_upper_start).max(0.0);
+  tau.array() =
+      m_settings.stiffness * (m_lower_activation - m_upper_activation);
+
+  // Damp the motion towards the limit only
+  m_lower_activation = (m_lower_activation * m_inverse_margin).min(1.0);
+  m_upper_activation = (m_upper_activation * m_inverse_margin).min(1.0);
+  tau.array() -= m_settings.damping *
+                 (m_lower_activation * velocity.min(0.0) +
+                  m_upper_activation * velocity.max(0.0));
+
+  m_velocity_activation =
+      ((velocity.abs() - m_velocity_start) * m_inverse_velocity_band)
+          .max(0.0)
+          .min(1.0);
+  tau.array() -=
+      m_settings.velocity_damping * m_velocity_activation * velocity;
+
+  m_activation.array() = m_lower_activation.max(m_upper_activation)
+                             .max(m_velocity_activation);
+}
+
+}  // namespace effort_controller_base
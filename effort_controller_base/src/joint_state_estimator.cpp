@@ -0,0 +1,79 @@
+#include <effort_controller_base/JointStateEstimator.h>
+
+namespace effort_controller_base {
+
+void JointStateEstimator::init(size_t joints, double period,
+                               double position_noise, double velocity_noise,
+                               double jerk_noise) {
+  const double dt = period;
+  const double dt2 = dt * dt;
+  const double dt3 = dt2 * dt;
+
+  // Constant acceleration model
+  m_transition << 1.0, dt, 0.5 * dt2,  //
+      0.0, 1.0, dt,                    //
+      0.0, 0.0, 1.0;
+
+  // Integrated white jerk noise over one period
+  m_process_noise << dt2 * dt3 / 20, dt2 * dt2 / 8, dt3 / 6,  //
+      dt2 * dt2 / 8, dt3 / 3, dt2 / 2,                        //
+      dt3 / 6, dt2 / 2, dt;
+  m_process_noise *= jerk_noise;
+
+  m_measurement_noise.setZero();
+  m_measurement_noise(0, 0) = position_noise * position_noise;
+  m_measurement_noise(1, 1) = velocity_noise * velocity_noise;
+
+  m_position = ctrl::VectorND::Zero(joints);
+  m_velocity = ctrl::VectorND::Zero(joints);
+  m_acceleration = ctrl::VectorND::Zero(joints);
+  m_position_innovation = ctrl::VectorND::Zero(joints);
+  m_velocity_innovation = ctrl::VectorND::Zero(joints);
+  m_covariance = m_process_noise;
+  m_gain.setZero();
+}
+
+void JointStateEstimator::reset(const KDL::JntArray &q,
+                                const KDL::JntArray &q_dot) {
+  m_position = q.data;
+  m_velocity = q_dot.data;
+  m_acceleration.setZero();
+
+  // Measured position and velocity, unknown acceleration
+  m_covariance.setZero();
+  m_covariance.topLeftCorner<2, 2>() = m_measurement_noise;
+  m_covariance(2, 2) = 1e6 * m_process_noise(2, 2);
+}
+
+void JointStateEstimator::update(const KDL::JntArray &q,
+                                 const KDL::JntArray &q_dot,
+                                 const ctrl::VectorND *acceleration) {
+  const double dt = m_transition(0, 1);
+
+  // Shared covariance and gain
+  m_covariance =
+      m_transition * m_covariance * m_transition.transpose() + m_process_noise;
+  const Eigen::Matrix2d innovation_covariance =
+      m_covariance.topLeftCorner<2, 2>() + m_measurement_noise;
+  m_gain = m_covariance.leftCols<2>() * innovation_covariance.inverse();
+  m_covariance -= m_gain * m_covariance.topRows<2>();
+
+  // Prediction of all joints
+  if (acceleration) {
+    m_acceleration = *acceleration;
+  }
+  m_position += dt * m_velocity + (0.5 * dt * dt) * m_acceleration;
+  m_velocity += dt * m_acceleration;
+
+  // Correction of all joints
+  m_position_innovation = q.data - m_position;
+  m_velocity_innovation = q_dot.data - m_velocity;
+  m_position += m_gain(0, 0) * m_position_innovation +
+                m_gain(0, 1) * m_velocity_innovation;
+  m_velocity += m_gain(1, 0) * m_position_innovation +
+                m_gain(1, 1) * m_velocity_innovation;
+  m_acceleration += m_gain(2, 0) * m_position_innovation +
+                    m_gain(2, 1) * m_velocity_innovation;
+}
+
+}  // namespace effort_controller_base
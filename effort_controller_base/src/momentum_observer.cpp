@@ -0,0 +1,37 @@
+#include <effort_controller_base/MomentumObserver.h>
+
+namespace effort_controller_base {
+
+void MomentumObserver::init(size_t joints, double gain) {
+  m_gain = gain;
+  m_last_mass = ctrl::MatrixND::Zero(joints, joints);
+  m_mass_change = ctrl::MatrixND::Zero(joints, joints);
+  m_initial_momentum = ctrl::VectorND::Zero(joints);
+  m_momentum = ctrl::VectorND::Zero(joints);
+  m_integral = ctrl::VectorND::Zero(joints);
+  m_residual = ctrl::VectorND::Zero(joints);
+}
+
+void MomentumObserver::reset(const ctrl::MatrixND &mass,
+                             const ctrl::VectorND &q_dot) {
+  m_last_mass = mass;
+  m_initial_momentum.noalias() = mass * q_dot;
+  m_integral.setZero();
+  m_residual.setZero();
+}
+
+void MomentumObserver::update(const ctrl::MatrixND &mass,
+                              const ctrl::VectorND &q_dot,
+                              const ctrl::VectorND &torque, double period) {
+  // Integrate the momentum change predicted by the model
+  m_mass_change = mass - m_last_mass;
+  m_last_mass = mass;
+  m_integral += period * (torque + m_residual);
+  m_integral.noalias() += m_mass_change * q_dot;
+
+  // The difference to the actual momentum is due to external torques
+  m_momentum.noalias() = mass * q_dot;
+  m_residual = m_gain * (m_momentum - m_initial_momentum - m_integral);
+}
+
+}  // namespace effort_controller_base
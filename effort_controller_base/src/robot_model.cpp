@@ -0,0 +1,189 @@
+#include <effort_controller_base/RobotModel.h>
+#include <effort_controller_base/TreeModel.h>
+
+namespace effort_controller_base {
+
+void RobotModel::init(const KDL::Chain &chain, const std::string &base_link,
+                      const KDL::JntArray *joint_positions,
+                      const KDL::JntArray *joint_velocities,
+                      const KDL::Vector &gravity) {
+  m_chain = chain;
+  m_joint_positions = joint_positions;
+  m_joint_velocities = joint_velocities;
+  m_jnt_to_jac_solver.reset(new KDL::ChainJntToJacSolver(m_chain));
+  m_dyn_solver.reset(new KDL::ChainDynParam(m_chain, gravity));
+  m_gravity_vector = gravity;
+  m_worker.reset();
+  m_dynamics_from_worker = false;
+  m_dynamics_fallbacks = 0;
+
+  const unsigned int segments = m_chain.getNrOfSegments();
+  const unsigned int joints = m_chain.getNrOfJoints();
+
+  m_link_ids.clear();
+  m_link_ids[base_link] = 0;
+  for (unsigned int i = 0; i < segments; ++i) {
+    m_link_ids[m_chain.getSegment(i).getName()] = i + 1;
+  }
+
+  // Single pass along the chain
+  m_link_poses.init(
+      &m_epoch, std::vector<KDL::Frame>(segments + 1, KDL::Frame::Identity()),
+      [this](std::vector<KDL::Frame> &poses) {
+        KDL::Frame pose = KDL::Frame::Identity();
+        unsigned int joint = 0;
+        for (unsigned int i = 0; i < m_chain.getNrOfSegments(); ++i) {
+          const KDL::Segment &segment = m_chain.getSegment(i);
+          if (segment.getJoint().getType() != KDL::Joint::None) {
+            pose = pose * segment.pose((*m_joint_positions)(joint++));
+          } else {
+            pose = pose * segment.pose(0.0);
+          }
+          poses[i + 1] = pose;
+        }
+      });
+
+  m_jacobian.init(&m_epoch, KDL::Jacobian(joints),
+                  [this](KDL::Jacobian &jacobian) {
+                    m_jnt_to_jac_solver->JntToJac(*m_joint_positions,
+                                                  jacobian);
+                  });
+
+  m_jacobian_svd.init(
+      &m_epoch,
+      Eigen::JacobiSVD<ctrl::MatrixND>(6, joints, Eigen::ComputeThinU |
+                                                      Eigen::ComputeThinV),
+      [this](Eigen::JacobiSVD<ctrl::MatrixND> &svd) {
+        svd.compute(m_jacobian.get().data);
+      });
+
+  // With J = U S V^T, the damped pseudo-inverse of J^T is
+  // U diag(s / (s^2 + lambda^2)) V^T.
+  m_jacobian_transpose_pinv.init(
+      &m_epoch, ctrl::MatrixND::Zero(6, joints),
+      [this](ctrl::MatrixND &pinv) {
+        const auto &svd = m_jacobian_svd.get();
+        const auto &s = svd.singularValues();
+        const double lambda2 = m_pinv_damping * m_pinv_damping;
+        pinv.noalias() =
+            svd.matrixU() *
+            (s.array() / (s.array().square() + lambda2)).matrix().asDiagonal() *
+            svd.matrixV().transpose();
+      });
+
+  m_mass_matrix.init(&m_epoch, KDL::JntSpaceInertiaMatrix(joints),
+                     [this](KDL::JntSpaceInertiaMatrix &mass) {
+                       if (m_dynamics_from_worker) {
+                         m_worker->massMatrix(*m_joint_positions, mass);
+                       } else {
+                         m_dyn_solver->JntToMass(*m_joint_positions, mass);
+                       }
+                     });
+
+  m_mass_llt.init(&m_epoch, Eigen::LLT<ctrl::MatrixND>(joints),
+                  [this](Eigen::LLT<ctrl::MatrixND> &llt) {
+                    llt.compute(m_mass_matrix.get().data);
+                  });
+
+  m_scaled_jacobian_transpose.init(
+      &m_epoch, ctrl::MatrixND::Zero(joints, 6), [this](ctrl::MatrixND &x) {
+        x = m_jacobian.get().data.transpose();
+        m_mass_llt.get().matrixL().solveInPlace(x);
+      });
+
+  m_task_inertia.init(
+      &m_epoch, ctrl::Matrix6D::Identity(), [this](ctrl::Matrix6D &lambda) {
+        const ctrl::MatrixND &x = m_scaled_jacobian_transpose.get();
+        ctrl::Matrix6D lambda_inv;
+        lambda_inv.noalias() = x.transpose() * x;
+        lambda_inv.diagonal().array() += m_task_inertia_regularization;
+        lambda = lambda_inv.llt().solve(ctrl::Matrix6D::Identity());
+      });
+
+  // M^-1 J^T Lambda = L^-T (L^-1 J^T) Lambda
+  m_dynamically_consistent_inverse.init(
+      &m_epoch, ctrl::MatrixND::Zero(joints, 6),
+      [this](ctrl::MatrixND &j_bar) {
+        j_bar.noalias() =
+            m_scaled_jacobian_transpose.get() * m_task_inertia.get();
+        m_mass_llt.get().matrixU().solveInPlace(j_bar);
+      });
+
+  m_gravity.init(&m_epoch, KDL::JntArray(joints),
+                 [this](KDL::JntArray &gravity) {
+                   if (m_dynamics_from_worker) {
+                     m_worker->gravity(*m_joint_positions, gravity);
+                   } else {
+                     m_dyn_solver->JntToGravity(*m_joint_positions, gravity);
+                   }
+                 });
+
+  m_coriolis.init(&m_epoch, KDL::JntArray(joints),
+                  [this](KDL::JntArray &coriolis) {
+                    if (m_dynamics_from_worker) {
+                      m_worker->coriolis(*m_joint_velocities, coriolis);
+                    } else {
+                      m_dyn_solver->JntToCoriolis(
+                          *m_joint_positions, *m_joint_velocities, coriolis);
+                    }
+                  });
+}
+
+void RobotModel::useTreeKinematics(const TreeModel &tree, size_t end_effector,
+                                   const std::vector<size_t> &joints) {
+  // Tree link id of each chain link
+  std::vector<int> links(m_chain.getNrOfSegments() + 1, 0);
+  for (unsigned int i = 0; i < m_chain.getNrOfSegments(); ++i) {
+    links[i + 1] = tree.linkId(m_chain.getSegment(i).getName());
+  }
+
+  m_link_poses.init(
+      &m_epoch, std::vector<KDL::Frame>(links.size(), KDL::Frame::Identity()),
+      [&tree, links](std::vector<KDL::Frame> &poses) {
+        const std::vector<KDL::Frame> &tree_poses = tree.linkPoses();
+        for (size_t i = 0; i < links.size(); ++i) {
+          poses[i] = tree_poses[links[i]];
+        }
+      });
+
+  m_jacobian.init(&m_epoch, KDL::Jacobian(joints.size()),
+                  [&tree, end_effector, joints](KDL::Jacobian &jacobian) {
+                    const ctrl::MatrixND &tree_jacobian =
+                        tree.jacobian(end_effector).data;
+                    for (size_t i = 0; i < joints.size(); ++i) {
+                      jacobian.data.col(i) = tree_jacobian.col(joints[i]);
+                    }
+                  });
+}
+
+void RobotModel::enableDynamicsWorker(double rate, double max_staleness) {
+  m_worker.reset(new DynamicsWorker());
+  m_worker->init(m_chain, m_gravity_vector, rate, max_staleness);
+}
+
+void RobotModel::startDynamicsWorker() {
+  if (m_worker) {
+    m_worker->start();
+  }
+}
+
+void RobotModel::stopDynamicsWorker() {
+  if (m_worker) {
+    m_worker->stop();
+  }
+  m_dynamics_from_worker = false;
+}
+
+void RobotModel::invalidate() {
+  ++m_epoch;
+  if (!m_worker) {
+    return;
+  }
+  m_worker->setJointState(*m_joint_positions, *m_joint_velocities);
+  m_dynamics_from_worker = m_worker->fetch();
+  if (!m_dynamics_from_worker) {
+    ++m_dynamics_fallbacks;
+  }
+}
+
+}  // namespace effort_controller_base
@@ -0,0 +1,280 @@
+#include <effort_controller_base/SelfCollision.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace effort_controller_base {
+
+namespace {
+
+ctrl::Vector3D toEigen(const KDL::Vector &vector) {
+  return ctrl::Vector3D(vector.x(), vector.y(), vector.z());
+}
+
+double pointSegmentDistance(const KDL::Vector &point, const KDL::Vector &start,
+                            const KDL::Vector &end) {
+  const KDL::Vector direction = end - start;
+  const double length2 = KDL::dot(direction, direction);
+  double s = 0.0;
+  if (length2 > 0.0) {
+    s = std::clamp(KDL::dot(point - start, direction) / length2, 0.0, 1.0);
+  }
+  return (start + s * direction - point).Norm();
+}
+
+}  // namespace
+
+size_t SelfCollision::appendUrdfCapsules(const urdf::Link &link, int id,
+                                         int depth,
+                                         std::vector<Capsule> &capsules) {
+  const size_t first = capsules.size();
+  size_t skipped = 0;
+  std::vector<Capsule> spheres;
+  for (const auto &collision : link.collision_array) {
+    if (!collision || !collision->geometry) {
+      continue;
+    }
+    double x, y, z, w;
+    collision->origin.rotation.getQuaternion(x, y, z, w);
+    const KDL::Frame origin(
+        KDL::Rotation::Quaternion(x, y, z, w),
+        KDL::Vector(collision->origin.position.x,
+                    collision->origin.position.y,
+                    collision->origin.position.z));
+
+    Capsule capsule;
+    capsule.link = id;
+    capsule.depth = depth;
+    switch (collision->geometry->type) {
+      case urdf::Geometry::CYLINDER: {
+        const auto &cylinder =
+            static_cast<const urdf::Cylinder &>(*collision->geometry);
+        capsule.start = origin * KDL::Vector(0.0, 0.0, -0.5 * cylinder.length);
+        capsule.end = origin * KDL::Vector(0.0, 0.0, 0.5 * cylinder.length);
+        capsule.radius = cylinder.radius;
+        capsules.push_back(capsule);
+        break;
+      }
+      case urdf::Geometry::SPHERE: {
+        const auto &sphere =
+            static_cast<const urdf::Sphere &>(*collision->geometry);
+        capsule.start = origin.p;
+        capsule.end = origin.p;
+        capsule.radius = sphere.radius;
+        spheres.push_back(capsule);
+        break;
+      }
+      default:
+        ++skipped;
+    }
+  }
+
+  for (const auto &sphere : spheres) {
+    bool covered = false;
+    for (size_t i = first; i < capsules.size() && !covered; ++i) {
+      covered = pointSegmentDistance(sphere.start, capsules[i].start,
+                                     capsules[i].end) +
+                    sphere.radius <=
+                capsules[i].radius + 1e-9;
+    }
+    if (!covered) {
+      capsules.push_back(sphere);
+    }
+  }
+  return skipped;
+}
+
+void SelfCollision::init(const std::vector<Capsule> &capsules,
+                         const std::vector<std::pair<int, int>> &ignored_links,
+                         size_t joints, const Settings &settings) {
+  m_settings = settings;
+  m_capsules = capsules;
+
+  m_pairs.clear();
+  int links = 0;
+  for (size_t i = 0; i < capsules.size(); ++i) {
+    links = std::max(links, capsules[i].link + 1);
+    for (size_t j = i + 1; j < capsules.size(); ++j) {
+      const int first = capsules[i].link;
+      const int second = capsules[j].link;
+      if (std::abs(capsules[i].depth - capsules[j].depth) <=
+          settings.ignore_adjacent) {
+        continue;
+      }
+      const bool ignored =
+          std::find_if(ignored_links.begin(), ignored_links.end(),
+                       [&](const std::pair<int, int> &link_pair) {
+                         return (link_pair.first == first &&
+                                 link_pair.second == second) ||
+                                (link_pair.first == second &&
+                                 link_pair.second == first);
+                       }) != ignored_links.end();
+      if (!ignored) {
+        m_pairs.emplace_back(i, j);
+      }
+    }
+  }
+
+  m_starts.assign(capsules.size(), ctrl::Vector3D::Zero());
+  m_directions.assign(capsules.size(), ctrl::Vector3D::Zero());
+  m_centers.assign(capsules.size(), ctrl::Vector3D::Zero());
+  m_bounds.assign(capsules.size(), 0.0);
+
+  const size_t lanes = m_pairs.size();
+  m_batch.assign(lanes, 0);
+  for (Lanes3 *lanes3 : {&m_start_1, &m_direction_1, &m_start_2,
+                         &m_direction_2, &m_closest_1, &m_closest_2,
+                         &m_offset}) {
+    lanes3->setZero(lanes, 3);
+  }
+  for (Eigen::ArrayXd *lane : {&m_a, &m_b, &m_c, &m_e, &m_f, &m_denominator,
+                               &m_s, &m_t, &m_radii, &m_distances}) {
+    lane->setZero(lanes);
+  }
+
+  m_link_slots.assign(links, -1);
+  m_link_jacobians.clear();
+  for (const auto &capsule : capsules) {
+    if (m_link_slots[capsule.link] < 0) {
+      m_link_slots[capsule.link] = m_link_jacobians.size();
+      m_link_jacobians.emplace_back(joints);
+    }
+  }
+  m_link_jacobian_ready.assign(m_link_jacobians.size(), 0);
+  m_row = ctrl::VectorND::Zero(joints);
+  m_close = 0;
+  m_minimum_distance = settings.distance;
+}
+
+void SelfCollision::computeDistances(size_t n) {
+  // Closest points of two segments p_1 + s d_1 and p_2 + t d_2.  The best s
+  // for the clamped t is exact in all cases, including parallel and
+  // degenerate segments, so that no lane needs a branch.
+  constexpr double eps = 1e-12;
+  auto p1 = m_start_1.topRows(n);
+  auto d1 = m_direction_1.topRows(n);
+  auto p2 = m_start_2.topRows(n);
+  auto d2 = m_direction_2.topRows(n);
+  auto r = m_offset.topRows(n);
+  auto a = m_a.head(n);
+  auto b = m_b.head(n);
+  auto c = m_c.head(n);
+  auto e = m_e.head(n);
+  auto f = m_f.head(n);
+  auto denominator = m_denominator.head(n);
+  auto s = m_s.head(n);
+  auto t = m_t.head(n);
+
+  r = p1 - p2;
+  a = (d1 * d1).rowwise().sum();
+  b = (d1 * d2).rowwise().sum();
+  c = (d1 * r).rowwise().sum();
+  e = (d2 * d2).rowwise().sum();
+  f = (d2 * r).rowwise().sum();
+  denominator = a * e - b * b;
+
+  s = (denominator > eps)
+          .select(((b * f - c * e) / denominator.max(eps)).max(0.0).min(1.0),
+                  0.0);
+  t = ((b * s + f) / e.max(eps)).max(0.0).min(1.0);
+  s = ((b * t - c) / a.max(eps)).max(0.0).min(1.0);
+
+  m_closest_1.topRows(n) = p1 + d1.colwise() * s;
+  m_closest_2.topRows(n) = p2 + d2.colwise() * t;
+  m_distances.head(n) =
+      (m_closest_1.topRows(n) - m_closest_2.topRows(n))
+          .square()
+          .rowwise()
+          .sum()
+          .sqrt() -
+      m_radii.head(n);
+}
+
+void SelfCollision::update(const RobotModel &model,
+                           const ctrl::VectorND &q_dot, ctrl::VectorND &tau) {
+  tau.setZero();
+  const std::vector<KDL::Frame> &poses = model.linkPoses();
+
+  // Capsules and their bounding spheres in the robot base frame
+  for (size_t i = 0; i < m_capsules.size(); ++i) {
+    const Capsule &capsule = m_capsules[i];
+    const KDL::Frame &pose = poses[capsule.link];
+    m_starts[i] = toEigen(pose * capsule.start);
+    m_directions[i] = toEigen(pose * capsule.end) - m_starts[i];
+    m_centers[i] = m_starts[i] + 0.5 * m_directions[i];
+    m_bounds[i] = 0.5 * m_directions[i].norm() + capsule.radius;
+  }
+
+  // Broadphase
+  m_close = 0;
+  for (size_t k = 0; k < m_pairs.size(); ++k) {
+    const size_t i = m_pairs[k].first;
+    const size_t j = m_pairs[k].second;
+    const double reach = m_bounds[i] + m_bounds[j] + m_settings.distance;
+    if ((m_centers[i] - m_centers[j]).squaredNorm() >= reach * reach) {
+      continue;
+    }
+    m_batch[m_close] = k;
+    m_start_1.row(m_close) = m_starts[i].transpose();
+    m_direction_1.row(m_close) = m_directions[i].transpose();
+    m_start_2.row(m_close) = m_starts[j].transpose();
+    m_direction_2.row(m_close) = m_directions[j].transpose();
+    m_radii[m_close] = m_capsules[i].radius + m_capsules[j].radius;
+    ++m_close;
+  }
+  m_minimum_distance = m_settings.distance;
+  if (m_close == 0) {
+    return;
+  }
+
+  computeDistances(m_close);
+  m_minimum_distance =
+      std::min(m_minimum_distance, m_distances.head(m_close).minCoeff());
+
+  // Repulsion of the pairs within the activation distance
+  std::fill(m_link_jacobian_ready.begin(), m_link_jacobian_ready.end(), 0);
+  for (size_t lane = 0; lane < m_close; ++lane) {
+    const double distance = m_distances[lane];
+    if (distance >= m_settings.distance) {
+      continue;
+    }
+    const ctrl::Vector3D closest_1 = m_closest_1.row(lane).transpose();
+    const ctrl::Vector3D closest_2 = m_closest_2.row(lane).transpose();
+    ctrl::Vector3D normal = closest_1 - closest_2;
+    const double norm = normal.norm();
+    if (norm < 1e-9) {
+      continue;  // Intersecting axes, no direction to push
+    }
+    normal /= norm;
+
+    // n^T J of a point p on a link is the wrench (n, (p - o) x n) applied
+    // to the Jacobian of the link origin o.
+    m_row.setZero();
+    const auto &pair = m_pairs[m_batch[lane]];
+    const int links[2] = {m_capsules[pair.first].link,
+                          m_capsules[pair.second].link};
+    const ctrl::Vector3D points[2] = {closest_1, closest_2};
+    for (int side = 0; side < 2; ++side) {
+      const int slot = m_link_slots[links[side]];
+      KDL::Jacobian &jacobian = m_link_jacobians[slot];
+      if (!m_link_jacobian_ready[slot]) {
+        model.linkJacobian(links[side], jacobian);
+        m_link_jacobian_ready[slot] = 1;
+      }
+      const double sign = side == 0 ? 1.0 : -1.0;
+      const ctrl::Vector3D lever = points[side] - toEigen(poses[links[side]].p);
+      ctrl::Vector6D wrench;
+      wrench.head<3>() = sign * normal;
+      wrench.tail<3>() = lever.cross(wrench.head<3>());
+      m_row.noalias() += jacobian.data.transpose() * wrench;
+    }
+
+    const double force =
+        std::max(0.0, m_settings.stiffness * (m_settings.distance - distance) -
+                          m_settings.damping * m_row.dot(q_dot));
+    tau += force * m_row;
+  }
+}
+
+}  // namespace effort_controller_base
@@ -0,0 +1,309 @@
+#include <effort_controller_base/TreeModel.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace effort_controller_base {
+
+namespace {
+
+ctrl::Vector3D toEigen(const KDL::Vector &vector) {
+  return ctrl::Vector3D(vector.x(), vector.y(), vector.z());
+}
+
+ctrl::Matrix3D skew(const ctrl::Vector3D &v) {
+  ctrl::Matrix3D m;
+  m << 0.0, -v.z(), v.y(), v.z(), 0.0, -v.x(), -v.y(), v.x(), 0.0;
+  return m;
+}
+
+bool isPrismatic(const KDL::Joint &joint) {
+  switch (joint.getType()) {
+    case KDL::Joint::TransAxis:
+    case KDL::Joint::TransX:
+    case KDL::Joint::TransY:
+    case KDL::Joint::TransZ:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Spatial cross products for motions and forces, linear parts first
+ctrl::Vector6D crossMotion(const ctrl::Vector6D &v, const ctrl::Vector6D &u) {
+  ctrl::Vector6D out;
+  out.head<3>() = v.tail<3>().cross(u.head<3>()) +
+                  v.head<3>().cross(u.tail<3>());
+  out.tail<3>() = v.tail<3>().cross(u.tail<3>());
+  return out;
+}
+
+ctrl::Vector6D crossForce(const ctrl::Vector6D &v, const ctrl::Vector6D &f) {
+  ctrl::Vector6D out;
+  out.head<3>() = v.tail<3>().cross(f.head<3>());
+  out.tail<3>() = v.tail<3>().cross(f.tail<3>()) +
+                  v.head<3>().cross(f.head<3>());
+  return out;
+}
+
+}  // namespace
+
+bool TreeModel::init(const KDL::Tree &tree, const std::string &base_link,
+                     const std::vector<std::string> &joint_names,
+                     const std::vector<std::string> &end_effectors,
+                     const KDL::JntArray *joint_positions,
+                     const KDL::JntArray *joint_velocities,
+                     const KDL::Vector &gravity) {
+  m_joint_positions = joint_positions;
+  m_joint_velocities = joint_velocities;
+  m_gravity_vector = toEigen(gravity);
+  m_segments.clear();
+  m_parents.clear();
+  m_joints.clear();
+  m_masses.clear();
+  m_centers_of_mass.clear();
+  m_central_inertias.clear();
+  m_link_ids.clear();
+
+  const auto base = tree.getSegments().find(base_link);
+  if (base == tree.getSegments().end()) {
+    return false;
+  }
+
+  // Depth-first, so that parents come before their children
+  std::vector<std::pair<KDL::SegmentMap::const_iterator, int>> open;
+  open.emplace_back(base, -1);
+  std::vector<bool> found(joint_names.size(), false);
+  while (!open.empty()) {
+    const auto element = open.back().first;
+    const int parent = open.back().second;
+    open.pop_back();
+
+    const int id = m_segments.size();
+    const KDL::Segment &segment = KDL::GetTreeElementSegment(element->second);
+    int joint = -1;
+    if (parent >= 0 && segment.getJoint().getType() != KDL::Joint::None) {
+      const auto it = std::find(joint_names.begin(), joint_names.end(),
+                                segment.getJoint().getName());
+      if (it != joint_names.end()) {
+        joint = it - joint_names.begin();
+        found[joint] = true;
+      }
+    }
+
+    // KDL stores the rotational inertia about the link frame's origin
+    const KDL::RigidBodyInertia &inertia = segment.getInertia();
+    const double mass = parent >= 0 ? inertia.getMass() : 0.0;
+    const ctrl::Vector3D cog = toEigen(inertia.getCOG());
+    const KDL::RotationalInertia rotational = inertia.getRotationalInertia();
+    ctrl::Matrix3D about_origin;
+    for (int i = 0; i < 3; ++i) {
+      KDL::Vector axis = KDL::Vector::Zero();
+      axis(i) = 1.0;
+      about_origin.col(i) = toEigen(rotational * axis);
+    }
+
+    const ctrl::Matrix3D central =
+        about_origin - mass * (cog.squaredNorm() * ctrl::Matrix3D::Identity() -
+                               cog * cog.transpose());
+
+    m_segments.push_back(segment);
+    m_parents.push_back(parent);
+    m_joints.push_back(joint);
+    m_masses.push_back(mass);
+    m_centers_of_mass.push_back(inertia.getCOG());
+    m_central_inertias.push_back(parent >= 0 ? central
+                                             : ctrl::Matrix3D::Zero());
+    m_link_ids[segment.getName()] = id;
+
+    for (const auto &child : KDL::GetTreeElementChildren(element->second)) {
+      open.emplace_back(child, id);
+    }
+  }
+  if (std::find(found.begin(), found.end(), false) != found.end()) {
+    return false;
+  }
+
+  m_end_effector_paths.clear();
+  m_end_effector_ids.clear();
+  for (const auto &name : end_effectors) {
+    const int id = linkId(name);
+    if (id < 0) {
+      return false;
+    }
+    std::vector<int> path;
+    for (int body = id; body > 0; body = m_parents[body]) {
+      if (m_joints[body] >= 0) {
+        path.push_back(body);
+      }
+    }
+    m_end_effector_ids.push_back(id);
+    m_end_effector_paths.push_back(path);
+  }
+
+  const size_t bodies = m_segments.size();
+  const size_t joints = joint_names.size();
+
+  Kinematics kinematics;
+  kinematics.poses.assign(bodies, KDL::Frame::Identity());
+  kinematics.motions.assign(bodies, ctrl::Vector6D::Zero());
+  kinematics.inertias.assign(bodies, ctrl::Matrix6D::Zero());
+  m_kinematics.init(&m_epoch, std::move(kinematics),
+                    [this](Kinematics &k) { computeKinematics(k); });
+
+  Bias bias;
+  bias.gravity = KDL::JntArray(joints);
+  bias.coriolis = KDL::JntArray(joints);
+  bias.velocities.assign(bodies, ctrl::Vector6D::Zero());
+  bias.accelerations.assign(bodies, ctrl::Vector6D::Zero());
+  bias.gravity_forces.assign(bodies, ctrl::Vector6D::Zero());
+  bias.coriolis_forces.assign(bodies, ctrl::Vector6D::Zero());
+  m_bias.init(&m_epoch, std::move(bias),
+              [this](Bias &b) { computeBias(b); });
+
+  m_mass_matrix.init(&m_epoch, KDL::JntSpaceInertiaMatrix(joints),
+                     [this](KDL::JntSpaceInertiaMatrix &mass) {
+                       computeMassMatrix(mass);
+                     });
+  m_composite_inertias.assign(bodies, ctrl::Matrix6D::Zero());
+
+  m_jacobians = std::vector<LazyNode<KDL::Jacobian>>(end_effectors.size());
+  for (size_t k = 0; k < end_effectors.size(); ++k) {
+    KDL::Jacobian jacobian(joints);
+    jacobian.data.setZero();
+    m_jacobians[k].init(
+        &m_epoch, std::move(jacobian),
+        [this, k](KDL::Jacobian &j) { computeJacobian(k, j); });
+  }
+  return true;
+}
+
+void TreeModel::computeKinematics(Kinematics &kinematics) const {
+  const KDL::JntArray &q = *m_joint_positions;
+  for (size_t i = 1; i < m_segments.size(); ++i) {
+    const KDL::Segment &segment = m_segments[i];
+    const KDL::Frame &parent = kinematics.poses[m_parents[i]];
+    const int joint = m_joints[i];
+    kinematics.poses[i] = parent * segment.pose(joint >= 0 ? q(joint) : 0.0);
+    const KDL::Frame &pose = kinematics.poses[i];
+
+    // The joint axis is fixed in the parent link
+    if (joint >= 0) {
+      const ctrl::Vector3D axis =
+          toEigen(parent.M * segment.getJoint().JointAxis());
+      ctrl::Vector6D &motion = kinematics.motions[i];
+      if (isPrismatic(segment.getJoint())) {
+        motion << axis, ctrl::Vector3D::Zero();
+      } else {
+        const ctrl::Vector3D origin =
+            toEigen(parent * segment.getJoint().JointOrigin());
+        motion << origin.cross(axis), axis;
+      }
+    }
+
+    // Spatial inertia about the base origin
+    ctrl::Matrix3D rotation;
+    for (int r = 0; r < 3; ++r) {
+      for (int c = 0; c < 3; ++c) {
+        rotation(r, c) = pose.M(r, c);
+      }
+    }
+    const double mass = m_masses[i];
+    const ctrl::Matrix3D center = skew(toEigen(pose * m_centers_of_mass[i]));
+    ctrl::Matrix6D &inertia = kinematics.inertias[i];
+    inertia.topLeftCorner<3, 3>() = mass * ctrl::Matrix3D::Identity();
+    inertia.topRightCorner<3, 3>() = -mass * center;
+    inertia.bottomLeftCorner<3, 3>() = mass * center;
+    inertia.bottomRightCorner<3, 3>() =
+        rotation * m_central_inertias[i] * rotation.transpose() -
+        mass * center * center;
+  }
+}
+
+void TreeModel::computeBias(Bias &bias) const {
+  const Kinematics &kinematics = m_kinematics.get();
+  const KDL::JntArray &q_dot = *m_joint_velocities;
+
+  // Gravity as an upward acceleration of the base
+  ctrl::Vector6D base_acceleration;
+  base_acceleration << -m_gravity_vector, ctrl::Vector3D::Zero();
+
+  // Velocities and velocity product accelerations towards the leaves
+  for (size_t i = 1; i < m_segments.size(); ++i) {
+    const int parent = m_parents[i];
+    const int joint = m_joints[i];
+    ctrl::Vector6D &velocity = bias.velocities[i];
+    ctrl::Vector6D &acceleration = bias.accelerations[i];
+    velocity = bias.velocities[parent];
+    acceleration = bias.accelerations[parent];
+    if (joint >= 0) {
+      const ctrl::Vector6D joint_velocity =
+          kinematics.motions[i] * q_dot(joint);
+      velocity += joint_velocity;
+      acceleration += crossMotion(velocity, joint_velocity);
+    }
+    const ctrl::Matrix6D &inertia = kinematics.inertias[i];
+    bias.coriolis_forces[i].noalias() = inertia * acceleration;
+    bias.coriolis_forces[i] += crossForce(velocity, inertia * velocity);
+    bias.gravity_forces[i].noalias() = inertia * base_acceleration;
+  }
+
+  // Forces of whole subtrees towards the base
+  for (size_t i = m_segments.size() - 1; i > 0; --i) {
+    const int parent = m_parents[i];
+    const int joint = m_joints[i];
+    if (joint >= 0) {
+      bias.gravity(joint) = kinematics.motions[i].dot(bias.gravity_forces[i]);
+      bias.coriolis(joint) =
+          kinematics.motions[i].dot(bias.coriolis_forces[i]);
+    }
+    if (parent > 0) {
+      bias.gravity_forces[parent] += bias.gravity_forces[i];
+      bias.coriolis_forces[parent] += bias.coriolis_forces[i];
+    }
+  }
+}
+
+void TreeModel::computeMassMatrix(KDL::JntSpaceInertiaMatrix &mass) const {
+  const Kinematics &kinematics = m_kinematics.get();
+  mass.data.setZero();
+  for (size_t i = 1; i < m_segments.size(); ++i) {
+    m_composite_inertias[i] = kinematics.inertias[i];
+  }
+
+  // Composite rigid bodies.  Joints on different branches do not couple.
+  for (size_t i = m_segments.size() - 1; i > 0; --i) {
+    const int parent = m_parents[i];
+    const int joint = m_joints[i];
+    if (joint >= 0) {
+      const ctrl::Vector6D force =
+          m_composite_inertias[i] * kinematics.motions[i];
+      mass(joint, joint) = kinematics.motions[i].dot(force);
+      for (int body = parent; body > 0; body = m_parents[body]) {
+        const int other = m_joints[body];
+        if (other >= 0) {
+          mass(other, joint) = kinematics.motions[body].dot(force);
+          mass(joint, other) = mass(other, joint);
+        }
+      }
+    }
+    if (parent > 0) {
+      m_composite_inertias[parent] += m_composite_inertias[i];
+    }
+  }
+}
+
+void TreeModel::computeJacobian(size_t k, KDL::Jacobian &jacobian) const {
+  const Kinematics &kinematics = m_kinematics.get();
+  const ctrl::Vector3D tip =
+      toEigen(kinematics.poses[m_end_effector_ids[k]].p);
+  for (const int body : m_end_effector_paths[k]) {
+    const ctrl::Vector6D &motion = kinematics.motions[body];
+    const int joint = m_joints[body];
+    jacobian.data.col(joint).head<3>() =
+        motion.head<3>() + motion.tail<3>().cross(tip);
+    jacobian.data.col(joint).tail<3>() = motion.tail<3>();
+  }
+}
+
+}  // namespace effort_controller_base
@@ -0,0 +1,441 @@
+#include <effort_controller_base/VirtualFixtures.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <sstream>
+
+namespace effort_controller_base {
+
+namespace {
+
+constexpr int leaf_size = 4;
+constexpr int max_depth = 64;
+
+ctrl::Vector3D toEigen(const KDL::Vector &vector) {
+  return ctrl::Vector3D(vector.x(), vector.y(), vector.z());
+}
+
+ctrl::Matrix3D toEigen(const KDL::Rotation &rotation) {
+  ctrl::Matrix3D matrix;
+  for (int r = 0; r < 3; ++r) {
+    for (int c = 0; c < 3; ++c) {
+      matrix(r, c) = rotation(r, c);
+    }
+  }
+  return matrix;
+}
+
+double sign(double value) { return value < 0.0 ? -1.0 : 1.0; }
+
+// Closest point on triangle abc, see Ericson, Real-Time Collision Detection
+ctrl::Vector3D closestOnTriangle(const ctrl::Vector3D &p,
+                                 const ctrl::Vector3D &a,
+                                 const ctrl::Vector3D &b,
+                                 const ctrl::Vector3D &c) {
+  const ctrl::Vector3D ab = b - a;
+  const ctrl::Vector3D ac = c - a;
+  const ctrl::Vector3D ap = p - a;
+  const double d1 = ab.dot(ap);
+  const double d2 = ac.dot(ap);
+  if (d1 <= 0.0 && d2 <= 0.0) {
+    return a;
+  }
+  const ctrl::Vector3D bp = p - b;
+  const double d3 = ab.dot(bp);
+  const double d4 = ac.dot(bp);
+  if (d3 >= 0.0 && d4 <= d3) {
+    return b;
+  }
+  const double vc = d1 * d4 - d3 * d2;
+  if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) {
+    return a + d1 / (d1 - d3) * ab;
+  }
+  const ctrl::Vector3D cp = p - c;
+  const double d5 = ab.dot(cp);
+  const double d6 = ac.dot(cp);
+  if (d6 >= 0.0 && d5 <= d6) {
+    return c;
+  }
+  const double vb = d5 * d2 - d1 * d6;
+  if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) {
+    return a + d2 / (d2 - d6) * ac;
+  }
+  const double va = d3 * d6 - d5 * d4;
+  if (va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0) {
+    return b + (d4 - d3) / ((d4 - d3) + (d5 - d6)) * (c - b);
+  }
+  const double denominator = 1.0 / (va + vb + vc);
+  return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+}  // namespace
+
+bool VirtualFixtures::loadStl(const std::string &filename,
+                              std::vector<KDL::Vector> &vertices,
+                              std::string &error) {
+  const std::string prefix = "file://";
+  const std::string path = filename.compare(0, prefix.size(), prefix) == 0
+                               ? filename.substr(prefix.size())
+                               : filename;
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    error = "cannot open " + path;
+    return false;
+  }
+  const std::string content((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+
+  // Binary files have an 80 byte header, a triangle count and 50 bytes per
+  // triangle.  ASCII files start with "solid", but so do some binary ones.
+  const size_t first = vertices.size();
+  uint32_t count = 0;
+  if (content.size() >= 84) {
+    std::memcpy(&count, content.data() + 80, sizeof(count));
+  }
+  if (content.size() >= 84 && content.size() == 84 + 50 * size_t(count)) {
+    for (uint32_t i = 0; i < count; ++i) {
+      float coordinates[9];
+      std::memcpy(coordinates, content.data() + 84 + 50 * i + 12,
+                  sizeof(coordinates));
+      for (int v = 0; v < 3; ++v) {
+        vertices.emplace_back(coordinates[3 * v], coordinates[3 * v + 1],
+                              coordinates[3 * v + 2]);
+      }
+    }
+  } else if (content.compare(0, 5, "solid") == 0) {
+    std::istringstream stream(content);
+    std::string token;
+    while (stream >> token) {
+      if (token == "vertex") {
+        double x, y, z;
+        if (!(stream >> x >> y >> z)) {
+          error = path + " has a malformed vertex";
+          vertices.resize(first);
+          return false;
+        }
+        vertices.emplace_back(x, y, z);
+      }
+    }
+  } else {
+    error = path + " is not an STL file";
+    return false;
+  }
+
+  if (vertices.size() == first || (vertices.size() - first) % 3 != 0) {
+    error = path + " has no complete triangles";
+    vertices.resize(first);
+    return false;
+  }
+  return true;
+}
+
+void VirtualFixtures::init(const std::vector<Fixture> &fixtures,
+                           const std::vector<int> &links,
+                           const std::vector<double> &radii, size_t joints,
+                           const Settings &settings) {
+  m_settings = settings;
+  m_half_spaces.clear();
+  m_primitives.clear();
+  m_nodes.clear();
+  std::vector<Eigen::AlignedBox3d> bounds;
+
+  int slots = 0;
+  for (const auto &fixture : fixtures) {
+    const ctrl::Matrix3D rotation = toEigen(fixture.pose.M);
+    const ctrl::Vector3D origin = toEigen(fixture.pose.p);
+    const ctrl::Vector3D size = toEigen(fixture.size);
+
+    Primitive primitive;
+    primitive.type = fixture.type;
+    primitive.rotation = rotation;
+    primitive.origin = origin;
+    primitive.a.setZero();
+    primitive.b.setZero();
+    primitive.c.setZero();
+    switch (fixture.type) {
+      case Type::Plane: {
+        HalfSpace half_space;
+        half_space.normal = rotation.col(2);
+        half_space.offset = half_space.normal.dot(origin);
+        half_space.slot = slots++;
+        m_half_spaces.push_back(half_space);
+        break;
+      }
+      case Type::Box: {
+        const ctrl::Vector3D half = 0.5 * size;
+        if (fixture.inside) {
+          // One wall per face, each with its own slot, so that links in a
+          // corner are pushed back by both walls
+          for (int axis = 0; axis < 3; ++axis) {
+            for (const double side : {-1.0, 1.0}) {
+              HalfSpace half_space;
+              half_space.normal = -side * rotation.col(axis);
+              half_space.offset = half_space.normal.dot(
+                  origin + side * half[axis] * rotation.col(axis));
+              half_space.slot = slots++;
+              m_half_spaces.push_back(half_space);
+            }
+          }
+          break;
+        }
+        primitive.slot = slots++;
+        primitive.a = half;
+        Eigen::AlignedBox3d box;
+        for (int corner = 0; corner < 8; ++corner) {
+          const ctrl::Vector3D local(corner & 1 ? half.x() : -half.x(),
+                                     corner & 2 ? half.y() : -half.y(),
+                                     corner & 4 ? half.z() : -half.z());
+          box.extend(origin + rotation * local);
+        }
+        m_primitives.push_back(primitive);
+        bounds.push_back(box);
+        break;
+      }
+      case Type::Cylinder: {
+        primitive.slot = slots++;
+        primitive.a << size.x(), 0.5 * size.y(), 0.0;
+        const ctrl::Vector3D axis = 0.5 * size.y() * rotation.col(2);
+        const ctrl::Vector3D radius = ctrl::Vector3D::Constant(size.x());
+        Eigen::AlignedBox3d box(origin - axis - radius, origin - axis + radius);
+        box.extend(Eigen::AlignedBox3d(origin + axis - radius,
+                                       origin + axis + radius));
+        m_primitives.push_back(primitive);
+        bounds.push_back(box);
+        break;
+      }
+      case Type::Mesh: {
+        primitive.slot = slots++;
+        for (size_t i = 0; i + 2 < fixture.vertices.size(); i += 3) {
+          ctrl::Vector3D *corners[3] = {&primitive.a, &primitive.b,
+                                        &primitive.c};
+          Eigen::AlignedBox3d box;
+          for (int v = 0; v < 3; ++v) {
+            *corners[v] = origin + rotation * toEigen(fixture.vertices[i + v])
+                                                  .cwiseProduct(size);
+            box.extend(*corners[v]);
+          }
+          m_primitives.push_back(primitive);
+          bounds.push_back(box);
+        }
+        break;
+      }
+    }
+  }
+
+  if (!m_primitives.empty()) {
+    m_nodes.reserve(2 * m_primitives.size());
+    build(0, m_primitives.size(), bounds);
+  }
+
+  m_links = links;
+  m_radii = radii;
+  m_wrenches.assign(links.size(), ctrl::Vector6D::Zero());
+  m_slot_penetrations.assign(slots, 0.0);
+  m_slot_normals.assign(slots, ctrl::Vector3D::Zero());
+  m_touched_slots.clear();
+  m_touched_slots.reserve(slots);
+  m_jacobian = KDL::Jacobian(joints);
+  m_maximum_penetration = 0.0;
+  m_contacts = 0;
+}
+
+int VirtualFixtures::build(int first, int count,
+                           std::vector<Eigen::AlignedBox3d> &bounds) {
+  Node node;
+  node.bounds.setEmpty();
+  for (int i = first; i < first + count; ++i) {
+    node.bounds.extend(bounds[i]);
+  }
+  node.left = -1;
+  node.right = -1;
+  node.first = first;
+  node.count = count;
+  const int id = m_nodes.size();
+  m_nodes.push_back(node);
+  if (count <= leaf_size) {
+    return id;
+  }
+
+  // Split at the median center along the longest axis
+  Eigen::Index axis;
+  node.bounds.sizes().maxCoeff(&axis);
+  std::vector<int> order(count);
+  std::iota(order.begin(), order.end(), first);
+  std::nth_element(order.begin(), order.begin() + count / 2, order.end(),
+                   [&bounds, axis](int i, int j) {
+                     return bounds[i].center()[axis] <
+                            bounds[j].center()[axis];
+                   });
+  std::vector<Primitive> primitives;
+  std::vector<Eigen::AlignedBox3d> boxes;
+  for (const int i : order) {
+    primitives.push_back(m_primitives[i]);
+    boxes.push_back(bounds[i]);
+  }
+  std::copy(primitives.begin(), primitives.end(),
+            m_primitives.begin() + first);
+  std::copy(boxes.begin(), boxes.end(), bounds.begin() + first);
+
+  const int left = build(first, count / 2, bounds);
+  const int right = build(first + count / 2, count - count / 2, bounds);
+  m_nodes[id].left = left;
+  m_nodes[id].right = right;
+  m_nodes[id].count = 0;
+  return id;
+}
+
+double VirtualFixtures::distance(const Primitive &primitive,
+                                 const ctrl::Vector3D &point,
+                                 ctrl::Vector3D &normal) {
+  switch (primitive.type) {
+    case Type::Box: {
+      const ctrl::Vector3D local =
+          primitive.rotation.transpose() * (point - primitive.origin);
+      const ctrl::Vector3D outside = local.cwiseAbs() - primitive.a;
+      Eigen::Index axis;
+      const double deepest = outside.maxCoeff(&axis);
+      ctrl::Vector3D direction = ctrl::Vector3D::Zero();
+      double distance = deepest;
+      if (deepest > 0.0) {
+        const ctrl::Vector3D excess = outside.cwiseMax(0.0);
+        distance = excess.norm();
+        for (int i = 0; i < 3; ++i) {
+          direction[i] = sign(local[i]) * excess[i] / distance;
+        }
+      } else {
+        direction[axis] = sign(local[axis]);
+      }
+      normal = primitive.rotation * direction;
+      return distance;
+    }
+    case Type::Cylinder: {
+      const ctrl::Vector3D local =
+          primitive.rotation.transpose() * (point - primitive.origin);
+      const double rho = local.head<2>().norm();
+      const ctrl::Vector3D radial = rho > 1e-12
+                                        ? ctrl::Vector3D(local.x() / rho,
+                                                         local.y() / rho, 0.0)
+                                        : ctrl::Vector3D::UnitX();
+      const ctrl::Vector3D axial(0.0, 0.0, sign(local.z()));
+      const double to_mantle = rho - primitive.a.x();
+      const double to_cap = std::abs(local.z()) - primitive.a.y();
+      ctrl::Vector3D direction;
+      double distance;
+      if (to_mantle > 0.0 || to_cap > 0.0) {
+        const double mantle = std::max(to_mantle, 0.0);
+        const double cap = std::max(to_cap, 0.0);
+        distance = std::hypot(mantle, cap);
+        direction = (mantle * radial + cap * axial) / distance;
+      } else {
+        distance = std::max(to_mantle, to_cap);
+        direction = to_mantle > to_cap ? radial : axial;
+      }
+      normal = primitive.rotation * direction;
+      return distance;
+    }
+    default: {
+      // Triangles have no inside and push away from their surface
+      const ctrl::Vector3D closest =
+          closestOnTriangle(point, primitive.a, primitive.b, primitive.c);
+      normal = point - closest;
+      const double distance = normal.norm();
+      if (distance > 1e-12) {
+        normal /= distance;
+      } else {
+        normal = (primitive.b - primitive.a)
+                     .cross(primitive.c - primitive.a)
+                     .normalized();
+      }
+      return distance;
+    }
+  }
+}
+
+void VirtualFixtures::addContact(int slot, double penetration,
+                                 const ctrl::Vector3D &normal) {
+  if (m_slot_penetrations[slot] == 0.0) {
+    m_touched_slots.push_back(slot);
+  }
+  if (penetration > m_slot_penetrations[slot]) {
+    m_slot_penetrations[slot] = penetration;
+    m_slot_normals[slot] = normal;
+  }
+}
+
+void VirtualFixtures::update(const RobotModel &model,
+                             const ctrl::VectorND &q_dot,
+                             ctrl::VectorND &tau) {
+  tau.setZero();
+  m_maximum_penetration = 0.0;
+  m_contacts = 0;
+  const std::vector<KDL::Frame> &poses = model.linkPoses();
+
+  for (size_t k = 0; k < m_links.size(); ++k) {
+    m_wrenches[k].setZero();
+    const ctrl::Vector3D center = toEigen(poses[m_links[k]].p);
+    const double radius = m_radii[k];
+    m_touched_slots.clear();
+
+    for (const auto &half_space : m_half_spaces) {
+      const double penetration =
+          radius - (half_space.normal.dot(center) - half_space.offset);
+      if (penetration > 0.0) {
+        addContact(half_space.slot, penetration, half_space.normal);
+      }
+    }
+
+    // Depth-first through all nodes whose bounds the sphere overlaps
+    int stack[max_depth];
+    int top = 0;
+    if (!m_nodes.empty()) {
+      stack[top++] = 0;
+    }
+    while (top > 0) {
+      const Node &node = m_nodes[stack[--top]];
+      if (node.bounds.squaredExteriorDistance(center) >= radius * radius) {
+        continue;
+      }
+      if (node.left >= 0) {
+        stack[top++] = node.left;
+        stack[top++] = node.right;
+        continue;
+      }
+      for (int i = node.first; i < node.first + node.count; ++i) {
+        ctrl::Vector3D normal;
+        const double penetration =
+            radius - distance(m_primitives[i], center, normal);
+        if (penetration > 0.0) {
+          addContact(m_primitives[i].slot, penetration, normal);
+        }
+      }
+    }
+    if (m_touched_slots.empty()) {
+      continue;
+    }
+
+    // Unilateral spring-damper walls on the link origin
+    model.linkJacobian(m_links[k], m_jacobian);
+    const auto linear = m_jacobian.data.topRows<3>();
+    const ctrl::Vector3D velocity = linear * q_dot;
+    ctrl::Vector3D force = ctrl::Vector3D::Zero();
+    for (const int slot : m_touched_slots) {
+      const double penetration = m_slot_penetrations[slot];
+      const ctrl::Vector3D &normal = m_slot_normals[slot];
+      force += std::max(0.0, m_settings.stiffness * penetration -
+                                 m_settings.damping * normal.dot(velocity)) *
+               normal;
+      m_maximum_penetration = std::max(m_maximum_penetration, penetration);
+      m_slot_penetrations[slot] = 0.0;
+      ++m_contacts;
+    }
+    m_wrenches[k].head<3>() = force;
+    tau.noalias() += linear.transpose() * force;
+  }
+}
+
+}  // namespace effort_controller_base
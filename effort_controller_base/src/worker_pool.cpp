@@ -0,0 +1,132 @@
+#include <effort_controller_base/WorkerPool.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <climits>
+
+namespace effort_controller_base {
+
+namespace {
+
+// Polling rounds of idle workers before they sleep
+constexpr int spin_rounds = 2000;
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) &&
+                  std::atomic<uint32_t>::is_always_lock_free,
+              "The generation counter must be usable as a futex word");
+
+long futex(std::atomic<uint32_t> *word, int op, uint32_t value) {
+  return syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), op, value,
+                 nullptr, nullptr, 0);
+}
+
+}  // namespace
+
+bool WorkerPool::start(size_t threads, const std::vector<int> &cpus,
+                       int priority, bool busy_wait) {
+  stop();
+  m_busy_wait = busy_wait;
+  m_stopping = false;
+  m_stride = threads + 1;
+
+  // Workers only wait for runs after this one, even if they start late
+  const uint32_t generation = m_generation.load(std::memory_order_acquire);
+  bool applied = true;
+  m_threads.reserve(threads);
+  for (size_t i = 0; i < threads; ++i) {
+    m_threads.emplace_back(&WorkerPool::work, this, i + 1, generation);
+    const pthread_t handle = m_threads.back().native_handle();
+    if (i < cpus.size()) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpus[i], &set);
+      applied &= pthread_setaffinity_np(handle, sizeof(set), &set) == 0;
+    }
+    if (priority > 0) {
+      sched_param param;
+      param.sched_priority = priority;
+      applied &= pthread_setschedparam(handle, SCHED_FIFO, &param) == 0;
+    }
+  }
+  return applied;
+}
+
+void WorkerPool::stop() {
+  m_stopping = true;
+  advance();
+  for (auto &thread : m_threads) {
+    thread.join();
+  }
+  m_threads.clear();
+  m_stride = 1;
+}
+
+void WorkerPool::run(size_t count, const Job &job) {
+  if (m_threads.empty() || count < 2) {
+    for (size_t k = 0; k < count; ++k) {
+      job(k);
+    }
+    return;
+  }
+
+  // Hand the job over.  The workers of the last run are all done, so nobody
+  // reads these while they change.
+  m_job = &job;
+  m_count = count;
+  m_pending.store(m_threads.size(), std::memory_order_relaxed);
+  advance();
+
+  // The calling thread takes its share
+  for (size_t k = 0; k < count; k += m_stride) {
+    job(k);
+  }
+
+  // Barrier
+  while (m_pending.load(std::memory_order_acquire) > 0) {
+    std::this_thread::yield();
+  }
+}
+
+void WorkerPool::advance() {
+  // Either a worker that is about to sleep sees the new generation, or this
+  // thread sees it as a sleeper and wakes it.  Both orders are sequentially
+  // consistent, and the futex only sleeps while the generation is unchanged.
+  m_generation.fetch_add(1, std::memory_order_seq_cst);
+  if (m_sleepers.load(std::memory_order_seq_cst) > 0) {
+    futex(&m_generation, FUTEX_WAKE_PRIVATE, INT_MAX);
+  }
+}
+
+void WorkerPool::wait(uint32_t seen) {
+  int round = 0;
+  while (m_generation.load(std::memory_order_acquire) == seen) {
+    if (!m_busy_wait && ++round >= spin_rounds) {
+      m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+      while (m_generation.load(std::memory_order_seq_cst) == seen) {
+        futex(&m_generation, FUTEX_WAIT_PRIVATE, seen);
+      }
+      m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+}
+
+void WorkerPool::work(size_t first, uint32_t seen) {
+  while (true) {
+    wait(seen);
+    if (m_stopping) {
+      return;
+    }
+    seen = m_generation.load(std::memory_order_acquire);
+
+    for (size_t k = first; k < m_count; k += m_stride) {
+      (*m_job)(k);
+    }
+    m_pending.fetch_sub(1, std::memory_order_acq_rel);
+  }
+}
+
+}  // namespace effort_controller_base
@@ -0,0 +1,158 @@
+#include <effort_controller_base/BoxQP.h>
+#include <gtest/gtest.h>
+
+#include <limits>
+#include <random>
+
+using effort_controller_base::BoxQP;
+
+namespace {
+
+using QP = BoxQP<7>;
+
+constexpr double kTolerance = 1e-9;
+
+QP::Matrix randomHessian(std::mt19937 &generator, int n) {
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  QP::Matrix A(n, n);
+  for (int i = 0; i < n; ++i) {
+    for (int j = 0; j < n; ++j) {
+      A(i, j) = uniform(generator);
+    }
+  }
+  QP::Matrix H = A * A.transpose();
+  H.diagonal().array() += 1e-3;
+  return H;
+}
+
+// Check the KKT conditions of a box QP: feasibility, and a gradient that
+// vanishes on free variables and points into the box on active bounds
+void expectKKT(const QP::Matrix &H, const QP::Vector &f,
+               const QP::Vector &lower, const QP::Vector &upper,
+               const QP::Vector &x) {
+  const QP::Vector gradient = H * x + f;
+  for (int i = 0; i < x.size(); ++i) {
+    EXPECT_GE(x[i], lower[i] - kTolerance);
+    EXPECT_LE(x[i], upper[i] + kTolerance);
+    if (x[i] <= lower[i] + kTolerance) {
+      EXPECT_GE(gradient[i], -1e-6);
+    } else if (x[i] >= upper[i] - kTolerance) {
+      EXPECT_LE(gradient[i], 1e-6);
+    } else {
+      EXPECT_NEAR(gradient[i], 0.0, 1e-6);
+    }
+  }
+}
+
+}  // namespace
+
+TEST(BoxQP, SatisfiesKKTConditions) {
+  std::mt19937 generator(7);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  for (int n = 1; n <= 7; ++n) {
+    for (int trial = 0; trial < 50; ++trial) {
+      const QP::Matrix H = randomHessian(generator, n);
+      QP::Vector f(n), lower(n), upper(n), x = QP::Vector::Zero(n);
+      for (int i = 0; i < n; ++i) {
+        f[i] = 10.0 * uniform(generator);
+        lower[i] = -1.0 + 0.5 * uniform(generator);
+        upper[i] = 1.0 + 0.5 * uniform(generator);
+      }
+      QP qp;
+      qp.init(n, 50);
+      ASSERT_TRUE(qp.solve(H, f, lower, upper, x));
+      expectKKT(H, f, lower, upper, x);
+    }
+  }
+}
+
+TEST(BoxQP, UnconstrainedMinimizerIsExact) {
+  std::mt19937 generator(3);
+  const QP::Matrix H = randomHessian(generator, 7);
+  const QP::Vector expected = QP::Vector::Constant(7, 0.1);
+  const QP::Vector f = -H * expected;
+  const QP::Vector lower = QP::Vector::Constant(7, -1.0);
+  const QP::Vector upper = QP::Vector::Constant(7, 1.0);
+  QP::Vector x = QP::Vector::Zero(7);
+  QP qp;
+  qp.init(7, 20);
+  ASSERT_TRUE(qp.solve(H, f, lower, upper, x));
+  EXPECT_TRUE(x.isApprox(expected, 1e-9));
+}
+
+TEST(BoxQP, RespectsBoundsWhenCapped) {
+  std::mt19937 generator(5);
+  const QP::Matrix H = randomHessian(generator, 7);
+  const QP::Vector f = QP::Vector::Constant(7, 100.0);
+  const QP::Vector lower = QP::Vector::Constant(7, -0.5);
+  const QP::Vector upper = QP::Vector::Constant(7, 0.5);
+  QP::Vector x = QP::Vector::Zero(7);
+  QP qp;
+  qp.init(7, 1);
+  qp.solve(H, f, lower, upper, x);
+  EXPECT_LE(qp.iterations(), 1);
+  EXPECT_TRUE((x.array() >= lower.array()).all());
+  EXPECT_TRUE((x.array() <= upper.array()).all());
+}
+
+TEST(BoxQP, WarmStartConvergesQuickly) {
+  std::mt19937 generator(11);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  const QP::Matrix H = randomHessian(generator, 7);
+  const QP::Vector lower = QP::Vector::Constant(7, -1.0);
+  const QP::Vector upper = QP::Vector::Constant(7, 1.0);
+  QP::Vector command(7), x = QP::Vector::Zero(7);
+  for (int i = 0; i < 7; ++i) {
+    command[i] = 3.0 * uniform(generator);
+  }
+  QP qp;
+  qp.init(7, 20);
+  ASSERT_TRUE(qp.solve(H, -H * command, lower, upper, x));
+
+  // Slowly drifting commands keep their active set
+  for (int k = 0; k < 100; ++k) {
+    command.array() += 1e-4;
+    const QP::Vector f = -H * command;
+    ASSERT_TRUE(qp.solve(H, f, lower, upper, x));
+    EXPECT_LE(qp.iterations(), 2);
+    expectKKT(H, f, lower, upper, x);
+  }
+}
+
+TEST(TorqueBounds, IntersectsConsistentBounds) {
+  double lower, upper;
+  EXPECT_EQ(effort_controller_base::torqueBounds(10.0, -4.0, 6.0, -2.0, 8.0,
+                                                 lower, upper),
+            0);
+  EXPECT_DOUBLE_EQ(lower, -2.0);
+  EXPECT_DOUBLE_EQ(upper, 6.0);
+}
+
+TEST(TorqueBounds, JointLimitsWinOverRateLimit) {
+  constexpr double inf = std::numeric_limits<double>::infinity();
+  double lower, upper;
+
+  // The joint limits demand at least 5 Nm, the rate limit at most 1 Nm
+  EXPECT_EQ(effort_controller_base::torqueBounds(10.0, 5.0, inf, -1.0, 1.0,
+                                                 lower, upper),
+            1);
+  EXPECT_DOUBLE_EQ(lower, 5.0);
+  EXPECT_DOUBLE_EQ(upper, 5.0);
+
+  // And the other way round
+  EXPECT_EQ(effort_controller_base::torqueBounds(10.0, -inf, -5.0, -1.0, 1.0,
+                                                 lower, upper),
+            1);
+  EXPECT_DOUBLE_EQ(lower, -5.0);
+  EXPECT_DOUBLE_EQ(upper, -5.0);
+}
+
+TEST(TorqueBounds, EffortLimitsWinOverJointLimits) {
+  constexpr double inf = std::numeric_limits<double>::infinity();
+  double lower, upper;
+  EXPECT_EQ(effort_controller_base::torqueBounds(10.0, 20.0, inf, 15.0, 25.0,
+                                                 lower, upper),
+            2);
+  EXPECT_DOUBLE_EQ(lower, 10.0);
+  EXPECT_DOUBLE_EQ(upper, 10.0);
+}
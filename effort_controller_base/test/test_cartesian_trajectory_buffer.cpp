@@ -0,0 +1,233 @@
+#include <effort_controller_base/CartesianTrajectoryBuffer.h>
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+using effort_controller_base::CartesianTrajectoryBuffer;
+using effort_controller_base::CartesianWaypoint;
+
+namespace {
+
+constexpr double kStep = 1e-6;
+
+CartesianWaypoint waypoint(double time, const ctrl::Vector3D &position,
+                           const Eigen::Quaterniond &orientation =
+                               Eigen::Quaterniond::Identity()) {
+  CartesianWaypoint w;
+  w.time = time;
+  w.position = position;
+  w.orientation = orientation;
+  return w;
+}
+
+// Angular velocity in the base frame between two orientations
+ctrl::Vector3D angularVelocity(const Eigen::Quaterniond &from,
+                               const Eigen::Quaterniond &to, double dt) {
+  const Eigen::AngleAxisd rotation(to * from.conjugate());
+  return rotation.angle() / dt * rotation.axis();
+}
+
+// Samples the buffer just before, at and just after a time, which keeps the
+// sample times increasing as the buffer requires
+struct Samples {
+  Samples(CartesianTrajectoryBuffer &buffer, double time) {
+    EXPECT_TRUE(buffer.sample(time - kStep, before, orientation_before));
+    EXPECT_TRUE(buffer.sample(time, at, orientation_at));
+    EXPECT_TRUE(buffer.sample(time + kStep, after, orientation_after));
+  }
+
+  ctrl::Vector3D velocityBefore() const { return (at - before) / kStep; }
+  ctrl::Vector3D velocityAfter() const { return (after - at) / kStep; }
+  ctrl::Vector3D angularVelocityBefore() const {
+    return angularVelocity(orientation_before, orientation_at, kStep);
+  }
+  ctrl::Vector3D angularVelocityAfter() const {
+    return angularVelocity(orientation_at, orientation_after, kStep);
+  }
+
+  ctrl::Vector3D before, at, after;
+  Eigen::Quaterniond orientation_before, orientation_at, orientation_after;
+};
+
+}  // namespace
+
+TEST(CartesianTrajectoryBuffer, RejectsWaypointsWhenFull) {
+  CartesianTrajectoryBuffer buffer;
+  buffer.init(4);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(buffer.push(waypoint(i, ctrl::Vector3D::Zero())));
+  }
+  EXPECT_EQ(buffer.size(), 4u);
+  EXPECT_EQ(buffer.space(), 0u);
+  EXPECT_FALSE(buffer.push(waypoint(4, ctrl::Vector3D::Zero())));
+  EXPECT_DOUBLE_EQ(buffer.lastPushedTime(), 3.0);
+
+  // Waypoints that are not newer are discarded without taking space
+  EXPECT_TRUE(buffer.push(waypoint(3, ctrl::Vector3D::Ones())));
+  EXPECT_EQ(buffer.size(), 4u);
+
+  // Sampling past the second waypoint frees the first one
+  ctrl::Vector3D position;
+  Eigen::Quaterniond orientation;
+  EXPECT_FALSE(buffer.sample(-0.5, position, orientation));
+  EXPECT_TRUE(buffer.sample(2.5, position, orientation));
+  EXPECT_EQ(buffer.space(), 1u);
+  EXPECT_TRUE(buffer.push(waypoint(4, ctrl::Vector3D::Zero())));
+  EXPECT_FALSE(buffer.push(waypoint(5, ctrl::Vector3D::Zero())));
+}
+
+TEST(CartesianTrajectoryBuffer, StreamsThroughTheRingManyTimes) {
+  // A straight line at constant velocity, streamed through a small ring.
+  // Hermite splines reproduce it exactly wherever both neighbours of a
+  // segment are queued.  A segment needs four waypoints, the fifth slot lets
+  // the producer queue the next one before the segment starts.
+  const ctrl::Vector3D velocity(1.0, 2.0, -1.0);
+  const double spacing = 0.1;
+  const int waypoints = 100;
+  CartesianTrajectoryBuffer buffer;
+  buffer.init(5);
+
+  int pushed = 0;
+  ctrl::Vector3D position;
+  Eigen::Quaterniond orientation;
+  for (int k = 0; k <= 10000; ++k) {
+    while (pushed < waypoints && buffer.space() > 0) {
+      const double time = pushed * spacing;
+      ASSERT_TRUE(buffer.push(waypoint(time, time * velocity)));
+      ++pushed;
+    }
+    const double time = k * 1e-3;
+    ASSERT_TRUE(buffer.sample(time, position, orientation)) << "time " << time;
+    if (time >= spacing && time <= (waypoints - 3) * spacing) {
+      EXPECT_LT((position - time * velocity).norm(), 1e-12) << "time " << time;
+    }
+    if (pushed == waypoints && time >= (waypoints - 1) * spacing) {
+      break;
+    }
+  }
+
+  // The last waypoint is returned once, then the queue is empty
+  EXPECT_LT((position - (waypoints - 1) * spacing * velocity).norm(), 1e-12);
+  EXPECT_EQ(buffer.size(), 0u);
+  EXPECT_FALSE(buffer.sample(100.0, position, orientation));
+}
+
+TEST(CartesianTrajectoryBuffer, HermiteIsContinuousAtTheKnots) {
+  std::mt19937 generator(13);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  std::uniform_real_distribution<double> spacing(0.05, 0.5);
+
+  std::vector<CartesianWaypoint> path;
+  double time = 0.0;
+  for (int i = 0; i < 20; ++i) {
+    path.push_back(waypoint(time, ctrl::Vector3D(uniform(generator),
+                                                 uniform(generator),
+                                                 uniform(generator))));
+    time += spacing(generator);
+  }
+  CartesianTrajectoryBuffer buffer;
+  buffer.init(path.size());
+  for (const auto &w : path) {
+    ASSERT_TRUE(buffer.push(w));
+  }
+
+  // Rest at the first waypoint
+  ctrl::Vector3D start, later;
+  Eigen::Quaterniond orientation;
+  ASSERT_TRUE(buffer.sample(path.front().time, start, orientation));
+  ASSERT_TRUE(buffer.sample(path.front().time + kStep, later, orientation));
+  EXPECT_LT((start - path.front().position).norm(), 1e-12);
+  EXPECT_LT((later - start).norm() / kStep, 1e-3);
+
+  // Position and velocity continuous across inner knots, where the velocity
+  // is the average of the neighbouring finite differences
+  for (size_t i = 1; i + 1 < path.size(); ++i) {
+    const Samples samples(buffer, path[i].time);
+    EXPECT_LT((samples.at - path[i].position).norm(), 1e-12) << "knot " << i;
+    const ctrl::Vector3D tangent =
+        0.5 * ((path[i].position - path[i - 1].position) /
+                   (path[i].time - path[i - 1].time) +
+               (path[i + 1].position - path[i].position) /
+                   (path[i + 1].time - path[i].time));
+    EXPECT_LT((samples.velocityBefore() - tangent).norm(), 1e-3)
+        << "knot " << i;
+    EXPECT_LT((samples.velocityAfter() - tangent).norm(), 1e-3)
+        << "knot " << i;
+  }
+
+  // Rest at the last waypoint
+  ctrl::Vector3D before, end;
+  ASSERT_TRUE(buffer.sample(path.back().time - kStep, before, orientation));
+  ASSERT_TRUE(buffer.sample(path.back().time, end, orientation));
+  EXPECT_LT((end - path.back().position).norm(), 1e-12);
+  EXPECT_LT((end - before).norm() / kStep, 1e-3);
+}
+
+TEST(CartesianTrajectoryBuffer, SquadFollowsAConstantRotation) {
+  // Evenly timed rotations about one axis by equal angles.  The SQUAD
+  // control points then coincide with the waypoints, so that the angle
+  // grows linearly in time on every inner segment.
+  const ctrl::Vector3D axis = ctrl::Vector3D(1.0, -2.0, 0.5).normalized();
+  const double rate = 0.7;
+  CartesianTrajectoryBuffer buffer;
+  buffer.init(16);
+  for (int i = 0; i < 16; ++i) {
+    const double time = 0.2 * i;
+    ASSERT_TRUE(buffer.push(waypoint(
+        time, ctrl::Vector3D::Zero(),
+        Eigen::Quaterniond(Eigen::AngleAxisd(rate * time, axis)))));
+  }
+
+  ctrl::Vector3D position;
+  Eigen::Quaterniond orientation;
+  for (double time = 0.2; time <= 2.8; time += 0.01) {
+    ASSERT_TRUE(buffer.sample(time, position, orientation));
+    const Eigen::Quaterniond expected(Eigen::AngleAxisd(rate * time, axis));
+    EXPECT_LT(orientation.angularDistance(expected), 1e-9) << "time " << time;
+  }
+}
+
+TEST(CartesianTrajectoryBuffer, SquadIsContinuousAtTheKnots) {
+  std::mt19937 generator(17);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+
+  // Random orientations, evenly timed, a few of them in the opposite
+  // hemisphere to exercise the shortest arc
+  std::vector<CartesianWaypoint> path;
+  Eigen::Quaterniond orientation = Eigen::Quaterniond::Identity();
+  for (int i = 0; i < 12; ++i) {
+    const ctrl::Vector3D rotation(uniform(generator), uniform(generator),
+                                  uniform(generator));
+    orientation = orientation * Eigen::Quaterniond(Eigen::AngleAxisd(
+                                    rotation.norm(), rotation.normalized()));
+    Eigen::Quaterniond pushed = orientation;
+    if (i % 3 == 2) {
+      pushed.coeffs() *= -1.0;
+    }
+    path.push_back(waypoint(0.25 * i, ctrl::Vector3D::Zero(), pushed));
+  }
+  CartesianTrajectoryBuffer buffer;
+  buffer.init(path.size());
+  for (const auto &w : path) {
+    ASSERT_TRUE(buffer.push(w));
+  }
+
+  ctrl::Vector3D position;
+  Eigen::Quaterniond start;
+  ASSERT_TRUE(buffer.sample(0.0, position, start));
+  EXPECT_LT(start.angularDistance(path.front().orientation), 1e-12);
+
+  for (size_t i = 1; i + 1 < path.size(); ++i) {
+    const Samples samples(buffer, path[i].time);
+    EXPECT_LT(samples.orientation_at.angularDistance(path[i].orientation),
+              1e-9)
+        << "knot " << i;
+    EXPECT_LT((samples.angularVelocityBefore() -
+               samples.angularVelocityAfter())
+                  .norm(),
+              1e-3)
+        << "knot " << i;
+  }
+}
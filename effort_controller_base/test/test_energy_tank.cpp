@@ -0,0 +1,90 @@
+#include <effort_controller_base/EnergyTank.h>
+#include <gtest/gtest.h>
+
+using effort_controller_base::EnergyTank;
+
+namespace {
+
+// A unit mass on a spring with damping whose stiffness is switched to pump
+// energy in: stiff while the mass moves back, soft while it moves out.  The
+// stiffness increases are booked with the tank as 1/2 x^2 dK, as the
+// cartesian impedance controller does, and the damping refills it.
+struct Pump {
+  static constexpr double kSoft = 10.0;
+  static constexpr double kStiff = 40.0;
+  static constexpr double kDamping = 0.05;
+  static constexpr double kTimeStep = 1e-4;
+
+  double x = 0.1;
+  double v = 0.0;
+  double stiffness = kSoft;
+  double dissipated = 0.0;  // By the damping over the last cycle
+
+  double energy() const { return 0.5 * v * v + 0.5 * stiffness * x * x; }
+
+  void step(EnergyTank *tank) {
+    const double target = x * v < 0.0 ? kStiff : kSoft;
+    const double injected = 0.5 * x * x * (target - stiffness);
+    const double scale = tank ? tank->update(dissipated, injected) : 1.0;
+    stiffness += scale * (target - stiffness);
+
+    // Symplectic Euler, so that the undamped oscillator does not drift
+    v += (-stiffness * x - kDamping * v) * kTimeStep;
+    x += v * kTimeStep;
+    dissipated = kDamping * v * v * kTimeStep;
+  }
+};
+
+}  // namespace
+
+TEST(EnergyTank, ScalesInjectionToTheAvailableEnergy) {
+  EnergyTank tank;
+  tank.init({1.0, 0.2, 2.0});
+
+  EXPECT_DOUBLE_EQ(tank.update(0.0, 0.3), 1.0);
+  EXPECT_DOUBLE_EQ(tank.energy(), 0.7);
+
+  // Only 0.5 J are left above the minimum
+  EXPECT_DOUBLE_EQ(tank.update(0.0, 1.0), 0.5);
+  EXPECT_DOUBLE_EQ(tank.energy(), 0.2);
+  EXPECT_DOUBLE_EQ(tank.update(0.0, 1.0), 0.0);
+  EXPECT_DOUBLE_EQ(tank.energy(), 0.2);
+
+  // Extraction and dissipation refill the tank up to its cap
+  EXPECT_DOUBLE_EQ(tank.update(0.1, -0.4), 1.0);
+  EXPECT_DOUBLE_EQ(tank.energy(), 0.7);
+  tank.update(5.0, 0.0);
+  EXPECT_DOUBLE_EQ(tank.energy(), 2.0);
+
+  tank.reset();
+  EXPECT_DOUBLE_EQ(tank.energy(), 1.0);
+  EXPECT_DOUBLE_EQ(tank.scale(), 1.0);
+}
+
+TEST(EnergyTank, StiffnessPumpDivergesWithoutTank) {
+  Pump pump;
+  const double initial = pump.energy();
+  for (int k = 0; k < 100000; ++k) {
+    pump.step(nullptr);
+  }
+  EXPECT_GT(pump.energy(), 100.0 * initial);
+}
+
+TEST(EnergyTank, StiffnessPumpStaysPassiveWithTank) {
+  Pump pump;
+  EnergyTank tank;
+  tank.init({0.05, 0.0, 0.1});
+  const double initial = pump.energy() + tank.energy();
+
+  // The oscillator and the tank never hold more than they started with.
+  // The tolerance covers the integration error of the oscillator energy.
+  int scaled = 0;
+  for (int k = 0; k < 100000; ++k) {
+    pump.step(&tank);
+    scaled += tank.scale() < 1.0;
+    EXPECT_GE(tank.energy(), 0.0);
+    ASSERT_LE(pump.energy() + tank.energy(), initial * (1.0 + 1e-2))
+        << "cycle " << k;
+  }
+  EXPECT_GT(scaled, 0);
+}
@@ -0,0 +1,203 @@
+#include <effort_controller_base/GainSchedule.h>
+#include <effort_controller_base/RobotModel.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+using effort_controller_base::GainSchedule;
+using effort_controller_base::RobotModel;
+
+namespace {
+
+constexpr size_t kGains = 2;
+
+// A multilinear function of three keys, which multilinear interpolation
+// reproduces exactly on any grid
+double multilinear(const double *c, double a, double b, double d) {
+  return c[0] + c[1] * a + c[2] * b + c[3] * d + c[4] * a * b + c[5] * b * d +
+         c[6] * a * d + c[7] * a * b * d;
+}
+
+// Sorted random breakpoints with uneven spacing
+std::vector<double> randomBreakpoints(std::mt19937 &generator, size_t size) {
+  std::uniform_real_distribution<double> spacing(0.1, 1.0);
+  std::vector<double> breakpoints = {-1.0};
+  for (size_t i = 1; i < size; ++i) {
+    breakpoints.push_back(breakpoints.back() + spacing(generator));
+  }
+  return breakpoints;
+}
+
+// Constant gains over a single key
+GainSchedule::Table constantTable(const std::string &name, double gain) {
+  return {name, {0}, {{0.0, 1.0}}, std::vector<double>(2 * kGains, gain)};
+}
+
+}  // namespace
+
+TEST(GainSchedule, InterpolatesMultilinearFunctionsExactly) {
+  std::mt19937 generator(7);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  double coefficients[kGains][8];
+  for (auto &gain : coefficients) {
+    for (double &c : gain) {
+      c = uniform(generator);
+    }
+  }
+
+  // Three of four keys, in a different order than the key values
+  GainSchedule::Table table;
+  table.name = "phase";
+  table.keys = {2, 0, 3};
+  table.breakpoints = {randomBreakpoints(generator, 4),
+                       randomBreakpoints(generator, 3),
+                       randomBreakpoints(generator, 5)};
+  for (const double a : table.breakpoints[0]) {
+    for (const double b : table.breakpoints[1]) {
+      for (const double d : table.breakpoints[2]) {
+        for (const auto &gain : coefficients) {
+          table.gains.push_back(multilinear(gain, a, b, d));
+        }
+      }
+    }
+  }
+  GainSchedule schedule;
+  std::string error;
+  ASSERT_TRUE(schedule.init({table}, kGains, error)) << error;
+
+  ctrl::VectorND keys(4);
+  for (int trial = 0; trial < 1000; ++trial) {
+    // Partly outside the grid, which clamps to its border
+    for (int k = 0; k < 4; ++k) {
+      keys[k] = 2.0 * uniform(generator);
+    }
+    const ctrl::VectorND &gains = schedule.update(keys, 0.001);
+    const auto clamped = [&](size_t axis) {
+      const auto &breakpoints = table.breakpoints[axis];
+      return std::clamp(keys[table.keys[axis]], breakpoints.front(),
+                        breakpoints.back());
+    };
+    for (size_t g = 0; g < kGains; ++g) {
+      EXPECT_NEAR(gains[g],
+                  multilinear(coefficients[g], clamped(0), clamped(1),
+                              clamped(2)),
+                  1e-12);
+    }
+  }
+}
+
+TEST(GainSchedule, BlendsLinearlyBetweenTables) {
+  GainSchedule schedule;
+  std::string error;
+  ASSERT_TRUE(schedule.init(
+      {constantTable("approach", 1.0), constantTable("contact", 3.0)}, kGains,
+      error));
+  ASSERT_EQ(schedule.tableId("contact"), 1);
+  ASSERT_EQ(schedule.tableId("missing"), -1);
+
+  const ctrl::VectorND keys = ctrl::VectorND::Zero(1);
+  EXPECT_DOUBLE_EQ(schedule.update(keys, 0.001)[0], 1.0);
+
+  schedule.select(1, 1.0);
+  for (int k = 0; k < 500; ++k) {
+    schedule.update(keys, 0.001);
+  }
+  EXPECT_NEAR(schedule.blend(), 0.5, 1e-12);
+  EXPECT_NEAR(schedule.gains()[0], 2.0, 1e-12);
+  EXPECT_NEAR(schedule.gains()[1], 2.0, 1e-12);
+
+  for (int k = 0; k < 600; ++k) {
+    schedule.update(keys, 0.001);
+  }
+  EXPECT_DOUBLE_EQ(schedule.blend(), 1.0);
+  EXPECT_DOUBLE_EQ(schedule.gains()[0], 3.0);
+}
+
+TEST(GainSchedule, RejectsMalformedTables) {
+  GainSchedule schedule;
+  std::string error;
+  GainSchedule::Table table = constantTable("phase", 1.0);
+
+  table.breakpoints = {{0.0, 0.0}};
+  EXPECT_FALSE(schedule.init({table}, kGains, error));
+  table.breakpoints = {{1.0, 0.0}};
+  EXPECT_FALSE(schedule.init({table}, kGains, error));
+  table.breakpoints = {{0.0}};
+  EXPECT_FALSE(schedule.init({table}, kGains, error));
+
+  table = constantTable("phase", 1.0);
+  table.gains.pop_back();
+  EXPECT_FALSE(schedule.init({table}, kGains, error));
+
+  table = constantTable("phase", 1.0);
+  table.keys = {0, 1, 2, 3, 4};
+  table.breakpoints.assign(5, {0.0, 1.0});
+  table.gains.assign(32 * kGains, 1.0);
+  EXPECT_FALSE(schedule.init({table}, kGains, error));
+
+  EXPECT_FALSE(schedule.init({}, kGains, error));
+  EXPECT_TRUE(schedule.init({constantTable("phase", 1.0)}, kGains, error));
+}
+
+TEST(Manipulability, MatchesTheJacobianDeterminant) {
+  std::mt19937 generator(9);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+
+  // Arms with more, as many and fewer joints than task space dimensions
+  for (const unsigned int joints : {7u, 6u, 3u}) {
+    KDL::Chain chain;
+    for (unsigned int i = 0; i < joints; ++i) {
+      chain.addSegment(KDL::Segment(
+          "link" + std::to_string(i + 1),
+          KDL::Joint(i % 2 ? KDL::Joint::RotX : KDL::Joint::RotZ),
+          KDL::Frame(KDL::Rotation::RPY(uniform(generator), uniform(generator),
+                                        uniform(generator)),
+                     KDL::Vector(0.0, 0.0, 0.3))));
+    }
+    KDL::JntArray q(joints), q_dot(joints);
+    RobotModel model;
+    model.init(chain, "base", &q, &q_dot, KDL::Vector(0.0, 0.0, -9.81));
+
+    for (int trial = 0; trial < 20; ++trial) {
+      for (unsigned int i = 0; i < joints; ++i) {
+        q(i) = M_PI * uniform(generator);
+      }
+      model.invalidate();
+      const auto &jacobian = model.jacobian().data;
+      const double expected =
+          joints >= 6
+              ? std::sqrt((jacobian * jacobian.transpose()).determinant())
+              : std::sqrt((jacobian.transpose() * jacobian).determinant());
+      EXPECT_NEAR(model.manipulability(), expected, 1e-9);
+      if (joints < 6) {
+        EXPECT_GT(model.manipulability(), 0.0);
+      }
+    }
+  }
+}
+
+TEST(Manipulability, VanishesForAStretchedPlanarArm) {
+  KDL::Chain chain;
+  for (int i = 0; i < 3; ++i) {
+    chain.addSegment(KDL::Segment("link" + std::to_string(i + 1),
+                                  KDL::Joint(KDL::Joint::RotZ),
+                                  KDL::Frame(KDL::Vector(0.4, 0.0, 0.0))));
+  }
+  KDL::JntArray q(3), q_dot(3);
+  RobotModel model;
+  model.init(chain, "base", &q, &q_dot, KDL::Vector(0.0, 0.0, -9.81));
+
+  q(1) = 0.5;
+  q(2) = -0.8;
+  model.invalidate();
+  EXPECT_GT(model.manipulability(), 1e-3);
+
+  q(1) = 0.0;
+  q(2) = 0.0;
+  model.invalidate();
+  EXPECT_NEAR(model.manipulability(), 0.0, 1e-9);
+}
@@ -0,0 +1,85 @@
+#include <effort_controller_base/JerkLimitedFilter.h>
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+using effort_controller_base::CartesianTargetFilter;
+
+namespace {
+
+constexpr double kPeriod = 0.001;
+constexpr double kMaxVelocity = 0.5;
+constexpr double kMaxAcceleration = 2.0;
+constexpr double kMaxJerk = 20.0;
+constexpr double kTolerance = 1e-9;
+// The discretized profile may exceed the limits by a few um/s
+constexpr double kLimitTolerance = 1e-5;
+
+CartesianTargetFilter makeFilter() {
+  CartesianTargetFilter filter;
+  filter.setLinearLimits(kMaxVelocity, kMaxAcceleration, kMaxJerk);
+  filter.setAngularLimits(kMaxVelocity, kMaxAcceleration, kMaxJerk);
+  filter.reset(KDL::Frame::Identity());
+  return filter;
+}
+
+ctrl::Vector3D toEigen(const KDL::Vector &vector) {
+  return ctrl::Vector3D(vector.x(), vector.y(), vector.z());
+}
+
+}  // namespace
+
+TEST(CartesianTargetFilter, DiagonalTranslationStepIsStraightAndLimited) {
+  CartesianTargetFilter filter = makeFilter();
+  const ctrl::Vector3D goal(0.3, 0.3, 0.3);
+  const ctrl::Vector3D direction = goal.normalized();
+  const KDL::Frame target(KDL::Rotation::Identity(),
+                          KDL::Vector(goal.x(), goal.y(), goal.z()));
+
+  double max_speed = 0.0;
+  ctrl::Vector3D last_acceleration = ctrl::Vector3D::Zero();
+  for (int k = 0; k < 5000; ++k) {
+    const ctrl::Vector3D p = toEigen(filter.update(target, kPeriod).p);
+    const ctrl::Vector6D twist = filter.twist();
+    const ctrl::Vector6D acceleration = filter.acceleration();
+
+    // On the line from the start to the goal, without overshoot
+    const double along = p.dot(direction);
+    EXPECT_LT((p - along * direction).norm(), kTolerance);
+    EXPECT_LE(along, goal.norm() + kTolerance);
+
+    // Limits on the norms
+    max_speed = std::max(max_speed, twist.head<3>().norm());
+    EXPECT_LE(twist.head<3>().norm(), kMaxVelocity + kLimitTolerance);
+    EXPECT_LE(acceleration.head<3>().norm(), kMaxAcceleration + kLimitTolerance);
+    EXPECT_LE((acceleration.head<3>() - last_acceleration).norm() / kPeriod,
+              kMaxJerk + kLimitTolerance);
+    last_acceleration = acceleration.head<3>();
+  }
+  EXPECT_GT(max_speed, 0.9 * kMaxVelocity);
+  EXPECT_LT((toEigen(filter.reference().p) - goal).norm(), 1e-6);
+  EXPECT_LT(filter.twist().norm(), 1e-5);
+}
+
+TEST(CartesianTargetFilter, DiagonalRotationStepIsStraightAndLimited) {
+  CartesianTargetFilter filter = makeFilter();
+  const ctrl::Vector3D axis = ctrl::Vector3D(1.0, 1.0, 1.0).normalized();
+  const double angle = 1.0;
+  const KDL::Frame target(
+      KDL::Rotation::Rot2(KDL::Vector(axis.x(), axis.y(), axis.z()), angle),
+      KDL::Vector::Zero());
+
+  for (int k = 0; k < 5000; ++k) {
+    const KDL::Frame &reference = filter.update(target, kPeriod);
+    const ctrl::Vector3D rotation = toEigen(reference.M.GetRot());
+    const ctrl::Vector6D twist = filter.twist();
+
+    // About the fixed axis, without overshoot
+    EXPECT_LT((rotation - rotation.dot(axis) * axis).norm(), 1e-9);
+    EXPECT_LE(rotation.dot(axis), angle + kTolerance);
+    EXPECT_LE(twist.tail<3>().norm(), kMaxVelocity + kLimitTolerance);
+    EXPECT_LE(filter.acceleration().tail<3>().norm(),
+              kMaxAcceleration + kLimitTolerance);
+  }
+  EXPECT_NEAR(toEigen(filter.reference().M.GetRot()).dot(axis), angle, 1e-6);
+}
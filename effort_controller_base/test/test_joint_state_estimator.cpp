@@ -0,0 +1,93 @@
+#include <effort_controller_base/JointStateEstimator.h>
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+
+using effort_controller_base::JointStateEstimator;
+
+namespace {
+
+constexpr size_t kJoints = 3;
+constexpr double kPeriod = 0.001;
+constexpr double kPositionNoise = 1e-4;
+constexpr double kVelocityNoise = 1e-2;
+
+// Root mean square errors of a replayed run
+struct Errors {
+  double raw_velocity = 0.0;
+  double velocity = 0.0;
+  double acceleration = 0.0;
+};
+
+// Replay noisy measurements of sinusoidal joint motions through the filter,
+// optionally with the exact accelerations as model prediction
+Errors replay(bool model) {
+  JointStateEstimator estimator;
+  estimator.init(kJoints, kPeriod, kPositionNoise, kVelocityNoise, 100.0);
+
+  std::mt19937 generator(42);
+  std::normal_distribution<double> position_noise(0.0, kPositionNoise);
+  std::normal_distribution<double> velocity_noise(0.0, kVelocityNoise);
+
+  KDL::JntArray q(kJoints), q_dot(kJoints);
+  ctrl::VectorND acceleration = ctrl::VectorND::Zero(kJoints);
+  Errors errors;
+  size_t samples = 0;
+  const size_t cycles = 5000;
+  for (size_t k = 0; k < cycles; ++k) {
+    const double t = k * kPeriod;
+    ctrl::VectorND true_velocity(kJoints), true_acceleration(kJoints);
+    for (size_t i = 0; i < kJoints; ++i) {
+      const double w = 2.0 * (i + 1);
+      q(i) = std::sin(w * t) + position_noise(generator);
+      q_dot(i) = w * std::cos(w * t) + velocity_noise(generator);
+      true_velocity[i] = w * std::cos(w * t);
+      true_acceleration[i] = -w * w * std::sin(w * t);
+      // Average acceleration over the last period
+      const double t0 = t - kPeriod;
+      acceleration[i] = (std::cos(w * t) - std::cos(w * t0)) * w / kPeriod;
+    }
+    if (k == 0) {
+      estimator.reset(q, q_dot);
+      continue;
+    }
+    estimator.update(q, q_dot, model ? &acceleration : nullptr);
+
+    // Skip the settling of the first 0.5 s
+    if (k < cycles / 10) {
+      continue;
+    }
+    errors.raw_velocity += (q_dot.data - true_velocity).squaredNorm();
+    errors.velocity +=
+        (estimator.velocities() - true_velocity).squaredNorm();
+    errors.acceleration +=
+        (estimator.accelerations() - true_acceleration).squaredNorm();
+    samples += kJoints;
+  }
+  errors.raw_velocity = std::sqrt(errors.raw_velocity / samples);
+  errors.velocity = std::sqrt(errors.velocity / samples);
+  errors.acceleration = std::sqrt(errors.acceleration / samples);
+  return errors;
+}
+
+}  // namespace
+
+TEST(JointStateEstimator, ReducesVelocityNoise) {
+  const Errors errors = replay(false);
+  EXPECT_NEAR(errors.raw_velocity, kVelocityNoise, 0.1 * kVelocityNoise);
+  EXPECT_LT(errors.velocity, 0.5 * errors.raw_velocity);
+}
+
+TEST(JointStateEstimator, EstimatesAccelerations) {
+  const Errors errors = replay(false);
+  // Peak accelerations are 36 rad/s^2
+  EXPECT_LT(errors.acceleration, 1.0);
+}
+
+TEST(JointStateEstimator, ModelPredictionImprovesEstimate) {
+  const Errors plain = replay(false);
+  const Errors model = replay(true);
+  EXPECT_LT(model.velocity, plain.velocity);
+  EXPECT_LT(model.acceleration, plain.acceleration);
+}
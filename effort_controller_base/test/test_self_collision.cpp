@@ -0,0 +1,119 @@
+#include <effort_controller_base/RobotModel.h>
+#include <effort_controller_base/SelfCollision.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <vector>
+
+using effort_controller_base::RobotModel;
+using effort_controller_base::SelfCollision;
+
+namespace {
+
+// Distance of a point to a segment, with the exact projection
+double pointSegmentDistance(const KDL::Vector &point, const KDL::Vector &start,
+                            const KDL::Vector &end) {
+  const KDL::Vector direction = end - start;
+  const double length2 = KDL::dot(direction, direction);
+  double s = 0.0;
+  if (length2 > 0.0) {
+    s = std::clamp(KDL::dot(point - start, direction) / length2, 0.0, 1.0);
+  }
+  return (start + s * direction - point).Norm();
+}
+
+// Distance of two segments by sampling the first one densely.  The distance
+// is Lipschitz in the sample position with the segment length, so that the
+// error is below half the sample spacing.
+double bruteForceDistance(const KDL::Vector &start_1, const KDL::Vector &end_1,
+                          const KDL::Vector &start_2,
+                          const KDL::Vector &end_2) {
+  constexpr int kSamples = 20000;
+  double distance = std::numeric_limits<double>::infinity();
+  for (int k = 0; k <= kSamples; ++k) {
+    const KDL::Vector point =
+        start_1 + (static_cast<double>(k) / kSamples) * (end_1 - start_1);
+    distance =
+        std::min(distance, pointSegmentDistance(point, start_2, end_2));
+  }
+  return distance;
+}
+
+// Both segments are placed on the robot base link, whose pose is the
+// identity, so that the kernel sees them as given.  The activation distance
+// is large enough for the pair to always pass the broadphase.
+class SegmentKernel : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    chain.addSegment(
+        KDL::Segment("link1", KDL::Joint(KDL::Joint::RotZ), KDL::Frame()));
+    q.resize(1);
+    q_dot.resize(1);
+    model.init(chain, "base", &q, &q_dot, KDL::Vector(0.0, 0.0, -9.81));
+    model.invalidate();
+  }
+
+  double kernelDistance(const KDL::Vector &start_1, const KDL::Vector &end_1,
+                        const KDL::Vector &start_2,
+                        const KDL::Vector &end_2) {
+    SelfCollision::Settings settings;
+    settings.distance = 100.0;
+    settings.stiffness = 0.0;
+    settings.damping = 0.0;
+    settings.ignore_adjacent = 1;
+    const std::vector<SelfCollision::Capsule> capsules = {
+        {0, 0, start_1, end_1, 0.0}, {0, 2, start_2, end_2, 0.0}};
+    SelfCollision self_collision;
+    self_collision.init(capsules, {}, 1, settings);
+    ctrl::VectorND tau(1);
+    self_collision.update(model, q_dot.data, tau);
+    EXPECT_EQ(self_collision.closePairs(), 1u);
+    return self_collision.minimumDistance();
+  }
+
+  KDL::Chain chain;
+  KDL::JntArray q, q_dot;
+  RobotModel model;
+};
+
+constexpr double kTolerance = 1e-4;
+
+}  // namespace
+
+TEST_F(SegmentKernel, MatchesBruteForceOnRandomSegments) {
+  std::mt19937 generator(3);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  auto random = [&]() {
+    return KDL::Vector(uniform(generator), uniform(generator),
+                       uniform(generator));
+  };
+  for (int trial = 0; trial < 200; ++trial) {
+    const KDL::Vector a = random(), b = random(), c = random(), d = random();
+    EXPECT_NEAR(kernelDistance(a, b, c, d), bruteForceDistance(a, b, c, d),
+                kTolerance);
+  }
+}
+
+TEST_F(SegmentKernel, HandlesDegenerateSegments) {
+  const KDL::Vector origin = KDL::Vector::Zero();
+  const KDL::Vector x(1.0, 0.0, 0.0);
+  const KDL::Vector y(0.0, 1.0, 0.0);
+
+  // Parallel, overlapping and disjoint
+  EXPECT_NEAR(kernelDistance(origin, x, y, y + x), 1.0, 1e-9);
+  EXPECT_NEAR(kernelDistance(origin, x, 2 * x + y, 3 * x + y),
+              bruteForceDistance(origin, x, 2 * x + y, 3 * x + y), kTolerance);
+
+  // Collinear
+  EXPECT_NEAR(kernelDistance(origin, x, 2 * x, 3 * x), 1.0, 1e-9);
+
+  // Points, i.e. spheres
+  EXPECT_NEAR(kernelDistance(origin, origin, y, y), 1.0, 1e-9);
+  EXPECT_NEAR(kernelDistance(origin, origin, y, y + x), 1.0, 1e-9);
+  EXPECT_NEAR(kernelDistance(y + 0.5 * x, y + 0.5 * x, origin, x), 1.0, 1e-9);
+
+  // Crossing
+  EXPECT_NEAR(kernelDistance(-1.0 * x, x, -1.0 * y, y), 0.0, 1e-9);
+}
@@ -0,0 +1,152 @@
+#include <effort_controller_base/TorqueSaturation.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+using namespace effort_controller_base;
+
+namespace {
+
+constexpr int kJoints = 7;
+constexpr int kCases = 100000;
+constexpr double kTolerance = 1e-12;
+
+// Random limits, a last command within them and commands that violate them
+// in most cases.  Some joints are unlimited.
+class SaturationCases : public ::testing::Test {
+ protected:
+  void next() {
+    std::uniform_real_distribution<double> limit(1.0, 50.0);
+    std::uniform_real_distribution<double> unit(-1.0, 1.0);
+    for (int i = 0; i < kJoints; ++i) {
+      effort_limits[i] = unit(generator) < -0.8
+                             ? std::numeric_limits<double>::infinity()
+                             : limit(generator);
+      rate_limits[i] = 0.1 * limit(generator);
+      const double bound = std::min(effort_limits[i], 50.0);
+      previous[i] = bound * unit(generator);
+      tau[i] = 80.0 * unit(generator);
+      secondary[i] = 5.0 * unit(generator);
+    }
+    saturationBox(previous, rate_limits, effort_limits, lower, upper);
+    efforts = previous;
+  }
+
+  void expectWithinLimits() const {
+    for (int i = 0; i < kJoints; ++i) {
+      ASSERT_GE(efforts[i], lower[i] - kTolerance);
+      ASSERT_LE(efforts[i], upper[i] + kTolerance);
+      ASSERT_LE(std::abs(efforts[i]), effort_limits[i] + kTolerance);
+      ASSERT_LE(std::abs(efforts[i] - previous[i]),
+                rate_limits[i] + kTolerance);
+    }
+  }
+
+  // Whether a step beyond the result would leave the box
+  bool atBound(const ctrl::VectorND &x, const ctrl::VectorND &direction) const {
+    for (int i = 0; i < kJoints; ++i) {
+      if ((direction[i] > 0.0 && x[i] >= upper[i] - 1e-9) ||
+          (direction[i] < 0.0 && x[i] <= lower[i] + 1e-9)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::mt19937 generator{11};
+  Eigen::ArrayXd effort_limits{kJoints}, rate_limits{kJoints};
+  Eigen::ArrayXd lower{kJoints}, upper{kJoints};
+  ctrl::VectorND previous{kJoints}, tau{kJoints}, secondary{kJoints};
+  ctrl::VectorND efforts{kJoints};
+};
+
+}  // namespace
+
+TEST_F(SaturationCases, ClipProjectsOntoTheLimits) {
+  for (int k = 0; k < kCases; ++k) {
+    next();
+    clipTorques(tau, lower, upper, efforts);
+    expectWithinLimits();
+    for (int i = 0; i < kJoints; ++i) {
+      ASSERT_EQ(efforts[i], std::clamp(tau[i], lower[i], upper[i]));
+    }
+  }
+}
+
+TEST_F(SaturationCases, ScaleKeepsTheDirection) {
+  for (int k = 0; k < kCases; ++k) {
+    next();
+    const double scale = scaleTorques(tau, lower, upper, efforts);
+    expectWithinLimits();
+    ASSERT_GE(scale, 0.0);
+    ASSERT_LE(scale, 1.0);
+    const ctrl::VectorND change = tau - previous;
+    ASSERT_LT((efforts - previous - scale * change).norm(), 1e-9);
+
+    // The step is the largest feasible one
+    if (scale < 1.0) {
+      ASSERT_TRUE(atBound(efforts, change)) << "case " << k;
+    }
+  }
+}
+
+TEST_F(SaturationCases, PriorityKeepsThePrimaryTorques) {
+  int primary_kept = 0;
+  for (int k = 0; k < kCases; ++k) {
+    next();
+    // Primary torques within reach in about half of the cases
+    if (k % 2 == 0) {
+      tau = previous + secondary;
+      for (int i = 0; i < kJoints; ++i) {
+        tau[i] += 0.5 * rate_limits[i] * std::uniform_real_distribution<double>(
+                                             -1.0, 1.0)(generator);
+      }
+    }
+    const ctrl::VectorND primary = tau - secondary;
+    double secondary_scale;
+    const double scale = prioritizeTorques(tau, secondary, lower, upper,
+                                           efforts, secondary_scale);
+    expectWithinLimits();
+    ASSERT_GE(secondary_scale, 0.0);
+    ASSERT_LE(secondary_scale, 1.0);
+
+    const bool feasible = ((primary.array() >= lower - kTolerance) &&
+                           (primary.array() <= upper + kTolerance))
+                              .all();
+    if (scale < 1.0) {
+      // Secondary torques dropped, primary ones scaled as far as possible
+      ASSERT_FALSE(feasible);
+      ASSERT_EQ(secondary_scale, 0.0);
+      const ctrl::VectorND change = primary - previous;
+      ASSERT_LT((efforts - previous - scale * change).norm(), 1e-9);
+      ASSERT_TRUE(atBound(efforts, change)) << "case " << k;
+    } else {
+      // Primary torques in full, secondary ones as far as possible
+      ++primary_kept;
+      ASSERT_TRUE(feasible);
+      ASSERT_LT((efforts - primary - secondary_scale * secondary).norm(),
+                1e-9);
+      if (secondary_scale < 1.0) {
+        ASSERT_TRUE(atBound(efforts, secondary)) << "case " << k;
+      }
+    }
+  }
+  EXPECT_GT(primary_kept, kCases / 4);
+}
+
+TEST_F(SaturationCases, EffortLimitsWinOverRateLimits) {
+  // A last command outside shrunk effort limits must be pulled back within
+  // them, even beyond the rate limit
+  effort_limits.setConstant(1.0);
+  rate_limits.setConstant(0.1);
+  previous.setConstant(3.0);
+  saturationBox(previous, rate_limits, effort_limits, lower, upper);
+  EXPECT_TRUE((upper <= 1.0).all());
+  EXPECT_TRUE((lower <= upper).all());
+  tau.setConstant(5.0);
+  clipTorques(tau, lower, upper, efforts);
+  EXPECT_TRUE((efforts.array() <= 1.0).all());
+}
@@ -0,0 +1,184 @@
+#include <effort_controller_base/TreeModel.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <kdl/chain.hpp>
+#include <kdl/chaindynparam.hpp>
+#include <kdl/chainfksolverpos_recursive.hpp>
+#include <kdl/chainjnttojacsolver.hpp>
+#include <kdl/tree.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+using effort_controller_base::TreeModel;
+
+namespace {
+
+constexpr double kTolerance = 1e-9;
+const KDL::Vector kGravity(0.0, 0.0, -9.81);
+
+// A link with a random joint, placement and inertia.  The joint types cycle
+// through revolute joints about the frame axes, about an arbitrary axis with
+// an offset origin, and prismatic joints.
+KDL::Segment randomSegment(std::mt19937 &generator, const std::string &name,
+                           int type) {
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  std::uniform_real_distribution<double> positive(0.1, 1.0);
+  auto vector = [&](double scale) {
+    return KDL::Vector(scale * uniform(generator), scale * uniform(generator),
+                       scale * uniform(generator));
+  };
+
+  KDL::Joint joint;
+  switch (type % 4) {
+    case 0:
+      joint = KDL::Joint(name + "_joint", KDL::Joint::RotZ);
+      break;
+    case 1:
+      joint = KDL::Joint(name + "_joint", KDL::Joint::RotX);
+      break;
+    case 2: {
+      KDL::Vector axis = vector(1.0);
+      axis.Normalize();
+      joint = KDL::Joint(name + "_joint", vector(0.1), axis,
+                         KDL::Joint::RotAxis);
+      break;
+    }
+    default:
+      joint = KDL::Joint(name + "_joint", KDL::Joint::TransY);
+  }
+  const KDL::Frame tip(KDL::Rotation::RPY(uniform(generator),
+                                          uniform(generator),
+                                          uniform(generator)),
+                       vector(0.3));
+  const KDL::RigidBodyInertia inertia(
+      positive(generator), vector(0.1),
+      KDL::RotationalInertia(0.1 * positive(generator),
+                             0.1 * positive(generator),
+                             0.1 * positive(generator), 0.0, 0.0, 0.0));
+  return KDL::Segment(name, joint, tip, inertia);
+}
+
+// Compare the tree model along a branch with KDL's solvers for the chain
+// from the base to the branch's end effector.  The branch must not share
+// joints with other branches, so that their loads do not couple.
+class TreeModelTest : public ::testing::Test {
+ protected:
+  void initModel(const std::vector<std::string> &end_effectors) {
+    q.resize(joint_names.size());
+    q_dot.resize(joint_names.size());
+    std::mt19937 generator(5);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    for (size_t i = 0; i < joint_names.size(); ++i) {
+      q(i) = uniform(generator);
+      q_dot(i) = uniform(generator);
+    }
+    ASSERT_TRUE(model.init(tree, "base", joint_names, end_effectors, &q,
+                           &q_dot, kGravity));
+    model.invalidate();
+  }
+
+  void expectMatchesChain(size_t end_effector, const std::string &tip) {
+    KDL::Chain chain;
+    ASSERT_TRUE(tree.getChain("base", tip, chain));
+
+    // The chain's joints among the model's joints
+    std::vector<size_t> joints;
+    for (const auto &segment : chain.segments) {
+      if (segment.getJoint().getType() != KDL::Joint::None) {
+        joints.push_back(std::find(joint_names.begin(), joint_names.end(),
+                                   segment.getJoint().getName()) -
+                         joint_names.begin());
+      }
+    }
+    const size_t n = joints.size();
+    KDL::JntArray chain_q(n), chain_q_dot(n);
+    for (size_t i = 0; i < n; ++i) {
+      chain_q(i) = q(joints[i]);
+      chain_q_dot(i) = q_dot(joints[i]);
+    }
+
+    KDL::ChainDynParam dynamics(chain, kGravity);
+    KDL::JntArray gravity(n), coriolis(n);
+    KDL::JntSpaceInertiaMatrix mass(n);
+    ASSERT_GE(dynamics.JntToGravity(chain_q, gravity), 0);
+    ASSERT_GE(dynamics.JntToCoriolis(chain_q, chain_q_dot, coriolis), 0);
+    ASSERT_GE(dynamics.JntToMass(chain_q, mass), 0);
+    KDL::Jacobian jacobian(n);
+    ASSERT_GE(KDL::ChainJntToJacSolver(chain).JntToJac(chain_q, jacobian), 0);
+    KDL::Frame pose;
+    ASSERT_GE(KDL::ChainFkSolverPos_recursive(chain).JntToCart(chain_q, pose),
+              0);
+
+    for (size_t i = 0; i < n; ++i) {
+      EXPECT_NEAR(model.gravity()(joints[i]), gravity(i), kTolerance);
+      EXPECT_NEAR(model.coriolis()(joints[i]), coriolis(i), kTolerance);
+      for (size_t j = 0; j < n; ++j) {
+        EXPECT_NEAR(model.massMatrix()(joints[i], joints[j]), mass(i, j),
+                    kTolerance);
+      }
+      EXPECT_TRUE(model.jacobian(end_effector)
+                      .data.col(joints[i])
+                      .isApprox(jacobian.data.col(i), kTolerance));
+    }
+    EXPECT_TRUE(KDL::Equal(model.linkPoses()[model.linkId(tip)], pose,
+                           kTolerance));
+  }
+
+  KDL::Tree tree{"base"};
+  std::vector<std::string> joint_names;
+  KDL::JntArray q, q_dot;
+  TreeModel model;
+};
+
+}  // namespace
+
+TEST_F(TreeModelTest, MatchesKdlOnSerialChain) {
+  std::mt19937 generator(1);
+  std::string parent = "base";
+  for (int i = 0; i < 7; ++i) {
+    const KDL::Segment segment =
+        randomSegment(generator, "link" + std::to_string(i), i);
+    ASSERT_TRUE(tree.addSegment(segment, parent));
+    joint_names.push_back(segment.getJoint().getName());
+    parent = segment.getName();
+  }
+  initModel({parent});
+  expectMatchesChain(0, parent);
+}
+
+TEST_F(TreeModelTest, MatchesKdlOnEachBranch) {
+  std::mt19937 generator(2);
+
+  // A fixed trunk with a mass, and two branches on it
+  ASSERT_TRUE(tree.addSegment(
+      KDL::Segment("trunk", KDL::Joint(KDL::Joint::None),
+                   KDL::Frame(KDL::Vector(0.0, 0.0, 0.5)),
+                   KDL::RigidBodyInertia(
+                       5.0, KDL::Vector(0.0, 0.0, 0.2),
+                       KDL::RotationalInertia(0.1, 0.1, 0.1, 0.0, 0.0, 0.0))),
+      "base"));
+  std::vector<std::string> tips;
+  for (const std::string branch : {"left", "right"}) {
+    std::string parent = "trunk";
+    for (int i = 0; i < 4; ++i) {
+      const KDL::Segment segment =
+          randomSegment(generator, branch + std::to_string(i), i);
+      ASSERT_TRUE(tree.addSegment(segment, parent));
+      joint_names.push_back(segment.getJoint().getName());
+      parent = segment.getName();
+    }
+    tips.push_back(parent);
+  }
+  initModel(tips);
+  expectMatchesChain(0, tips[0]);
+  expectMatchesChain(1, tips[1]);
+
+  // The branches do not couple through the fixed trunk
+  for (size_t i = 0; i < 4; ++i) {
+    for (size_t j = 4; j < 8; ++j) {
+      EXPECT_NEAR(model.massMatrix()(i, j), 0.0, kTolerance);
+    }
+  }
+}
@@ -0,0 +1,233 @@
+#include <effort_controller_base/RobotModel.h>
+#include <effort_controller_base/VirtualFixtures.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using effort_controller_base::RobotModel;
+using effort_controller_base::VirtualFixtures;
+
+namespace {
+
+ctrl::Vector3D toEigen(const KDL::Vector &vector) {
+  return ctrl::Vector3D(vector.x(), vector.y(), vector.z());
+}
+
+// Closest point on a segment, with the exact projection
+ctrl::Vector3D closestOnSegment(const ctrl::Vector3D &p,
+                                const ctrl::Vector3D &a,
+                                const ctrl::Vector3D &b) {
+  const ctrl::Vector3D ab = b - a;
+  const double s = std::clamp((p - a).dot(ab) / ab.squaredNorm(), 0.0, 1.0);
+  return a + s * ab;
+}
+
+// Closest point on a triangle: the projection onto its plane if that lies
+// inside, otherwise the closest point on one of its edges
+ctrl::Vector3D closestOnTriangle(const ctrl::Vector3D &p,
+                                 const ctrl::Vector3D &a,
+                                 const ctrl::Vector3D &b,
+                                 const ctrl::Vector3D &c) {
+  const ctrl::Vector3D normal = (b - a).cross(c - a).normalized();
+  const ctrl::Vector3D projection = p - normal.dot(p - a) * normal;
+  if ((b - a).cross(projection - a).dot(normal) >= 0.0 &&
+      (c - b).cross(projection - b).dot(normal) >= 0.0 &&
+      (a - c).cross(projection - c).dot(normal) >= 0.0) {
+    return projection;
+  }
+  ctrl::Vector3D closest = closestOnSegment(p, a, b);
+  for (const ctrl::Vector3D &candidate :
+       {closestOnSegment(p, b, c), closestOnSegment(p, c, a)}) {
+    if ((candidate - p).squaredNorm() < (closest - p).squaredNorm()) {
+      closest = candidate;
+    }
+  }
+  return closest;
+}
+
+// Three prismatic joints along the base axes, so that the origin of the last
+// link is at q and its linear Jacobian is the identity.  The wall torques
+// are then the wall force on that link.
+class VirtualFixturesTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    chain.addSegment(
+        KDL::Segment("link1", KDL::Joint(KDL::Joint::TransX), KDL::Frame()));
+    chain.addSegment(
+        KDL::Segment("link2", KDL::Joint(KDL::Joint::TransY), KDL::Frame()));
+    chain.addSegment(
+        KDL::Segment("link3", KDL::Joint(KDL::Joint::TransZ), KDL::Frame()));
+    q.resize(3);
+    q_dot.resize(3);
+    model.init(chain, "base", &q, &q_dot, KDL::Vector(0.0, 0.0, -9.81));
+    settings.stiffness = 1000.0;
+    settings.damping = 0.0;
+  }
+
+  ctrl::VectorND wallTorques(VirtualFixtures &fixtures,
+                             const ctrl::Vector3D &position) {
+    for (int i = 0; i < 3; ++i) {
+      q(i) = position[i];
+    }
+    model.invalidate();
+    ctrl::VectorND tau(3);
+    fixtures.update(model, q_dot.data, tau);
+    return tau;
+  }
+
+  KDL::Chain chain;
+  KDL::JntArray q, q_dot;
+  RobotModel model;
+  VirtualFixtures::Settings settings;
+  std::mt19937 generator{5};
+};
+
+}  // namespace
+
+TEST_F(VirtualFixturesTest, HierarchyMatchesBruteForceOnTriangleSoup) {
+  // Two meshes of small random triangles, so that the hierarchy has several
+  // levels and both slots can be touched at once
+  std::uniform_real_distribution<double> position(-1.0, 1.0);
+  std::uniform_real_distribution<double> offset(-0.2, 0.2);
+  std::vector<VirtualFixtures::Fixture> fixtures(2);
+  for (auto &fixture : fixtures) {
+    fixture.type = VirtualFixtures::Type::Mesh;
+    fixture.pose = KDL::Frame(KDL::Rotation::RPY(0.3, -0.2, 0.7),
+                              KDL::Vector(0.1, -0.1, 0.2));
+    fixture.size = KDL::Vector(1.0, 1.0, 1.0);
+    fixture.inside = false;
+    for (int t = 0; t < 300; ++t) {
+      const KDL::Vector center(position(generator), position(generator),
+                               position(generator));
+      for (int v = 0; v < 3; ++v) {
+        fixture.vertices.push_back(center + KDL::Vector(offset(generator),
+                                                        offset(generator),
+                                                        offset(generator)));
+      }
+    }
+  }
+  const double radius = 0.15;
+  VirtualFixtures virtual_fixtures;
+  virtual_fixtures.init(fixtures, {3}, {radius}, 3, settings);
+  ASSERT_EQ(virtual_fixtures.primitives(), 600u);
+
+  size_t touched = 0;
+  for (int trial = 0; trial < 500; ++trial) {
+    const ctrl::Vector3D center(position(generator), position(generator),
+                                position(generator));
+
+    // Deepest contact of each mesh over all of its triangles
+    ctrl::Vector3D expected = ctrl::Vector3D::Zero();
+    size_t contacts = 0;
+    double maximum_penetration = 0.0;
+    for (const auto &fixture : fixtures) {
+      double deepest = 0.0;
+      ctrl::Vector3D normal = ctrl::Vector3D::Zero();
+      for (size_t i = 0; i < fixture.vertices.size(); i += 3) {
+        const ctrl::Vector3D a = toEigen(fixture.pose * fixture.vertices[i]);
+        const ctrl::Vector3D b =
+            toEigen(fixture.pose * fixture.vertices[i + 1]);
+        const ctrl::Vector3D c =
+            toEigen(fixture.pose * fixture.vertices[i + 2]);
+        const ctrl::Vector3D away = center - closestOnTriangle(center, a, b, c);
+        const double penetration = radius - away.norm();
+        if (penetration > deepest) {
+          deepest = penetration;
+          normal = away.normalized();
+        }
+      }
+      if (deepest > 0.0) {
+        expected += settings.stiffness * deepest * normal;
+        maximum_penetration = std::max(maximum_penetration, deepest);
+        ++contacts;
+      }
+    }
+
+    const ctrl::VectorND tau = wallTorques(virtual_fixtures, center);
+    EXPECT_LT((tau - expected).norm(), 1e-9) << "trial " << trial;
+    EXPECT_EQ(virtual_fixtures.contacts(), contacts);
+    EXPECT_NEAR(virtual_fixtures.maximumPenetration(), maximum_penetration,
+                1e-12);
+    touched += contacts > 0;
+  }
+  // Both contact and free samples are covered
+  EXPECT_GT(touched, 50u);
+  EXPECT_LT(touched, 450u);
+}
+
+TEST_F(VirtualFixturesTest, HierarchyMatchesBruteForceOnBoxes) {
+  // Many rotated boxes to keep links out of, mixed with an unbounded floor
+  std::uniform_real_distribution<double> position(-1.0, 1.0);
+  std::uniform_real_distribution<double> extent(0.05, 0.3);
+  std::uniform_real_distribution<double> angle(-M_PI, M_PI);
+  std::vector<VirtualFixtures::Fixture> fixtures(40);
+  for (auto &fixture : fixtures) {
+    fixture.type = VirtualFixtures::Type::Box;
+    fixture.pose = KDL::Frame(
+        KDL::Rotation::RPY(angle(generator), angle(generator),
+                           angle(generator)),
+        KDL::Vector(position(generator), position(generator),
+                    position(generator)));
+    fixture.size =
+        KDL::Vector(extent(generator), extent(generator), extent(generator));
+    fixture.inside = false;
+  }
+  VirtualFixtures::Fixture floor;
+  floor.type = VirtualFixtures::Type::Plane;
+  floor.pose = KDL::Frame(KDL::Vector(0.0, 0.0, -0.9));
+  floor.inside = false;
+  fixtures.push_back(floor);
+
+  const double radius = 0.1;
+  VirtualFixtures virtual_fixtures;
+  virtual_fixtures.init(fixtures, {3}, {radius}, 3, settings);
+  ASSERT_EQ(virtual_fixtures.primitives(), 40u);
+
+  for (int trial = 0; trial < 500; ++trial) {
+    const ctrl::Vector3D center(position(generator), position(generator),
+                                position(generator));
+
+    ctrl::Vector3D expected = ctrl::Vector3D::Zero();
+    size_t contacts = 0;
+    for (const auto &fixture : fixtures) {
+      ctrl::Vector3D normal;
+      double distance;
+      if (fixture.type == VirtualFixtures::Type::Plane) {
+        normal = ctrl::Vector3D::UnitZ();
+        distance = center.z() - fixture.pose.p.z();
+      } else {
+        // Signed distance from the box surface in the box frame
+        const ctrl::Vector3D local =
+            toEigen(fixture.pose.Inverse() *
+                    KDL::Vector(center.x(), center.y(), center.z()));
+        const ctrl::Vector3D half = 0.5 * toEigen(fixture.size);
+        const ctrl::Vector3D closest = local.cwiseMax(-half).cwiseMin(half);
+        ctrl::Vector3D direction;
+        if (closest != local) {
+          direction = local - closest;
+          distance = direction.norm();
+          direction /= distance;
+        } else {
+          Eigen::Index axis;
+          distance = (local.cwiseAbs() - half).maxCoeff(&axis);
+          direction = ctrl::Vector3D::Unit(axis) * (local[axis] < 0.0 ? -1.0 : 1.0);
+        }
+        const KDL::Vector rotated = fixture.pose.M * KDL::Vector(
+                                        direction.x(), direction.y(),
+                                        direction.z());
+        normal = toEigen(rotated);
+      }
+      if (radius - distance > 0.0) {
+        expected += settings.stiffness * (radius - distance) * normal;
+        ++contacts;
+      }
+    }
+
+    const ctrl::VectorND tau = wallTorques(virtual_fixtures, center);
+    EXPECT_LT((tau - expected).norm(), 1e-9) << "trial " << trial;
+    EXPECT_EQ(virtual_fixtures.contacts(), contacts);
+  }
+}
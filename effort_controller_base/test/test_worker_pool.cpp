@@ -0,0 +1,58 @@
+#include <effort_controller_base/WorkerPool.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using effort_controller_base::WorkerPool;
+
+namespace {
+
+// Runs many short cycles and checks that every job ran exactly once per
+// cycle.  Pauses between some cycles let idle workers fall asleep, so that
+// both the polling and the sleeping hand-over are exercised.
+void expectAllJobsRun(WorkerPool &pool, size_t jobs, int cycles = 2000) {
+  std::vector<std::atomic<int>> counts(jobs);
+  const WorkerPool::Job job = [&counts](size_t k) { ++counts[k]; };
+  for (int cycle = 0; cycle < cycles; ++cycle) {
+    pool.run(jobs, job);
+    for (size_t k = 0; k < jobs; ++k) {
+      ASSERT_EQ(counts[k].load(), cycle + 1) << "job " << k;
+    }
+    if (cycle % 100 == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+  }
+}
+
+}  // namespace
+
+TEST(WorkerPool, RunsEveryJobOncePerCycle) {
+  WorkerPool pool;
+  pool.start(3, {}, 0, false);
+  expectAllJobsRun(pool, 4);
+  expectAllJobsRun(pool, 9);
+  pool.stop();
+}
+
+TEST(WorkerPool, RunsEveryJobOncePerCycleWithBusyWaiting) {
+  // Few cycles, since polling workers starve each other without dedicated
+  // CPUs
+  WorkerPool pool;
+  pool.start(2, {}, 0, true);
+  expectAllJobsRun(pool, 5, 100);
+  pool.stop();
+}
+
+TEST(WorkerPool, RunsOnTheCallingThreadWithoutWorkers) {
+  WorkerPool pool;
+  expectAllJobsRun(pool, 3);
+
+  // Restarting hands runs to the new workers
+  pool.start(2, {}, 0, false);
+  pool.stop();
+  pool.start(2, {}, 0, false);
+  expectAllJobsRun(pool, 3);
+}
@@ -4,6 +4,7 @@
 #include "geometry_msgs/msg/pose_stamped.hpp"
 #include "geometry_msgs/msg/wrench_stamped.hpp"
 #include <controller_interface/controller_interface.hpp>
+#include <effort_controller_base/TripleBuffer.h>
 #include <effort_controller_base/effort_controller_base.h>
 
 namespace joint_impedance_controller {
@@ -64,6 +65,10 @@ public:
 private:
   ctrl::Vector6D compensateGravity();
 
+  bool stageParameters(const std::vector<rclcpp::Parameter> &parameters,
+                       std::string &reason) override;
+  void publishParameters() override;
+
   void targetWrenchCallback(
       const geometry_msgs::msg::WrenchStamped::SharedPtr wrench);
   void
@@ -75,20 +80,14 @@ private:
   rclcpp::Subscription<geometry_msgs::msg::PoseStamped>::SharedPtr
       m_target_frame_subscriber;
   KDL::Frame m_target_frame;
-  ctrl::Vector6D m_ft_sensor_wrench;
-  std::string m_ft_sensor_ref_link;
-  KDL::Frame m_ft_sensor_transform;
 
   KDL::JntArray m_null_space;
   KDL::Frame m_current_frame;
 
-  ctrl::MatrixND m_identity;
   ctrl::VectorND m_q_starting_pose;
   ctrl::VectorND m_tau_old;
 
   ctrl::Vector3D m_old_rot_error;
-  ctrl::VectorND m_old_vel_error;
-  double const m_alpha = 0.3;
   /**
    * Allow users to choose whether to specify their target wrenches in the
    * end-effector frame (= True) or the base frame (= False). The first one
@@ -96,6 +95,19 @@ private:
    * intuitive for tele-manipulation.
    */
   bool m_hand_frame_control;
+
+  /**
+   * Hot-reload of `stiffness.joint*` and `nullspace_stiffness`.  Staged in
+   * the parameter callback and handed to the control loop as one snapshot
+   * once the whole change is accepted.  The damping follows critically.
+   */
+  struct Gains {
+    ctrl::VectorND stiffness;
+    double null_space_stiffness;
+  };
+  Gains m_staged_gains;
+  bool m_gains_staged = {false};
+  effort_controller_base::TripleBuffer<Gains> m_gains;
 };
 
 } // namespace joint_impedance_controller
@@ -1,5 +1,4 @@
 #include <joint_impedance_controller/joint_impedance_controller.h>
-#include <joint_impedance_controller/pseudo_inversion.h>
 
 #include "controller_interface/controller_interface.hpp"
 #include "effort_controller_base/Utility.h"
@@ -17,7 +16,6 @@ JointImpedanceController::on_init() {
     return ret;
   }
 
-  auto_declare<std::string>("ft_sensor_ref_link", "");
   auto_declare<bool>("hand_frame_control", true);
   auto_declare<double>("nullspace_stiffness", 0.0);
 
@@ -41,19 +39,6 @@ JointImpedanceController::on_configure(
     return ret;
   }
 
-  // Make sure sensor link is part of the robot chain
-  m_ft_sensor_ref_link =
-      get_node()->get_parameter("ft_sensor_ref_link").as_string();
-  if (!Base::robotChainContains(m_ft_sensor_ref_link)) {
-    RCLCPP_ERROR_STREAM(get_node()->get_logger(),
-                        m_ft_sensor_ref_link
-                            << " is not part of the kinematic chain from "
-                            << Base::m_robot_base_link << " to "
-                            << Base::m_end_effector_link);
-    return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
-        CallbackReturn::ERROR;
-  }
-
   // Set stiffness
   ctrl::VectorND tmp(Base::m_joint_number);
   for (size_t i = 1; i <= Base::m_joint_number; i++) {
@@ -78,11 +63,8 @@ JointImpedanceController::on_configure(
   // Set nullspace damping
   m_null_space_damping = 2 * sqrt(m_null_space_stiffness);
 
-  // Set the identity matrix with dimension of the joint space
-  m_identity = ctrl::MatrixND::Identity(m_joint_number, m_joint_number);
-
-  // Make sure sensor wrenches are interpreted correctly
-  // setFtSensorReferenceFrame(Base::m_end_effector_link);
+  m_gains.init({m_joint_stiffness, m_null_space_stiffness});
+  m_staged_gains = {m_joint_stiffness, m_null_space_stiffness};
 
   m_target_wrench_subscriber =
       get_node()->create_subscription<geometry_msgs::msg::WrenchStamped>(
@@ -90,13 +72,6 @@ JointImpedanceController::on_configure(
           std::bind(&JointImpedanceController::targetWrenchCallback, this,
                     std::placeholders::_1));
 
-  // m_ft_sensor_wrench_subscriber =
-  //   get_node()->create_subscription<geometry_msgs::msg::WrenchStamped>(
-  //     get_node()->get_name() + std::string("/ft_sensor_wrench"),
-  //     10,
-  //     std::bind(&JointImpedanceController::ftSensorWrenchCallback, this,
-  //     std::placeholders::_1));
-
   m_target_frame_subscriber =
       get_node()->create_subscription<geometry_msgs::msg::PoseStamped>(
           get_node()->get_name() + std::string("/target_frame"), 3,
@@ -116,8 +91,8 @@ JointImpedanceController::on_activate(
   // Update joint states
   Base::updateJointStates();
 
-  // Compute the forward kinematics
-  Base::m_fk_solver->JntToCart(Base::m_joint_positions, m_current_frame);
+  // Get the end effector pose
+  m_current_frame = Base::linkPose(Base::m_end_effector_link_id);
 
   // Set the target frame to the current frame
   m_target_frame = m_current_frame;
@@ -132,8 +107,6 @@ JointImpedanceController::on_activate(
 
   m_old_rot_error = ctrl::Vector3D::Zero();
 
-  m_old_vel_error = ctrl::VectorND::Zero(Base::m_joint_number);
-
   m_target_wrench = ctrl::Vector6D::Zero();
 
   return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
@@ -144,7 +117,7 @@ rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::CallbackReturn
 JointImpedanceController::on_deactivate(
     const rclcpp_lifecycle::State &previous_state) {
   // Stop drifting by sending zero joint velocities
-  Base::computeJointEffortCmds(ctrl::Vector6D::Zero());
+  Base::computeJointEffortCmds(ctrl::VectorND::Zero(Base::m_joint_number));
   Base::writeJointEffortCmds();
   Base::on_deactivate(previous_state);
 
@@ -158,6 +131,15 @@ controller_interface::return_type JointImpedanceController::update(
   // Update joint states
   Base::updateJointStates();
 
+  // Take over gains changed at runtime
+  if (m_gains.update()) {
+    const Gains &gains = m_gains.readBuffer();
+    m_joint_stiffness = gains.stiffness;
+    m_joint_damping = 2 * m_joint_stiffness.cwiseSqrt();
+    m_null_space_stiffness = gains.null_space_stiffness;
+    m_null_space_damping = 2 * sqrt(m_null_space_stiffness);
+  }
+
   // Compute the torque to applay at the joints
   ctrl::VectorND tau_tot = computeTorque();
 
@@ -167,6 +149,8 @@ controller_interface::return_type JointImpedanceController::update(
   // Write final commands to the hardware interface
   Base::writeJointEffortCmds();
 
+  Base::m_telemetry.publish(time);
+
   return controller_interface::return_type::OK;
 }
 
@@ -214,21 +198,9 @@ ctrl::VectorND JointImpedanceController::computeTorque() {
   // Compute the inverse kinematics
   Base::computeIKSolution(m_target_frame, m_q_desired);
 
-  // Compute the jacobian
-  Base::m_jnt_to_jac_solver->JntToJac(Base::m_joint_positions,
-                                      Base::m_jacobian);
-
-  // Compute the pseudo-inverse of the jacobian
-  ctrl::MatrixND jac = Base::m_jacobian.data;
-  ctrl::MatrixND jac_tran_pseudo_inverse;
-
-  pseudoInverse(jac.transpose(), &jac_tran_pseudo_inverse);
-
-  // Compute the desired joint positions
-
   // Redefine joints velocities in Eigen format
   ctrl::VectorND q = Base::m_joint_positions.data;
-  ctrl::VectorND q_dot = Base::m_joint_velocities.data;
+  const ctrl::VectorND &q_dot = Base::m_filtered_joint_velocities;
 
   ctrl::VectorND tau_task(Base::m_joint_number);
 
@@ -239,21 +211,59 @@ ctrl::VectorND JointImpedanceController::computeTorque() {
   }
   ctrl::VectorND tau = tau_task;
 
-  KDL::JntArray tau_coriolis(Base::m_joint_number),
-      tau_gravity(Base::m_joint_number);
-
   if (m_compensate_gravity) {
-    Base::m_dyn_solver->JntToGravity(Base::m_joint_positions, tau_gravity);
-    tau = tau + tau_gravity.data;
+    tau += Base::m_model.gravity().data;
   }
   if (m_compensate_coriolis) {
-    Base::m_dyn_solver->JntToCoriolis(Base::m_joint_positions,
-                                      Base::m_joint_velocities, tau_coriolis);
-    tau = tau + tau_coriolis.data;
+    tau += Base::m_model.coriolis().data;
   }
   return tau;
 }
 
+bool JointImpedanceController::stageParameters(
+    const std::vector<rclcpp::Parameter> &parameters, std::string &reason) {
+  // Start from the current values, which the change does not include
+  for (size_t i = 0; i < Base::m_joint_number; ++i) {
+    m_staged_gains.stiffness[i] =
+        get_node()
+            ->get_parameter("stiffness.joint" + std::to_string(i + 1))
+            .as_double();
+  }
+  m_staged_gains.null_space_stiffness =
+      get_node()->get_parameter("nullspace_stiffness").as_double();
+
+  m_gains_staged = false;
+  for (const auto &parameter : parameters) {
+    const std::string &name = parameter.get_name();
+    if (name == "nullspace_stiffness") {
+      m_staged_gains.null_space_stiffness = parameter.as_double();
+      m_gains_staged = true;
+      continue;
+    }
+    for (size_t i = 0; i < Base::m_joint_number; ++i) {
+      if (name == "stiffness.joint" + std::to_string(i + 1)) {
+        m_staged_gains.stiffness[i] = parameter.as_double();
+        m_gains_staged = true;
+      }
+    }
+  }
+
+  if (m_gains_staged && (m_staged_gains.stiffness.minCoeff() < 0.0 ||
+                         m_staged_gains.null_space_stiffness < 0.0)) {
+    reason = "stiffness.joint* and nullspace_stiffness must not be negative";
+    m_gains_staged = false;
+    return false;
+  }
+  return true;
+}
+
+void JointImpedanceController::publishParameters() {
+  if (m_gains_staged) {
+    m_gains.write(m_staged_gains);
+  }
+  m_gains_staged = false;
+}
+
 void JointImpedanceController::targetWrenchCallback(
     const geometry_msgs::msg::WrenchStamped::SharedPtr wrench) {
   // Parse the target wrench
@@ -0,0 +1,84 @@
+#ifndef STACK_OF_TASKS_CONTROLLER_H_INCLUDED
+#define STACK_OF_TASKS_CONTROLLER_H_INCLUDED
+
+#include "geometry_msgs/msg/pose_stamped.hpp"
+#include <controller_interface/controller_interface.hpp>
+#include <effort_controller_base/effort_controller_base.h>
+#include <memory>
+#include <stack_of_tasks_controller/tasks.h>
+#include <vector>
+
+namespace stack_of_tasks_controller {
+
+/**
+ * @brief A ROS2-control controller for a prioritized stack of tasks
+ *
+ * Users configure an ordered list of tasks, highest priority first.  Each
+ * task requests joint torques, which are projected into the nullspace of all
+ * tasks above it with recursive nullspace projection:
+ *
+ *   tau = sum_k P_{k-1} tau_k,   P_0 = I,
+ *   P_k = P_{k-1} - pinv(A_k P_{k-1}) A_k P_{k-1}
+ *
+ * with the task Jacobians A_k and damped pseudo-inverses.  The projector is
+ * updated incrementally from one task to the next and all workspaces are
+ * allocated at configure time.  The time spent on each task is published as
+ * telemetry.
+ */
+class StackOfTasksController
+    : public virtual effort_controller_base::EffortControllerBase {
+public:
+  StackOfTasksController();
+
+  virtual LifecycleNodeInterface::CallbackReturn on_init() override;
+
+  rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::CallbackReturn
+  on_configure(const rclcpp_lifecycle::State &previous_state) override;
+
+  rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::CallbackReturn
+  on_activate(const rclcpp_lifecycle::State &previous_state) override;
+
+  rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::CallbackReturn
+  on_deactivate(const rclcpp_lifecycle::State &previous_state) override;
+
+  controller_interface::return_type
+  update(const rclcpp::Time &time, const rclcpp::Duration &period) override;
+
+  ctrl::VectorND computeTorque();
+
+  using Base = effort_controller_base::EffortControllerBase;
+
+private:
+  /**
+   * @brief Create a task from its parameters
+   *
+   * @param name The task name, also the prefix of its parameters
+   *
+   * @return The task or nullptr if the parameters are invalid
+   */
+  std::unique_ptr<Task> createTask(const std::string &name);
+
+  /**
+   * Per-task storage for the projector update
+   */
+  struct Workspace {
+    ctrl::MatrixND projected_jacobian;  // A_k P_{k-1}
+    Eigen::JacobiSVD<ctrl::MatrixND> svd;
+    ctrl::MatrixND weighted_v;  // V W
+    size_t telemetry_time;
+  };
+
+  std::vector<std::unique_ptr<Task>> m_tasks;
+  std::vector<Workspace> m_workspaces;
+  std::vector<rclcpp::Subscription<geometry_msgs::msg::PoseStamped>::SharedPtr>
+      m_target_subscribers;
+
+  ctrl::MatrixND m_projector;
+  ctrl::VectorND m_tau;
+  double m_projector_damping;
+  size_t m_telemetry_total_time;
+};
+
+} // namespace stack_of_tasks_controller
+
+#endif
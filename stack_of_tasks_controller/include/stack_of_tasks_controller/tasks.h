@@ -0,0 +1,165 @@
+#ifndef STACK_OF_TASKS_CONTROLLER_TASKS_H_INCLUDED
+#define STACK_OF_TASKS_CONTROLLER_TASKS_H_INCLUDED
+
+#include <effort_controller_base/JointLimitRepulsion.h>
+#include <effort_controller_base/RobotModel.h>
+#include <effort_controller_base/Utility.h>
+
+#include <kdl/frames.hpp>
+#include <kdl/jacobian.hpp>
+#include <kdl/jntarray.hpp>
+#include <realtime_tools/realtime_buffer.h>
+#include <string>
+#include <vector>
+
+namespace stack_of_tasks_controller {
+
+/**
+ * @brief A single task of the stack
+ *
+ * In each cycle, a task provides its Jacobian A (m x n) and the joint torques
+ * tau it requests.  The stack projects tau into the nullspace of all tasks
+ * with higher priority and uses A to shrink the nullspace for the tasks
+ * below.  All storage is allocated in the constructor.
+ */
+class Task {
+ public:
+  Task(const std::string &name, size_t dimension, size_t joints)
+      : m_name(name),
+        m_jacobian(ctrl::MatrixND::Zero(dimension, joints)),
+        m_torque(ctrl::VectorND::Zero(joints)) {}
+  virtual ~Task() = default;
+
+  /**
+   * @brief Reset the task's target to the current state
+   */
+  virtual void activate(const effort_controller_base::RobotModel &model,
+                        const KDL::JntArray &q) = 0;
+
+  /**
+   * @brief Compute the Jacobian and the requested torques of this cycle
+   */
+  virtual void update(const effort_controller_base::RobotModel &model,
+                      const KDL::JntArray &q, const KDL::JntArray &q_dot) = 0;
+
+  const std::string &name() const { return m_name; }
+  size_t dimension() const { return m_jacobian.rows(); }
+  const ctrl::MatrixND &jacobian() const { return m_jacobian; }
+  const ctrl::VectorND &torque() const { return m_torque; }
+
+ protected:
+  std::string m_name;
+  ctrl::MatrixND m_jacobian;
+  ctrl::VectorND m_torque;
+};
+
+/**
+ * @brief Cartesian impedance of an arbitrary link of the robot chain
+ *
+ * Axes with zero stiffness are left out of the task, so that they do not
+ * consume degrees of freedom of lower priority tasks.  For instance, an elbow
+ * orientation task only sets the rotational stiffness.
+ */
+class CartesianTask : public Task {
+ public:
+  /**
+   * @param name The task name
+   * @param link_id The link id of the controlled link, see RobotModel::linkId
+   * @param stiffness Stiffness along x, y, z, rx, ry, rz in the base frame
+   * @param joints The number of joints
+   */
+  CartesianTask(const std::string &name, int link_id,
+                const ctrl::Vector6D &stiffness, size_t joints);
+
+  /**
+   * @brief Set a new target pose in the robot base frame (non real-time)
+   */
+  void setTarget(const KDL::Frame &target) { m_target.writeFromNonRT(target); }
+
+  void activate(const effort_controller_base::RobotModel &model,
+                const KDL::JntArray &q) override;
+
+  void update(const effort_controller_base::RobotModel &model,
+              const KDL::JntArray &q, const KDL::JntArray &q_dot) override;
+
+  static size_t countAxes(const ctrl::Vector6D &stiffness);
+
+ private:
+  int m_link_id;
+  std::vector<int> m_axes;
+  ctrl::VectorND m_stiffness;
+  ctrl::VectorND m_damping;
+  KDL::Jacobian m_link_jacobian;
+  ctrl::Vector6D m_error;
+  ctrl::VectorND m_wrench;
+  realtime_tools::RealtimeBuffer<KDL::Frame> m_target;
+};
+
+/**
+ * @brief Joint space impedance towards a posture
+ */
+class PostureTask : public Task {
+ public:
+  /**
+   * @param name The task name
+   * @param stiffness The joint stiffness, shared by all joints
+   * @param posture The target posture.  If empty, the posture at activation
+   * is used.
+   * @param joints The number of joints
+   */
+  PostureTask(const std::string &name, double stiffness,
+              const std::vector<double> &posture, size_t joints);
+
+  void activate(const effort_controller_base::RobotModel &model,
+                const KDL::JntArray &q) override;
+
+  void update(const effort_controller_base::RobotModel &model,
+              const KDL::JntArray &q, const KDL::JntArray &q_dot) override;
+
+ private:
+  double m_stiffness;
+  double m_damping;
+  bool m_fixed_posture;
+  ctrl::VectorND m_posture;
+};
+
+/**
+ * @brief Repulsion from the joint position limits and damping near the
+ * velocity limits
+ *
+ * Within margin of a limit, a spring pushes the joint back, damped along the
+ * direction towards the limit only.  The torques are those of the base's
+ * joint limit avoidance, see effort_controller_base::JointLimitRepulsion.
+ */
+class JointLimitTask : public Task {
+ public:
+  /**
+   * @param name The task name
+   * @param lower The lower position limits, NaN for continuous joints
+   * @param upper The upper position limits, NaN for continuous joints
+   * @param velocity The velocity limits, NaN for unlimited joints
+   * @param margin The distance to the limits where the repulsion starts
+   * @param stiffness The repulsion stiffness
+   * @param velocity_ratio The fraction of the velocity limits where the
+   * velocity damping starts
+   * @param velocity_damping The velocity damping at the velocity limits, 0
+   * to disable
+   */
+  JointLimitTask(const std::string &name, const KDL::JntArray &lower,
+                 const KDL::JntArray &upper, const KDL::JntArray &velocity,
+                 double margin, double stiffness, double velocity_ratio,
+                 double velocity_damping);
+
+  void activate(const effort_controller_base::RobotModel &model,
+                const KDL::JntArray &q) override {}
+
+  void update(const effort_controller_base::RobotModel &model,
+              const KDL::JntArray &q, const KDL::JntArray &q_dot) override;
+
+ private:
+  effort_controller_base::JointLimitRepulsion m_repulsion;
+};
+
+}  // namespace stack_of_tasks_controller
+
+#endif
@@ -0,0 +1,330 @@
+#include <stack_of_tasks_controller/stack_of_tasks_controller.h>
+
+#include <chrono>
+
+#include "controller_interface/controller_interface.hpp"
+#include "effort_controller_base/Utility.h"
+
+namespace stack_of_tasks_controller {
+
+StackOfTasksController::StackOfTasksController()
+    : Base::EffortControllerBase() {}
+
+rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::CallbackReturn
+StackOfTasksController::on_init() {
+  const auto ret = Base::on_init();
+  if (ret != rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+                 CallbackReturn::SUCCESS) {
+    return ret;
+  }
+
+  // Ordered task names, highest priority first.  Each task is configured with
+  // parameters prefixed by its name.
+  auto_declare<std::vector<std::string>>("tasks", std::vector<std::string>());
+  auto_declare<double>("projector_damping", 0.01);
+
+  return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+      CallbackReturn::SUCCESS;
+}
+
+rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::CallbackReturn
+StackOfTasksController::on_configure(
+    const rclcpp_lifecycle::State &previous_state) {
+  const auto ret = Base::on_configure(previous_state);
+  if (ret != rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+                 CallbackReturn::SUCCESS) {
+    return ret;
+  }
+
+  m_projector_damping =
+      get_node()->get_parameter("projector_damping").as_double();
+  if (m_projector_damping < 0.0) {
+    RCLCPP_ERROR(get_node()->get_logger(),
+                 "projector_damping must not be negative");
+    return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+        CallbackReturn::ERROR;
+  }
+
+  const auto task_names =
+      get_node()->get_parameter("tasks").as_string_array();
+  if (task_names.empty()) {
+    RCLCPP_ERROR(get_node()->get_logger(), "tasks array is empty");
+    return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+        CallbackReturn::ERROR;
+  }
+
+  // Create the tasks and their workspaces
+  m_tasks.clear();
+  m_workspaces.clear();
+  m_target_subscribers.clear();
+  for (const auto &name : task_names) {
+    auto task = createTask(name);
+    if (!task) {
+      return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+          CallbackReturn::ERROR;
+    }
+
+    const Eigen::Index rows = task->dimension();
+    const Eigen::Index cols = Base::m_joint_number;
+    Workspace workspace{
+        ctrl::MatrixND::Zero(rows, cols),
+        Eigen::JacobiSVD<ctrl::MatrixND>(
+            rows, cols, Eigen::ComputeThinU | Eigen::ComputeThinV),
+        ctrl::MatrixND::Zero(cols, std::min(rows, cols)),
+        Base::m_telemetry.addChannel("task_" + name + "_time")};
+    m_workspaces.push_back(std::move(workspace));
+
+    RCLCPP_INFO(get_node()->get_logger(), "Task %zu: %s with %ld dimensions",
+                m_tasks.size(), name.c_str(), rows);
+    m_tasks.push_back(std::move(task));
+  }
+  m_telemetry_total_time = Base::m_telemetry.addChannel("tasks_time");
+
+  m_projector = ctrl::MatrixND::Identity(Base::m_joint_number,
+                                         Base::m_joint_number);
+  m_tau = ctrl::VectorND::Zero(Base::m_joint_number);
+
+  RCLCPP_INFO(get_node()->get_logger(), "Finished Stack of Tasks on_configure");
+  return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+      CallbackReturn::SUCCESS;
+}
+
+std::unique_ptr<Task> StackOfTasksController::createTask(
+    const std::string &name) {
+  auto_declare<std::string>(name + ".type", "");
+  const std::string type =
+      get_node()->get_parameter(name + ".type").as_string();
+
+  if (type == "cartesian") {
+    auto_declare<std::string>(name + ".link", "");
+    auto_declare<std::vector<double>>(
+        name + ".stiffness", {500.0, 500.0, 500.0, 50.0, 50.0, 50.0});
+    const std::string link =
+        get_node()->get_parameter(name + ".link").as_string();
+    const int link_id = Base::linkId(link);
+    if (link_id < 1) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "%s.link: %s is not a moving link of the robot chain",
+                   name.c_str(), link.c_str());
+      return nullptr;
+    }
+    const auto values =
+        get_node()->get_parameter(name + ".stiffness").as_double_array();
+    if (values.size() != 6) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "%s.stiffness must have 6 entries", name.c_str());
+      return nullptr;
+    }
+    const ctrl::Vector6D stiffness =
+        Eigen::Map<const ctrl::Vector6D>(values.data());
+    if ((stiffness.array() < 0.0).any() ||
+        CartesianTask::countAxes(stiffness) == 0) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "%s.stiffness must be non-negative with at least one "
+                   "positive entry",
+                   name.c_str());
+      return nullptr;
+    }
+
+    auto task = std::make_unique<CartesianTask>(name, link_id, stiffness,
+                                                Base::m_joint_number);
+    CartesianTask *target = task.get();
+    m_target_subscribers.push_back(
+        get_node()->create_subscription<geometry_msgs::msg::PoseStamped>(
+            get_node()->get_name() + std::string("/") + name +
+                "/target_frame",
+            3,
+            [this, target](
+                const geometry_msgs::msg::PoseStamped::SharedPtr msg) {
+              if (msg->header.frame_id != Base::m_robot_base_link) {
+                auto &clock = *get_node()->get_clock();
+                RCLCPP_WARN_THROTTLE(
+                    get_node()->get_logger(), clock, 3000,
+                    "Got target pose in wrong reference frame. Expected: %s "
+                    "but got %s",
+                    Base::m_robot_base_link.c_str(),
+                    msg->header.frame_id.c_str());
+                return;
+              }
+              target->setTarget(KDL::Frame(
+                  KDL::Rotation::Quaternion(
+                      msg->pose.orientation.x, msg->pose.orientation.y,
+                      msg->pose.orientation.z, msg->pose.orientation.w),
+                  KDL::Vector(msg->pose.position.x, msg->pose.position.y,
+                              msg->pose.position.z)));
+            }));
+    return task;
+  }
+
+  if (type == "posture") {
+    auto_declare<double>(name + ".stiffness", 10.0);
+    auto_declare<std::vector<double>>(name + ".posture",
+                                      std::vector<double>());
+    const double stiffness =
+        get_node()->get_parameter(name + ".stiffness").as_double();
+    const auto posture =
+        get_node()->get_parameter(name + ".posture").as_double_array();
+    if (stiffness < 0.0) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "%s.stiffness must not be negative", name.c_str());
+      return nullptr;
+    }
+    if (!posture.empty() && posture.size() != Base::m_joint_number) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "%s.posture must be empty or have %zu entries",
+                   name.c_str(), Base::m_joint_number);
+      return nullptr;
+    }
+    return std::make_unique<PostureTask>(name, stiffness, posture,
+                                         Base::m_joint_number);
+  }
+
+  if (type == "joint_limits") {
+    auto_declare<double>(name + ".margin", 0.1);
+    auto_declare<double>(name + ".stiffness", 20.0);
+    auto_declare<double>(name + ".velocity_ratio", 0.8);
+    auto_declare<double>(name + ".velocity_damping", 0.0);
+    const double margin =
+        get_node()->get_parameter(name + ".margin").as_double();
+    const double stiffness =
+        get_node()->get_parameter(name + ".stiffness").as_double();
+    const double velocity_ratio =
+        get_node()->get_parameter(name + ".velocity_ratio").as_double();
+    const double velocity_damping =
+        get_node()->get_parameter(name + ".velocity_damping").as_double();
+    if (margin <= 0.0 || stiffness < 0.0) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "%s.margin must be positive and %s.stiffness must not be "
+                   "negative",
+                   name.c_str(), name.c_str());
+      return nullptr;
+    }
+    if (velocity_ratio < 0.0 || velocity_ratio >= 1.0 ||
+        velocity_damping < 0.0) {
+      RCLCPP_ERROR(get_node()->get_logger(),
+                   "%s.velocity_ratio must be in [0, 1) and "
+                   "%s.velocity_damping must not be negative",
+                   name.c_str(), name.c_str());
+      return nullptr;
+    }
+    return std::make_unique<JointLimitTask>(
+        name, Base::m_joint_lower_limits, Base::m_joint_upper_limits,
+        Base::m_joint_velocity_limits, margin, stiffness, velocity_ratio,
+        velocity_damping);
+  }
+
+  RCLCPP_ERROR(get_node()->get_logger(),
+               "Unsupported type '%s' of task %s. Choose cartesian, posture "
+               "or joint_limits",
+               type.c_str(), name.c_str());
+  return nullptr;
+}
+
+rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::CallbackReturn
+StackOfTasksController::on_activate(
+    const rclcpp_lifecycle::State &previous_state) {
+  Base::on_activate(previous_state);
+
+  // Update joint states
+  Base::updateJointStates();
+
+  // Hold the current state
+  for (auto &task : m_tasks) {
+    task->activate(Base::m_model, Base::m_joint_positions);
+  }
+
+  RCLCPP_INFO(get_node()->get_logger(), "Finished Stack of Tasks on_activate");
+  return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+      CallbackReturn::SUCCESS;
+}
+
+rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::CallbackReturn
+StackOfTasksController::on_deactivate(
+    const rclcpp_lifecycle::State &previous_state) {
+  // Stop drifting by sending zero joint velocities
+  Base::computeJointEffortCmds(ctrl::VectorND::Zero(Base::m_joint_number));
+  Base::writeJointEffortCmds();
+  Base::on_deactivate(previous_state);
+
+  RCLCPP_INFO(get_node()->get_logger(),
+              "Finished Stack of Tasks on_deactivate");
+  return rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::
+      CallbackReturn::SUCCESS;
+}
+
+controller_interface::return_type StackOfTasksController::update(
+    const rclcpp::Time &time, const rclcpp::Duration &period) {
+  // Update joint states
+  Base::updateJointStates();
+
+  // Compute the torque to applay at the joints
+  ctrl::VectorND tau_tot = computeTorque();
+
+  // Saturation of the torque
+  Base::computeJointEffortCmds(tau_tot);
+
+  // Write final commands to the hardware interface
+  Base::writeJointEffortCmds();
+
+  Base::m_telemetry.publish(time);
+
+  return controller_interface::return_type::OK;
+}
+
+ctrl::VectorND StackOfTasksController::computeTorque() {
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+
+  const double lambda2 = m_projector_damping * m_projector_damping;
+  m_projector.setIdentity();
+  m_tau.setZero();
+
+  for (size_t k = 0; k < m_tasks.size(); ++k) {
+    const auto task_start = Clock::now();
+    Task &task = *m_tasks[k];
+    Workspace &workspace = m_workspaces[k];
+
+    // The projector is symmetric, so P^T tau = P tau
+    task.update(Base::m_model, Base::m_joint_positions,
+                Base::m_joint_velocities);
+    m_tau.noalias() += m_projector * task.torque();
+
+    // Remove this task's directions from the nullspace of the tasks below.
+    // With A P = U S V^T: pinv(A P) A P = V W V^T, W = S^2 / (S^2 + lambda^2)
+    if (k + 1 < m_tasks.size()) {
+      workspace.projected_jacobian.noalias() =
+          task.jacobian() * m_projector;
+      workspace.svd.compute(workspace.projected_jacobian);
+      const auto s2 = workspace.svd.singularValues().array().square();
+      workspace.weighted_v.noalias() =
+          workspace.svd.matrixV() * (s2 / (s2 + lambda2)).matrix().asDiagonal();
+      m_projector.noalias() -=
+          workspace.weighted_v * workspace.svd.matrixV().transpose();
+    }
+
+    Base::m_telemetry.set(
+        workspace.telemetry_time,
+        std::chrono::duration<double>(Clock::now() - task_start).count());
+  }
+
+  ctrl::VectorND tau = m_tau;
+  if (m_compensate_gravity) {
+    tau += Base::m_model.gravity().data;
+  }
+  if (m_compensate_coriolis) {
+    tau += Base::m_model.coriolis().data;
+  }
+
+  Base::m_telemetry.set(
+      m_telemetry_total_time,
+      std::chrono::duration<double>(Clock::now() - start).count());
+  return tau;
+}
+
+}  // namespace stack_of_tasks_controller
+
+// Pluginlib
+#include <pluginlib/class_list_macros.hpp>
+
+PLUGINLIB_EXPORT_CLASS(stack_of_tasks_controller::StackOfTasksController,
+                       controller_interface::ControllerInterface)
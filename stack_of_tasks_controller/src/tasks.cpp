@@ -0,0 +1,133 @@
+#include <stack_of_tasks_controller/tasks.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace stack_of_tasks_controller {
+
+//------------------------------------------------------------------------------
+// CartesianTask
+//------------------------------------------------------------------------------
+
+size_t CartesianTask::countAxes(const ctrl::Vector6D &stiffness) {
+  return (stiffness.array() > 0.0).count();
+}
+
+CartesianTask::CartesianTask(const std::string &name, int link_id,
+                             const ctrl::Vector6D &stiffness, size_t joints)
+    : Task(name, countAxes(stiffness), joints),
+      m_link_id(link_id),
+      m_link_jacobian(joints),
+      m_error(ctrl::Vector6D::Zero()) {
+  for (int i = 0; i < 6; ++i) {
+    if (stiffness[i] > 0.0) {
+      m_axes.push_back(i);
+    }
+  }
+  m_stiffness = ctrl::VectorND::Zero(m_axes.size());
+  for (size_t i = 0; i < m_axes.size(); ++i) {
+    m_stiffness[i] = stiffness[m_axes[i]];
+  }
+  m_damping = 2 * m_stiffness.cwiseSqrt();
+  m_wrench = ctrl::VectorND::Zero(m_axes.size());
+  m_target.initRT(KDL::Frame::Identity());
+}
+
+void CartesianTask::activate(const effort_controller_base::RobotModel &model,
+                             const KDL::JntArray &q) {
+  m_target.writeFromNonRT(model.linkPoses()[m_link_id]);
+}
+
+void CartesianTask::update(const effort_controller_base::RobotModel &model,
+                           const KDL::JntArray &q,
+                           const KDL::JntArray &q_dot) {
+  const KDL::Frame &current = model.linkPoses()[m_link_id];
+  const KDL::Frame &target = *m_target.readFromRT();
+
+  // Position error and rotation vector, clamped like the Cartesian impedance
+  // controller's motion error
+  constexpr double max_distance = 1.0;
+  constexpr double max_angle = 1.0;
+  KDL::Vector p_error = target.p - current.p;
+  const double distance = p_error.Norm();
+  if (distance > max_distance) {
+    p_error = p_error * (max_distance / distance);
+  }
+  KDL::Vector r_error = (target.M * current.M.Inverse()).GetRot();
+  const double angle = r_error.Norm();
+  if (angle > max_angle) {
+    r_error = r_error * (max_angle / angle);
+  }
+  m_error << p_error.x(), p_error.y(), p_error.z(), r_error.x(), r_error.y(),
+      r_error.z();
+
+  // Keep the selected axes only
+  model.linkJacobian(m_link_id, m_link_jacobian);
+  for (size_t i = 0; i < m_axes.size(); ++i) {
+    m_jacobian.row(i) = m_link_jacobian.data.row(m_axes[i]);
+    m_wrench[i] = m_stiffness[i] * m_error[m_axes[i]] -
+                  m_damping[i] * m_jacobian.row(i).dot(q_dot.data);
+  }
+  m_torque.noalias() = m_jacobian.transpose() * m_wrench;
+}
+
+//------------------------------------------------------------------------------
+// PostureTask
+//------------------------------------------------------------------------------
+
+PostureTask::PostureTask(const std::string &name, double stiffness,
+                         const std::vector<double> &posture, size_t joints)
+    : Task(name, joints, joints),
+      m_stiffness(stiffness),
+      m_damping(2 * std::sqrt(stiffness)),
+      m_fixed_posture(!posture.empty()),
+      m_posture(ctrl::VectorND::Zero(joints)) {
+  m_jacobian.setIdentity();
+  for (size_t i = 0; i < posture.size() && i < joints; ++i) {
+    m_posture[i] = posture[i];
+  }
+}
+
+void PostureTask::activate(const effort_controller_base::RobotModel &model,
+                           const KDL::JntArray &q) {
+  if (!m_fixed_posture) {
+    m_posture = q.data;
+  }
+}
+
+void PostureTask::update(const effort_controller_base::RobotModel &model,
+                         const KDL::JntArray &q, const KDL::JntArray &q_dot) {
+  m_torque = m_stiffness * (m_posture - q.data) - m_damping * q_dot.data;
+}
+
+//------------------------------------------------------------------------------
+// JointLimitTask
+//------------------------------------------------------------------------------
+
+JointLimitTask::JointLimitTask(const std::string &name,
+                               const KDL::JntArray &lower,
+                               const KDL::JntArray &upper,
+                               const KDL::JntArray &velocity, double margin,
+                               double stiffness, double velocity_ratio,
+                               double velocity_damping)
+    : Task(name, lower.rows(), lower.rows()) {
+  effort_controller_base::JointLimitRepulsion::Settings settings;
+  settings.margin = margin;
+  settings.stiffness = stiffness;
+  settings.damping = 2 * std::sqrt(stiffness);
+  settings.velocity_ratio = velocity_ratio;
+  settings.velocity_damping = velocity_damping;
+  m_repulsion.init(lower, upper, velocity, settings);
+}
+
+void JointLimitTask::update(const effort_controller_base::RobotModel &model,
+                            const KDL::JntArray &q,
+                            const KDL::JntArray &q_dot) {
+  // Rows of joints far from their limits stay zero and do not restrict lower
+  // priority tasks.  Rows ramp up with the activation, so that the nullspace
+  // changes continuously.
+  m_repulsion.update(q.data, q_dot.data, m_torque);
+  m_jacobian.diagonal() = m_repulsion.activation();
+}
+
+}  // namespace stack_of_tasks_controller